@@ -0,0 +1,699 @@
+/* loadgen: HTTP/1.1 load generator for this server.
+ *
+ * Each thread runs an epoll loop over its share of the connections. Two
+ * modes:
+ *  - closed loop (default): every connection keeps --pipeline requests in
+ *    flight and sends the next one as soon as a response completes.
+ *  - open loop (--rate=R): requests are scheduled at a constant total rate
+ *    of R/s spread over the connections. Latency is measured from the
+ *    scheduled send time, not the actual one, so a stalled server is
+ *    charged for the requests it kept us from sending (no coordinated
+ *    omission).
+ * Closed-loop results additionally report percentiles corrected for
+ * coordinated omission the HdrHistogram way: each recorded latency L adds
+ * synthetic samples L-I, L-2I, ... down to I, with I the mean
+ * per-connection interval between requests.
+ *
+ * Targets are weighted paths (--mix=/small.txt:9,/big.bin:1). Results go to
+ * stdout as text, or are appended to --out as CSV (header written for a new
+ * file) or JSON lines; --label tags the row (e.g. with the scheduler name).
+ */
+#define _GNU_SOURCE /* memmem, strcasestr */
+#include "histogram.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LG_MAX_TARGETS 16
+#define LG_MAX_PIPELINE 64
+#define LG_RBUF 16384
+
+struct target {
+    char path[256];
+    unsigned weight;
+    char req[512];          /* prebuilt request bytes */
+    size_t req_len;
+};
+
+struct opts {
+    const char *host;
+    int port;
+    int conns;
+    int threads;
+    double duration_s;
+    int pipeline;
+    int keepalive;
+    double rate;            /* total requests/s; 0 = closed loop */
+    unsigned timeout_ms;
+    struct target targets[LG_MAX_TARGETS];
+    int ntargets;
+    unsigned total_weight;
+    const char *label;
+    const char *format;     /* text, csv, json */
+    const char *out;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+};
+
+struct conn {
+    int fd;
+    int connected;
+    /* in-flight requests, oldest first: scheduled send time and target */
+    uint64_t sched_ns[LG_MAX_PIPELINE];
+    int target[LG_MAX_PIPELINE];
+    int head, inflight;
+    char wbuf[LG_MAX_PIPELINE * 512];
+    size_t wlen, woff;
+    int want_out;           /* EPOLLOUT registered */
+    char rbuf[LG_RBUF];
+    size_t rlen;
+    int in_body;
+    uint64_t body_left;
+    int resp_status;
+    int resp_close;
+    uint64_t next_ns;       /* open loop: next scheduled send */
+    uint64_t last_progress_ns;
+};
+
+struct worker {
+    const struct opts *o;
+    pthread_t thread;
+    int epfd;
+    struct conn *conns;
+    int nconns;
+    uint64_t interval_ns;   /* open loop: per-connection spacing */
+    uint32_t rnd;
+    hist_t lat_us;                         /* all requests */
+    hist_t target_lat_us[LG_MAX_TARGETS];  /* per target */
+    uint64_t requests, errors, bytes;
+    uint64_t connect_errors, resets, timeouts;
+    uint64_t start_ns, end_ns;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t xorshift(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static int pick_target(struct worker *w) {
+    const struct opts *o = w->o;
+    unsigned r = xorshift(&w->rnd) % o->total_weight;
+    for (int i = 0; i < o->ntargets; ++i) {
+        if (r < o->targets[i].weight) return i;
+        r -= o->targets[i].weight;
+    }
+    return 0;
+}
+
+static void conn_events(struct worker *w, struct conn *c, int want_out) {
+    if (c->want_out == want_out) return;
+    struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0), .data.ptr = c};
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_out = want_out;
+}
+
+static int conn_open(struct worker *w, struct conn *c) {
+    const struct opts *o = w->o;
+    c->fd = socket(o->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (const struct sockaddr *)&o->addr, o->addrlen) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        w->connect_errors++;
+        return -1;
+    }
+    c->connected = 0;
+    c->head = c->inflight = 0;
+    c->wlen = c->woff = 0;
+    c->rlen = 0;
+    c->in_body = 0;
+    c->last_progress_ns = now_ns();
+    /* wait for the connect to finish before writing */
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.ptr = c};
+    c->want_out = 1;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* conn_reset: drop the connection (its in-flight requests are lost) and
+   dial again; open-loop scheduling carries on where it was */
+static void conn_reset(struct worker *w, struct conn *c) {
+    if (c->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+    c->fd = -1;
+    conn_open(w, c);
+}
+
+static int conn_flush(struct worker *w, struct conn *c) {
+    while (c->woff < c->wlen) {
+        ssize_t n = send(c->fd, c->wbuf + c->woff, c->wlen - c->woff, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn_events(w, c, 1);
+                return 0;
+            }
+            return -1;
+        }
+        c->woff += (size_t)n;
+    }
+    c->wlen = c->woff = 0;
+    conn_events(w, c, 0);
+    return 0;
+}
+
+/* conn_fill: queue as many requests as the pipeline depth and, in open
+   loop mode, the schedule allow, then write them in one go */
+static int conn_fill(struct worker *w, struct conn *c, uint64_t now) {
+    const struct opts *o = w->o;
+    if (c->fd < 0 || !c->connected) return 0;
+    int depth = o->keepalive ? o->pipeline : 1;
+    int queued = 0;
+    if (c->inflight == 0) c->last_progress_ns = now; /* stall clock starts now */
+    while (c->inflight < depth) {
+        int t = pick_target(w);
+        const struct target *tg = &o->targets[t];
+        if (c->wlen + tg->req_len > sizeof(c->wbuf)) break;
+        uint64_t sched = now;
+        if (o->rate > 0) {
+            if (c->next_ns > now) break;
+            sched = c->next_ns;
+            c->next_ns += w->interval_ns;
+        }
+        memcpy(c->wbuf + c->wlen, tg->req, tg->req_len);
+        c->wlen += tg->req_len;
+        int slot = (c->head + c->inflight) % LG_MAX_PIPELINE;
+        c->sched_ns[slot] = sched;
+        c->target[slot] = t;
+        c->inflight++;
+        queued++;
+    }
+    if (queued == 0 && c->wlen == 0) return 0;
+    return conn_flush(w, c);
+}
+
+static void record_response(struct worker *w, struct conn *c, uint64_t now) {
+    int slot = c->head;
+    uint64_t lat = now > c->sched_ns[slot] ? (now - c->sched_ns[slot]) / 1000 : 0;
+    hist_record(&w->lat_us, lat);
+    hist_record(&w->target_lat_us[c->target[slot]], lat);
+    w->requests++;
+    if (c->resp_status < 200 || c->resp_status >= 400) w->errors++;
+    c->head = (c->head + 1) % LG_MAX_PIPELINE;
+    c->inflight--;
+}
+
+/* parse_head: status, Content-Length and Connection: close from a
+   complete response head */
+static int parse_head(struct conn *c, const char *p, size_t len, uint64_t *clen) {
+    if (len < 12 || memcmp(p, "HTTP/1.", 7) != 0) return -1;
+    c->resp_status = atoi(p + 9);
+    *clen = 0;
+    c->resp_close = 0;
+    const char *end = p + len;
+    const char *line = memchr(p, '\n', len);
+    while (line && line + 1 < end) {
+        line++;
+        size_t rest = (size_t)(end - line);
+        if (rest > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+            *clen = strtoull(line + 15, NULL, 10);
+        else if (rest > 11 && strncasecmp(line, "Connection:", 11) == 0) {
+            const char *v = line + 11;
+            while (*v == ' ') v++;
+            if (strncasecmp(v, "close", 5) == 0) c->resp_close = 1;
+        }
+        line = memchr(line, '\n', rest);
+    }
+    return 0;
+}
+
+/* conn_readable: consume every complete response. Returns 0, or -1 if the
+   connection has to be reset (error, EOF or a close response). */
+static int conn_readable(struct worker *w, struct conn *c) {
+    while (1) {
+        ssize_t n = recv(c->fd, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        if (n == 0) return -1;
+        uint64_t now = now_ns();
+        c->last_progress_ns = now;
+        w->bytes += (uint64_t)n;
+        c->rlen += (size_t)n;
+        size_t off = 0;
+        while (off < c->rlen) {
+            if (c->in_body) {
+                size_t take = c->rlen - off;
+                if (take > c->body_left) take = (size_t)c->body_left;
+                off += take;
+                c->body_left -= take;
+                if (c->body_left > 0) break;
+                c->in_body = 0;
+                if (c->inflight > 0) record_response(w, c, now);
+                if (c->resp_close || !w->o->keepalive) return -1;
+                continue;
+            }
+            const char *hend = memmem(c->rbuf + off, c->rlen - off, "\r\n\r\n", 4);
+            if (!hend) {
+                if (off == 0 && c->rlen == sizeof(c->rbuf)) return -1; /* head too large */
+                break;
+            }
+            size_t hlen = (size_t)(hend - (c->rbuf + off)) + 4;
+            uint64_t clen;
+            if (parse_head(c, c->rbuf + off, hlen, &clen) < 0) return -1;
+            off += hlen;
+            c->in_body = 1;
+            c->body_left = clen;
+        }
+        if (off) {
+            memmove(c->rbuf, c->rbuf + off, c->rlen - off);
+            c->rlen -= off;
+        }
+        /* a body with nothing buffered after it completes on the next
+           pass; finish it now when it is empty */
+        if (c->in_body && c->body_left == 0) {
+            c->in_body = 0;
+            if (c->inflight > 0) record_response(w, c, now);
+            if (c->resp_close || !w->o->keepalive) return -1;
+        }
+        if (conn_fill(w, c, now) < 0) return -1;
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    const struct opts *o = w->o;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd < 0) {
+        perror("epoll_create1");
+        return NULL;
+    }
+    w->start_ns = now_ns();
+    uint64_t deadline = w->start_ns + (uint64_t)(o->duration_s * 1e9);
+    for (int i = 0; i < w->nconns; ++i) {
+        struct conn *c = &w->conns[i];
+        /* stagger open-loop schedules so connections don't fire in lockstep */
+        c->next_ns = w->start_ns + (w->interval_ns * (uint64_t)i) / (uint64_t)(w->nconns ? w->nconns : 1);
+        conn_open(w, c);
+    }
+    struct epoll_event evs[256];
+    uint64_t timeout_ns = (uint64_t)o->timeout_ms * 1000000ull;
+    uint64_t next_due = w->start_ns;  /* open loop: earliest pending send */
+    int have_pwait2 = 1;
+    while (1) {
+        uint64_t now = now_ns();
+        if (now >= deadline) break;
+        /* open loop: wake up in time for the next scheduled send; a ms
+           timeout would add up to 1ms of generator lateness per request */
+        uint64_t wake = o->rate > 0 && next_due < deadline ? next_due : deadline;
+        uint64_t wait_ns = wake > now ? wake - now : 0;
+        int n = -1;
+        if (have_pwait2) {
+            struct timespec ts = {.tv_sec = (time_t)(wait_ns / 1000000000ull),
+                                  .tv_nsec = (long)(wait_ns % 1000000000ull)};
+            n = epoll_pwait2(w->epfd, evs, 256, &ts, NULL);
+            if (n < 0 && errno == ENOSYS) have_pwait2 = 0;
+        }
+        if (!have_pwait2) n = epoll_wait(w->epfd, evs, 256, (int)((wait_ns + 999999) / 1000000));
+        now = now_ns();
+        for (int i = 0; i < n; ++i) {
+            struct conn *c = evs[i].data.ptr;
+            if (c->fd < 0) continue;
+            if (!c->connected && (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t elen = sizeof(err);
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+                if (err) {
+                    w->connect_errors++;
+                    conn_reset(w, c);
+                    continue;
+                }
+                c->connected = 1;
+                conn_events(w, c, 0);
+                if (conn_fill(w, c, now) < 0) {
+                    w->resets++;
+                    conn_reset(w, c);
+                }
+                continue;
+            }
+            if ((evs[i].events & EPOLLOUT) && conn_flush(w, c) < 0) {
+                w->resets++;
+                conn_reset(w, c);
+                continue;
+            }
+            if ((evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && conn_readable(w, c) < 0) {
+                /* a close after a complete response is normal */
+                if (c->inflight > 0) w->resets++;
+                conn_reset(w, c);
+            }
+        }
+        next_due = deadline;
+        int depth = o->keepalive ? o->pipeline : 1;
+        for (int i = 0; i < w->nconns; ++i) {
+            struct conn *c = &w->conns[i];
+            if (c->fd < 0) {
+                conn_open(w, c);
+                continue;
+            }
+            /* last_progress may be newer than now */
+            if (c->inflight > 0 && now > c->last_progress_ns + timeout_ns) {
+                w->timeouts++;
+                conn_reset(w, c);
+                continue;
+            }
+            if (o->rate > 0 && conn_fill(w, c, now) < 0) {
+                w->resets++;
+                conn_reset(w, c);
+                continue;
+            }
+            /* a full pipeline waits for a response, not the clock */
+            if (c->connected && c->inflight < depth && c->next_ns < next_due) next_due = c->next_ns;
+        }
+    }
+    w->end_ns = now_ns();
+    for (int i = 0; i < w->nconns; ++i)
+        if (w->conns[i].fd >= 0) close(w->conns[i].fd);
+    close(w->epfd);
+    return NULL;
+}
+
+/* co_correct: copy of s with coordinated-omission backfill for expected
+   interval (same unit as s), done per bucket: a bucket with upper bound v
+   and count c adds c samples at each of v-I, v-2I, ... >= I */
+static void co_correct(hist_snapshot_t *out, const hist_snapshot_t *s, uint64_t interval) {
+    *out = *s;
+    if (interval == 0) return;
+    for (int b = 0; b < HIST_BUCKETS; ++b) {
+        uint64_t c = s->counts[b];
+        uint64_t v = hist_bucket_upper(b);
+        if (c == 0 || v < 2 * interval) continue;
+        uint64_t kmax_all = v / interval - 1;     /* v - k*I >= I */
+        for (int j = 0; j <= b; ++j) {
+            uint64_t lo = j ? hist_bucket_upper(j - 1) + 1 : 0;
+            uint64_t hi = hist_bucket_upper(j);
+            if (hi < interval) continue;
+            /* k with lo <= v - k*I <= hi */
+            uint64_t kmin = hi >= v ? 1 : (v - hi + interval - 1) / interval;
+            if (kmin < 1) kmin = 1;
+            uint64_t kmax = (v - lo) / interval;
+            if (kmax > kmax_all) kmax = kmax_all;
+            if (kmax < kmin) continue;
+            uint64_t add = c * (kmax - kmin + 1);
+            out->counts[j] += add;
+            out->total += add;
+            out->sum += c * ((kmax - kmin + 1) * v - interval * (kmin + kmax) * (kmax - kmin + 1) / 2);
+        }
+    }
+}
+
+static int parse_mix(struct opts *o, const char *spec) {
+    o->ntargets = 0;
+    o->total_weight = 0;
+    char *dup = strdup(spec);
+    if (!dup) return -1;
+    char *save = NULL;
+    for (char *tok = strtok_r(dup, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (o->ntargets == LG_MAX_TARGETS) break;
+        struct target *t = &o->targets[o->ntargets];
+        char *colon = strrchr(tok, ':');
+        t->weight = 1;
+        if (colon) {
+            *colon = '\0';
+            t->weight = (unsigned)strtoul(colon + 1, NULL, 10);
+        }
+        if (t->weight == 0 || tok[0] != '/' || strlen(tok) >= sizeof(t->path)) continue;
+        snprintf(t->path, sizeof(t->path), "%s", tok);
+        o->total_weight += t->weight;
+        o->ntargets++;
+    }
+    free(dup);
+    return o->ntargets ? 0 : -1;
+}
+
+static int resolve(struct opts *o) {
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    char port[16];
+    snprintf(port, sizeof(port), "%d", o->port);
+    int rc = getaddrinfo(o->host, port, &hints, &res);
+    if (rc != 0 || !res) {
+        fprintf(stderr, "loadgen: cannot resolve %s: %s\n", o->host, gai_strerror(rc));
+        return -1;
+    }
+    memcpy(&o->addr, res->ai_addr, res->ai_addrlen);
+    o->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host=H            server host (127.0.0.1)\n"
+            "  --port=P            server port (8080)\n"
+            "  --connections=N     concurrent connections (64)\n"
+            "  --threads=T         client threads (1)\n"
+            "  --duration=S        seconds to run (10)\n"
+            "  --pipeline=D        requests in flight per connection (1)\n"
+            "  --keepalive=0|1     reuse connections (1)\n"
+            "  --rate=R            open loop at R req/s total (0: closed loop)\n"
+            "  --mix=P:W,...       weighted paths (/small.txt)\n"
+            "  --timeout-ms=MS     reset a connection stalled this long (10000)\n"
+            "  --label=NAME        row label, e.g. the scheduler (-)\n"
+            "  --format=text|csv|json\n"
+            "  --out=FILE          append results to FILE (stdout)\n",
+            prog);
+}
+
+/* opt: value of --name=value, or NULL */
+static const char *opt(const char *arg, const char *name) {
+    size_t n = strlen(name);
+    return strncmp(arg, name, n) == 0 ? arg + n : NULL;
+}
+
+static void emit(const struct opts *o, FILE *f, int new_file, const hist_snapshot_t *all,
+                 const hist_snapshot_t *corr, const hist_snapshot_t *per, uint64_t requests,
+                 uint64_t errors, uint64_t bytes, uint64_t resets, uint64_t conn_errs,
+                 uint64_t timeouts, double secs) {
+    double rps = secs > 0 ? (double)requests / secs : 0.0;
+    double mbps = secs > 0 ? (double)bytes / (1024.0 * 1024.0) / secs : 0.0;
+    const char *mode = o->rate > 0 ? "open" : "closed";
+    const double qs[] = {0.50, 0.90, 0.99, 0.999};
+    if (strcmp(o->format, "csv") == 0) {
+        if (new_file)
+            fprintf(f, "label,mode,connections,pipeline,keepalive,rate,duration_s,requests,errors,"
+                       "resets,rps,mb_per_s,p50_us,p90_us,p99_us,p999_us,max_us,raw_p99_us\n");
+        fprintf(f, "%s,%s,%d,%d,%d,%.0f,%.2f,%llu,%llu,%llu,%.1f,%.2f", o->label, mode, o->conns,
+                o->pipeline, o->keepalive, o->rate, secs, (unsigned long long)requests,
+                (unsigned long long)errors, (unsigned long long)(resets + conn_errs + timeouts),
+                rps, mbps);
+        for (int i = 0; i < 4; ++i) fprintf(f, ",%llu", (unsigned long long)hist_percentile(corr, qs[i]));
+        fprintf(f, ",%llu,%llu\n", (unsigned long long)all->max,
+                (unsigned long long)hist_percentile(all, 0.99));
+        return;
+    }
+    if (strcmp(o->format, "json") == 0) {
+        fprintf(f, "{\"label\":\"%s\",\"mode\":\"%s\",\"connections\":%d,\"pipeline\":%d,"
+                   "\"keepalive\":%d,\"rate\":%.0f,\"duration_s\":%.2f,\"requests\":%llu,"
+                   "\"errors\":%llu,\"resets\":%llu,\"connect_errors\":%llu,\"timeouts\":%llu,"
+                   "\"rps\":%.1f,\"mb_per_s\":%.2f,\"latency_us\":{",
+                o->label, mode, o->conns, o->pipeline, o->keepalive, o->rate, secs,
+                (unsigned long long)requests, (unsigned long long)errors,
+                (unsigned long long)resets, (unsigned long long)conn_errs,
+                (unsigned long long)timeouts, rps, mbps);
+        fprintf(f, "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"raw_p99\":%llu},\"targets\":[",
+                (unsigned long long)hist_percentile(corr, 0.50),
+                (unsigned long long)hist_percentile(corr, 0.90),
+                (unsigned long long)hist_percentile(corr, 0.99),
+                (unsigned long long)hist_percentile(corr, 0.999), (unsigned long long)all->max,
+                (unsigned long long)hist_percentile(all, 0.99));
+        for (int t = 0; t < o->ntargets; ++t)
+            fprintf(f, "%s{\"path\":\"%s\",\"requests\":%llu,\"p50_us\":%llu,\"p99_us\":%llu}",
+                    t ? "," : "", o->targets[t].path, (unsigned long long)per[t].total,
+                    (unsigned long long)hist_percentile(&per[t], 0.50),
+                    (unsigned long long)hist_percentile(&per[t], 0.99));
+        fprintf(f, "]}\n");
+        return;
+    }
+    fprintf(f, "%s: %s loop, %d connections, pipeline %d, %.2fs\n", o->label, mode, o->conns,
+            o->pipeline, secs);
+    fprintf(f, "  requests %llu (%.1f/s, %.2f MB/s), errors %llu, resets %llu, connect errors %llu, timeouts %llu\n",
+            (unsigned long long)requests, rps, mbps, (unsigned long long)errors,
+            (unsigned long long)resets, (unsigned long long)conn_errs, (unsigned long long)timeouts);
+    fprintf(f, "  latency us (CO-corrected): p50 %llu  p90 %llu  p99 %llu  p999 %llu  max %llu\n",
+            (unsigned long long)hist_percentile(corr, 0.50),
+            (unsigned long long)hist_percentile(corr, 0.90),
+            (unsigned long long)hist_percentile(corr, 0.99),
+            (unsigned long long)hist_percentile(corr, 0.999), (unsigned long long)all->max);
+    if (o->rate <= 0)
+        fprintf(f, "  latency us (raw):          p50 %llu  p90 %llu  p99 %llu  p999 %llu\n",
+                (unsigned long long)hist_percentile(all, 0.50),
+                (unsigned long long)hist_percentile(all, 0.90),
+                (unsigned long long)hist_percentile(all, 0.99),
+                (unsigned long long)hist_percentile(all, 0.999));
+    for (int t = 0; t < o->ntargets; ++t)
+        fprintf(f, "  %-20s n=%llu p50 %llu p99 %llu\n", o->targets[t].path,
+                (unsigned long long)per[t].total,
+                (unsigned long long)hist_percentile(&per[t], 0.50),
+                (unsigned long long)hist_percentile(&per[t], 0.99));
+}
+
+int main(int argc, char **argv) {
+    struct opts o = {
+        .host = "127.0.0.1", .port = 8080, .conns = 64, .threads = 1, .duration_s = 10,
+        .pipeline = 1, .keepalive = 1, .rate = 0, .timeout_ms = 10000, .label = "-",
+        .format = "text", .out = NULL,
+    };
+    const char *mix = "/small.txt";
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i], *v;
+        if ((v = opt(a, "--host="))) o.host = v;
+        else if ((v = opt(a, "--port="))) o.port = atoi(v);
+        else if ((v = opt(a, "--connections="))) o.conns = atoi(v);
+        else if ((v = opt(a, "--threads="))) o.threads = atoi(v);
+        else if ((v = opt(a, "--duration="))) o.duration_s = atof(v);
+        else if ((v = opt(a, "--pipeline="))) o.pipeline = atoi(v);
+        else if ((v = opt(a, "--keepalive="))) o.keepalive = atoi(v);
+        else if ((v = opt(a, "--rate="))) o.rate = atof(v);
+        else if ((v = opt(a, "--mix="))) mix = v;
+        else if ((v = opt(a, "--timeout-ms="))) o.timeout_ms = (unsigned)atoi(v);
+        else if ((v = opt(a, "--label="))) o.label = v;
+        else if ((v = opt(a, "--format="))) o.format = v;
+        else if ((v = opt(a, "--out="))) o.out = v;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (o.conns < 1) o.conns = 1;
+    if (o.threads < 1) o.threads = 1;
+    if (o.threads > o.conns) o.threads = o.conns;
+    if (o.pipeline < 1) o.pipeline = 1;
+    if (o.pipeline > LG_MAX_PIPELINE) o.pipeline = LG_MAX_PIPELINE;
+    if (parse_mix(&o, mix) < 0) {
+        fprintf(stderr, "loadgen: bad --mix '%s'\n", mix);
+        return 2;
+    }
+    if (resolve(&o) < 0) return 1;
+    for (int t = 0; t < o.ntargets; ++t) {
+        struct target *tg = &o.targets[t];
+        int n = snprintf(tg->req, sizeof(tg->req), "GET %s HTTP/1.1\r\nHost: %s\r\n%s\r\n", tg->path,
+                         o.host, o.keepalive ? "" : "Connection: close\r\n");
+        tg->req_len = n > 0 && (size_t)n < sizeof(tg->req) ? (size_t)n : 0;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct worker *ws = calloc((size_t)o.threads, sizeof(*ws));
+    struct conn *conns = calloc((size_t)o.conns, sizeof(*conns));
+    if (!ws || !conns) {
+        perror("calloc");
+        return 1;
+    }
+    int given = 0;
+    for (int i = 0; i < o.threads; ++i) {
+        struct worker *w = &ws[i];
+        w->o = &o;
+        w->conns = conns + given;
+        w->nconns = o.conns / o.threads + (i < o.conns % o.threads ? 1 : 0);
+        given += w->nconns;
+        w->rnd = 0x9e3779b9u ^ (uint32_t)(i * 2654435761u);
+        if (w->rnd == 0) w->rnd = 1;
+        for (int k = 0; k < w->nconns; ++k) w->conns[k].fd = -1;
+        /* each connection carries rate / connections of the load */
+        if (o.rate > 0) w->interval_ns = (uint64_t)(1e9 * (double)o.conns / o.rate);
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    hist_snapshot_t *all = calloc(1, sizeof(*all));
+    hist_snapshot_t *corr = calloc(1, sizeof(*corr));
+    hist_snapshot_t *per = calloc(LG_MAX_TARGETS, sizeof(*per));
+    if (!all || !corr || !per) {
+        perror("calloc");
+        return 1;
+    }
+    uint64_t requests = 0, errors = 0, bytes = 0, resets = 0, conn_errs = 0, timeouts = 0;
+    uint64_t start = UINT64_MAX, end = 0;
+    for (int i = 0; i < o.threads; ++i) {
+        struct worker *w = &ws[i];
+        pthread_join(w->thread, NULL);
+        hist_snapshot_add(all, &w->lat_us);
+        for (int t = 0; t < o.ntargets; ++t) hist_snapshot_add(&per[t], &w->target_lat_us[t]);
+        requests += w->requests;
+        errors += w->errors;
+        bytes += w->bytes;
+        resets += w->resets;
+        conn_errs += w->connect_errors;
+        timeouts += w->timeouts;
+        if (w->start_ns && w->start_ns < start) start = w->start_ns;
+        if (w->end_ns > end) end = w->end_ns;
+    }
+    double secs = end > start ? (double)(end - start) / 1e9 : 0.0;
+
+    /* open loop already measures from the schedule; closed loop backfills
+       with the mean per-connection request interval */
+    uint64_t interval_us = 0;
+    if (o.rate <= 0 && requests > 0)
+        interval_us = (uint64_t)(secs * 1e6 * (double)o.conns / (double)requests);
+    co_correct(corr, all, interval_us);
+
+    FILE *f = stdout;
+    int new_file = 1;
+    if (o.out) {
+        struct stat st;
+        new_file = stat(o.out, &st) != 0 || st.st_size == 0;
+        f = fopen(o.out, "a");
+        if (!f) {
+            perror(o.out);
+            return 1;
+        }
+    }
+    emit(&o, f, new_file, all, corr, per, requests, errors, bytes, resets, conn_errs, timeouts, secs);
+    if (f != stdout) fclose(f);
+    free(all);
+    free(corr);
+    free(per);
+    free(ws);
+    free(conns);
+    return requests > 0 ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Benchmark harness: start the server once per scheduler and drive it with
+# bin/loadgen, appending one result row per run to $OUT.
+#
+# Knobs (environment):
+#   SCHEDULERS  schedulers to compare            (fifo sjf mpmc ws)
+#   PORT        server port                      (8090)
+#   WORKERS     server worker threads            (4)
+#   DOCROOT     docroot; test files are created  (bench/www)
+#   MIX         loadgen --mix                    (/small.txt:9,/big.bin:1)
+#   CONNS       connections                      (64)
+#   THREADS     loadgen threads                  (2)
+#   PIPELINE    requests in flight per conn      (1)
+#   RATE        open-loop req/s; 0 = closed loop (0)
+#   DURATION    seconds per run                  (10)
+#   REPEAT      runs per scheduler               (3)
+#   FORMAT      csv or json                      (csv)
+#   OUT         results file                     (bench/results.$FORMAT)
+#   SERVER_ARGS extra server flags               ()
+set -eu
+
+SCHEDULERS=${SCHEDULERS:-"fifo sjf mpmc ws"}
+PORT=${PORT:-8090}
+WORKERS=${WORKERS:-4}
+DOCROOT=${DOCROOT:-bench/www}
+MIX=${MIX:-/small.txt:9,/big.bin:1}
+CONNS=${CONNS:-64}
+THREADS=${THREADS:-2}
+PIPELINE=${PIPELINE:-1}
+RATE=${RATE:-0}
+DURATION=${DURATION:-10}
+REPEAT=${REPEAT:-3}
+FORMAT=${FORMAT:-csv}
+OUT=${OUT:-bench/results.$FORMAT}
+SERVER_ARGS=${SERVER_ARGS:-}
+
+if [ ! -d "$DOCROOT" ]; then
+    mkdir -p "$DOCROOT"
+    echo '<html><body>small</body></html>' > "$DOCROOT/small.txt"
+    dd if=/dev/zero of="$DOCROOT/big.bin" bs=1M count=1 2>/dev/null
+fi
+
+for sched in $SCHEDULERS; do
+    run=1
+    while [ "$run" -le "$REPEAT" ]; do
+        # shellcheck disable=SC2086
+        ./bin/server "$PORT" "$WORKERS" "$DOCROOT" --scheduler="$sched" $SERVER_ARGS \
+            > "bench/server-$sched.log" 2>&1 &
+        pid=$!
+        sleep 1
+        ./bin/loadgen --port="$PORT" --connections="$CONNS" --threads="$THREADS" \
+            --pipeline="$PIPELINE" --rate="$RATE" --duration="$DURATION" --mix="$MIX" \
+            --label="$sched" --format="$FORMAT" --out="$OUT" || echo "run $sched/$run failed" >&2
+        kill "$pid"
+        wait "$pid" 2>/dev/null || true
+        run=$((run + 1))
+    done
+done
+echo "results appended to $OUT"
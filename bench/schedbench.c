@@ -0,0 +1,552 @@
+/* schedbench: scheduler and thread-pool microbenchmarks, no network.
+ *
+ * Modes (--mode=, comma-separated):
+ *  - single : one thread, queue held at --depth jobs; each op is a pop
+ *             followed by a push, so the figure is the steady-state cost of
+ *             the backend at that depth (heap depth matters for sjf).
+ *  - mt     : P producer and C consumer threads on one scheduler instance.
+ *             Schedulers without SCHED_F_LOCKFREE are driven under a mutex,
+ *             as the pool does. Handoff = consumer pop time - push time.
+ *  - pool   : P producers calling threadpool_submit_job on a pool of C
+ *             workers; handoff = handler start - submit time, so it includes
+ *             the wake-up path. --work-ns adds synthetic service time per
+ *             KiB of est_cost.
+ *
+ * Job streams (--dist=): uniform est_cost in 1..64KiB, heavy (Pareto,
+ * alpha 1.1, 512B..64MiB) or bursty (uniform costs sent in bursts of
+ * --burst jobs separated by --gap-us pauses).
+ *
+ * Hardware counters (cycles, instructions, cache misses; context switches)
+ * come from perf_event_open with inherit, so every thread of a run is
+ * counted; they print as -1 when the kernel or container denies access.
+ */
+#include "scheduler.h"
+#include "threadpool.h"
+#include "histogram.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SB_MAX_THREADS 64
+#define SB_NCOUNTERS 4
+
+enum { DIST_UNIFORM, DIST_HEAVY, DIST_BURSTY };
+
+struct opts {
+    const char *scheds;
+    const char *modes;
+    const char *dists;
+    const char *producers;
+    const char *consumers;
+    uint64_t ops;
+    size_t capacity;
+    size_t depth;
+    unsigned burst;
+    unsigned gap_us;
+    unsigned work_ns;
+    size_t shards;
+    const char *format;
+};
+
+struct result {
+    double secs;
+    uint64_t ops;
+    hist_snapshot_t handoff_ns;
+    long long counters[SB_NCOUNTERS];
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t xorshift(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static long gen_cost(int dist, uint32_t *rnd) {
+    if (dist == DIST_HEAVY) {
+        /* Pareto: xmin / u^(1/alpha) */
+        double u = ((double)(xorshift(rnd) >> 8) + 1.0) / 16777217.0;
+        double v = 512.0 / pow(u, 1.0 / 1.1);
+        return v > 64.0 * 1024 * 1024 ? 64L * 1024 * 1024 : (long)v;
+    }
+    return (long)(xorshift(rnd) % 65536) + 1;
+}
+
+static void spin_ns(uint64_t ns) {
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {}
+}
+
+/* ---- perf counters ---- */
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_defs[SB_NCOUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+static void counters_start(int fds[SB_NCOUNTERS]) {
+    for (int i = 0; i < SB_NCOUNTERS; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_defs[i].type;
+        attr.config = counter_defs[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;        /* count the threads spawned for the run */
+        /* context switches happen in the kernel; hardware events are
+           user-only so paranoid level 2 still allows them */
+        attr.exclude_kernel = counter_defs[i].type == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/* counters_stop: call after the run's threads are joined (inherited
+   counts are folded in at thread exit) */
+static void counters_stop(int fds[SB_NCOUNTERS], long long out[SB_NCOUNTERS]) {
+    for (int i = 0; i < SB_NCOUNTERS; ++i) {
+        out[i] = -1;
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        long long v;
+        if (read(fds[i], &v, sizeof(v)) == (ssize_t)sizeof(v)) out[i] = v;
+        close(fds[i]);
+    }
+}
+
+/* ---- single-thread push/pop cost ---- */
+
+static int run_single(const struct opts *o, const char *name, int dist, struct result *r) {
+    size_t depth = o->depth < o->capacity ? o->depth : o->capacity - 1;
+    scheduler_t *s = scheduler_create(name, o->capacity, 1);
+    if (!s) return -1;
+    /* costs are drawn up front so the generator stays out of the timing */
+    enum { NCOSTS = 4096 };
+    long *costs = malloc(NCOSTS * sizeof(*costs));
+    if (!costs) {
+        s->destroy(s);
+        return -1;
+    }
+    uint32_t rnd = 12345;
+    for (int i = 0; i < NCOSTS; ++i) costs[i] = gen_cost(dist, &rnd);
+    job_t j = {0};
+    for (size_t i = 0; i < depth; ++i) {
+        j.est_cost = costs[i % NCOSTS];
+        s->push(s, j);
+    }
+    int fds[SB_NCOUNTERS];
+    counters_start(fds);
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < o->ops; ++i) {
+        job_t out;
+        if (depth && s->pop(s, &out) == 0 && s->done) s->done(s, &out);
+        j.est_cost = costs[i % NCOSTS];
+        j.arrival_ns = i;
+        s->push(s, j);
+        if (!depth && s->pop(s, &out) == 0 && s->done) s->done(s, &out);
+    }
+    r->secs = (double)(now_ns() - t0) / 1e9;
+    counters_stop(fds, r->counters);
+    r->ops = o->ops;
+    free(costs);
+    s->destroy(s);
+    return 0;
+}
+
+/* ---- multi-threaded scheduler ---- */
+
+struct mt_ctx {
+    const struct opts *o;
+    scheduler_t *s;
+    pthread_mutex_t lock;    /* for schedulers without SCHED_F_LOCKFREE */
+    int lockfree;
+    int dist;
+    int producers;
+    atomic_uint_fast64_t popped;
+    uint64_t total;
+};
+
+struct mt_thread {
+    struct mt_ctx *ctx;
+    pthread_t thread;
+    size_t index;
+    uint64_t quota;          /* producers: jobs to push */
+    hist_t handoff_ns;       /* consumers: single writer */
+};
+
+static int mt_push(struct mt_ctx *c, job_t *j) {
+    if (c->lockfree) return c->s->push(c->s, *j);
+    pthread_mutex_lock(&c->lock);
+    int rc = c->s->push(c->s, *j);
+    pthread_mutex_unlock(&c->lock);
+    return rc;
+}
+
+static int mt_pop(struct mt_ctx *c, size_t worker, job_t *j) {
+    if (c->lockfree)
+        return c->s->pop_worker ? c->s->pop_worker(c->s, worker, j) : c->s->pop(c->s, j);
+    pthread_mutex_lock(&c->lock);
+    int rc = c->s->pop_worker ? c->s->pop_worker(c->s, worker, j) : c->s->pop(c->s, j);
+    pthread_mutex_unlock(&c->lock);
+    return rc;
+}
+
+/* mt_done: completion for schedulers that track running jobs (mlq) */
+static void mt_done(struct mt_ctx *c, const job_t *j) {
+    if (!c->s->done) return;
+    if (c->lockfree) {
+        c->s->done(c->s, j);
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    c->s->done(c->s, j);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void *mt_producer(void *arg) {
+    struct mt_thread *t = arg;
+    struct mt_ctx *c = t->ctx;
+    uint32_t rnd = 0x9e3779b9u ^ (uint32_t)(t->index * 2654435761u);
+    if (!rnd) rnd = 1;
+    for (uint64_t i = 0; i < t->quota; ++i) {
+        if (c->dist == DIST_BURSTY && i && i % c->o->burst == 0) spin_ns((uint64_t)c->o->gap_us * 1000);
+        job_t j = {0};
+        j.client_fd = -1;
+        j.est_cost = gen_cost(c->dist == DIST_HEAVY ? DIST_HEAVY : DIST_UNIFORM, &rnd);
+        j.arrival_ns = now_ns();
+        while (mt_push(c, &j) != 0) sched_yield(); /* full */
+    }
+    return NULL;
+}
+
+static void *mt_consumer(void *arg) {
+    struct mt_thread *t = arg;
+    struct mt_ctx *c = t->ctx;
+    while (atomic_load_explicit(&c->popped, memory_order_relaxed) < c->total) {
+        job_t j;
+        if (mt_pop(c, t->index, &j) != 0) {
+            sched_yield();
+            continue;
+        }
+        uint64_t now = now_ns();
+        hist_record(&t->handoff_ns, now > j.arrival_ns ? now - j.arrival_ns : 0);
+        mt_done(c, &j);
+        atomic_fetch_add_explicit(&c->popped, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static int run_mt(const struct opts *o, const char *name, int dist, int np, int nc, struct result *r) {
+    struct mt_ctx c;
+    memset(&c, 0, sizeof(c));
+    c.o = o;
+    c.s = scheduler_create(name, o->capacity, (size_t)nc);
+    if (!c.s) return -1;
+    pthread_mutex_init(&c.lock, NULL);
+    c.lockfree = (c.s->flags & SCHED_F_LOCKFREE) != 0;
+    c.dist = dist;
+    c.total = o->ops;
+    atomic_init(&c.popped, 0);
+    struct mt_thread *ts = calloc((size_t)(np + nc), sizeof(*ts));
+    if (!ts) {
+        c.s->destroy(c.s);
+        return -1;
+    }
+    int fds[SB_NCOUNTERS];
+    counters_start(fds);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < np + nc; ++i) {
+        ts[i].ctx = &c;
+        ts[i].index = i < np ? (size_t)i : (size_t)(i - np);
+        ts[i].quota = i < np ? o->ops / (uint64_t)np + ((uint64_t)i < o->ops % (uint64_t)np ? 1 : 0) : 0;
+        pthread_create(&ts[i].thread, NULL, i < np ? mt_producer : mt_consumer, &ts[i]);
+    }
+    for (int i = 0; i < np + nc; ++i) pthread_join(ts[i].thread, NULL);
+    r->secs = (double)(now_ns() - t0) / 1e9;
+    counters_stop(fds, r->counters);
+    r->ops = o->ops;
+    for (int i = np; i < np + nc; ++i) hist_snapshot_add(&r->handoff_ns, &ts[i].handoff_ns);
+    free(ts);
+    c.s->destroy(c.s);
+    pthread_mutex_destroy(&c.lock);
+    return 0;
+}
+
+/* ---- thread pool handoff ---- */
+
+/* per-worker handoff histograms, claimed on first use */
+struct pool_ctx {
+    const struct opts *o;
+    threadpool_t *tp;
+    int dist;
+    hist_t hists[SB_MAX_THREADS];
+    atomic_int nhists;
+    atomic_uint_fast64_t handled;
+};
+
+static __thread hist_t *my_hist;
+static __thread struct pool_ctx *my_hist_owner;
+
+static void pool_handler(job_t *job, void *arg) {
+    struct pool_ctx *p = arg;
+    uint64_t now = now_ns();
+    if (my_hist_owner != p) {
+        int i = atomic_fetch_add(&p->nhists, 1);
+        my_hist = i < SB_MAX_THREADS ? &p->hists[i] : NULL;
+        my_hist_owner = p;
+    }
+    if (my_hist) hist_record(my_hist, now > job->arrival_ns ? now - job->arrival_ns : 0);
+    if (p->o->work_ns) spin_ns((uint64_t)p->o->work_ns * (uint64_t)(job->est_cost / 1024 + 1));
+    atomic_fetch_add_explicit(&p->handled, 1, memory_order_release);
+}
+
+struct pool_producer {
+    struct pool_ctx *ctx;
+    pthread_t thread;
+    size_t index;
+    uint64_t quota;
+};
+
+static void *pool_producer_main(void *arg) {
+    struct pool_producer *t = arg;
+    struct pool_ctx *p = t->ctx;
+    uint32_t rnd = 0x85ebca6bu ^ (uint32_t)(t->index * 2654435761u);
+    if (!rnd) rnd = 1;
+    for (uint64_t i = 0; i < t->quota; ++i) {
+        if (p->dist == DIST_BURSTY && i && i % p->o->burst == 0) spin_ns((uint64_t)p->o->gap_us * 1000);
+        job_t j = {0};
+        j.client_fd = -1;
+        j.est_cost = gen_cost(p->dist == DIST_HEAVY ? DIST_HEAVY : DIST_UNIFORM, &rnd);
+        j.arrival_ns = now_ns();
+        if (threadpool_submit_job(p->tp, j) != 0) break;
+    }
+    return NULL;
+}
+
+static int run_pool(const struct opts *o, const char *name, int dist, int np, int nc, struct result *r) {
+    struct pool_ctx *p = calloc(1, sizeof(*p));
+    if (!p) return -1;
+    p->o = o;
+    p->dist = dist;
+    nc = nc > SB_MAX_THREADS ? SB_MAX_THREADS : nc;
+    struct pool_producer *ts = calloc((size_t)np, sizeof(*ts));
+    if (!ts) {
+        free(p);
+        return -1;
+    }
+    /* counters first: only threads created afterwards inherit them */
+    int fds[SB_NCOUNTERS];
+    counters_start(fds);
+    p->tp = threadpool_create_sharded((size_t)nc, o->capacity, NULL, o->shards, TP_SHARD_ROUND_ROBIN);
+    if (!p->tp || threadpool_set_scheduler_by_name(p->tp, name) != 0) {
+        threadpool_destroy(p->tp);
+        counters_stop(fds, r->counters);
+        free(ts);
+        free(p);
+        return -1;
+    }
+    threadpool_set_job_handler(p->tp, pool_handler, p);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < np; ++i) {
+        ts[i].ctx = p;
+        ts[i].index = (size_t)i;
+        ts[i].quota = o->ops / (uint64_t)np + ((uint64_t)i < o->ops % (uint64_t)np ? 1 : 0);
+        pthread_create(&ts[i].thread, NULL, pool_producer_main, &ts[i]);
+    }
+    for (int i = 0; i < np; ++i) pthread_join(ts[i].thread, NULL);
+    while (atomic_load_explicit(&p->handled, memory_order_acquire) < o->ops) sched_yield();
+    r->secs = (double)(now_ns() - t0) / 1e9;
+    /* workers are pool threads: joining them folds in their counts */
+    threadpool_destroy(p->tp);
+    counters_stop(fds, r->counters);
+    r->ops = o->ops;
+    int nh = atomic_load(&p->nhists);
+    for (int i = 0; i < nh && i < SB_MAX_THREADS; ++i) hist_snapshot_add(&r->handoff_ns, &p->hists[i]);
+    free(ts);
+    free(p);
+    return 0;
+}
+
+/* ---- driver ---- */
+
+static const char *dist_names[] = {"uniform", "heavy", "bursty"};
+
+static void report(const struct opts *o, const char *sched, const char *mode, int dist, int np,
+                   int nc, const struct result *r, int *header_done) {
+    double ops_s = r->secs > 0 ? (double)r->ops / r->secs : 0.0;
+    double ns_op = r->ops ? r->secs * 1e9 / (double)r->ops : 0.0;
+    double per_op[SB_NCOUNTERS];
+    for (int i = 0; i < SB_NCOUNTERS; ++i)
+        per_op[i] = r->counters[i] >= 0 && r->ops ? (double)r->counters[i] / (double)r->ops : -1.0;
+    const hist_snapshot_t *h = &r->handoff_ns;
+    if (strcmp(o->format, "csv") == 0) {
+        if (!*header_done)
+            printf("sched,mode,dist,producers,consumers,ops,secs,ops_per_s,ns_per_op,"
+                   "handoff_p50_ns,handoff_p99_ns,handoff_max_ns,cycles_per_op,insns_per_op,"
+                   "cache_misses_per_op,ctx_switches\n");
+        printf("%s,%s,%s,%d,%d,%llu,%.4f,%.0f,%.1f,%llu,%llu,%llu,%.1f,%.1f,%.3f,%lld\n", sched, mode,
+               dist_names[dist], np, nc, (unsigned long long)r->ops, r->secs, ops_s, ns_op,
+               (unsigned long long)hist_percentile(h, 0.50),
+               (unsigned long long)hist_percentile(h, 0.99), (unsigned long long)h->max,
+               per_op[0], per_op[1], per_op[2], r->counters[3]);
+    } else {
+        if (!*header_done)
+            printf("%-5s %-6s %-7s %3s %3s %12s %9s %10s %10s %9s %9s %9s %8s\n", "sched", "mode",
+                   "dist", "P", "C", "ops/s", "ns/op", "ho_p50ns", "ho_p99ns", "cyc/op", "ins/op",
+                   "miss/op", "ctxsw");
+        printf("%-5s %-6s %-7s %3d %3d %12.0f %9.1f %10llu %10llu %9.1f %9.1f %9.3f %8lld\n", sched,
+               mode, dist_names[dist], np, nc, ops_s, ns_op,
+               (unsigned long long)hist_percentile(h, 0.50),
+               (unsigned long long)hist_percentile(h, 0.99), per_op[0], per_op[1], per_op[2],
+               r->counters[3]);
+    }
+    *header_done = 1;
+    fflush(stdout);
+}
+
+/* parse_ints: "1,2,4" -> out[], returns count */
+static int parse_ints(const char *spec, int *out, int max) {
+    int n = 0;
+    const char *p = spec;
+    while (*p && n < max) {
+        int v = atoi(p);
+        if (v > 0) out[n++] = v > SB_MAX_THREADS ? SB_MAX_THREADS : v;
+        p = strchr(p, ',');
+        if (!p) break;
+        p++;
+    }
+    return n;
+}
+
+static int has_token(const char *list, const char *tok) {
+    size_t n = strlen(tok);
+    for (const char *p = list; p && *p;) {
+        const char *e = strchr(p, ',');
+        size_t len = e ? (size_t)(e - p) : strlen(p);
+        if (len == n && strncmp(p, tok, n) == 0) return 1;
+        p = e ? e + 1 : NULL;
+    }
+    return 0;
+}
+
+static const char *opt(const char *arg, const char *name) {
+    size_t n = strlen(name);
+    return strncmp(arg, name, n) == 0 ? arg + n : NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --sched=LIST      schedulers (fifo,sjf,mpmc,ws,mlq)\n"
+            "  --mode=LIST       single,mt,pool (all)\n"
+            "  --dist=LIST       uniform,heavy,bursty (uniform,heavy,bursty)\n"
+            "  --producers=LIST  producer thread counts (1,2,4)\n"
+            "  --consumers=LIST  consumer / worker thread counts (1,2,4)\n"
+            "  --ops=N           jobs per run (200000)\n"
+            "  --capacity=N      queue capacity (1024)\n"
+            "  --depth=N         single mode: queued jobs held (256)\n"
+            "  --burst=N         bursty: jobs per burst (64)\n"
+            "  --gap-us=N        bursty: pause between bursts (50)\n"
+            "  --work-ns=N       pool: service time per KiB of est_cost (0)\n"
+            "  --shards=N        pool: shards (1)\n"
+            "  --format=text|csv\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    struct opts o = {
+        .scheds = "fifo,sjf,mpmc,ws,mlq", .modes = "single,mt,pool", .dists = "uniform,heavy,bursty",
+        .producers = "1,2,4", .consumers = "1,2,4", .ops = 200000, .capacity = 1024,
+        .depth = 256, .burst = 64, .gap_us = 50, .work_ns = 0, .shards = 1, .format = "text",
+    };
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i], *v;
+        if ((v = opt(a, "--sched="))) o.scheds = v;
+        else if ((v = opt(a, "--mode="))) o.modes = v;
+        else if ((v = opt(a, "--dist="))) o.dists = v;
+        else if ((v = opt(a, "--producers="))) o.producers = v;
+        else if ((v = opt(a, "--consumers="))) o.consumers = v;
+        else if ((v = opt(a, "--ops="))) o.ops = strtoull(v, NULL, 10);
+        else if ((v = opt(a, "--capacity="))) o.capacity = strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--depth="))) o.depth = strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--burst="))) o.burst = (unsigned)strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--gap-us="))) o.gap_us = (unsigned)strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--work-ns="))) o.work_ns = (unsigned)strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--shards="))) o.shards = strtoul(v, NULL, 10);
+        else if ((v = opt(a, "--format="))) o.format = v;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (o.ops == 0) o.ops = 1;
+    if (o.capacity < 2) o.capacity = 2;
+    if (o.burst == 0) o.burst = 1;
+    int prods[16], cons[16];
+    int np = parse_ints(o.producers, prods, 16), nc = parse_ints(o.consumers, cons, 16);
+    if (np == 0 || nc == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char *list = strdup(o.scheds);
+    if (!list) return 1;
+    int header = 0, failed = 0;
+    char *save = NULL;
+    for (char *sched = strtok_r(list, ",", &save); sched; sched = strtok_r(NULL, ",", &save)) {
+        for (int d = 0; d < 3; ++d) {
+            if (!has_token(o.dists, dist_names[d])) continue;
+            struct result *r = calloc(1, sizeof(*r));
+            if (!r) return 1;
+            /* bursty only shapes arrivals: nothing to time single-threaded */
+            if (has_token(o.modes, "single") && d != DIST_BURSTY) {
+                if (run_single(&o, sched, d, r) == 0) report(&o, sched, "single", d, 1, 1, r, &header);
+                else failed = 1;
+            }
+            for (int pi = 0; pi < np; ++pi) {
+                for (int ci = 0; ci < nc; ++ci) {
+                    if (has_token(o.modes, "mt")) {
+                        memset(r, 0, sizeof(*r));
+                        if (run_mt(&o, sched, d, prods[pi], cons[ci], r) == 0)
+                            report(&o, sched, "mt", d, prods[pi], cons[ci], r, &header);
+                        else failed = 1;
+                    }
+                    if (has_token(o.modes, "pool")) {
+                        memset(r, 0, sizeof(*r));
+                        if (run_pool(&o, sched, d, prods[pi], cons[ci], r) == 0)
+                            report(&o, sched, "pool", d, prods[pi], cons[ci], r, &header);
+                        else failed = 1;
+                    }
+                }
+            }
+            free(r);
+        }
+    }
+    free(list);
+    if (failed) fprintf(stderr, "schedbench: some runs failed (unknown scheduler or allocation failure)\n");
+    return failed;
+}
@@ -0,0 +1,237 @@
+#define _GNU_SOURCE /* pthread_setaffinity_np */
+#include "acceptor.h"
+#include "http.h"
+#include "log.h"
+#include "metrics.h"
+#include "net.h"
+#include "tls.h"
+#include "topology.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* one acceptor thread and the listen socket it owns */
+struct acceptor_thread {
+    acceptor_t *a;
+    size_t index;
+    int listen_fd;
+    pthread_t thread;
+    int started;
+    atomic_int exited;
+};
+
+struct acceptor {
+    acceptor_config_t cfg;
+    atomic_int running;
+    size_t nthreads;
+    struct acceptor_thread *threads;
+};
+
+/* monotonic ms */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* acceptor_cpu: CPU for acceptor index; with a topology, consecutive
+   acceptors alternate between NUMA nodes like the pool's shards do */
+static int acceptor_cpu(size_t index) {
+    if (topology_nnodes() > 0) return topology_spread_cpu(index);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpu > 0 ? (int)(index % (size_t)ncpu) : -1;
+}
+
+static void pin_to_cpu(size_t index) {
+    int cpu = acceptor_cpu(index);
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_WARN("acceptor %zu: failed to pin to cpu %d", index, cpu);
+    }
+}
+
+/* submit_blocking: blocking mode - estimate cost and queue the raw fd */
+static void submit_blocking(const acceptor_config_t *cfg, int client_fd) {
+    /* peek whatever request bytes already arrived (TCP_DEFER_ACCEPT makes
+       that the usual case) to estimate the file size for SJF; never wait
+       for more, an unknown cost is cheaper than a stalled accept loop */
+    long est = 0;
+    char peek[4096];
+    ssize_t n = recv(client_fd, peek, sizeof(peek), MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) {
+        est = http_estimate_cost(peek, (size_t)n, cfg->docroot);
+    }
+
+    job_t j = { .client_fd = client_fd,
+                .est_cost = est,
+                .priority = 0,
+                .arrival_ms = now_ms() };
+
+    /* log estimated cost for debugging/verification (debug builds) */
+    LOG_DEBUG("submit: fd=%d est=%ld", client_fd, est);
+
+    /* metrics: record submit and whether est==0 */
+    metrics_inc_submit(est);
+
+    int rc = threadpool_admit_job(cfg->tp, j);
+    if (rc > 0) http_send_unavailable(client_fd, 0); /* overloaded: refuse now, don't queue */
+    if (rc != 0) close(client_fd);
+}
+
+void acceptor_dispatch(int client_fd, void *cfg) {
+    const acceptor_config_t *c = cfg;
+    if (c->reactor) {
+        /* the reactor reads the request and submits it when complete */
+        reactor_add(c->reactor, client_fd);
+        return;
+    }
+    submit_blocking(c, client_fd);
+}
+
+static void *acceptor_main(void *arg) {
+    struct acceptor_thread *t = arg;
+    acceptor_t *a = t->a;
+
+    if (a->cfg.pin_cpus) pin_to_cpu(t->index);
+
+    int failing = 0; /* consecutive failed accepts: only the first is logged */
+    while (atomic_load(&a->running)) {
+        struct sockaddr_in client_addr;
+        socklen_t addrlen = sizeof(client_addr);
+        int client_fd = accept(t->listen_fd, (struct sockaddr*)&client_addr, &addrlen);
+        if (client_fd < 0) {
+            if (!atomic_load(&a->running)) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK) {
+                /* the socket itself is gone or not listening: nothing to
+                   retry, but say so loudly - its share of connections
+                   is no longer accepted */
+                perror("accept");
+                LOG_ERROR("acceptor %zu: listen socket unusable, acceptor stopped", t->index);
+                metrics_inc_accept_error(METRICS_ACCEPT_FATAL);
+                break;
+            }
+            /* out of fds or memory, or a transient network error: back off
+               instead of spinning, and never leave the backlog unserved */
+            if (!failing++) perror("accept");
+            metrics_inc_accept_error(METRICS_ACCEPT_RETRY);
+            usleep(10000);
+            continue;
+        }
+        failing = 0;
+
+        if (a->cfg.tls) tls_add(a->cfg.tls, client_fd);
+        else acceptor_dispatch(client_fd, &a->cfg);
+    }
+    atomic_store(&t->exited, 1);
+    return NULL;
+}
+
+acceptor_t *acceptor_start(const acceptor_config_t *cfg) {
+    acceptor_t *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->cfg = *cfg;
+    a->nthreads = cfg->nlisten_fds ? cfg->nlisten_fds : cfg->nacceptors ? cfg->nacceptors : 1;
+    a->cfg.listen_fds = NULL; /* borrowed: only read below */
+    a->threads = calloc(a->nthreads, sizeof(*a->threads));
+    if (!a->threads) {
+        free(a);
+        return NULL;
+    }
+
+    int flags = a->nthreads > 1 ? NET_LISTEN_REUSEPORT : 0;
+    if (!cfg->reactor) flags |= NET_LISTEN_DEFER_ACCEPT;
+    for (size_t i = 0; i < a->nthreads; ++i) {
+        a->threads[i].a = a;
+        a->threads[i].index = i;
+        a->threads[i].listen_fd = cfg->nlisten_fds ? cfg->listen_fds[i]
+                                                   : create_and_bind_listen_ex(cfg->port, cfg->backlog, flags);
+        if (a->threads[i].listen_fd < 0) {
+            for (size_t k = 0; k < i; ++k) close(a->threads[k].listen_fd);
+            free(a->threads);
+            free(a);
+            return NULL;
+        }
+        /* reuseport picks the socket whose CPU matches the one the packet
+           arrived on, so a connection stays on its RX queue's core */
+        int cpu = acceptor_cpu(i);
+        if (cfg->incoming_cpu && cpu >= 0 &&
+            setsockopt(a->threads[i].listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0)
+            perror("setsockopt SO_INCOMING_CPU");
+    }
+
+    atomic_store(&a->running, 1);
+    for (size_t i = 0; i < a->nthreads; ++i) {
+        /* an io_uring reactor accepts on the socket itself (TLS
+           connections start on the TLS threads instead) */
+        if (cfg->reactor && !cfg->tls && reactor_listen(cfg->reactor, a->threads[i].listen_fd) == 0) continue;
+        if (pthread_create(&a->threads[i].thread, NULL, acceptor_main, &a->threads[i]) != 0) {
+            perror("pthread_create acceptor");
+            continue;
+        }
+        a->threads[i].started = 1;
+    }
+    return a;
+}
+
+size_t acceptor_listen_fds(const acceptor_t *a, int *fds, size_t max) {
+    if (!a) return 0;
+    for (size_t i = 0; i < a->nthreads && i < max; ++i) fds[i] = a->threads[i].listen_fd;
+    return a->nthreads;
+}
+
+/* no-op handler: its only job is to make a blocked accept() fail with EINTR */
+static void on_release_signal(int sig) {
+    (void)sig;
+}
+
+void acceptor_release(acceptor_t *a) {
+    if (!a) return;
+    atomic_store(&a->running, 0);
+    reactor_unlisten(a->cfg.reactor);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_release_signal; /* no SA_RESTART */
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    for (size_t i = 0; i < a->nthreads; ++i) {
+        struct acceptor_thread *t = &a->threads[i];
+        if (!t->started) continue;
+        /* a signal landing just before accept() is lost: repeat until the
+           thread is out */
+        while (!atomic_load(&t->exited)) {
+            pthread_kill(t->thread, SIGUSR1);
+            usleep(1000);
+        }
+        pthread_join(t->thread, NULL);
+    }
+    for (size_t i = 0; i < a->nthreads; ++i) close(a->threads[i].listen_fd);
+    free(a->threads);
+    free(a);
+}
+
+void acceptor_stop(acceptor_t *a) {
+    if (!a) return;
+    atomic_store(&a->running, 0);
+    /* shutdown() wakes a thread blocked in accept() on Linux */
+    for (size_t i = 0; i < a->nthreads; ++i) shutdown(a->threads[i].listen_fd, SHUT_RDWR);
+    for (size_t i = 0; i < a->nthreads; ++i) {
+        if (a->threads[i].started) pthread_join(a->threads[i].thread, NULL);
+        close(a->threads[i].listen_fd);
+    }
+    free(a->threads);
+    free(a);
+}
@@ -0,0 +1,71 @@
+// Acceptor threads: accept() new connections and hand them to the reactor
+// (epoll mode) or straight to the thread pool (blocking mode).
+//
+// acceptor_start:
+//  - Start cfg->nacceptors acceptor threads.
+//  - nacceptors == 1: one listen socket, as before.
+//  - nacceptors > 1 : one SO_REUSEPORT listen socket per thread, so the
+//    kernel spreads new connections across independent accept queues.
+//  - pin_cpus != 0 pins acceptor i to CPU (i % online CPUs), or with a
+//    topology (topology_init) to CPUs alternating between NUMA nodes.
+//  - incoming_cpu != 0 sets SO_INCOMING_CPU on each listen socket to its
+//    acceptor's CPU, so with reuseport the kernel hands a connection to the
+//    acceptor on the core its NIC RX queue interrupts (steer the queues'
+//    IRQs to those cores for the full effect).
+//  - A reactor that accepts by itself (io_uring engine, see reactor_listen)
+//    takes the listen sockets and no acceptor threads are started.
+//  - tls != NULL: accepted sockets go to tls_add, which passes them on
+//    with acceptor_dispatch once the handshake is done (always through
+//    acceptor threads, whatever the reactor).
+//  - listen_fds/nlisten_fds: adopt these already listening sockets (from
+//    a previous process, see handoff.h) instead of binding new ones; one
+//    acceptor per socket, whatever nacceptors says.
+//  - Returns NULL if no listen socket could be created.
+//
+// acceptor_dispatch:
+//  - Hand an accepted connection to cfg's reactor, or queue it on cfg's
+//    pool in blocking mode. The tls_config_t deliver callback: cfg (the
+//    caller's, not a copy) must then outlive the tls_t.
+//
+// acceptor_listen_fds:
+//  - Copy up to max listen socket fds into fds; returns how many there are.
+//
+// acceptor_release:
+//  - Like acceptor_stop, but for sockets now shared with another process:
+//    the threads are woken with a signal instead of shutdown() (which would
+//    shut the socket down for every holder) and only this process's
+//    descriptors are closed. Connections already accepted are served.
+//
+// acceptor_stop:
+//  - Wake and join every acceptor thread and close the listen sockets.
+//    No new jobs are submitted once this returns. Passing NULL is a no-op.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reactor.h"
+#include "threadpool.h"
+#include "tls.h"
+
+typedef struct acceptor acceptor_t;
+
+typedef struct {
+    uint16_t port;
+    int backlog;            /* listen() backlog per socket */
+    size_t nacceptors;      /* number of acceptor threads (>= 1) */
+    int pin_cpus;           /* pin each acceptor thread to one CPU */
+    int incoming_cpu;       /* SO_INCOMING_CPU on the listen sockets */
+    const char *docroot;    /* used for SJF estimates in blocking mode */
+    threadpool_t *tp;
+    reactor_t *reactor;     /* NULL: blocking mode, submit fds directly */
+    tls_t *tls;             /* NULL: plain HTTP */
+    const int *listen_fds;  /* inherited listen sockets, NULL: bind */
+    size_t nlisten_fds;
+} acceptor_config_t;
+
+acceptor_t *acceptor_start(const acceptor_config_t *cfg);
+void acceptor_dispatch(int client_fd, void *cfg);
+size_t acceptor_listen_fds(const acceptor_t *a, int *fds, size_t max);
+void acceptor_release(acceptor_t *a);
+void acceptor_stop(acceptor_t *a);
@@ -0,0 +1,70 @@
+#include "arena.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* an oversized allocation, chained until the next reset */
+struct arena_spill {
+    struct arena_spill *next;
+    _Alignas(ARENA_ALIGN) char data[];
+};
+
+void arena_init(arena_t *a, void *buf, size_t size) {
+    a->base = buf;
+    a->size = buf ? size : 0;
+    a->used = 0;
+    a->spill = NULL;
+}
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void *spill(arena_t *a, size_t n) {
+    struct arena_spill *s = malloc(sizeof(*s) + n);
+    if (!s) return NULL;
+    s->next = a->spill;
+    a->spill = s;
+    return s->data;
+}
+
+void *arena_alloc(arena_t *a, size_t n) {
+    size_t off = align_up(a->used);
+    if (off <= a->size && n <= a->size - off) {
+        a->used = off + n;
+        return a->base + off;
+    }
+    return spill(a, n);
+}
+
+char *arena_printf(arena_t *a, const char *fmt, ...) {
+    /* format straight into the free tail; only a string that does not fit
+       is formatted twice */
+    size_t off = align_up(a->used);
+    size_t room = off < a->size ? a->size - off : 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(room ? a->base + off : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n < 0) return NULL;
+    if ((size_t)n < room) {
+        a->used = off + (size_t)n + 1;
+        return a->base + off;
+    }
+    char *p = spill(a, (size_t)n + 1);
+    if (!p) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(p, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    return p;
+}
+
+void arena_reset(arena_t *a) {
+    while (a->spill) {
+        struct arena_spill *next = a->spill->next;
+        free(a->spill);
+        a->spill = next;
+    }
+    a->used = 0;
+}
@@ -0,0 +1,41 @@
+// Bump allocator for per-request scratch memory.
+//
+// An arena hands out memory from one caller-provided buffer (e.g. inside a
+// connection object) by bumping an offset; nothing is freed on its own and
+// arena_reset drops everything at once, between requests. Allocations that
+// do not fit the buffer spill into malloc'd blocks that the next reset
+// frees, so a small buffer only costs speed on unusually long paths.
+//
+// arena_init:
+//  - Use buf[0..size) as the inline block (size 0: every allocation spills).
+//
+// arena_alloc:
+//  - n bytes aligned to ARENA_ALIGN, valid until the next reset. Returns
+//    NULL only if a spill block could not be allocated.
+//
+// arena_printf:
+//  - Format into the arena; returns the string or NULL (format error/OOM).
+//
+// arena_reset:
+//  - Forget every allocation and free the spill blocks.
+//
+// Not thread-safe: an arena belongs to whoever owns the connection.
+#pragma once
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+
+struct arena_spill;
+
+typedef struct arena {
+    char *base;
+    size_t size;
+    size_t used;
+    struct arena_spill *spill;
+} arena_t;
+
+void arena_init(arena_t *a, void *buf, size_t size);
+void *arena_alloc(arena_t *a, size_t n);
+char *arena_printf(arena_t *a, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void arena_reset(arena_t *a);
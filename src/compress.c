@@ -0,0 +1,124 @@
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+static struct {
+    int enabled;
+    size_t max_file;
+} cz;
+
+/* text-like types that shrink well; everything else (images, archives,
+   media) is usually compressed already */
+static const char *const compressible_ext[] = {
+    ".html", ".htm", ".css", ".js", ".mjs", ".json", ".map", ".txt", ".xml",
+    ".svg", ".csv", ".md", ".wasm", NULL,
+};
+
+void compress_init(int enabled, size_t max_file) {
+    cz.enabled = enabled;
+    cz.max_file = max_file;
+}
+
+int compress_enabled(void) {
+    return cz.enabled;
+}
+
+size_t compress_max_file(void) {
+    return cz.max_file;
+}
+
+int compress_available(int enc) {
+#ifdef HAVE_ZLIB
+    if (enc == COMPRESS_GZIP) return 1;
+#endif
+#ifdef HAVE_BROTLI
+    if (enc == COMPRESS_BR) return 1;
+#endif
+    (void)enc;
+    return 0;
+}
+
+const char *compress_name(int enc) {
+    return enc == COMPRESS_BR ? "br" : enc == COMPRESS_GZIP ? "gzip" : "identity";
+}
+
+const char *compress_suffix(int enc) {
+    return enc == COMPRESS_BR ? ".br" : enc == COMPRESS_GZIP ? ".gz" : "";
+}
+
+int compress_type_ok(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return 0;
+    for (size_t i = 0; compressible_ext[i]; ++i) {
+        if (strcasecmp(dot, compressible_ext[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+#ifdef HAVE_ZLIB
+static char *encode_gzip(const char *in, size_t len, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    /* windowBits 15 + 16: gzip wrapper rather than zlib */
+    if (deflateInit2(&zs, COMPRESS_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+    size_t cap = deflateBound(&zs, (uLong)len);
+    char *out = malloc(cap);
+    if (!out) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = (uInt)cap;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static char *encode_br(const char *in, size_t len, size_t *out_len) {
+    size_t cap = BrotliEncoderMaxCompressedSize(len);
+    if (cap == 0) return NULL;
+    char *out = malloc(cap);
+    if (!out) return NULL;
+    size_t n = cap;
+    if (!BrotliEncoderCompress(COMPRESS_BR_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len,
+                               (const uint8_t *)in, &n, (uint8_t *)out)) {
+        free(out);
+        return NULL;
+    }
+    *out_len = n;
+    return out;
+}
+#endif
+
+char *compress_encode(int enc, const char *in, size_t len, size_t *out_len) {
+#ifdef HAVE_ZLIB
+    if (enc == COMPRESS_GZIP) return encode_gzip(in, len, out_len);
+#endif
+#ifdef HAVE_BROTLI
+    if (enc == COMPRESS_BR) return encode_br(in, len, out_len);
+#endif
+    (void)enc;
+    (void)in;
+    (void)len;
+    (void)out_len;
+    return NULL;
+}
@@ -0,0 +1,40 @@
+// Response compression for Accept-Encoding negotiation.
+//
+// Two sources of encoded bodies, tried in this order by http.c:
+//  1. Precompressed siblings in the docroot ("<file>.br", "<file>.gz"),
+//     served like any other file (cache or sendfile). Their existence is
+//     taken from the size index, so a miss costs no syscall.
+//  2. Compressible files (by extension) up to compress_max_file bytes are
+//     compressed once and kept in the file cache
+//     (filecache_lookup_encoded), keyed by path and encoding and
+//     revalidated against the source file like any cached entry.
+//
+// gzip needs zlib (HAVE_ZLIB) and br libbrotlienc (HAVE_BROTLI); without
+// them that encoding is only ever served from siblings.
+//
+// compress_init:
+//  - enabled  : 0 turns negotiation off entirely (no siblings, no Vary).
+//  - max_file : largest source compressed on the fly; 0 means siblings only.
+//
+// compress_encode:
+//  - Returns a malloc'd encoded copy of in[0..len) and its length, or NULL
+//    if the encoding is unavailable or compression failed.
+#pragma once
+
+#include <stddef.h>
+
+#define COMPRESS_IDENTITY 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_BR 2
+
+#define COMPRESS_GZIP_LEVEL 6   /* zlib 1..9 */
+#define COMPRESS_BR_QUALITY 9   /* brotli 0..11; done once per file version */
+
+void compress_init(int enabled, size_t max_file);
+int compress_enabled(void);
+size_t compress_max_file(void);
+int compress_available(int enc);
+const char *compress_name(int enc);    /* Content-Encoding token */
+const char *compress_suffix(int enc);  /* sibling file suffix */
+int compress_type_ok(const char *path);
+char *compress_encode(int enc, const char *in, size_t len, size_t *out_len);
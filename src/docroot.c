@@ -0,0 +1,216 @@
+#define _GNU_SOURCE /* O_PATH */
+#include "docroot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DR_SHARDS 16
+
+/* one direct-mapped slot: a colliding path simply replaces it */
+struct dr_slot {
+    uint64_t hash;
+    uint64_t checked_ms;
+    unsigned gen;
+    int kind;
+    char *path;
+};
+
+struct dr_shard {
+    pthread_mutex_t lock;
+    struct dr_slot *slots;
+} __attribute__((aligned(64)));
+
+static struct {
+    int dirfd;                  /* -1: paths are used as they are */
+    int confined;               /* openat2(RESOLVE_BENEATH) works */
+    char *root;
+    size_t root_len;
+    unsigned ttl_ms;
+    size_t mask;                /* slots per shard - 1; cache off if no shards */
+    struct dr_shard *shards;
+    atomic_uint gen;
+} dr = { .dirfd = -1 };
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t hash_path(const char *p) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* rel_of: path relative to the docroot descriptor, NULL if path is not
+   under the docroot string. Extra slashes are skipped: a relative lookup
+   must never turn into an absolute one. */
+static const char *rel_of(const char *path) {
+    if (dr.dirfd < 0 || strncmp(path, dr.root, dr.root_len) != 0) return NULL;
+    const char *p = path + dr.root_len;
+    if (*p && *p != '/') return NULL;
+    while (*p == '/') p++;
+    return *p ? p : ".";
+}
+
+static int open_beneath(const char *rel, int flags) {
+    struct open_how how = {
+        .flags = (uint64_t)flags,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+    };
+    return (int)syscall(SYS_openat2, dr.dirfd, rel, &how, sizeof(how));
+}
+
+int docroot_init(const char *docroot, size_t slots, unsigned ttl_ms) {
+    atomic_init(&dr.gen, 0);
+    dr.ttl_ms = ttl_ms;
+    if (slots) {
+        size_t per = 1;
+        while (per * DR_SHARDS < slots) per <<= 1;
+        dr.shards = aligned_alloc(64, DR_SHARDS * sizeof(struct dr_shard));
+        if (dr.shards) {
+            for (size_t i = 0; i < DR_SHARDS; ++i) {
+                pthread_mutex_init(&dr.shards[i].lock, NULL);
+                dr.shards[i].slots = calloc(per, sizeof(struct dr_slot));
+            }
+            dr.mask = per - 1;
+        }
+    }
+
+    dr.dirfd = open(docroot, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dr.dirfd < 0) {
+        perror("open docroot");
+        return -1;
+    }
+    dr.root = strdup(docroot);
+    if (!dr.root) {
+        close(dr.dirfd);
+        dr.dirfd = -1;
+        return -1;
+    }
+    dr.root_len = strlen(docroot);
+    /* trailing slashes would break the prefix match: "www/" + "/x" */
+    while (dr.root_len > 1 && dr.root[dr.root_len - 1] == '/') dr.root_len--;
+
+    /* openat2 is Linux 5.6+ and may be filtered by seccomp */
+    int fd = open_beneath(".", O_PATH | O_CLOEXEC);
+    if (fd >= 0) {
+        close(fd);
+        dr.confined = 1;
+    }
+    return 0;
+}
+
+void docroot_shutdown(void) {
+    if (dr.shards) {
+        for (size_t i = 0; i < DR_SHARDS; ++i) {
+            struct dr_shard *sh = &dr.shards[i];
+            if (sh->slots) {
+                for (size_t j = 0; j <= dr.mask; ++j) free(sh->slots[j].path);
+                free(sh->slots);
+            }
+            pthread_mutex_destroy(&sh->lock);
+        }
+        free(dr.shards);
+        dr.shards = NULL;
+    }
+    if (dr.dirfd >= 0) close(dr.dirfd);
+    dr.dirfd = -1;
+    dr.confined = 0;
+    free(dr.root);
+    dr.root = NULL;
+}
+
+int docroot_confined(void) {
+    return dr.confined;
+}
+
+int docroot_open(const char *path, int flags) {
+    const char *rel = rel_of(path);
+    if (!rel) return open(path, flags);
+    if (dr.confined) return open_beneath(rel, flags);
+    return openat(dr.dirfd, rel, flags);
+}
+
+int docroot_stat(const char *path, struct stat *st) {
+    const char *rel = rel_of(path);
+    if (!rel) return stat(path, st);
+    if (!dr.confined) return fstatat(dr.dirfd, rel, st, 0);
+    /* fstatat has no RESOLVE_* flags: resolve confined, then fstat, so a
+       path the open would refuse never reports a size or a directory */
+    int fd = open_beneath(rel, O_PATH | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = fstat(fd, st);
+    int e = errno;
+    close(fd);
+    errno = e;
+    return rc;
+}
+
+static struct dr_slot *slot_of(uint64_t h, struct dr_shard **shp) {
+    struct dr_shard *sh = &dr.shards[h % DR_SHARDS];
+    *shp = sh;
+    return sh->slots ? &sh->slots[(h / DR_SHARDS) & dr.mask] : NULL;
+}
+
+int docroot_cached(const char *path, unsigned *gen) {
+    *gen = atomic_load_explicit(&dr.gen, memory_order_acquire);
+    if (!dr.shards) return DOCROOT_UNKNOWN;
+    uint64_t h = hash_path(path);
+    struct dr_shard *sh;
+    struct dr_slot *s = slot_of(h, &sh);
+    if (!s) return DOCROOT_UNKNOWN;
+
+    int kind = DOCROOT_UNKNOWN;
+    pthread_mutex_lock(&sh->lock);
+    if (s->path && s->hash == h && s->gen == *gen && now_ms() - s->checked_ms <= dr.ttl_ms &&
+        strcmp(s->path, path) == 0)
+        kind = s->kind;
+    pthread_mutex_unlock(&sh->lock);
+    return kind;
+}
+
+void docroot_remember(const char *path, int kind, unsigned gen) {
+    if (!dr.shards || gen != atomic_load_explicit(&dr.gen, memory_order_acquire)) return;
+    uint64_t h = hash_path(path);
+    struct dr_shard *sh;
+    struct dr_slot *s = slot_of(h, &sh);
+    if (!s) return;
+
+    char *copy = NULL;
+    pthread_mutex_lock(&sh->lock);
+    if (!s->path || s->hash != h || strcmp(s->path, path) != 0) {
+        pthread_mutex_unlock(&sh->lock);
+        /* allocate outside the lock; a racing writer just wins the slot */
+        copy = strdup(path);
+        if (!copy) return;
+        pthread_mutex_lock(&sh->lock);
+        char *old = s->path;
+        s->path = copy;
+        copy = old;
+    }
+    s->hash = h;
+    s->kind = kind;
+    s->gen = gen;
+    s->checked_ms = now_ms();
+    pthread_mutex_unlock(&sh->lock);
+    free(copy);
+}
+
+void docroot_invalidate(void) {
+    atomic_fetch_add_explicit(&dr.gen, 1, memory_order_release);
+}
@@ -0,0 +1,65 @@
+// Docroot-relative file access and the request path lookup cache.
+//
+// The docroot is opened once as a directory descriptor, and every open and
+// stat done for a request path resolves relative to it (openat/fstatat), so
+// the kernel walks "<docroot>/" once at startup instead of on every lookup.
+// Where the kernel has openat2, opens use RESOLVE_BENEATH: "..", absolute
+// symlinks and symlinks leading out of the docroot fail with EXDEV instead
+// of relying on a string check of the request path.
+//
+// On top of that, a small table remembers what a request path turned out to
+// be: missing (404), a directory mapped to its index.html, a directory with
+// no index (403), or a regular file too large for the file cache. Repeated
+// 404s and index mappings become a hash lookup instead of a stat. Entries
+// expire after ttl_ms; with the inotify watcher (sizeindex_watch) running,
+// any change in the docroot also drops them at once.
+//
+// Paths are the ones the HTTP layer builds ("<docroot>/<path>", the same
+// keys the caches use). A path outside the docroot string falls back to a
+// plain open()/stat().
+//
+// docroot_init:
+//  - Open docroot and size the lookup cache (slots, rounded up to a power
+//    of two; 0 disables it). Returns 0, or -1 if docroot could not be
+//    opened (paths are then used as they are).
+//
+// docroot_confined:
+//  - 1 if opens are confined with RESOLVE_BENEATH, 0 otherwise (then the
+//    caller must reject ".." itself).
+//
+// docroot_open / docroot_stat:
+//  - open(path, flags) / stat(path, st) relative to the docroot. Same
+//    return values and errno as the plain calls.
+//
+// docroot_cached / docroot_remember:
+//  - cached: the DOCROOT_* kind known for path, DOCROOT_UNKNOWN if none.
+//    *gen is a snapshot to hand to remember after looking the path up, so
+//    a result that raced with a change in the docroot is not stored.
+//  - remember: record kind for path. Safe from any thread.
+//
+// docroot_invalidate:
+//  - Forget every cached lookup (called by the docroot watcher).
+//
+// docroot_shutdown:
+//  - Close the docroot descriptor and free the cache.
+#pragma once
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+enum {
+    DOCROOT_UNKNOWN = 0,
+    DOCROOT_MISSING,   /* nothing there: 404 */
+    DOCROOT_FILE,      /* regular file served from the fd cache */
+    DOCROOT_INDEX,     /* directory: serve <path>/index.html */
+    DOCROOT_NOINDEX,   /* directory without index.html: 403 */
+};
+
+int docroot_init(const char *docroot, size_t slots, unsigned ttl_ms);
+void docroot_shutdown(void);
+int docroot_confined(void);
+int docroot_open(const char *path, int flags);
+int docroot_stat(const char *path, struct stat *st);
+int docroot_cached(const char *path, unsigned *gen);
+void docroot_remember(const char *path, int kind, unsigned gen);
+void docroot_invalidate(void);
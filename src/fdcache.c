@@ -0,0 +1,272 @@
+#include "fdcache.h"
+#include "docroot.h"
+#include "sizeindex.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FDC_SHARDS 16       /* independent locks; power of two */
+#define FDC_BUCKETS 64      /* hash buckets per shard */
+
+/* cache entry; the public fd_entry_t view is the first member */
+struct fdc_item {
+    fd_entry_t pub;
+    atomic_int refs;              /* the table holds one reference */
+    int in_table;                 /* under shard lock */
+    uint64_t hash;
+    uint64_t checked_ms;          /* last successful revalidation */
+    struct fdc_item *hnext;       /* bucket chain */
+    struct fdc_item *prev, *next; /* LRU list, most recent first */
+    char path[];
+};
+
+struct fdc_shard {
+    pthread_mutex_t lock;
+    struct fdc_item *buckets[FDC_BUCKETS];
+    struct fdc_item *lru_head, *lru_tail;
+    size_t count;
+    size_t cap;
+} __attribute__((aligned(64)));
+
+static struct {
+    int enabled;
+    unsigned ttl_ms;
+    struct fdc_shard *shards;
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_uint_fast64_t open_fds;
+} fdc;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a */
+static uint64_t hash_path(const char *p) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static size_t bucket_of(uint64_t h) {
+    return (size_t)(h / FDC_SHARDS) % FDC_BUCKETS;
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static void item_put(struct fdc_item *it) {
+    if (atomic_fetch_sub(&it->refs, 1) == 1) {
+        close(it->pub.fd);
+        atomic_fetch_sub_explicit(&fdc.open_fds, 1, memory_order_relaxed);
+        free(it);
+    }
+}
+
+static struct fdc_item *open_item(const char *path, uint64_t h) {
+    int fd = docroot_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    size_t len = strlen(path) + 1;
+    struct fdc_item *it = calloc(1, sizeof(*it) + len);
+    if (!it) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (fstat(fd, &it->pub.st) < 0) {
+        int e = errno;
+        close(fd);
+        free(it);
+        errno = e;
+        return NULL;
+    }
+    it->pub.fd = fd;
+    if (S_ISREG(it->pub.st.st_mode)) {
+        sizeindex_update(path, (long)it->pub.st.st_size);
+        it->pub.validators_len = validator_build(it->pub.validators, sizeof(it->pub.validators),
+                                                 &it->pub.st, NULL, &it->pub.etag_off, &it->pub.etag_len);
+    }
+    memcpy(it->path, path, len);
+    it->hash = h;
+    it->checked_ms = now_ms();
+    atomic_init(&it->refs, 1);
+    atomic_fetch_add_explicit(&fdc.open_fds, 1, memory_order_relaxed);
+    return it;
+}
+
+static struct fdc_item *find(struct fdc_shard *sh, uint64_t h, const char *path) {
+    for (struct fdc_item *it = sh->buckets[bucket_of(h)]; it; it = it->hnext) {
+        if (it->hash == h && strcmp(it->path, path) == 0) return it;
+    }
+    return NULL;
+}
+
+static void lru_unlink(struct fdc_shard *sh, struct fdc_item *it) {
+    if (it->prev) it->prev->next = it->next;
+    else sh->lru_head = it->next;
+    if (it->next) it->next->prev = it->prev;
+    else sh->lru_tail = it->prev;
+    it->prev = it->next = NULL;
+}
+
+static void lru_push_front(struct fdc_shard *sh, struct fdc_item *it) {
+    it->prev = NULL;
+    it->next = sh->lru_head;
+    if (sh->lru_head) sh->lru_head->prev = it;
+    sh->lru_head = it;
+    if (!sh->lru_tail) sh->lru_tail = it;
+}
+
+/* remove: unlink from bucket and LRU (lock held); caller drops the
+   table reference */
+static void remove_item(struct fdc_shard *sh, struct fdc_item *it) {
+    struct fdc_item **pp = &sh->buckets[bucket_of(it->hash)];
+    while (*pp && *pp != it) pp = &(*pp)->hnext;
+    if (*pp) *pp = it->hnext;
+    it->hnext = NULL;
+    lru_unlink(sh, it);
+    sh->count--;
+    it->in_table = 0;
+}
+
+static void insert(struct fdc_shard *sh, struct fdc_item *it) {
+    while (sh->count >= sh->cap && sh->lru_tail) {
+        struct fdc_item *victim = sh->lru_tail;
+        remove_item(sh, victim);
+        item_put(victim);
+    }
+    size_t b = bucket_of(it->hash);
+    it->hnext = sh->buckets[b];
+    sh->buckets[b] = it;
+    lru_push_front(sh, it);
+    sh->count++;
+    it->in_table = 1;
+    atomic_fetch_add(&it->refs, 1);
+}
+
+int fdcache_init(size_t max_entries, unsigned ttl_ms) {
+    memset(&fdc, 0, sizeof(fdc));
+    atomic_init(&fdc.hits, 0);
+    atomic_init(&fdc.misses, 0);
+    atomic_init(&fdc.open_fds, 0);
+    fdc.ttl_ms = ttl_ms;
+    if (max_entries == 0) return 0;
+
+    fdc.shards = aligned_alloc(64, FDC_SHARDS * sizeof(struct fdc_shard));
+    if (!fdc.shards) return -1;
+    memset(fdc.shards, 0, FDC_SHARDS * sizeof(struct fdc_shard));
+    size_t per = (max_entries + FDC_SHARDS - 1) / FDC_SHARDS;
+    for (size_t i = 0; i < FDC_SHARDS; ++i) {
+        pthread_mutex_init(&fdc.shards[i].lock, NULL);
+        fdc.shards[i].cap = per;
+    }
+    fdc.enabled = 1;
+    return 0;
+}
+
+void fdcache_shutdown(void) {
+    if (!fdc.enabled) return;
+    fdc.enabled = 0;
+    for (size_t i = 0; i < FDC_SHARDS; ++i) {
+        struct fdc_shard *sh = &fdc.shards[i];
+        pthread_mutex_lock(&sh->lock);
+        while (sh->lru_head) {
+            struct fdc_item *it = sh->lru_head;
+            remove_item(sh, it);
+            item_put(it);
+        }
+        pthread_mutex_unlock(&sh->lock);
+        pthread_mutex_destroy(&sh->lock);
+    }
+    free(fdc.shards);
+    fdc.shards = NULL;
+}
+
+const fd_entry_t *fdcache_open(const char *path) {
+    uint64_t h = hash_path(path);
+    if (!fdc.enabled) {
+        struct fdc_item *it = open_item(path, h);
+        return it ? &it->pub : NULL;
+    }
+
+    struct fdc_shard *sh = &fdc.shards[h % FDC_SHARDS];
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&sh->lock);
+    struct fdc_item *it = find(sh, h, path);
+    if (it) {
+        atomic_fetch_add(&it->refs, 1);
+        lru_unlink(sh, it);
+        lru_push_front(sh, it);
+        if (now - it->checked_ms <= fdc.ttl_ms) {
+            pthread_mutex_unlock(&sh->lock);
+            atomic_fetch_add_explicit(&fdc.hits, 1, memory_order_relaxed);
+            return &it->pub;
+        }
+        pthread_mutex_unlock(&sh->lock);
+
+        /* TTL expired: is the path still the file we hold open? */
+        struct stat st;
+        if (docroot_stat(path, &st) == 0 && same_file(&st, &it->pub.st)) {
+            pthread_mutex_lock(&sh->lock);
+            it->checked_ms = now;
+            pthread_mutex_unlock(&sh->lock);
+            atomic_fetch_add_explicit(&fdc.hits, 1, memory_order_relaxed);
+            return &it->pub;
+        }
+        pthread_mutex_lock(&sh->lock);
+        int drop = it->in_table;
+        if (drop) remove_item(sh, it);
+        pthread_mutex_unlock(&sh->lock);
+        if (drop) item_put(it);
+        item_put(it);
+    } else {
+        pthread_mutex_unlock(&sh->lock);
+    }
+
+    atomic_fetch_add_explicit(&fdc.misses, 1, memory_order_relaxed);
+    struct fdc_item *fresh = open_item(path, h);
+    if (!fresh) return NULL;
+
+    pthread_mutex_lock(&sh->lock);
+    struct fdc_item *old = find(sh, h, path);
+    if (old) { /* raced with another opener; keep the newer descriptor */
+        remove_item(sh, old);
+        item_put(old);
+    }
+    insert(sh, fresh);
+    pthread_mutex_unlock(&sh->lock);
+    return &fresh->pub;
+}
+
+void fdcache_release(const fd_entry_t *e) {
+    if (e) item_put((struct fdc_item *)e);
+}
+
+int fdcache_stat(const char *path, struct stat *st) {
+    if (!fdc.enabled) return docroot_stat(path, st);
+    const fd_entry_t *e = fdcache_open(path);
+    if (!e) return -1;
+    *st = e->st;
+    fdcache_release(e);
+    return 0;
+}
+
+void fdcache_stats(uint64_t *hits, uint64_t *misses, uint64_t *open_fds) {
+    if (hits) *hits = atomic_load_explicit(&fdc.hits, memory_order_relaxed);
+    if (misses) *misses = atomic_load_explicit(&fdc.misses, memory_order_relaxed);
+    if (open_fds) *open_fds = atomic_load_explicit(&fdc.open_fds, memory_order_relaxed);
+}
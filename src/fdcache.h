@@ -0,0 +1,50 @@
+// Open file descriptor cache for the sendfile path.
+//
+// Large files are served with sendfile() from a shared, read-only
+// descriptor. Each request keeps its own offset (sendfile's offset argument
+// never moves the shared file position), so workers can stream the same
+// file concurrently without re-opening it. Entries carry the fstat() data
+// and are revalidated against stat(path) once their TTL expires; a replaced
+// or modified file gets a fresh descriptor. Descriptors are closed when the
+// last reference is released after eviction.
+//
+// fdcache_init:
+//  - max_entries : number of descriptors kept open (LRU per shard);
+//                  0 disables caching (every open is one-shot).
+//  - ttl_ms      : how long an entry is trusted before re-stat()ing.
+//
+// fdcache_open:
+//  - Returns a referenced entry for path, or NULL with errno set.
+//    Call fdcache_release when done with e->fd. e->validators holds the
+//    ETag/Last-Modified lines (see validators.h) for regular files.
+//
+// fdcache_stat:
+//  - stat() through the cache: a hit costs no syscall. A miss opens and
+//    caches the file, since a request for it is normally about to follow.
+//    Returns 0 or -1 with errno set.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "validators.h"
+
+typedef struct fd_entry {
+    int fd;
+    struct stat st;
+    /* "ETag: ...\r\nLast-Modified: ...\r\n" for st; the quoted tag is
+       validators[etag_off..+etag_len) */
+    char validators[VALIDATOR_MAX];
+    size_t validators_len;
+    size_t etag_off, etag_len;
+} fd_entry_t;
+
+int fdcache_init(size_t max_entries, unsigned ttl_ms);
+void fdcache_shutdown(void);
+const fd_entry_t *fdcache_open(const char *path);
+void fdcache_release(const fd_entry_t *e);
+int fdcache_stat(const char *path, struct stat *st);
+
+/* fdcache_stats: cumulative counters (any pointer may be NULL). */
+void fdcache_stats(uint64_t *hits, uint64_t *misses, uint64_t *open_fds);
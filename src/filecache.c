@@ -0,0 +1,411 @@
+#include "filecache.h"
+#include "compress.h"
+#include "docroot.h"
+#include "pack.h"
+#include "sizeindex.h"
+#include "validators.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FC_SHARDS 16        /* independent locks; power of two */
+#define FC_BUCKETS 256      /* hash buckets per shard */
+
+/* cache entry; the public fc_entry_t view is the first member so callers
+   can hand it back to filecache_release */
+struct fc_item {
+    fc_entry_t pub;
+    atomic_int refs;                /* the table holds one reference */
+    int in_table;                   /* under shard lock */
+    int referenced;                 /* CLOCK second-chance bit, under shard lock */
+    uint64_t hash;
+    const char *path;
+    int enc;                        /* COMPRESS_* of the body; source is path */
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t checked_ms;            /* last successful revalidation */
+    size_t charge;                  /* bytes counted against the shard budget */
+    struct fc_item *hnext;          /* bucket chain */
+    struct fc_item *cprev, *cnext;  /* CLOCK ring */
+};
+
+struct fc_shard {
+    pthread_mutex_t lock;
+    struct fc_item *buckets[FC_BUCKETS];
+    struct fc_item *hand;           /* CLOCK hand; NULL when empty */
+    size_t bytes;
+    size_t cap;
+} __attribute__((aligned(64)));
+
+static struct {
+    int enabled;
+    size_t max_file;
+    unsigned revalidate_ms;
+    struct fc_shard *shards;
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_uint_fast64_t evictions;
+} fc;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a over the path, then the encoding, so variants of one file
+   spread over shards like unrelated paths */
+static uint64_t hash_key(const char *p, int enc) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    h ^= (unsigned char)enc;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+static size_t bucket_of(uint64_t h) {
+    return (size_t)(h / FC_SHARDS) % FC_BUCKETS;
+}
+
+static int same_file(const struct fc_item *it, const struct stat *st) {
+    return it->dev == st->st_dev && it->ino == st->st_ino && it->size == st->st_size &&
+           it->mtime.tv_sec == st->st_mtim.tv_sec && it->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void item_put(struct fc_item *it) {
+    if (atomic_fetch_sub(&it->refs, 1) == 1) free(it);
+}
+
+static struct fc_item *find(struct fc_shard *sh, uint64_t h, const char *path, int enc) {
+    for (struct fc_item *it = sh->buckets[bucket_of(h)]; it; it = it->hnext) {
+        if (it->hash == h && it->enc == enc && strcmp(it->path, path) == 0) return it;
+    }
+    return NULL;
+}
+
+/* unlink: drop it from the bucket chain and CLOCK ring (lock held). The
+   table's reference must be released by the caller. */
+static void unlink_item(struct fc_shard *sh, struct fc_item *it) {
+    struct fc_item **pp = &sh->buckets[bucket_of(it->hash)];
+    while (*pp && *pp != it) pp = &(*pp)->hnext;
+    if (*pp) *pp = it->hnext;
+
+    if (it->cnext == it) {
+        sh->hand = NULL;
+    } else {
+        it->cprev->cnext = it->cnext;
+        it->cnext->cprev = it->cprev;
+        if (sh->hand == it) sh->hand = it->cnext;
+    }
+    it->hnext = it->cprev = it->cnext = NULL;
+    sh->bytes -= it->charge;
+    it->in_table = 0;
+}
+
+/* evict: CLOCK sweep until `need` more bytes fit (lock held). Referenced
+   entries get a second chance; each pass clears bits, so this ends. */
+static void evict(struct fc_shard *sh, size_t need) {
+    while (sh->hand && sh->bytes + need > sh->cap) {
+        struct fc_item *v = sh->hand;
+        if (v->referenced) {
+            v->referenced = 0;
+            sh->hand = v->cnext;
+            continue;
+        }
+        unlink_item(sh, v);
+        item_put(v);
+        atomic_fetch_add_explicit(&fc.evictions, 1, memory_order_relaxed);
+    }
+}
+
+/* hit: count a hit on the referenced entry it and hand it out, unless it
+   is a stub for an encoding that did not pay off */
+static int hit(struct fc_item *it, const fc_entry_t **out) {
+    atomic_fetch_add_explicit(&fc.hits, 1, memory_order_relaxed);
+    if (it->enc != COMPRESS_IDENTITY && !it->pub.body) {
+        item_put(it);
+        return FC_STAT;
+    }
+    *out = &it->pub;
+    return FC_HIT;
+}
+
+static void insert(struct fc_shard *sh, struct fc_item *it) {
+    size_t b = bucket_of(it->hash);
+    it->hnext = sh->buckets[b];
+    sh->buckets[b] = it;
+    /* new entries go just behind the hand, i.e. last to be inspected */
+    if (!sh->hand) {
+        it->cprev = it->cnext = it;
+        sh->hand = it;
+    } else {
+        it->cnext = sh->hand;
+        it->cprev = sh->hand->cprev;
+        sh->hand->cprev->cnext = it;
+        sh->hand->cprev = it;
+    }
+    sh->bytes += it->charge;
+    it->in_table = 1;
+}
+
+/* max_source: largest file cached for encoding enc */
+static size_t max_source(int enc) {
+    return enc == COMPRESS_IDENTITY ? fc.max_file : compress_max_file();
+}
+
+/* read_all: read exactly size bytes from fd into p; 0 or -1 if the file
+   ended early (truncated while reading) or failed */
+static int read_all(int fd, char *p, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, p + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    return got == size ? 0 : -1;
+}
+
+/* alloc_item: one allocation [fc_item][path\0][header][body of body_len]
+   with the header written for body_len and st; the body is left to the
+   caller. Encoded variants get their own ETag ("...-gzip"). */
+static struct fc_item *alloc_item(const char *path, uint64_t h, int enc, const struct stat *st,
+                                  size_t body_len) {
+    size_t path_len = strlen(path) + 1;
+    char suffix[16] = "";
+    if (enc != COMPRESS_IDENTITY) snprintf(suffix, sizeof(suffix), "-%s", compress_name(enc));
+    char hdr[96 + VALIDATOR_MAX];
+    int status_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n", body_len);
+    size_t etag_off = 0, etag_len = 0;
+    size_t vlen = validator_build(hdr + status_len, sizeof(hdr) - (size_t)status_len, st, suffix,
+                                  &etag_off, &etag_len);
+    int hdr_len = status_len + (int)vlen;
+    hdr_len += snprintf(hdr + hdr_len, sizeof(hdr) - (size_t)hdr_len, "Accept-Ranges: bytes\r\n");
+    size_t total = sizeof(struct fc_item) + path_len + (size_t)hdr_len + body_len;
+    struct fc_item *it = malloc(total);
+    if (!it) return NULL;
+    memset(it, 0, sizeof(*it));
+    char *p = (char *)(it + 1);
+    memcpy(p, path, path_len);
+    it->path = p;
+    p += path_len;
+    memcpy(p, hdr, (size_t)hdr_len);
+    it->pub.hdr = p;
+    it->pub.hdr_len = (size_t)hdr_len;
+    it->pub.validators = p + status_len;
+    it->pub.validators_len = vlen;
+    it->pub.etag = it->pub.validators + etag_off;
+    it->pub.etag_len = etag_len;
+    it->pub.mtime = st->st_mtim.tv_sec;
+    p += hdr_len;
+    it->pub.body = p;
+    it->pub.body_len = body_len;
+    it->hash = h;
+    it->enc = enc;
+    it->dev = st->st_dev;
+    it->ino = st->st_ino;
+    it->size = st->st_size;
+    it->mtime = st->st_mtim;
+    it->checked_ms = now_ms();
+    it->charge = total;
+    atomic_init(&it->refs, 1);
+    return it;
+}
+
+/* encode: compress the source in src[0..st->st_size) into a new entry. A
+   file that does not shrink gets a body-less stub, so it is not retried
+   until it changes. */
+static struct fc_item *encode(const char *path, uint64_t h, int enc, const struct stat *st,
+                              const char *src) {
+    size_t enc_len = 0;
+    char *data = compress_encode(enc, src, (size_t)st->st_size, &enc_len);
+    if (!data) return NULL;
+    /* a few percent (or bytes) does not pay for Content-Encoding */
+    int worth = enc_len + enc_len / 16 + 32 < (size_t)st->st_size;
+    struct fc_item *it = alloc_item(path, h, enc, st, worth ? enc_len : 0);
+    if (it) {
+        if (worth) memcpy((char *)it->pub.body, data, enc_len);
+        else it->pub.body = NULL;
+    }
+    free(data);
+    return it;
+}
+
+/* load: read a regular file and build its entry, the body compressed with
+   enc unless COMPRESS_IDENTITY. Returns NULL on any failure. */
+static struct fc_item *load(const char *path, uint64_t h, int enc) {
+    int fd = docroot_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size > max_source(enc)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct fc_item *it = NULL;
+    if (enc == COMPRESS_IDENTITY) {
+        it = alloc_item(path, h, enc, &st, (size_t)st.st_size);
+        if (it && read_all(fd, (char *)it->pub.body, (size_t)st.st_size) < 0) {
+            free(it);
+            it = NULL;
+        }
+        if (it) sizeindex_update(path, (long)st.st_size);
+    } else {
+        char *src = malloc((size_t)st.st_size + 1);
+        if (src && read_all(fd, src, (size_t)st.st_size) == 0) it = encode(path, h, enc, &st, src);
+        free(src);
+    }
+    close(fd);
+    return it;
+}
+
+int filecache_init(size_t max_bytes, size_t max_file_bytes, unsigned revalidate_ms) {
+    memset(&fc, 0, sizeof(fc));
+    atomic_init(&fc.hits, 0);
+    atomic_init(&fc.misses, 0);
+    atomic_init(&fc.evictions, 0);
+    if (max_bytes == 0) return 0;
+
+    fc.shards = aligned_alloc(64, FC_SHARDS * sizeof(struct fc_shard));
+    if (!fc.shards) return -1;
+    memset(fc.shards, 0, FC_SHARDS * sizeof(struct fc_shard));
+    for (size_t i = 0; i < FC_SHARDS; ++i) {
+        pthread_mutex_init(&fc.shards[i].lock, NULL);
+        fc.shards[i].cap = max_bytes / FC_SHARDS;
+    }
+    fc.max_file = max_file_bytes;
+    fc.revalidate_ms = revalidate_ms;
+    fc.enabled = 1;
+    return 0;
+}
+
+void filecache_shutdown(void) {
+    if (!fc.enabled) return;
+    fc.enabled = 0;
+    for (size_t i = 0; i < FC_SHARDS; ++i) {
+        struct fc_shard *sh = &fc.shards[i];
+        pthread_mutex_lock(&sh->lock);
+        while (sh->hand) {
+            struct fc_item *it = sh->hand;
+            unlink_item(sh, it);
+            item_put(it);
+        }
+        pthread_mutex_unlock(&sh->lock);
+        pthread_mutex_destroy(&sh->lock);
+    }
+    free(fc.shards);
+    fc.shards = NULL;
+}
+
+/* lookup: filecache_lookup for the (path, enc) variant. A hit on a stub
+   (encoding not worth it) reports FC_STAT. */
+static int lookup(const char *path, int enc, const fc_entry_t **out, struct stat *st) {
+    uint64_t h = hash_key(path, enc);
+    struct fc_shard *sh = &fc.shards[h % FC_SHARDS];
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&sh->lock);
+    struct fc_item *it = find(sh, h, path, enc);
+    if (it) {
+        atomic_fetch_add(&it->refs, 1);
+        it->referenced = 1;
+        if (now - it->checked_ms <= fc.revalidate_ms) {
+            pthread_mutex_unlock(&sh->lock);
+            return hit(it, out);
+        }
+        pthread_mutex_unlock(&sh->lock);
+
+        /* stale: revalidate outside the lock */
+        int ok = docroot_stat(path, st) == 0;
+        if (ok && same_file(it, st)) {
+            pthread_mutex_lock(&sh->lock);
+            it->checked_ms = now;
+            pthread_mutex_unlock(&sh->lock);
+            return hit(it, out);
+        }
+        /* changed or gone: drop the entry */
+        pthread_mutex_lock(&sh->lock);
+        int drop = it->in_table;
+        if (drop) unlink_item(sh, it);
+        pthread_mutex_unlock(&sh->lock);
+        if (drop) item_put(it);  /* table reference */
+        item_put(it);            /* ours */
+        if (!ok) return FC_ENOENT;
+    } else {
+        pthread_mutex_unlock(&sh->lock);
+        if (docroot_stat(path, st) < 0) return FC_ENOENT;
+    }
+
+    atomic_fetch_add_explicit(&fc.misses, 1, memory_order_relaxed);
+    if (!S_ISREG(st->st_mode) || (size_t)st->st_size > max_source(enc)) return FC_STAT;
+
+    struct fc_item *fresh = load(path, h, enc);
+    if (!fresh) return FC_STAT;
+
+    pthread_mutex_lock(&sh->lock);
+    struct fc_item *old = find(sh, h, path, enc);
+    if (old) { /* another worker loaded it meanwhile; keep the newer copy */
+        unlink_item(sh, old);
+        item_put(old);
+    }
+    if (fresh->charge <= sh->cap) {
+        evict(sh, fresh->charge);
+        insert(sh, fresh);
+        atomic_fetch_add(&fresh->refs, 1); /* caller's reference */
+    }
+    pthread_mutex_unlock(&sh->lock);
+    if (enc != COMPRESS_IDENTITY && !fresh->pub.body) {
+        item_put(fresh);
+        return FC_STAT;
+    }
+    *out = &fresh->pub;
+    return FC_HIT;
+}
+
+int filecache_lookup(const char *path, const fc_entry_t **out, struct stat *st) {
+    *out = pack_lookup(path);
+    if (*out) return FC_HIT;
+    if (!fc.enabled) return docroot_stat(path, st) == 0 ? FC_STAT : FC_ENOENT;
+    return lookup(path, COMPRESS_IDENTITY, out, st);
+}
+
+int filecache_lookup_encoded(const char *path, int enc, const fc_entry_t **out) {
+    *out = NULL;
+    if (!fc.enabled || !compress_available(enc)) return FC_STAT;
+    struct stat st;
+    return lookup(path, enc, out, &st);
+}
+
+void filecache_release(const fc_entry_t *e) {
+    if (e && e->packed) pack_release(e);
+    else if (e) item_put((struct fc_item *)e);
+}
+
+void filecache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions, uint64_t *bytes) {
+    if (hits) *hits = atomic_load_explicit(&fc.hits, memory_order_relaxed);
+    if (misses) *misses = atomic_load_explicit(&fc.misses, memory_order_relaxed);
+    if (evictions) *evictions = atomic_load_explicit(&fc.evictions, memory_order_relaxed);
+    if (bytes) {
+        uint64_t total = 0;
+        if (fc.enabled) {
+            for (size_t i = 0; i < FC_SHARDS; ++i) {
+                pthread_mutex_lock(&fc.shards[i].lock);
+                total += fc.shards[i].bytes;
+                pthread_mutex_unlock(&fc.shards[i].lock);
+            }
+        }
+        *bytes = total;
+    }
+}
@@ -0,0 +1,68 @@
+// In-memory hot file cache.
+//
+// Small regular files are kept in memory together with a prebuilt response
+// header, so a hit is served with a single writev() and no stat/open/read/
+// close. The cache is sharded by path hash (one mutex per shard), entries
+// are revalidated against stat() at most once per revalidate interval, and
+// total memory is capped with CLOCK (second-chance) eviction per shard.
+//
+// filecache_init:
+//  - max_bytes      : total memory budget across all entries; 0 disables
+//                     the cache (filecache_lookup then only stat()s).
+//  - max_file_bytes : files larger than this are never cached.
+//  - revalidate_ms  : how long a hit is trusted before re-stat()ing.
+//  - Returns 0 on success, -1 on allocation failure (cache disabled).
+//
+// filecache_lookup:
+//  - FC_HIT    : *out is a referenced entry; call filecache_release when the
+//                response has been written. *st is not touched. Validators
+//                are built at load, so conditional and range requests cost
+//                no stat() either. Paths in the docroot pack (pack.h) are
+//                hits straight from its mapping, even with the cache off.
+//  - FC_STAT   : not served from cache (too large, not a regular file, or
+//                cache disabled); *st holds the stat() result for the caller.
+//  - FC_ENOENT : stat() failed (errno set).
+//
+// filecache_lookup_encoded:
+//  - The same for a compressed variant of path (enc is a COMPRESS_*
+//    encoding): built on first use by compressing files of up to
+//    compress_max_file() bytes, then kept and revalidated against path like
+//    any entry, so a new mtime, size or inode means one fresh compression.
+//    A file that does not shrink is remembered and reported as FC_STAT, as
+//    is every miss when the cache is disabled. hdr carries the encoded
+//    Content-Length; the caller adds Content-Encoding.
+//
+// Thread-safety: all functions may be called concurrently after init.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef struct fc_entry {
+    const char *hdr;      /* "HTTP/1.1 200 OK\r\nContent-Length: N\r\n" + validators +
+                             "Accept-Ranges: bytes\r\n" (no Connection/blank line) */
+    size_t hdr_len;
+    const char *body;
+    size_t body_len;
+    const char *validators; /* ETag/Last-Modified lines inside hdr (validators.h) */
+    size_t validators_len;
+    const char *etag;       /* the quoted tag inside validators */
+    size_t etag_len;
+    time_t mtime;           /* source file's, for If-Modified-Since */
+    int packed;             /* lives in the docroot pack (pack.h), not the cache */
+} fc_entry_t;
+
+#define FC_HIT    0
+#define FC_STAT   1
+#define FC_ENOENT (-1)
+
+int filecache_init(size_t max_bytes, size_t max_file_bytes, unsigned revalidate_ms);
+void filecache_shutdown(void);
+int filecache_lookup(const char *path, const fc_entry_t **out, struct stat *st);
+int filecache_lookup_encoded(const char *path, int enc, const fc_entry_t **out);
+void filecache_release(const fc_entry_t *e);
+
+/* filecache_stats: cumulative counters (any pointer may be NULL). */
+void filecache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions, uint64_t *bytes);
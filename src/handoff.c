@@ -0,0 +1,238 @@
+#define _GNU_SOURCE /* struct ucred, accept4, MSG_CMSG_CLOEXEC */
+#include "handoff.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define HANDOFF_MAGIC "HTTPDFD1"
+#define HANDOFF_ACK 'A'
+#define HANDOFF_ACK_MS 30000   /* a successor has this long to start accepting */
+
+/* sent along with the fds */
+struct handoff_msg {
+    char magic[8];
+    uint32_t nfds;
+};
+
+static struct {
+    int listen_fd;             /* UNIX socket successors connect to, -1: none */
+    int wake[2];               /* handoff_shutdown -> thread */
+    pthread_t thread;
+    int running;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    dev_t dev;                 /* the socket file we bound */
+    ino_t ino;
+    int fds[HANDOFF_MAX_FDS];
+    size_t nfds;
+} ho = {.listen_fd = -1, .wake = {-1, -1}};
+
+static int unix_addr(const char *path, struct sockaddr_un *sa) {
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(sa->sun_path, path);
+    return 0;
+}
+
+int handoff_take(const char *path, int *fds, size_t max, int *peer) {
+    struct sockaddr_un sa;
+    if (unix_addr(path, &sa) != 0) {
+        perror("handoff");
+        return -1;
+    }
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        int err = errno;
+        close(s);
+        if (err == ENOENT || err == ECONNREFUSED) return 0; /* nobody to take over from */
+        errno = err;
+        perror("connect handoff");
+        return -1;
+    }
+
+    struct handoff_msg m;
+    char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct iovec iov = {.iov_base = &m, .iov_len = sizeof(m)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = cbuf,
+                         .msg_controllen = sizeof(cbuf)};
+    ssize_t n = recvmsg(s, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    size_t got = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t k = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *in = (int *)CMSG_DATA(c);
+        for (size_t i = 0; i < k; ++i) {
+            if (got < max) fds[got++] = in[i];
+            else close(in[i]);
+        }
+    }
+    if (n != (ssize_t)sizeof(m) || memcmp(m.magic, HANDOFF_MAGIC, sizeof(m.magic)) != 0 ||
+        m.nfds != got || got == 0 || (msg.msg_flags & MSG_CTRUNC)) {
+        LOG_WARN("handoff: malformed reply from %s", path);
+        for (size_t i = 0; i < got; ++i) close(fds[i]);
+        close(s);
+        return -1;
+    }
+    *peer = s;
+    return (int)got;
+}
+
+void handoff_commit(int peer) {
+    char ack = HANDOFF_ACK;
+    if (send(peer, &ack, 1, MSG_NOSIGNAL) != 1) perror("send handoff");
+    close(peer);
+}
+
+/* wait_readable: poll fd and the wake pipe; 1 if fd is readable, 0 on
+   timeout, -1 once handoff_shutdown was called */
+static int wait_readable(int fd, int timeout_ms) {
+    struct pollfd p[2] = {{.fd = fd, .events = POLLIN}, {.fd = ho.wake[0], .events = POLLIN}};
+    for (;;) {
+        int n = poll(p, 2, timeout_ms);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || p[1].revents) return -1;
+        return n > 0;
+    }
+}
+
+/* serve_one: hand the fds to a connected successor; 1 once it confirmed */
+static int serve_one(int c) {
+    struct ucred cr;
+    socklen_t len = sizeof(cr);
+    if (getsockopt(c, SOL_SOCKET, SO_PEERCRED, &cr, &len) != 0 ||
+        (cr.uid != geteuid() && cr.uid != 0)) {
+        LOG_WARN("handoff: refused a process of another user");
+        return 0;
+    }
+
+    struct handoff_msg m;
+    memcpy(m.magic, HANDOFF_MAGIC, sizeof(m.magic));
+    m.nfds = (uint32_t)ho.nfds;
+    char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct iovec iov = {.iov_base = &m, .iov_len = sizeof(m)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = cbuf,
+                         .msg_controllen = CMSG_SPACE(sizeof(int) * ho.nfds)};
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * ho.nfds);
+    memcpy(CMSG_DATA(cm), ho.fds, sizeof(int) * ho.nfds);
+    if (sendmsg(c, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(m)) {
+        perror("sendmsg handoff");
+        return 0;
+    }
+    LOG_INFO("handoff: passed %zu listen socket(s) to pid %d", ho.nfds, (int)cr.pid);
+
+    /* until it confirms, both accept; without a confirmation it failed to
+       start and this server simply carries on */
+    char ack = 0;
+    if (wait_readable(c, HANDOFF_ACK_MS) <= 0 || recv(c, &ack, 1, 0) != 1 || ack != HANDOFF_ACK) {
+        LOG_WARN("handoff: pid %d did not take over, still serving", (int)cr.pid);
+        return 0;
+    }
+    return 1;
+}
+
+static void *handoff_main(void *arg) {
+    (void)arg;
+    while (wait_readable(ho.listen_fd, -1) > 0) {
+        int c = accept4(ho.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (c < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept handoff");
+            break;
+        }
+        int done = serve_one(c);
+        close(c);
+        if (done) {
+            /* the successor owns path now: never unlink it */
+            ho.ino = 0;
+            LOG_INFO("handoff: successor is accepting, draining");
+            kill(getpid(), SIGUSR2);
+            break;
+        }
+    }
+    return NULL;
+}
+
+int handoff_serve(const char *path, const int *fds, size_t nfds) {
+    if (nfds == 0 || nfds > HANDOFF_MAX_FDS) return -1;
+    struct sockaddr_un sa;
+    if (unix_addr(path, &sa) != 0) {
+        perror("handoff");
+        return -1;
+    }
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) {
+        perror("socket");
+        return -1;
+    }
+    /* a predecessor that handed off (or crashed) leaves the file behind */
+    unlink(path);
+    mode_t old = umask(077);
+    int rc = bind(s, (struct sockaddr *)&sa, sizeof(sa));
+    umask(old);
+    struct stat st;
+    if (rc != 0 || listen(s, 4) != 0 || stat(path, &st) != 0) {
+        perror("bind handoff");
+        close(s);
+        return -1;
+    }
+    if (pipe2(ho.wake, O_CLOEXEC) != 0) {
+        perror("pipe2");
+        close(s);
+        unlink(path);
+        return -1;
+    }
+    ho.listen_fd = s;
+    ho.dev = st.st_dev;
+    ho.ino = st.st_ino;
+    strcpy(ho.path, path);
+    memcpy(ho.fds, fds, nfds * sizeof(*fds));
+    ho.nfds = nfds;
+    if (pthread_create(&ho.thread, NULL, handoff_main, NULL) != 0) {
+        perror("pthread_create handoff");
+        handoff_shutdown();
+        return -1;
+    }
+    ho.running = 1;
+    return 0;
+}
+
+void handoff_shutdown(void) {
+    if (ho.listen_fd < 0) return;
+    if (ho.running) {
+        char b = 0;
+        ssize_t w = write(ho.wake[1], &b, 1);
+        (void)w;
+        pthread_join(ho.thread, NULL);
+        ho.running = 0;
+    }
+    struct stat st;
+    if (ho.ino && stat(ho.path, &st) == 0 && st.st_dev == ho.dev && st.st_ino == ho.ino)
+        unlink(ho.path);
+    close(ho.listen_fd);
+    close(ho.wake[0]);
+    close(ho.wake[1]);
+    ho.listen_fd = -1;
+    ho.wake[0] = ho.wake[1] = -1;
+}
@@ -0,0 +1,37 @@
+// Listen socket handoff for zero-downtime binary upgrades (--handoff).
+//
+// A running server offers its listen sockets on a UNIX socket at path. A
+// new server started with the same path connects there before it would
+// bind, receives the sockets (SCM_RIGHTS) and starts accepting on them; the
+// kernel accept queues are shared, so no connection attempt is refused
+// while both run. Once the new server confirms, the old one stops
+// accepting, drains its connections and exits (it raises SIGUSR2 on itself,
+// the graceful-exit signal), while the new one warms its caches on live
+// traffic. Only processes of the same user (or root) are served.
+//
+// handoff_take:
+//  - In the new server: fetch up to max listen fds from the server at
+//    path. Returns how many were received (> 0, with *peer set for
+//    handoff_commit), 0 if no server listens there, or -1 on error.
+//
+// handoff_commit:
+//  - Tell the old server the sockets are being accepted on (call once the
+//    acceptors run), after which it drains. Closing peer without commit
+//    instead leaves the old server running unchanged.
+//
+// handoff_serve:
+//  - Offer fds to the next server at path (replacing a stale socket file)
+//    from a background thread. Returns 0, or -1 if path cannot be bound.
+//
+// handoff_shutdown:
+//  - Stop offering and remove path unless a successor has taken it over.
+#pragma once
+
+#include <stddef.h>
+
+#define HANDOFF_MAX_FDS 64
+
+int handoff_take(const char *path, int *fds, size_t max, int *peer);
+void handoff_commit(int peer);
+int handoff_serve(const char *path, const int *fds, size_t nfds);
+void handoff_shutdown(void);
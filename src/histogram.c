@@ -0,0 +1,68 @@
+#include "histogram.h"
+
+#include <string.h>
+
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_LINEAR (2 * HIST_SUB)   /* values below this are exact */
+
+static int bucket_of(uint64_t v) {
+    if (v < HIST_LINEAR) return (int)v;
+    int e = 63 - __builtin_clzll(v);             /* floor(log2 v), >= 6 */
+    int shift = e - HIST_SUB_BITS;               /* >= 1 */
+    int idx = HIST_LINEAR + (shift - 1) * (int)HIST_SUB + (int)((v >> shift) - HIST_SUB);
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+uint64_t hist_bucket_upper(int i) {
+    if (i < (int)HIST_LINEAR) return (uint64_t)i;
+    int k = i - (int)HIST_LINEAR;
+    int shift = k / (int)HIST_SUB + 1;
+    uint64_t mant = (uint64_t)(k % (int)HIST_SUB) + HIST_SUB;
+    return ((mant + 1) << shift) - 1;
+}
+
+/* single writer: a relaxed load + store is enough and avoids a locked RMW */
+static void bump(_Atomic uint64_t *c, uint64_t by) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + by,
+                          memory_order_relaxed);
+}
+
+void hist_record(hist_t *h, uint64_t v) {
+    bump(&h->counts[bucket_of(v)], 1);
+    bump(&h->sum, v);
+    if (v > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, v, memory_order_relaxed);
+}
+
+void hist_snapshot_add(hist_snapshot_t *s, const hist_t *h) {
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        uint64_t c = atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        s->counts[i] += c;
+        s->total += c;
+    }
+    s->sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+    uint64_t m = atomic_load_explicit(&h->max, memory_order_relaxed);
+    if (m > s->max) s->max = m;
+}
+
+void hist_snapshot_sub(hist_snapshot_t *s, const hist_snapshot_t *prev) {
+    s->total = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        /* a bucket read slightly earlier than its sum can lag; never wrap */
+        s->counts[i] = s->counts[i] >= prev->counts[i] ? s->counts[i] - prev->counts[i] : 0;
+        s->total += s->counts[i];
+    }
+    s->sum = s->sum >= prev->sum ? s->sum - prev->sum : 0;
+}
+
+uint64_t hist_percentile(const hist_snapshot_t *s, double q) {
+    if (s->total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)s->total);
+    if (rank >= s->total) rank = s->total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += s->counts[i];
+        if (seen > rank) return hist_bucket_upper(i);
+    }
+    return hist_bucket_upper(HIST_BUCKETS - 1);
+}
@@ -0,0 +1,47 @@
+// Log-linear (HDR-style) histograms for latency-like values.
+//
+// Values 0..63 get exact buckets; above that every power of two is split
+// into 32 linear sub-buckets, so any recorded value is reported within ~3%
+// (values up to 2^40, larger ones clamp into the last bucket).
+//
+// hist_t is the live, single-writer form: one thread records into it with
+// plain relaxed loads/stores (no locked instructions) while a reader may
+// copy it at any time with hist_snapshot_add. hist_snapshot_t is the merged,
+// read-side form used for percentiles.
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS (64 + 35 * 32)
+
+typedef struct hist {
+    _Atomic uint64_t counts[HIST_BUCKETS];
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+} hist_t;
+
+typedef struct hist_snapshot {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} hist_snapshot_t;
+
+/* hist_record: add one value; only the owning thread may call this */
+void hist_record(hist_t *h, uint64_t v);
+
+/* hist_snapshot_add: accumulate the current contents of h into s */
+void hist_snapshot_add(hist_snapshot_t *s, const hist_t *h);
+
+/* hist_snapshot_sub: s -= prev, bucket by bucket (for interval views);
+   max stays the lifetime maximum */
+void hist_snapshot_sub(hist_snapshot_t *s, const hist_snapshot_t *prev);
+
+/* hist_percentile: value at quantile q (0..1), reported as the upper bound
+   of its bucket; 0 for an empty snapshot */
+uint64_t hist_percentile(const hist_snapshot_t *s, double q);
+
+/* hist_bucket_upper: largest value mapped to bucket i */
+uint64_t hist_bucket_upper(int i);
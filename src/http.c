@@ -1,5 +1,14 @@
+#define _GNU_SOURCE /* memmem */
 #include "http.h"
+#include "compress.h"
+#include "docroot.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "log.h"
 #include "metrics.h"
+#include "metrics_prom.h"
+#include "sizeindex.h"
+#include "validators.h"
 
 // standard headers: errno for errors, fcntl/open, stdio/stdlib/string for helpers
 #include <errno.h>
@@ -9,20 +18,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/sendfile.h> // Linux sendfile
+#include <sys/socket.h>   // sendmsg
 #include <sys/stat.h>     // stat()
 #include <sys/types.h>
 #include <sys/time.h> /* for struct timeval, SO_RCVTIMEO */
+#include <sys/uio.h>      // writev
 #include <unistd.h>       // read/write/close
 #include <time.h>
 #include <stdint.h>
+#include <limits.h>     /* for PATH_MAX */
 
 #define REQ_BUF 8192 /* buffer size for reading the request */
 
-static uint64_t now_ms_local(void) {
+static uint64_t now_us_local(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 /* write_all: repeatedly call write() until the whole buffer is sent.
@@ -42,224 +55,1020 @@ static ssize_t write_all(int fd, const void *buf, size_t count) {
     return count; /* success: return original requested count */
 }
 
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+/* send_iov_all: sendmsg() until every iovec is sent; handles short writes
+   and EINTR. Modifies iov. flags may carry MSG_MORE to let the kernel
+   coalesce with what follows (e.g. a sendfile body). Returns 0 or -1. */
+static int send_iov_all(int fd, struct iovec *iov, int iovcnt, int flags) {
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)iovcnt;
+        ssize_t n = sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        /* skip fully written iovecs, then trim the partial one */
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+void http_out_init(http_out_t *o, int fd) {
+    o->fd = fd;
+    o->iovcnt = 0;
+    o->nrefs = 0;
+    o->nonblock = 0;
+    o->scratch_len = 0;
+    o->owned = NULL;
+    o->body = NULL;
+    o->body_off = o->body_end = o->body_begin = 0;
+    o->body_status = 200;
+}
+
+/* out_release: drop the batch and everything backing it */
+static void out_release(http_out_t *o) {
+    for (int i = 0; i < o->nrefs; ++i) filecache_release(o->refs[i]);
+    free(o->owned);
+    o->owned = NULL;
+    o->iovcnt = 0;
+    o->nrefs = 0;
+    o->scratch_len = 0;
+}
+
+int http_out_consume(http_out_t *o, size_t n) {
+    int first = 0;
+    while (first < o->iovcnt && n >= o->iov[first].iov_len) {
+        n -= o->iov[first].iov_len;
+        first++;
+    }
+    if (first < o->iovcnt) {
+        o->iov[first].iov_base = (char *)o->iov[first].iov_base + n;
+        o->iov[first].iov_len -= n;
+    }
+    if (first) {
+        memmove(o->iov, o->iov + first, (size_t)(o->iovcnt - first) * sizeof(o->iov[0]));
+        o->iovcnt -= first;
+    }
+    return o->iovcnt > 0;
+}
+
+/* out_flush_nb: send_iov_all for non-blocking sockets. When the socket
+   fills up the unsent iovecs stay queued (their backing memory stays held)
+   and 1 is returned. */
+static int out_flush_nb(http_out_t *o, int flags) {
+    while (o->iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = o->iov;
+        msg.msg_iovlen = (size_t)o->iovcnt;
+        ssize_t n = sendmsg(o->fd, &msg, flags | MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            out_release(o);
+            return -1;
+        }
+        http_out_consume(o, (size_t)n);
+    }
+    out_release(o);
+    return 0;
+}
+
+static int out_flush_flags(http_out_t *o, int flags) {
+    if (o->nonblock) return out_flush_nb(o, flags);
+    int rc = 0;
+    if (o->iovcnt > 0) rc = send_iov_all(o->fd, o->iov, o->iovcnt, flags);
+    out_release(o);
+    return rc;
+}
+
+int http_out_flush(http_out_t *o) {
+    return out_flush_flags(o, 0);
+}
+
+/* per-response worst case: cached file (3 iovecs), a generated header
+   carrying validators and a Content-Range (out_headf) */
+#define OUT_RESP_IOV 3
+#define OUT_RESP_SCRATCH 384
+
+int http_out_busy(const http_out_t *o) {
+    return o->body || o->owned || o->iovcnt + OUT_RESP_IOV > HTTP_OUT_IOV ||
+           o->scratch_len + OUT_RESP_SCRATCH > HTTP_OUT_SCRATCH;
+}
+
+void http_out_discard(http_out_t *o) {
+    out_release(o);
+    if (o->body) {
+        fdcache_release(o->body);
+        o->body = NULL;
+    }
+}
+
+int http_out_resume(http_out_t *o) {
+    int rc = out_flush_flags(o, o->body && o->body_off < o->body_end ? MSG_MORE : 0);
+    if (rc != 0 || !o->body) return rc;
+
+    size_t budget = HTTP_BODY_TURN_BYTES;
+    while (o->body_off < o->body_end) {
+        if (budget == 0) return 1; /* yield; the reactor re-queues us */
+        size_t want = (size_t)(o->body_end - o->body_off);
+        if (want > HTTP_BODY_CHUNK) want = HTTP_BODY_CHUNK;
+        if (want > budget) want = budget;
+        ssize_t sent = sendfile(o->fd, o->body->fd, &o->body_off, want);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            break;
+        }
+        if (sent == 0) break; /* file shrank under us */
+        budget -= (size_t)sent;
+    }
+
+    return http_out_body_finish(o);
+}
+
+int http_out_body_finish(http_out_t *o) {
+    int done = o->body_off >= o->body_end;
+    metrics_record_request(now_us_local() - o->body_start_us,
+                           (uint64_t)o->body_hdr_len + (uint64_t)(o->body_off - o->body_begin),
+                           o->body_status);
+    fdcache_release(o->body);
+    o->body = NULL;
+    if (!done) LOG_DEBUG("conn %d: body send failed", o->fd);
+    return done ? 0 : -1;
+}
+
+/* out_reserve: make room for niov iovecs and scratch bytes, flushing the
+   batch first if needed (never needed in nonblock mode, whose callers check
+   http_out_busy first). Returns 0 or -1 if the flush failed. */
+static int out_reserve(http_out_t *o, int niov, size_t scratch) {
+    if (o->iovcnt + niov <= HTTP_OUT_IOV && o->scratch_len + scratch <= HTTP_OUT_SCRATCH) return 0;
+    return http_out_flush(o) == 0 ? 0 : -1;
+}
+
+static void out_push(http_out_t *o, const void *p, size_t n) {
+    o->iov[o->iovcnt].iov_base = (void *)p;
+    o->iov[o->iovcnt].iov_len = n;
+    o->iovcnt++;
+}
+
+/* out_headf: format a response head into the batch's scratch space and
+   queue it, leaving room for one more iovec (the body). Returns its length,
+   or -1 if the flush to make room failed or it did not fit. */
+__attribute__((format(printf, 2, 3)))
+static int out_headf(http_out_t *o, const char *fmt, ...) {
+    if (out_reserve(o, 2, OUT_RESP_SCRATCH) < 0) return -1;
+    char *hdr = o->scratch + o->scratch_len;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(hdr, OUT_RESP_SCRATCH, fmt, ap);
+    va_end(ap);
+    if (n < 0 || n >= OUT_RESP_SCRATCH) return -1;
+    o->scratch_len += (size_t)n;
+    out_push(o, hdr, (size_t)n);
+    return n;
+}
+
+/* out_static: queue a response held in static storage and record it */
+static int out_static(http_out_t *o, const char *resp, int status, uint64_t start_us) {
+    size_t n = strlen(resp);
+    metrics_record_request(now_us_local() - start_us, n, status);
+    if (out_reserve(o, 1, 0) < 0) return -1;
+    out_push(o, resp, n);
+    return 0;
+}
+
+/* serve_metrics: answer HTTP_METRICS_PATH from an in-memory snapshot. The
+   heap-allocated body is owned by the batch and freed when it is flushed;
+   blocking callers flush right away. HEAD gets the headers only. Returns 0
+   or -1 if the connection must be closed. */
+static int serve_metrics(http_out_t *o, int head, int should_close, uint64_t start_us) {
+    size_t body_len = 0;
+    char *body = metrics_prom_render(&body_len);
+    if (!body) {
+        out_static(o, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", 500, start_us);
+        LOG_ERROR("conn %d: OOM rendering metrics", o->fd);
+        return -1;
+    }
+    const size_t hdr_cap = OUT_RESP_SCRATCH;
+    if (out_reserve(o, 2, hdr_cap) < 0) {
+        free(body);
+        return -1;
+    }
+    char *hdr = o->scratch + o->scratch_len;
+    int hdrlen = snprintf(hdr, hdr_cap,
+                          "HTTP/1.1 200 OK\r\nContent-Type: " METRICS_PROM_CONTENT_TYPE
+                          "\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                          body_len, should_close ? "close" : "keep-alive");
+    if (hdrlen < 0 || (size_t)hdrlen >= hdr_cap) hdrlen = 0;
+    o->scratch_len += (size_t)hdrlen;
+    out_push(o, hdr, (size_t)hdrlen);
+    if (head) {
+        free(body);
+        body_len = 0;
+    } else {
+        out_push(o, body, body_len);
+        o->owned = body;
+    }
+    metrics_record_request(now_us_local() - start_us, (uint64_t)hdrlen + body_len, 200);
+    if (o->nonblock) return 0; /* sent by the caller's http_out_resume */
+    return http_out_flush(o);
+}
+
 /* sanitize_path: simple path traversal protection.
-   Reject any path containing "..". This is minimal and not exhaustive. */
-static int sanitize_path(const char *path) {
-    if (strstr(path, "..") != NULL) return 0; /* found parent-traversal component */
-    return 1;                                  /* otherwise accept */
+   Reject any path containing "..". This is minimal and not exhaustive; when
+   the docroot opens are confined by the kernel (RESOLVE_BENEATH) it is not
+   needed and every path is let through to them. */
+static int sanitize_path(http_slice_t path) {
+    if (docroot_confined()) return 1;
+    if (memmem(path.p, path.len, "..", 2) != NULL) return 0; /* found parent-traversal component */
+    return 1;                                                 /* otherwise accept */
+}
+
+/* build_file_path: map a request path onto docroot ("/" -> /index.html).
+   Returns the path in scratch, or NULL if it does not fit PATH_MAX or
+   scratch is exhausted. */
+static char *build_file_path(arena_t *scratch, const char *docroot, http_slice_t path) {
+    char *out;
+    if (path.len == 0 || (path.len == 1 && path.p[0] == '/')) {
+        out = arena_printf(scratch, "%s/index.html", docroot);
+    } else {
+        const char *p = path.p;
+        size_t len = path.len;
+        if (p[0] == '/') {
+            p++;
+            len--;
+        }
+        if (strlen(docroot) + 1 + len >= PATH_MAX) return NULL;
+        out = arena_printf(scratch, "%s/%.*s", docroot, (int)len, p);
+    }
+    return out && strlen(out) < PATH_MAX ? out : NULL;
 }
 
 /* configurable keep-alive limits */
 #define MAX_KEEPALIVE_REQUESTS 8
 #define IDLE_TIMEOUT_SECONDS 60
 
-/* handle_client: handle up to MAX_KEEPALIVE_REQUESTS requests on client_fd.
-   Enforces an idle timeout via SO_RCVTIMEO and honors Connection headers
-   and HTTP version semantics. Returns 0 on normal completion, -1 on error. */
-int handle_client(int client_fd, const char *docroot) {
-    /* set a recv timeout so idle clients don't block workers forever */
-    struct timeval tv;
-    tv.tv_sec = IDLE_TIMEOUT_SECONDS;
-    tv.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+/* http_request_complete: a request is complete once the blank line ending
+   the header block is buffered (GET/HEAD carry no body). */
+size_t http_request_complete(const char *buf, size_t len) {
+    return http_find_head_end(buf, len, NULL);
+}
 
-    printf("conn %d: opened\n", client_fd);
-    fflush(stdout);
+/* http_estimate_cost: map the request path like http_serve_request does and
+   look its size up in the size index; used to fill job_t.est_cost for SJF.
+   Never touches the filesystem. Returns 0 when unknown. */
+long http_estimate_cost(const char *buf, size_t len, const char *docroot) {
+    http_request_t req;
+    if (http_parse_request(buf, len, &req) == 0 || req.malformed) return 0;
+    /* basic sanitize: reject .. in path */
+    if (!sanitize_path(req.path)) return 0;
+    char path_buf[PATH_MAX];
+    arena_t scratch;
+    arena_init(&scratch, path_buf, sizeof(path_buf));
+    const char *file_path = build_file_path(&scratch, docroot, req.path);
+    long size = 0;
+    if (!file_path || sizeindex_lookup(file_path, &size) != 0) size = 0;
+    arena_reset(&scratch);
+    return size;
+}
 
-    char buf[REQ_BUF];
-    int served = 0;
+/* response header tails: what follows the status and Content-Length
+   lines, by TAIL_* and then keep-alive / close */
+enum { TAIL_PLAIN, TAIL_VARY, TAIL_GZIP, TAIL_BR };
+static const char *const resp_tail[4][2] = {
+    {"Connection: keep-alive\r\n\r\n", "Connection: close\r\n\r\n"},
+    {"Vary: Accept-Encoding\r\nConnection: keep-alive\r\n\r\n",
+     "Vary: Accept-Encoding\r\nConnection: close\r\n\r\n"},
+    {"Content-Encoding: gzip\r\nVary: Accept-Encoding\r\nConnection: keep-alive\r\n\r\n",
+     "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\nConnection: close\r\n\r\n"},
+    {"Content-Encoding: br\r\nVary: Accept-Encoding\r\nConnection: keep-alive\r\n\r\n",
+     "Content-Encoding: br\r\nVary: Accept-Encoding\r\nConnection: close\r\n\r\n"},
+};
 
-    while (served < MAX_KEEPALIVE_REQUESTS) {
-        uint64_t req_start = 0;
-        req_start = now_ms_local(); /* helper below */
+static int tail_for(int enc) {
+    return enc == COMPRESS_BR ? TAIL_BR : enc == COMPRESS_GZIP ? TAIL_GZIP : TAIL_VARY;
+}
 
-        ssize_t n = read(client_fd, buf, sizeof(buf) - 1);
-        if (n == 0) {
-            printf("conn %d: client closed connection\n", client_fd);
-            fflush(stdout);
-            return 0;
+/* per-request parameters of a file response */
+struct resp {
+    const http_request_t *req;
+    arena_t *scratch;
+    int head;                /* HEAD: headers only */
+    int should_close;
+    uint64_t start_us;
+};
+
+/* byte range [start, end) of the selected representation */
+struct byte_range {
+    off_t start, end;
+};
+
+#define HTTP_MAX_RANGES 8                   /* more specs than this: answer 200 */
+#define HTTP_RANGE_MERGE_GAP 80             /* join ranges closer than a part header */
+#define HTTP_MULTIRANGE_MAX (1024 * 1024)   /* multipart bodies are assembled in memory */
+#define HTTP_BOUNDARY "2f6c1e9a07d3b54e"
+
+/* etag_listed: whether tag is in an If-None-Match list ("*" or a list of
+   entity tags, compared weakly: a W/ prefix is ignored) */
+static int etag_listed(http_slice_t list, http_slice_t tag) {
+    const char *p = list.p, *end = list.p + list.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        if (p == end) break;
+        if (*p == '*') return 1;
+        if (end - p >= 2 && p[0] == 'W' && p[1] == '/') p += 2;
+        const char *q = p;
+        if (q < end && *q == '"') {
+            q = memchr(q + 1, '"', (size_t)(end - q - 1));
+            if (!q) return 0;
+            q++;
+        } else {
+            while (q < end && *q != ',') q++;
         }
-        if (n < 0) {
-            if (errno == EINTR) continue; /* retry on interrupt */
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                /* timeout/idle: close connection gracefully */
-                printf("conn %d: idle timeout after %d seconds, closing\n",
-                       client_fd, IDLE_TIMEOUT_SECONDS);
-                fflush(stdout);
-                return 0;
-            }
-            perror("read");
-            printf("conn %d: read error, closing\n", client_fd);
-            fflush(stdout);
-            return -1; /* other read error */
+        if ((size_t)(q - p) == tag.len && memcmp(p, tag.p, tag.len) == 0) return 1;
+        p = q;
+    }
+    return 0;
+}
+
+/* not_modified: If-None-Match, or failing that If-Modified-Since, says the
+   client's copy is current */
+static int not_modified(const http_request_t *req, http_slice_t tag, time_t mtime) {
+    http_slice_t v;
+    if (http_find_header(req, "If-None-Match", &v)) return etag_listed(v, tag);
+    time_t since;
+    return http_find_header(req, "If-Modified-Since", &v) &&
+           validator_parse_date(v.p, v.len, &since) == 0 && mtime <= since;
+}
+
+/* if_range_ok: no If-Range, or it names the current version (strong tag
+   comparison, or the exact Last-Modified date) */
+static int if_range_ok(const http_request_t *req, http_slice_t tag, time_t mtime) {
+    http_slice_t v;
+    if (!http_find_header(req, "If-Range", &v)) return 1;
+    if (v.len > 0 && v.p[0] == '"') return v.len == tag.len && memcmp(v.p, tag.p, tag.len) == 0;
+    time_t t;
+    return validator_parse_date(v.p, v.len, &t) == 0 && t == mtime;
+}
+
+/* parse_offset: decimal digits at *p (at most 18); -1 if there are none */
+static long long parse_offset(const char **p, const char *end) {
+    long long v = 0;
+    int digits = 0;
+    while (*p < end && **p >= '0' && **p <= '9' && digits < 18) {
+        v = v * 10 + (**p - '0');
+        (*p)++;
+        digits++;
+    }
+    return digits ? v : -1;
+}
+
+/* parse_ranges: "bytes=a-b, c-, -n" against a body of size bytes. Fills r
+   with the satisfiable ranges, sorted and with near neighbours merged, and
+   returns how many (0: none satisfiable). -1 means ignore the header (bad
+   syntax, another unit, or more than max specs) and send the whole body. */
+static int parse_ranges(http_slice_t v, off_t size, struct byte_range *r, int max) {
+    const char *p = v.p, *end = v.p + v.len;
+    if (v.len < 6 || strncasecmp(p, "bytes=", 6) != 0) return -1;
+    p += 6;
+    int n = 0, specs = 0;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        if (p == end) break;
+        if (++specs > max) return -1;
+        long long first = -1, last = -1;
+        if (*p != '-' && (first = parse_offset(&p, end)) < 0) return -1;
+        if (p == end || *p != '-') return -1;
+        p++;
+        if (p < end && *p >= '0' && *p <= '9') last = parse_offset(&p, end);
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p < end && *p != ',') return -1;
+
+        struct byte_range br;
+        if (first < 0) { /* suffix: the last `last` bytes */
+            if (last < 0) return -1;
+            br.start = last < (long long)size ? size - (off_t)last : 0;
+            br.end = size;
+        } else {
+            if (last >= 0 && last < first) return -1;
+            br.start = (off_t)first;
+            br.end = last < 0 || last >= (long long)size ? size : (off_t)last + 1;
         }
-        buf[n] = '\0';
-
-        /* parse request line with HTTP version */
-        char method[16];
-        char path[1024];
-        char version[16] = "";
-        if (sscanf(buf, "%15s %1023s %15s", method, path, version) < 2) {
-            const char *resp = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-            write_all(client_fd, resp, strlen(resp));
-            printf("conn %d: malformed request, closing\n", client_fd);
-            fflush(stdout);
-            return -1;
+        if (br.start >= br.end) continue; /* unsatisfiable spec */
+
+        /* insert sorted by start */
+        int i = n++;
+        while (i > 0 && r[i - 1].start > br.start) {
+            r[i] = r[i - 1];
+            i--;
         }
+        r[i] = br;
+    }
+    if (specs == 0) return -1;
 
-        printf("conn %d: serving request #%d: %s %s\n", client_fd, served + 1, method, path);
-        fflush(stdout);
-
-        /* determine connection semantics: default depends on version */
-        int should_close = 0;
-        /* HTTP/1.0 closes by default unless Connection: keep-alive present */
-        if (strncmp(version, "HTTP/1.0", 8) == 0) should_close = 1;
-        /* scan headers for explicit Connection: close or keep-alive */
-        if (strcasestr(buf, "\r\nConnection: close") || strcasestr(buf, "\nConnection: close")) {
-            should_close = 1;
-        } else if (strcasestr(buf, "\r\nConnection: keep-alive") || strcasestr(buf, "\nConnection: keep-alive")) {
-            should_close = 0;
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        if (m > 0 && r[i].start <= r[m - 1].end + HTTP_RANGE_MERGE_GAP) {
+            if (r[i].end > r[m - 1].end) r[m - 1].end = r[i].end;
+        } else {
+            r[m++] = r[i];
         }
+    }
+    return m;
+}
 
-        /* only support GET and HEAD */
-        if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0) {
-            const char *resp = "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n";
-            write_all(client_fd, resp, strlen(resp));
-            printf("conn %d: method not allowed (%s), closing\n", client_fd, method);
-            fflush(stdout);
+/* serve_cached: queue a cache entry (consumed): all of it, or the one
+   range r as a 206. HEAD gets the headers only. */
+static int serve_cached(http_out_t *out, const struct resp *rs, const fc_entry_t *cached,
+                        const struct byte_range *r, const char *tail_hdr) {
+    uint64_t bytes;
+    if (!r) {
+        /* prebuilt status + length + validators, header tail, body; the
+           entry stays referenced until the batch is flushed */
+        if (out_reserve(out, 3, 0) < 0) {
+            filecache_release(cached);
             return -1;
         }
-
-        /* basic path sanitization */
-        if (!sanitize_path(path)) {
-            const char *resp = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n";
-            write_all(client_fd, resp, strlen(resp));
-            printf("conn %d: forbidden path %s\n", client_fd, path);
-            fflush(stdout);
-            if (should_close) return 0;
-            served++;
-            continue;
+        out_push(out, cached->hdr, cached->hdr_len);
+        out_push(out, tail_hdr, strlen(tail_hdr));
+        bytes = cached->hdr_len + strlen(tail_hdr);
+        if (!rs->head) {
+            out_push(out, cached->body, cached->body_len);
+            bytes += cached->body_len;
         }
-
-        /* build filesystem path */
-        char file_path[4096];
-        if (path[0] == '\0' || strcmp(path, "/") == 0) {
-            snprintf(file_path, sizeof(file_path), "%s/index.html", docroot);
-        } else {
-            const char *p = path[0] == '/' ? path + 1 : path;
-            snprintf(file_path, sizeof(file_path), "%s/%s", docroot, p);
+    } else {
+        int n = out_headf(out,
+                          "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\n"
+                          "Content-Range: bytes %lld-%lld/%zu\r\n%.*sAccept-Ranges: bytes\r\n%s",
+                          (long long)(r->end - r->start), (long long)r->start, (long long)r->end - 1,
+                          cached->body_len, (int)cached->validators_len, cached->validators, tail_hdr);
+        if (n < 0) {
+            filecache_release(cached);
+            return -1;
         }
+        out_push(out, cached->body + r->start, (size_t)(r->end - r->start));
+        bytes = (uint64_t)n + (uint64_t)(r->end - r->start);
+    }
+    out->refs[out->nrefs++] = cached;
+    metrics_record_request(now_us_local() - rs->start_us, bytes, r ? 206 : 200);
+    return 0;
+}
 
-        struct stat st;
-        if (stat(file_path, &st) < 0) {
-            const char *resp = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-            write_all(client_fd, resp, strlen(resp));
-            printf("conn %d: 404 %s\n", client_fd, file_path);
-            fflush(stdout);
-            if (should_close) return 0;
-            served++;
-            continue;
+/* serve_fd: send an fd cache entry (consumed), all of it or the range r,
+   with sendfile from the range's offset: deferred to http_out_resume in
+   nonblock mode, in one go otherwise. */
+static int serve_fd(http_out_t *out, const struct resp *rs, const fd_entry_t *fe,
+                    const struct byte_range *r, const char *tail_hdr) {
+    int client_fd = out->fd;
+    off_t fsize = fe->st.st_size;
+    off_t start = r ? r->start : 0, end = r ? r->end : fsize;
+    int status = r ? 206 : 200;
+
+    /* the header joins the queued batch; flush it all with MSG_MORE so the
+       kernel packs it into the same segments as the sendfile body */
+    int hdrlen;
+    if (r)
+        hdrlen = out_headf(out,
+                           "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\n"
+                           "Content-Range: bytes %lld-%lld/%lld\r\n%.*sAccept-Ranges: bytes\r\n%s",
+                           (long long)(end - start), (long long)start, (long long)end - 1,
+                           (long long)fsize, (int)fe->validators_len, fe->validators, tail_hdr);
+    else
+        hdrlen = out_headf(out, "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\n%.*sAccept-Ranges: bytes\r\n%s",
+                           (long long)fsize, (int)fe->validators_len, fe->validators, tail_hdr);
+    if (hdrlen < 0) {
+        fdcache_release(fe);
+        return -1;
+    }
+    if (rs->head || start == end) {
+        fdcache_release(fe);
+        metrics_record_request(now_us_local() - rs->start_us, (uint64_t)hdrlen, status);
+        return 0;
+    }
+    if (out->nonblock) {
+        /* sent in bounded chunks by http_out_resume so one download cannot
+           pin a worker while the client drains it */
+        out->body = fe;
+        out->body_off = out->body_begin = start;
+        out->body_end = end;
+        out->body_start_us = rs->start_us;
+        out->body_hdr_len = (size_t)hdrlen;
+        out->body_status = status;
+        return 0;
+    }
+    if (out_flush_flags(out, MSG_MORE) < 0) {
+        fdcache_release(fe);
+        LOG_DEBUG("conn %d: write header failed", client_fd);
+        return -1;
+    }
+
+#ifdef __linux__
+    off_t offset = start;
+    while (offset < end) {
+        ssize_t sent = sendfile(client_fd, fe->fd, &offset, (size_t)(end - offset));
+        if (sent <= 0) {
+            if (errno == EINTR) continue;
+            break;
         }
+    }
+#else
+    /* pread: the descriptor is shared, so never move its file position */
+    ssize_t rd;
+    off_t offset = start;
+    char tmp[8192];
+    while (offset < end &&
+           (rd = pread(fe->fd, tmp, end - offset < (off_t)sizeof(tmp) ? (size_t)(end - offset) : sizeof(tmp),
+                       offset)) > 0) {
+        if (write_all(client_fd, tmp, rd) < 0) break;
+        offset += rd;
+    }
+#endif
 
-        if (S_ISDIR(st.st_mode)) {
-            const char *suffix = "/index.html";
-            size_t base_len = strlen(file_path);
-            size_t need = base_len + strlen(suffix) + 1;
-            char *idx = malloc(need);
-            if (!idx) {
-                const char *resp = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
-                write_all(client_fd, resp, strlen(resp));
-                printf("conn %d: OOM building index path\n", client_fd);
-                fflush(stdout);
-                return -1;
+    fdcache_release(fe);
+    metrics_record_request(now_us_local() - rs->start_us, (uint64_t)hdrlen + (uint64_t)(offset - start),
+                           status);
+    if (offset < end) return -1; /* peer went away mid-body */
+    return 0;
+}
+
+/* serve_multipart: a multipart/byteranges 206 for ranges r[0..n) of a
+   cached body or an fd. The whole response is assembled in one heap buffer
+   owned by the batch (callers cap the selected bytes at
+   HTTP_MULTIRANGE_MAX); blocking callers flush right away, like
+   serve_metrics. */
+static int serve_multipart(http_out_t *out, const struct resp *rs, const fc_entry_t *cached,
+                           const fd_entry_t *fe, off_t size, const struct byte_range *r, int n,
+                           const char *validators, size_t vlen, const char *tail_hdr) {
+    static const char part_fmt[] = "\r\n--" HTTP_BOUNDARY "\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n";
+    static const char closing[] = "\r\n--" HTTP_BOUNDARY "--\r\n";
+    size_t body_len = sizeof(closing) - 1;
+    for (int i = 0; i < n; ++i) {
+        body_len += (size_t)snprintf(NULL, 0, part_fmt, (long long)r[i].start, (long long)r[i].end - 1,
+                                     (long long)size);
+        body_len += (size_t)(r[i].end - r[i].start);
+    }
+
+    const size_t head_cap = OUT_RESP_SCRATCH;
+    char *buf = malloc(head_cap + body_len);
+    if (!buf) {
+        LOG_ERROR("conn %d: OOM building multipart response", out->fd);
+        return -1;
+    }
+    int hl = snprintf(buf, head_cap,
+                      "HTTP/1.1 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary=" HTTP_BOUNDARY
+                      "\r\nContent-Length: %zu\r\n%.*sAccept-Ranges: bytes\r\n%s",
+                      body_len, (int)vlen, validators, tail_hdr);
+    if (hl < 0 || (size_t)hl >= head_cap) {
+        free(buf);
+        return -1;
+    }
+    char *p = buf + hl;
+    for (int i = 0; i < n; ++i) {
+        p += sprintf(p, part_fmt, (long long)r[i].start, (long long)r[i].end - 1, (long long)size);
+        size_t len = (size_t)(r[i].end - r[i].start);
+        if (cached) {
+            memcpy(p, cached->body + r[i].start, len);
+        } else {
+            size_t got = 0;
+            while (got < len) {
+                ssize_t rd = pread(fe->fd, p + got, len - got, r[i].start + (off_t)got);
+                if (rd < 0 && errno == EINTR) continue;
+                if (rd <= 0) break;
+                got += (size_t)rd;
             }
-            snprintf(idx, need, "%s%s", file_path, suffix);
-            if (stat(idx, &st) < 0) {
-                const char *resp = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n";
-                write_all(client_fd, resp, strlen(resp));
-                free(idx);
-                printf("conn %d: no index for dir %s\n", client_fd, file_path);
-                fflush(stdout);
-                if (should_close) return 0;
-                served++;
-                continue;
+            if (got < len) { /* file shrank under us */
+                free(buf);
+                return -1;
             }
-            strncpy(file_path, idx, sizeof(file_path) - 1);
-            file_path[sizeof(file_path) - 1] = '\0';
-            free(idx);
         }
+        p += len;
+    }
+    memcpy(p, closing, sizeof(closing) - 1);
+    p += sizeof(closing) - 1;
 
-        int fd = open(file_path, O_RDONLY);
-        if (fd < 0) {
-            const char *resp = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
-            write_all(client_fd, resp, strlen(resp));
-            printf("conn %d: failed to open %s\n", client_fd, file_path);
-            fflush(stdout);
+    if (out_reserve(out, 1, 0) < 0) {
+        free(buf);
+        return -1;
+    }
+    out_push(out, buf, (size_t)(p - buf));
+    out->owned = buf;
+    metrics_record_request(now_us_local() - rs->start_us, (uint64_t)(p - buf), 206);
+    if (out->nonblock) return 0; /* sent by the caller's http_out_resume */
+    return http_out_flush(out);
+}
+
+/* serve_file: answer a request for path with the given header tail, from
+   the cache entry if there is one (consumed), else via the fd cache:
+   304 when the client's validators match, 206/416 for Range requests,
+   200 otherwise. Returns 0, or -1 if the connection must be closed. */
+static int serve_file(http_out_t *out, const struct resp *rs, const char *file_path,
+                      const fc_entry_t *cached, int tail) {
+    const char *tail_hdr = resp_tail[tail][rs->should_close ? 1 : 0];
+    const fd_entry_t *fe = NULL;
+    if (!cached) {
+        /* shared descriptor from the fd cache; our offset is private */
+        fe = fdcache_open(file_path);
+        if (!fe && (errno == ENOENT || errno == ENOTDIR || errno == EXDEV || errno == ELOOP)) {
+            /* gone since the lookup, or resolves outside the docroot */
+            out_static(out, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", 404, rs->start_us);
+            LOG_DEBUG("conn %d: 404 %s", out->fd, file_path);
             return -1;
         }
-
-        char hdr[256];
-        int hdrlen = snprintf(hdr, sizeof(hdr),
-                              "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\nConnection: %s\r\n\r\n",
-                              (long long)st.st_size,
-                              should_close ? "close" : "keep-alive");
-        if (hdrlen < 0) hdrlen = 0;
-        if (write_all(client_fd, hdr, hdrlen) < 0) {
-            close(fd);
-            printf("conn %d: write header failed\n", client_fd);
-            fflush(stdout);
+        if (!fe) {
+            out_static(out, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", 500,
+                       rs->start_us);
+            LOG_WARN("conn %d: failed to open %s", out->fd, file_path);
             return -1;
         }
+    }
+    const char *validators = cached ? cached->validators : fe->validators;
+    size_t vlen = cached ? cached->validators_len : fe->validators_len;
+    http_slice_t tag = cached ? (http_slice_t){cached->etag, cached->etag_len}
+                              : (http_slice_t){fe->validators + fe->etag_off, fe->etag_len};
+    time_t mtime = cached ? cached->mtime : fe->st.st_mtim.tv_sec;
+    off_t size = cached ? (off_t)cached->body_len : fe->st.st_size;
+
+    int rc = 0;
+    if (not_modified(rs->req, tag, mtime)) {
+        int n = out_headf(out, "HTTP/1.1 304 Not Modified\r\n%.*s%s", (int)vlen, validators, tail_hdr);
+        if (n < 0) rc = -1;
+        else metrics_record_request(now_us_local() - rs->start_us, (uint64_t)n, 304);
+        goto done;
+    }
+
+    struct byte_range r[HTTP_MAX_RANGES];
+    int nr = -1;
+    http_slice_t range;
+    if (!rs->head && http_find_header(rs->req, "Range", &range) && if_range_ok(rs->req, tag, mtime))
+        nr = parse_ranges(range, size, r, HTTP_MAX_RANGES);
+    if (nr == 0) {
+        int n = out_headf(out,
+                          "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n"
+                          "Content-Length: 0\r\n%s",
+                          (long long)size, tail_hdr);
+        if (n < 0) rc = -1;
+        else metrics_record_request(now_us_local() - rs->start_us, (uint64_t)n, 416);
+        goto done;
+    }
+    if (nr > 1) {
+        off_t total = 0;
+        for (int i = 0; i < nr; ++i) total += r[i].end - r[i].start;
+        if (total <= HTTP_MULTIRANGE_MAX) {
+            rc = serve_multipart(out, rs, cached, fe, size, r, nr, validators, vlen, tail_hdr);
+            goto done;
+        }
+        /* too much to assemble: one part spanning them all */
+        r[0].end = r[nr - 1].end;
+        nr = 1;
+    }
+    if (cached) return serve_cached(out, rs, cached, nr == 1 ? r : NULL, tail_hdr);
+    return serve_fd(out, rs, fe, nr == 1 ? r : NULL, tail_hdr);
 
-#ifdef __linux__
-        off_t offset = 0;
-        while (offset < st.st_size) {
-            ssize_t sent = sendfile(client_fd, fd, &offset, st.st_size - offset);
-            if (sent <= 0) {
-                if (errno == EINTR) continue;
-                break;
+done:
+    if (cached) filecache_release(cached);
+    if (fe) fdcache_release(fe);
+    return rc;
+}
+
+/* accepted_encodings: bitmask of 1 << COMPRESS_* the client takes, per
+   Accept-Encoding. "q=0" refuses a coding; "*" stands for any not named. */
+static unsigned accepted_encodings(const http_request_t *req) {
+    unsigned yes = 0, no = 0;
+    int star = 0;
+    for (size_t i = 0; i < req->nheaders; ++i) {
+        if (!http_slice_ieq(req->headers[i].name, "Accept-Encoding")) continue;
+        const char *p = req->headers[i].value.p;
+        const char *end = p + req->headers[i].value.len;
+        while (p < end) {
+            const char *tok_end = memchr(p, ',', (size_t)(end - p));
+            if (!tok_end) tok_end = end;
+            while (p < tok_end && (*p == ' ' || *p == '\t')) p++;
+            const char *name_end = p;
+            while (name_end < tok_end && *name_end != ';' && *name_end != ' ' && *name_end != '\t')
+                name_end++;
+            http_slice_t coding = {p, (size_t)(name_end - p)};
+
+            /* refused: a q value of 0, 0.0, 0.00 ... */
+            int refused = 0;
+            const char *q = memmem(name_end, (size_t)(tok_end - name_end), "q=", 2);
+            if (q && q + 2 < tok_end && q[2] == '0') {
+                refused = 1;
+                for (q += 3; q < tok_end && (*q == '.' || (*q >= '0' && *q <= '9')); ++q)
+                    if (*q != '.' && *q != '0') refused = 0;
             }
+
+            unsigned bit = 0;
+            if (http_slice_ieq(coding, "gzip") || http_slice_ieq(coding, "x-gzip"))
+                bit = 1u << COMPRESS_GZIP;
+            else if (http_slice_ieq(coding, "br"))
+                bit = 1u << COMPRESS_BR;
+            else if (http_slice_eq(coding, "*") && !refused)
+                star = 1;
+            if (refused) no |= bit;
+            else yes |= bit;
+            p = tok_end + 1;
         }
-#else
-        ssize_t r;
-        char tmp[8192];
-        while ((r = read(fd, tmp, sizeof(tmp))) > 0) {
-            if (write_all(client_fd, tmp, r) < 0) break;
-        }
-#endif
+    }
+    if (star) yes |= (1u << COMPRESS_GZIP) | (1u << COMPRESS_BR);
+    return yes & ~no;
+}
 
-        close(fd);
+/* serve_encoded: answer with a compressed variant of file_path if the
+   client takes one: a precompressed sibling first (br, then gzip), else a
+   compressed copy from the file cache. Sets *tail to TAIL_VARY when the
+   resource has variants, so an identity answer says Vary too (for clients
+   that take no coding, only by type: siblings are not probed for them, and
+   a cached identity answer without Vary is still valid for everyone).
+   Returns 1 if a response was queued, 0 to serve identity, -1 to close. */
+static int serve_encoded(http_out_t *out, const struct resp *rs, const char *file_path, int *tail) {
+    static const int order[] = {COMPRESS_BR, COMPRESS_GZIP};
+    unsigned accept = accepted_encodings(rs->req);
+    if (!accept) {
+        if (compress_type_ok(file_path)) *tail = TAIL_VARY;
+        return 0;
+    }
 
-        /* after sending response successfully or on error, record metrics */
-        {
-            uint64_t latency = 0;
-            uint64_t bytes_sent = 0;
-            int status_code = 200; /* set appropriately in your code paths */
-            /* if serving a regular file you can set bytes_sent = st.st_size */
-            latency = now_ms_local() - req_start;
-            metrics_record_request(latency, bytes_sent, status_code);
+    /* siblings are found through the size index; one it has not seen (no
+       watcher, a full table) is looked up once and a miss remembered, so
+       a missing sibling costs no syscall either way */
+    size_t base = strlen(file_path);
+    char *sibling = arena_alloc(rs->scratch, base + sizeof(".gz"));
+    if (!sibling) return 0;
+    memcpy(sibling, file_path, base);
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+        int enc = order[i];
+        long size;
+        memcpy(sibling + base, compress_suffix(enc), sizeof(".gz")); /* ".br" / ".gz" and NUL */
+        const fc_entry_t *e = NULL;
+        struct stat st;
+        int lookup = -2; /* not looked up yet */
+        if (sizeindex_lookup(sibling, &size) != 0) {
+            unsigned gen;
+            if (docroot_cached(sibling, &gen) == DOCROOT_MISSING) continue;
+            lookup = filecache_lookup(sibling, &e, &st);
+            if (lookup == FC_ENOENT) docroot_remember(sibling, DOCROOT_MISSING, gen);
+            if (lookup == FC_ENOENT || (lookup == FC_STAT && !S_ISREG(st.st_mode))) continue;
+        }
+        *tail = TAIL_VARY;
+        if (!(accept & (1u << enc))) {
+            if (e) filecache_release(e);
+            continue;
         }
-        /* finished one request */
-        served++;
+        if (lookup == -2) lookup = filecache_lookup(sibling, &e, &st);
+        if (lookup == FC_ENOENT || (lookup == FC_STAT && !S_ISREG(st.st_mode))) continue;
+        return serve_file(out, rs, sibling, e, tail_for(enc)) < 0 ? -1 : 1;
+    }
+
+    if (!compress_type_ok(file_path)) return 0;
+    *tail = TAIL_VARY;
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+        int enc = order[i];
+        const fc_entry_t *e = NULL;
+        if (!(accept & (1u << enc)) || filecache_lookup_encoded(file_path, enc, &e) != FC_HIT) continue;
+        return serve_file(out, rs, file_path, e, tail_for(enc)) < 0 ? -1 : 1;
+    }
+    return 0;
+}
+
+/* http_serve_request: queue the response to the parsed request req on out.
+   Returns 0 when the request was answered (keep_alive tells whether the
+   connection may be reused), -1 when the connection must be closed; flush
+   out either way. */
+int http_serve_request(http_out_t *out, const http_request_t *req, const char *docroot,
+                       int force_close, arena_t *scratch, int *keep_alive) {
+    int client_fd = out->fd;
+    uint64_t req_start = now_us_local();
+    *keep_alive = 0;
+
+    if (req->malformed) {
+        out_static(out, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", 400, req_start);
+        LOG_DEBUG("conn %d: malformed request, closing", client_fd);
+        return -1;
+    }
+
+    LOG_DEBUG("conn %d: serving request: %.*s %.*s", client_fd,
+              (int)req->method.len, req->method.p, (int)req->path.len, req->path.p);
+
+    /* determine connection semantics: default depends on version */
+    int should_close = 0;
+    /* HTTP/1.0 closes by default unless Connection: keep-alive present */
+    if (http_slice_eq(req->version, "HTTP/1.0")) should_close = 1;
+    /* explicit Connection: close or keep-alive */
+    if (req->conn_close) {
+        should_close = 1;
+    } else if (req->conn_keep_alive) {
+        should_close = 0;
+    }
+    if (force_close) should_close = 1;
 
-        if (should_close) {
-            printf("conn %d: client requested close, closing\n", client_fd);
-            fflush(stdout);
+    /* only support GET and HEAD */
+    int head = http_slice_eq(req->method, "HEAD");
+    if (!head && !http_slice_eq(req->method, "GET")) {
+        out_static(out, "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n", 405, req_start);
+        LOG_DEBUG("conn %d: method not allowed (%.*s), closing", client_fd,
+                  (int)req->method.len, req->method.p);
+        return -1;
+    }
+
+    /* reserved path: metrics come from memory, never the docroot */
+    if (http_slice_eq(req->path, HTTP_METRICS_PATH)) {
+        if (serve_metrics(out, head, should_close, req_start) < 0) return -1;
+        *keep_alive = !should_close;
+        return 0;
+    }
+
+    /* basic path sanitization */
+    if (!sanitize_path(req->path)) {
+        if (out_static(out, "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n", 403, req_start) < 0) return -1;
+        LOG_DEBUG("conn %d: forbidden path %.*s", client_fd, (int)req->path.len, req->path.p);
+        *keep_alive = !should_close;
+        return 0;
+    }
+
+    /* build filesystem path */
+    char *file_path = build_file_path(scratch, docroot, req->path);
+    if (!file_path) {
+        out_static(out, "HTTP/1.1 414 URI Too Long\r\nContent-Length: 0\r\n\r\n", 414, req_start);
+        LOG_DEBUG("conn %d: path too long", client_fd);
+        return -1;
+    }
+
+    /* what this path resolved to last time: 404s, directory index mappings
+       and files too large for the file cache skip the stat */
+    unsigned gen;
+    int known = docroot_cached(file_path, &gen);
+    int fresh = known == DOCROOT_UNKNOWN;
+
+    /* hot small files come straight from the cache (no stat/open) */
+    const fc_entry_t *cached = NULL;
+    struct stat st;
+    if (fresh) {
+        int lookup = filecache_lookup(file_path, &cached, &st);
+        if (lookup == FC_ENOENT) known = DOCROOT_MISSING;
+        else if (lookup == FC_STAT && S_ISDIR(st.st_mode)) known = DOCROOT_INDEX;
+        else if (lookup == FC_STAT && S_ISREG(st.st_mode)) known = DOCROOT_FILE;
+        /* a directory is remembered once its index lookup is done */
+        if (known == DOCROOT_MISSING || known == DOCROOT_FILE) docroot_remember(file_path, known, gen);
+    }
+    if (known == DOCROOT_MISSING) {
+        if (out_static(out, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", 404, req_start) < 0) return -1;
+        LOG_DEBUG("conn %d: 404 %s", client_fd, file_path);
+        *keep_alive = !should_close;
+        return 0;
+    }
+
+    if (known == DOCROOT_INDEX || known == DOCROOT_NOINDEX) {
+        char *idx = arena_printf(scratch, "%s/index.html", file_path);
+        if (!idx) {
+            out_static(out, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", 500, req_start);
+            LOG_ERROR("conn %d: OOM building index path", client_fd);
+            return -1;
+        }
+        if (known == DOCROOT_NOINDEX || filecache_lookup(idx, &cached, &st) == FC_ENOENT) {
+            if (known != DOCROOT_NOINDEX) docroot_remember(file_path, DOCROOT_NOINDEX, gen);
+            if (out_static(out, "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n", 403, req_start) < 0) return -1;
+            LOG_DEBUG("conn %d: no index for dir %s", client_fd, file_path);
+            *keep_alive = !should_close;
             return 0;
         }
+        if (fresh) docroot_remember(file_path, DOCROOT_INDEX, gen);
+        file_path = idx;
+    }
 
-        if (served >= MAX_KEEPALIVE_REQUESTS) {
-            printf("conn %d: max keep-alive requests (%d) reached, closing\n",
-                   client_fd, MAX_KEEPALIVE_REQUESTS);
-            fflush(stdout);
+    struct resp rs = {.req = req, .scratch = scratch, .head = head, .should_close = should_close,
+                      .start_us = req_start};
+    int tail = TAIL_PLAIN;
+    if (compress_enabled()) {
+        int rc = serve_encoded(out, &rs, file_path, &tail);
+        if (rc != 0) {
+            filecache_release(cached);
+            if (rc < 0) return -1;
+            *keep_alive = !should_close;
             return 0;
         }
+    }
+    if (serve_file(out, &rs, file_path, cached, tail) < 0) return -1;
+    *keep_alive = !should_close;
+    return 0;
+}
+
+/* the overload response; rebuilt by http_set_retry_after at startup */
+#define UNAVAILABLE_HEAD "HTTP/1.1 503 Service Unavailable\r\nRetry-After: "
+#define UNAVAILABLE_TAIL "\r\nContent-Type: text/plain\r\nContent-Length: 20\r\n" \
+                         "Connection: close\r\n\r\nService Unavailable\n"
+static char unavailable[192] = UNAVAILABLE_HEAD "1" UNAVAILABLE_TAIL;
+static size_t unavailable_len = sizeof(UNAVAILABLE_HEAD "1" UNAVAILABLE_TAIL) - 1;
+
+void http_set_retry_after(unsigned seconds) {
+    int n = snprintf(unavailable, sizeof(unavailable), UNAVAILABLE_HEAD "%u" UNAVAILABLE_TAIL, seconds);
+    if (n > 0 && (size_t)n < sizeof(unavailable)) unavailable_len = (size_t)n;
+}
+
+void http_send_unavailable(int fd, uint64_t latency_us) {
+    ssize_t n = send(fd, unavailable, unavailable_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    metrics_record_request(latency_us, n > 0 ? (uint64_t)n : 0, 503);
+}
+
+/* handle_client: handle up to MAX_KEEPALIVE_REQUESTS requests on client_fd.
+   Enforces an idle timeout via SO_RCVTIMEO and honors Connection headers
+   and HTTP version semantics. Returns 0 on normal completion, -1 on error. */
+int handle_client(int client_fd, const char *docroot) {
+    /* set a recv timeout so idle clients don't block workers forever */
+    struct timeval tv;
+    tv.tv_sec = IDLE_TIMEOUT_SECONDS;
+    tv.tv_usec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    LOG_DEBUG("conn %d: opened", client_fd);
+
+    http_out_t out;
+    http_out_init(&out, client_fd);
+    char scratch_buf[HTTP_REQ_ARENA];
+    arena_t scratch;
+    arena_init(&scratch, scratch_buf, sizeof(scratch_buf));
+    char buf[REQ_BUF];
+    size_t len = 0;      /* bytes buffered */
+    size_t scanned = 0;  /* head-end search resumes here */
+    int served = 0;
+
+    while (served < MAX_KEEPALIVE_REQUESTS) {
+        /* serve every complete request already buffered (pipelining) */
+        /* responses are batched and written once the buffer is drained */
+        size_t off = 0;
+        while (served < MAX_KEEPALIVE_REQUESTS &&
+               http_find_head_end(buf + off, len - off, &scanned) > 0) {
+            http_request_t req;
+            size_t hlen = http_parse_request(buf + off, len - off, &req);
+            scanned = 0;
+            served++;
+            int keep_alive = 0;
+            int rc = http_serve_request(&out, &req, docroot,
+                                        served >= MAX_KEEPALIVE_REQUESTS, &scratch, &keep_alive);
+            arena_reset(&scratch);
+            if (rc < 0) {
+                http_out_flush(&out);
+                return -1;
+            }
+            if (!keep_alive) {
+                http_out_flush(&out);
+                LOG_DEBUG("conn %d: closing after served=%d", client_fd, served);
+                return 0;
+            }
+            off += hlen;
+        }
+        if (http_out_flush(&out) < 0) return -1;
+        if (off) {
+            memmove(buf, buf + off, len - off);
+            len -= off;
+        }
+        if (served >= MAX_KEEPALIVE_REQUESTS) break;
 
-        /* continue loop to handle next request on same socket (keep-alive) */
+        if (len == sizeof(buf)) {
+            const char *resp = "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                               "Content-Length: 0\r\nConnection: close\r\n\r\n";
+            write_all(client_fd, resp, strlen(resp));
+            LOG_DEBUG("conn %d: request head too large, closing", client_fd);
+            return -1;
+        }
+
+        /* partial (or no) request buffered: read more */
+        ssize_t n = read(client_fd, buf + len, sizeof(buf) - len);
+        if (n == 0) {
+            LOG_DEBUG("conn %d: client closed connection", client_fd);
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue; /* retry on interrupt */
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* timeout/idle: close connection gracefully */
+                LOG_DEBUG("conn %d: idle timeout after %d seconds, closing",
+                          client_fd, IDLE_TIMEOUT_SECONDS);
+                return 0;
+            }
+            perror("read");
+            LOG_WARN("conn %d: read error, closing", client_fd);
+            return -1; /* other read error */
+        }
+        len += (size_t)n;
     }
 
     /* reached max requests; close connection */
-    printf("conn %d: returning after served=%d\n", client_fd, served);
-    fflush(stdout);
+    LOG_DEBUG("conn %d: max keep-alive requests (%d) reached, closing",
+              client_fd, MAX_KEEPALIVE_REQUESTS);
     return 0;
 }
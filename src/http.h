@@ -1,19 +1,140 @@
 // Public API for per-connection HTTP handling.
 //
 // handle_client:
-//  - Handles a single client connection: parses a simple HTTP request,
-//    validates method/path, and serves a static file from docroot.
+//  - Handles a single client connection: reads until a request head is
+//    complete (any number of reads), serves every pipelined request in the
+//    buffer, validates method/path, and serves static files from docroot.
 //  - Parameters:
 //      client_fd : connected socket FD for the client (must be valid).
 //      docroot   : path to document root directory (must remain valid for call).
 //  - Behavior:
 //      - Sends an HTTP response (headers + body) on client_fd.
 //      - Does NOT close client_fd; caller is responsible for closing the socket.
-//      - Supports GET and HEAD (note: current implementation may still send body for HEAD).
+//      - Supports GET and HEAD (HEAD gets the headers only).
 //  - Return:
 //      0  on success (request handled), -1 on error (response may have been sent).
 //  - Thread-safety:
 //      Safe to call concurrently from multiple threads as long as docroot is immutable.
+//
+// http_serve_request:
+//  - Answers one parsed request (see http_parse_request; its slices must
+//    still point into the live receive buffer). Used by handle_client and
+//    by the epoll reactor, which does its own reading.
+//  - The response is queued on out rather than written: callers serve every
+//    pipelined request in their buffer and then http_out_flush() once, so a
+//    batch of small responses costs a single sendmsg(). Large bodies flush
+//    the batch (with MSG_MORE) and follow with sendfile().
+//  - With out->nonblock set (reactor sockets are O_NONBLOCK) nothing is
+//    written here: a large body is recorded on out instead and sent by
+//    http_out_resume, and the caller must stop serving pipelined requests
+//    while http_out_busy(out).
+//  - Accept-Encoding picks a .br/.gz sibling or a compressed copy from the
+//    file cache (see compress.h); negotiable resources get Vary.
+//  - File responses carry ETag/Last-Modified from the caches (validators.h).
+//    If-None-Match (or If-Modified-Since) answers 304; Range answers 206
+//    (one range with sendfile from its offset, several as
+//    multipart/byteranges) or 416, subject to If-Range.
+//  - force_close makes the response carry "Connection: close".
+//  - scratch holds request-scoped strings (file paths); nothing queued on
+//    out points into it, so callers arena_reset it once this returns.
+//  - HTTP_METRICS_PATH is reserved: it is answered with the Prometheus
+//    exposition from metrics_prom_render and never maps to the docroot.
+//  - Return:
+//      0  response queued; *keep_alive is 1 if the connection may be reused.
+//      -1 the connection must be closed (an error response may be queued).
+//    Always flush out before closing or reading more.
+//
+// http_out_init / http_out_flush:
+//  - Bind a batch to a socket / write everything queued and release held
+//    cache entries. Flush returns 0 or -1 on a socket error; in nonblock
+//    mode it returns 1 if the socket filled up, keeping the unsent iovecs.
+//
+// http_out_resume (nonblock mode):
+//  - Continue the output: the queued batch, then at most
+//    HTTP_BODY_TURN_BYTES of a deferred sendfile body in HTTP_BODY_CHUNK
+//    pieces. Returns 0 when everything is out, 1 when the socket would
+//    block or the turn's budget is spent (wait for EPOLLOUT and call again,
+//    so one worker can multiplex many downloads), -1 on error.
+//
+// http_out_consume / http_out_body_finish (for engines that do the I/O
+// themselves, e.g. io_uring):
+//  - consume: drop the first n bytes of the queued batch after a send;
+//    returns 1 while bytes remain. http_out_flush on the emptied batch then
+//    releases what backed it.
+//  - body_finish: account and release the deferred body once sent (or
+//    abandoned); returns 0 if all of it went out, else -1.
+//
+// http_out_busy / http_out_discard:
+//  - busy: nonzero while output is pending or the batch cannot take
+//    another response without flushing.
+//  - discard: drop pending output and release held entries (before close).
+//
+// http_set_retry_after / http_send_unavailable:
+//  - The overload answer: a prebuilt "503 Service Unavailable" carrying
+//    "Retry-After: <seconds>" and "Connection: close". send_unavailable
+//    writes it with one non-blocking send and ignores errors (a client that
+//    cannot take 150 bytes is not worth waiting for) and records the 503
+//    with latency_us in the metrics; the caller closes.
+//  - set_retry_after rebuilds the response (default 1 s); call at startup.
+//
+// http_request_complete:
+//  - Returns the length of the request head (through the terminating blank
+//    line) if buf holds a complete request, 0 otherwise.
+//
+// http_estimate_cost:
+//  - Best-effort SJF cost (file size) for the request at the start of
+//    buf[0..len); 0 if unknown or incomplete.
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "arena.h"
+#include "http_parser.h"
+
+#define HTTP_METRICS_PATH "/__metrics"
+
+#define HTTP_OUT_IOV 64        /* iovecs per batch (well under IOV_MAX) */
+#define HTTP_OUT_SCRATCH 2048  /* bytes for generated headers per batch */
+#define HTTP_BODY_CHUNK (64 * 1024)         /* bytes per sendfile() call */
+#define HTTP_BODY_TURN_BYTES (256 * 1024)   /* body bytes per resume before yielding */
+#define HTTP_REQ_ARENA 1024    /* inline per-request scratch a connection keeps (see arena.h) */
+
+struct fc_entry;
+struct fd_entry;
+
+typedef struct http_out {
+    int fd;
+    int iovcnt;
+    int nrefs;
+    int nonblock;          /* socket is O_NONBLOCK: defer bodies, never wait */
+    size_t scratch_len;
+    char *owned;           /* heap buffer referenced by iov, freed with the batch */
+    /* deferred sendfile body (nonblock mode only) */
+    const struct fd_entry *body;
+    off_t body_off, body_end;
+    off_t body_begin;      /* where the (range's) body started */
+    int body_status;       /* 200 or 206, for metrics */
+    uint64_t body_start_us;
+    size_t body_hdr_len;
+    struct iovec iov[HTTP_OUT_IOV];
+    const struct fc_entry *refs[HTTP_OUT_IOV]; /* cache entries backing iov */
+    char scratch[HTTP_OUT_SCRATCH];
+} http_out_t;
+
 int handle_client(int client_fd, const char *docroot);
+void http_out_init(http_out_t *o, int fd);
+int http_out_flush(http_out_t *o);
+int http_out_resume(http_out_t *o);
+int http_out_consume(http_out_t *o, size_t n);
+int http_out_body_finish(http_out_t *o);
+int http_out_busy(const http_out_t *o);
+void http_out_discard(http_out_t *o);
+int http_serve_request(http_out_t *out, const http_request_t *req, const char *docroot,
+                       int force_close, arena_t *scratch, int *keep_alive);
+void http_set_retry_after(unsigned seconds);
+void http_send_unavailable(int fd, uint64_t latency_us);
+size_t http_request_complete(const char *buf, size_t len);
+long http_estimate_cost(const char *buf, size_t len, const char *docroot);
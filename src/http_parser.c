@@ -0,0 +1,166 @@
+#include "http_parser.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86 1
+#endif
+
+/* find_byte: first c in [p, end), or end. Dispatched once at startup. */
+typedef const char *(*find_byte_fn)(const char *p, const char *end, char c);
+
+static const char *find_byte_scalar(const char *p, const char *end, char c) {
+    const char *hit = memchr(p, c, (size_t)(end - p));
+    return hit ? hit : end;
+}
+
+#ifdef HTTP_PARSER_X86
+/* unaligned 16-byte loads, never past end; the tail goes scalar */
+__attribute__((target("sse2")))
+static const char *find_byte_sse2(const char *p, const char *end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (m) return p + __builtin_ctz((unsigned)m);
+        p += 16;
+    }
+    for (; p < end; ++p) {
+        if (*p == c) return p;
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static const char *find_byte_avx2(const char *p, const char *end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (m) return p + __builtin_ctz(m);
+        p += 32;
+    }
+    return find_byte_sse2(p, end, c);
+}
+#endif
+
+static find_byte_fn find_byte = find_byte_scalar;
+
+__attribute__((constructor))
+static void http_parser_select(void) {
+#ifdef HTTP_PARSER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) find_byte = find_byte_avx2;
+    else if (__builtin_cpu_supports("sse2")) find_byte = find_byte_sse2;
+#endif
+}
+
+int http_slice_eq(http_slice_t s, const char *lit) {
+    size_t n = strlen(lit);
+    return s.len == n && memcmp(s.p, lit, n) == 0;
+}
+
+int http_slice_ieq(http_slice_t s, const char *lit) {
+    size_t n = strlen(lit);
+    return s.len == n && strncasecmp(s.p, lit, n) == 0;
+}
+
+int http_find_header(const http_request_t *req, const char *name, http_slice_t *value) {
+    for (size_t i = 0; i < req->nheaders; ++i) {
+        if (http_slice_ieq(req->headers[i].name, name)) {
+            *value = req->headers[i].value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t http_find_head_end(const char *buf, size_t len, size_t *scanned) {
+    const char *end = buf + len;
+    const char *p = buf + (scanned && *scanned < len ? *scanned : 0);
+    while (p < end) {
+        const char *nl = find_byte(p, end, '\n');
+        if (nl == end) break;
+        /* a blank line follows as "\n" or "\r\n"; undecided if cut off */
+        if (nl + 1 == end || (nl[1] == '\r' && nl + 2 == end)) {
+            p = nl;
+            break;
+        }
+        if (nl[1] == '\n') return (size_t)(nl + 2 - buf);
+        if (nl[1] == '\r' && nl[2] == '\n') return (size_t)(nl + 3 - buf);
+        p = nl + 1;
+    }
+    if (scanned) *scanned = (size_t)(p - buf);
+    return 0;
+}
+
+static http_slice_t trim(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+    return (http_slice_t){ p, (size_t)(end - p) };
+}
+
+/* connection_tokens: fold a Connection header value into req */
+static void connection_tokens(http_request_t *req, http_slice_t v) {
+    const char *p = v.p, *end = v.p + v.len;
+    while (p < end) {
+        const char *comma = find_byte(p, end, ',');
+        http_slice_t tok = trim(p, comma);
+        if (http_slice_ieq(tok, "close")) req->conn_close = 1;
+        else if (http_slice_ieq(tok, "keep-alive")) req->conn_keep_alive = 1;
+        if (comma == end) break;
+        p = comma + 1;
+    }
+}
+
+/* next_token: slice up to the next space on the request line */
+static http_slice_t next_token(const char **pp, const char *end) {
+    const char *p = *pp;
+    while (p < end && *p == ' ') ++p;
+    const char *sp = find_byte(p, end, ' ');
+    *pp = sp;
+    return (http_slice_t){ p, (size_t)(sp - p) };
+}
+
+size_t http_parse_request(const char *buf, size_t len, http_request_t *req) {
+    size_t head = http_find_head_end(buf, len, NULL);
+    if (head == 0) return 0;
+
+    memset(req, 0, sizeof(*req));
+    req->head_len = head;
+    const char *end = buf + head;
+
+    /* request line: METHOD SP PATH [SP VERSION] */
+    const char *nl = find_byte(buf, end, '\n');
+    const char *line_end = nl;
+    if (line_end > buf && line_end[-1] == '\r') --line_end;
+    const char *p = buf;
+    req->method = next_token(&p, line_end);
+    req->path = next_token(&p, line_end);
+    req->version = trim(p, line_end);
+    if (req->method.len == 0 || req->path.len == 0) req->malformed = 1;
+
+    /* header lines until the blank line */
+    for (p = nl + 1; p < end;) {
+        nl = find_byte(p, end, '\n');
+        line_end = nl;
+        if (line_end > p && line_end[-1] == '\r') --line_end;
+        if (line_end == p) break; /* blank line */
+        const char *colon = find_byte(p, line_end, ':');
+        if (colon != line_end) {
+            http_slice_t name = trim(p, colon);
+            http_slice_t value = trim(colon + 1, line_end);
+            if (http_slice_ieq(name, "Connection")) connection_tokens(req, value);
+            if (req->nheaders < HTTP_MAX_HEADERS) {
+                req->headers[req->nheaders].name = name;
+                req->headers[req->nheaders].value = value;
+                req->nheaders++;
+            }
+        }
+        p = nl + 1;
+    }
+    return head;
+}
@@ -0,0 +1,62 @@
+// Zero-copy, incremental HTTP/1.x request head parser.
+//
+// Nothing is copied or NUL-terminated: the parsed request holds slices
+// (pointer + length) into the caller's receive buffer, which must stay
+// unchanged while the slices are in use. Line and delimiter scans use
+// SSE2/AVX2 (picked once at startup from the running CPU) with a scalar
+// fallback elsewhere.
+//
+// http_find_head_end:
+//  - Returns the length of the request head (through the blank line) if
+//    buf holds a complete one, 0 otherwise. If scanned is non-NULL it is a
+//    resume hint: start the search there and store how far it got, so a
+//    head trickling in over many reads is scanned once overall. Reset it to
+//    0 whenever the buffer start moves.
+//
+// http_parse_request:
+//  - Parses the head at the start of buf. Returns its length (> 0) once
+//    complete, 0 if more bytes are needed. A complete head with an unusable
+//    request line sets req->malformed; the caller should answer 400.
+//  - Connection header tokens ("close", "keep-alive", case-insensitive,
+//    comma-separated) are folded into conn_close / conn_keep_alive. Headers
+//    beyond HTTP_MAX_HEADERS are still checked for Connection, just not
+//    stored in headers[].
+#pragma once
+
+#include <stddef.h>
+
+#define HTTP_MAX_HEADERS 32
+
+typedef struct http_slice {
+    const char *p;
+    size_t len;
+} http_slice_t;
+
+typedef struct http_header {
+    http_slice_t name;
+    http_slice_t value;       /* surrounding whitespace trimmed */
+} http_header_t;
+
+typedef struct http_request {
+    http_slice_t method;
+    http_slice_t path;
+    http_slice_t version;     /* empty for a bare "GET /path" line */
+    http_header_t headers[HTTP_MAX_HEADERS];
+    size_t nheaders;
+    size_t head_len;
+    int malformed;
+    int conn_close;
+    int conn_keep_alive;
+} http_request_t;
+
+size_t http_find_head_end(const char *buf, size_t len, size_t *scanned);
+size_t http_parse_request(const char *buf, size_t len, http_request_t *req);
+
+/* http_slice_eq / http_slice_ieq: compare a slice with a C string
+   (exactly / ASCII case-insensitively) */
+int http_slice_eq(http_slice_t s, const char *lit);
+int http_slice_ieq(http_slice_t s, const char *lit);
+
+/* http_find_header: first stored header named name (case-insensitive);
+   1 and *value set if present, else 0 */
+int http_find_header(const http_request_t *req, const char *name, http_slice_t *value);
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE /* gettid */
+#include "log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_RING_SLOTS 512         /* records per thread; power of two */
+#define LOG_MSG_MAX 232            /* message bytes kept per record */
+#define LOG_BATCH_BYTES (64 * 1024) /* writer output buffer */
+#define LOG_IDLE_SLEEP_MS 10       /* writer poll interval when idle */
+
+struct log_rec {
+    uint64_t ts_ns;
+    uint32_t tid;
+    uint8_t level;
+    uint16_t len;
+    char msg[LOG_MSG_MAX];
+};
+
+/* single-producer/single-consumer ring owned by one thread; the writer is
+   the only consumer */
+struct log_ring {
+    _Atomic uint64_t head __attribute__((aligned(64)));  /* next write (producer) */
+    _Atomic uint64_t tail __attribute__((aligned(64)));  /* next read (writer) */
+    atomic_int dead;               /* owning thread exited */
+    uint32_t tid;
+    struct log_ring *next;         /* registry, under reg_lock */
+    struct log_rec recs[LOG_RING_SLOTS];
+};
+
+static struct {
+    atomic_int running;
+    int level;
+    int format;
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t reg_lock;
+    struct log_ring *rings;
+    pthread_key_t key;
+    atomic_uint_fast64_t dropped;
+    char out[LOG_BATCH_BYTES];
+} lg = { .level = LOG_LEVEL_INFO, .fd = 2, .reg_lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread struct log_ring *my_ring;
+
+static const char *level_name(int level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG: return "DEBUG";
+    case LOG_LEVEL_INFO: return "INFO";
+    case LOG_LEVEL_WARN: return "WARN";
+    default: return "ERROR";
+    }
+}
+
+int log_level_parse(const char *name) {
+    if (!name) return -1;
+    if (strcmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+    if (strcmp(name, "info") == 0) return LOG_LEVEL_INFO;
+    if (strcmp(name, "warn") == 0) return LOG_LEVEL_WARN;
+    if (strcmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+    return -1;
+}
+
+uint64_t log_dropped(void) {
+    return atomic_load_explicit(&lg.dropped, memory_order_relaxed);
+}
+
+/* write_fully: write() the whole buffer, retrying short writes and EINTR */
+static void write_fully(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+/* format_rec: render one record into dst in the configured format.
+   Returns bytes used (0 if it does not fit). */
+static size_t format_rec(char *dst, size_t cap, const struct log_rec *r, int format) {
+    if (format == LOG_FMT_BINARY) {
+        size_t need = 16 + r->len;
+        if (need > cap) return 0;
+        uint8_t zero = 0;
+        memcpy(dst, &r->ts_ns, 8);
+        memcpy(dst + 8, &r->tid, 4);
+        memcpy(dst + 12, &r->level, 1);
+        memcpy(dst + 13, &zero, 1);
+        memcpy(dst + 14, &r->len, 2);
+        memcpy(dst + 16, r->msg, r->len);
+        return need;
+    }
+    time_t secs = (time_t)(r->ts_ns / 1000000000ULL);
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    int n = snprintf(dst, cap, "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [%u] %.*s\n",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                     tm.tm_sec, (unsigned)(r->ts_ns / 1000000ULL % 1000),
+                     level_name(r->level), r->tid, (int)r->len, r->msg);
+    if (n < 0 || (size_t)n >= cap) return 0;
+    return (size_t)n;
+}
+
+static void fill_rec(struct log_rec *r, int level, const char *fmt, va_list ap) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    r->level = (uint8_t)level;
+    int n = vsnprintf(r->msg, sizeof(r->msg), fmt, ap);
+    if (n < 0) n = 0;
+    if ((size_t)n >= sizeof(r->msg)) n = sizeof(r->msg) - 1; /* truncated */
+    while (n > 0 && r->msg[n - 1] == '\n') n--;
+    r->len = (uint16_t)n;
+}
+
+/* ring_destructor: thread exit; the writer frees the ring once drained */
+static void ring_destructor(void *p) {
+    struct log_ring *ring = p;
+    atomic_store_explicit(&ring->dead, 1, memory_order_release);
+}
+
+static struct log_ring *ring_get(void) {
+    if (my_ring) return my_ring;
+    struct log_ring *ring = aligned_alloc(64, sizeof(*ring));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dead, 0);
+    ring->tid = (uint32_t)gettid();
+    pthread_mutex_lock(&lg.reg_lock);
+    ring->next = lg.rings;
+    lg.rings = ring;
+    pthread_mutex_unlock(&lg.reg_lock);
+    pthread_setspecific(lg.key, ring);
+    my_ring = ring;
+    return ring;
+}
+
+void log_write(int level, const char *fmt, ...) {
+    if (level < lg.level) return;
+    va_list ap;
+    va_start(ap, fmt);
+
+    struct log_ring *ring = atomic_load_explicit(&lg.running, memory_order_acquire) ? ring_get() : NULL;
+    if (!ring) {
+        /* no writer: format and write synchronously */
+        struct log_rec r;
+        fill_rec(&r, level, fmt, ap);
+        va_end(ap);
+        r.tid = (uint32_t)gettid();
+        char line[LOG_MSG_MAX + 64];
+        size_t n = format_rec(line, sizeof(line), &r, LOG_FMT_TEXT);
+        write_fully(lg.fd, line, n);
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOG_RING_SLOTS) {
+        va_end(ap);
+        atomic_fetch_add_explicit(&lg.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    struct log_rec *r = &ring->recs[head & (LOG_RING_SLOTS - 1)];
+    fill_rec(r, level, fmt, ap);
+    va_end(ap);
+    r->tid = ring->tid;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* drain: move every published record into the output buffer, writing it out
+   whenever it fills. Frees rings of exited threads once empty. Returns the
+   number of records emitted. */
+static size_t drain(void) {
+    size_t used = 0, nrec = 0;
+    pthread_mutex_lock(&lg.reg_lock);
+    struct log_ring **pp = &lg.rings;
+    while (*pp) {
+        struct log_ring *ring = *pp;
+        int dead = atomic_load_explicit(&ring->dead, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const struct log_rec *r = &ring->recs[tail & (LOG_RING_SLOTS - 1)];
+            size_t n = format_rec(lg.out + used, sizeof(lg.out) - used, r, lg.format);
+            if (n == 0) {
+                write_fully(lg.fd, lg.out, used);
+                used = 0;
+                n = format_rec(lg.out, sizeof(lg.out), r, lg.format);
+            }
+            used += n;
+            nrec++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        if (dead) {
+            *pp = ring->next;
+            free(ring);
+        } else {
+            pp = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&lg.reg_lock);
+    if (used) write_fully(lg.fd, lg.out, used);
+    return nrec;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    while (atomic_load(&lg.running)) {
+        if (drain() == 0) {
+            struct timespec ts = { 0, LOG_IDLE_SLEEP_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+int log_init(int level, int format, int fd) {
+    lg.level = level;
+    lg.format = format;
+    lg.fd = fd;
+    atomic_init(&lg.dropped, 0);
+    if (pthread_key_create(&lg.key, ring_destructor) != 0) return -1;
+    atomic_store(&lg.running, 1);
+    if (pthread_create(&lg.thread, NULL, writer_main, NULL) != 0) {
+        perror("pthread_create log");
+        atomic_store(&lg.running, 0);
+        pthread_key_delete(lg.key);
+        return -1;
+    }
+    return 0;
+}
+
+void log_shutdown(void) {
+    if (!atomic_load(&lg.running)) return;
+    atomic_store(&lg.running, 0);
+    pthread_join(lg.thread, NULL);
+    drain();
+    uint64_t dropped = log_dropped();
+    if (dropped) {
+        char line[96];
+        int n = snprintf(line, sizeof(line), "log: %llu records dropped (ring full)\n",
+                         (unsigned long long)dropped);
+        if (n > 0) write_fully(2, line, (size_t)n);
+    }
+    /* remaining rings belong to threads that may still log synchronously */
+    pthread_mutex_lock(&lg.reg_lock);
+    while (lg.rings) {
+        struct log_ring *ring = lg.rings;
+        lg.rings = ring->next;
+        free(ring);
+    }
+    pthread_mutex_unlock(&lg.reg_lock);
+    pthread_key_delete(lg.key);
+    my_ring = NULL;
+}
@@ -0,0 +1,67 @@
+// Asynchronous, level-filtered logging.
+//
+// Callers format into a per-thread single-producer ring (no stdio lock, no
+// syscall); a background writer thread drains every ring and emits the
+// records in batched write()s. When a ring is full the record is dropped
+// and counted rather than blocking the caller.
+//
+// Messages below LOG_COMPILE_LEVEL compile to nothing, so per-request debug
+// logging costs nothing in normal builds (`make LOG_COMPILE_LEVEL=0` keeps
+// it). Messages below the runtime level set in log_init are discarded after
+// a single compare.
+//
+// Output formats:
+//  - LOG_FMT_TEXT   : "YYYY-mm-dd HH:MM:SS.mmm LEVEL [tid] message\n"
+//  - LOG_FMT_BINARY : packed records, little-endian host order:
+//                     u64 realtime_ns, u32 tid, u8 level, u8 0, u16 len,
+//                     then len message bytes (no terminator).
+//
+// log_init:
+//  - level  : runtime threshold (LOG_LEVEL_*).
+//  - format : LOG_FMT_TEXT or LOG_FMT_BINARY.
+//  - fd     : destination descriptor (not closed by log_shutdown).
+//  - Returns 0, or -1 if the writer thread could not start (records are
+//    then written synchronously).
+//
+// log_shutdown:
+//  - Drain every ring, report dropped records, and stop the writer. Call it
+//    once the other threads have stopped; safe when log_init was never
+//    called. Later messages are written synchronously to the same fd.
+//
+// Before log_init, messages are written synchronously to stderr.
+#pragma once
+
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+
+#define LOG_FMT_TEXT   0
+#define LOG_FMT_BINARY 1
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+int log_init(int level, int format, int fd);
+void log_shutdown(void);
+
+/* log_level_parse: "debug"/"info"/"warn"/"error" -> LOG_LEVEL_*, -1 if unknown */
+int log_level_parse(const char *name);
+
+/* log_dropped: records lost to full rings so far */
+uint64_t log_dropped(void);
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_AT(lvl, ...)                                        \
+    do {                                                        \
+        if ((lvl) >= LOG_COMPILE_LEVEL) log_write((lvl), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
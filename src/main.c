@@ -1,30 +1,188 @@
-#include <arpa/inet.h>
-#include <errno.h>
-#include <netinet/in.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <fcntl.h>
 #include <time.h>
-#include <limits.h>   /* for PATH_MAX */
+#include <unistd.h>
 
-#include "net.h"
+#include "acceptor.h"
+#include "compress.h"
+#include "docroot.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "handoff.h"
+#include "http.h"
+#include "log.h"
+#include "pack.h"
+#include "sizeindex.h"
 #include "threadpool.h"
+#include "tls.h"
+#include "topology.h"
 #include "scheduler.h"
 #include "metrics.h"
+#include "reactor.h"
+
+/* get_option: value of "--name=value" on the command line, else the
+   environment variable env (may be NULL), else NULL. CLI wins over env. */
+static const char *get_option(int argc, char **argv, const char *flag, const char *env) {
+    size_t lp = strlen(flag);
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], flag, lp) == 0) return argv[i] + lp;
+    }
+    return env ? getenv(env) : NULL;
+}
+
+/* get_option_long: numeric get_option with a default */
+static long get_option_long(int argc, char **argv, const char *flag, const char *env, long def) {
+    const char *v = get_option(argc, argv, flag, env);
+    return (v && *v) ? strtol(v, NULL, 10) : def;
+}
+
+/* load_pack: serve small files from the pack image, reusing a valid image
+   unless rebuild is set; the pack in use stays if building fails */
+static void load_pack(const char *docroot, const char *image, size_t max_file, int rebuild) {
+    if (!rebuild && pack_load(docroot, image) == 0) {
+        size_t files = 0, bytes = 0;
+        pack_stats(&files, &bytes);
+        LOG_INFO("pack: mapped %s (%zu paths, %zu bytes)", image, files, bytes);
+        return;
+    }
+    long n = pack_build(docroot, image, max_file);
+    if (n < 0 || pack_load(docroot, image) != 0) {
+        LOG_WARN("pack: could not build %s", image);
+        return;
+    }
+    LOG_INFO("pack: packed %ld paths of up to %zu bytes into %s", n, max_file, image);
+}
+
+/* read_options: the whitespace-separated "--name=value" options in path
+   ('#' comments out the rest of a line) as an argv for get_option, with
+   argv[0] unused. Returns argc, or -1; the caller frees *argv and *buf. */
+static int read_options(const char *path, char **buf, char ***argv) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char *text = NULL;
+    size_t cap = 0, len = 0, n;
+    char chunk[4096];
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (len + n + 1 > cap) {
+            cap = (len + n + 1) * 2;
+            char *t = realloc(text, cap);
+            if (!t) {
+                free(text);
+                fclose(f);
+                return -1;
+            }
+            text = t;
+        }
+        memcpy(text + len, chunk, n);
+        len += n;
+    }
+    fclose(f);
+    if (!text) text = calloc(1, 1);
+    if (!text) return -1;
+    text[len] = '\0';
+
+    int argc = 1;
+    char **av = calloc(len / 2 + 2, sizeof(*av)); /* at most one option per two bytes */
+    if (!av) {
+        free(text);
+        return -1;
+    }
+    for (char *p = text; *p;) {
+        if (*p == '#') {
+            while (*p && *p != '\n') *p++ = '\0';
+        } else if (isspace((unsigned char)*p)) {
+            *p++ = '\0';
+        } else {
+            av[argc++] = p; /* ends at the next space or '#', zeroed above */
+            while (*p && !isspace((unsigned char)*p) && *p != '#') p++;
+        }
+    }
+    *buf = text;
+    *argv = av;
+    return argc;
+}
+
+/* pool settings SIGHUP may change */
+struct live_cfg {
+    char sched[16];
+    size_t min_workers, max_workers;
+};
+
+/* reload_options: apply the scheduler and pool size options of the reload
+   file to the running pool. Everything else needs a restart (use
+   --handoff for one without downtime). */
+static void reload_options(const char *path, threadpool_t *tp, const char *docroot,
+                           struct live_cfg *live) {
+    char *buf = NULL, **av = NULL;
+    int ac = read_options(path, &buf, &av);
+    if (ac < 0) {
+        LOG_WARN("reload: could not read %s", path);
+        return;
+    }
+    const char *sched = get_option(ac, av, "--scheduler=", NULL);
+    if (sched && strcmp(sched, live->sched) != 0) {
+        if (threadpool_set_scheduler_by_name(tp, sched) == 0) {
+            LOG_INFO("reload: scheduler %s -> %s", live->sched, sched);
+            snprintf(live->sched, sizeof(live->sched), "%s", sched);
+        } else {
+            LOG_WARN("reload: unknown scheduler '%s', keeping %s", sched, live->sched);
+        }
+    }
+    /* --workers=N fixes the pool; --min/--max-workers make it a range */
+    long workers = get_option_long(ac, av, "--workers=", NULL, 0);
+    size_t n = workers > 0 ? (size_t)workers : 0;
+    size_t max = (size_t)get_option_long(ac, av, "--max-workers=", NULL, n ? (long)n : (long)live->max_workers);
+    size_t min = (size_t)get_option_long(ac, av, "--min-workers=", NULL,
+                                         n ? (long)(max > n ? 1 : n) : (long)live->min_workers);
+    if (min != live->min_workers || max != live->max_workers) {
+        if (threadpool_resize(tp, min, max) == 0) {
+            LOG_INFO("reload: pool %zu-%zu -> %zu-%zu workers", live->min_workers, live->max_workers,
+                     min, max);
+            live->min_workers = min;
+            live->max_workers = max;
+        } else {
+            LOG_WARN("reload: cannot resize the pool to %zu-%zu workers", min, max);
+        }
+    }
+    const char *root = get_option(ac, av, "--docroot=", NULL);
+    if (root && strcmp(root, docroot) != 0)
+        LOG_WARN("reload: moving the docroot to %s needs a restart (see --handoff)", root);
+    free(av);
+    free(buf);
+}
 
-static volatile sig_atomic_t stop = 0;
-static void sigint_handler(int sig) { (void)sig; stop = 1; }
+/* drain: stop accepting and give open connections until deadline_ms to
+   finish (responses now close them) */
+static void drain(reactor_t *reactor, unsigned deadline_ms) {
+    reactor_drain(reactor);
+    struct timespec t0, t;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (;;) {
+        size_t open = reactor_conns(reactor);
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        long ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+        if (open == 0) {
+            LOG_INFO("drained in %ldms", ms);
+            return;
+        }
+        if (ms >= (long)deadline_ms) {
+            LOG_WARN("drain: closing %zu connection(s) still open after %ums", open, deadline_ms);
+            return;
+        }
+        usleep(20000);
+    }
+}
 
-/* monotonic ms */
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+/* metrics depth source: queued jobs across every shard of the pool */
+static size_t pool_queue_depth(void *arg) {
+    return threadpool_queue_depth((threadpool_t *)arg);
 }
 
 int main(int argc, char **argv) {
@@ -37,107 +195,342 @@ int main(int argc, char **argv) {
     if (argc >= 3) nworkers = (size_t)atoi(argv[2]);
     if (argc >= 4) docroot = argv[3];
 
-    signal(SIGINT, sigint_handler);
+    /* SIGINT/SIGTERM, SIGHUP (reload) and SIGUSR2 (drain, then exit) are
+       consumed by sigwait() in main below; block them before any thread is
+       created so workers inherit the mask. SIGPIPE is ignored so writes to
+       vanished clients fail with EPIPE instead. */
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
-    int server_fd = create_and_bind_listen(port, 128);
-    if (server_fd < 0) return 1;
+    /* asynchronous logging to stdout: --log-level=debug|info|warn|error,
+       --log-format=text|binary. Debug messages also need a build with
+       LOG_COMPILE_LEVEL=0. */
+    const char *level_name = get_option(argc, argv, "--log-level=", "LOG_LEVEL");
+    int log_level = level_name ? log_level_parse(level_name) : LOG_LEVEL_INFO;
+    if (log_level < 0) log_level = LOG_LEVEL_INFO;
+    const char *log_format = get_option(argc, argv, "--log-format=", "LOG_FORMAT");
+    int fmt = (log_format && strcmp(log_format, "binary") == 0) ? LOG_FMT_BINARY : LOG_FMT_TEXT;
+    log_init(log_level, fmt, STDOUT_FILENO);
+    if (level_name && log_level_parse(level_name) < 0)
+        LOG_WARN("unknown log level '%s', using info", level_name);
 
-    printf("Listening on port %u with %zu workers, docroot=%s\n", port, nworkers, docroot);
+    /* --shards=N splits the pool into N shared-nothing shards (own queue,
+       lock and workers); --shard-policy=rr|fd|node picks how jobs are spread */
+    size_t nshards = (size_t)get_option_long(argc, argv, "--shards=", "SHARDS", 1);
+    const char *shard_policy = get_option(argc, argv, "--shard-policy=", "SHARD_POLICY");
+    int policy = TP_SHARD_ROUND_ROBIN;
+    if (shard_policy && strcmp(shard_policy, "fd") == 0) policy = TP_SHARD_FD_HASH;
+    else if (shard_policy && strcmp(shard_policy, "node") == 0) policy = TP_SHARD_NODE;
 
-    threadpool_t *tp = threadpool_create(nworkers, queue_capacity, docroot);
+    threadpool_t *tp = threadpool_create_sharded(nworkers, queue_capacity, docroot, nshards, policy);
     if (!tp) {
-        fprintf(stderr, "failed to create threadpool\n");
-        close(server_fd);
+        LOG_ERROR("failed to create threadpool");
+        log_shutdown();
         return 1;
     }
 
-    /* start metrics/logging thread */
-    metrics_init();
+    /* --max-workers=N above the initial count lets a controller grow the
+       pool under load and park workers again (down to --min-workers) when
+       it goes quiet; --autoscale-ms sets its sampling interval. The
+       default keeps the pool fixed at the initial count. */
+    size_t max_workers = (size_t)get_option_long(argc, argv, "--max-workers=", "MAX_WORKERS", (long)nworkers);
+    size_t min_workers = (size_t)get_option_long(argc, argv, "--min-workers=", "MIN_WORKERS",
+                                                 (long)(max_workers > nworkers ? 1 : nworkers));
+    struct live_cfg live = {.min_workers = nworkers, .max_workers = nworkers};
+    if (max_workers != nworkers || min_workers != nworkers) {
+        tp_autoscale_t as = {
+            .min_workers = min_workers,
+            .max_workers = max_workers,
+            .interval_ms = (unsigned)get_option_long(argc, argv, "--autoscale-ms=", "AUTOSCALE_MS", 100),
+        };
+        if (threadpool_autoscale(tp, &as) == 0) {
+            LOG_INFO("pool autoscaling between %zu and %zu workers", min_workers, max_workers);
+            live.min_workers = min_workers;
+            live.max_workers = max_workers;
+        } else
+            LOG_WARN("pool autoscaling disabled (need min <= max workers)");
+    }
 
-    /* determine scheduler choice: CLI (--scheduler=...) overrides env SCHEDULER.
-       Supported values: "fifo" or "sjf". Default: "sjf" (to preserve current behavior). */
-    const char *sched_choice = getenv("SCHEDULER");
-    for (int i = 1; i < argc; ++i) {
-        const char *p = "--scheduler=";
-        size_t lp = strlen(p);
-        if (strncmp(argv[i], p, lp) == 0) {
-            sched_choice = argv[i] + lp;
-            break;
+    /* --affinity=1: pin every worker to a core, shards spread over the NUMA
+       nodes with their queues in node-local memory, and acceptors pinned to
+       alternating nodes (--shard-policy=node keeps their jobs there). The
+       threads started below it (reactor, metrics, watcher) inherit node 0. */
+    int affinity = (int)get_option_long(argc, argv, "--affinity=", "AFFINITY", 0);
+    if (affinity) {
+        if (topology_init() == 0 && threadpool_place(tp) == 0) {
+            if (topology_pin_node(pthread_self(), 0) != 0)
+                LOG_WARN("affinity: failed to restrict the main thread to node 0");
+            LOG_INFO("affinity: %zu NUMA node(s), %zu CPU(s) on node 0", topology_nnodes(),
+                     topology_node_cpus(0));
+        } else {
+            LOG_WARN("affinity: no CPU topology, threads are not pinned");
+            affinity = 0;
         }
     }
+
+    /* overload control: refuse new requests with a prebuilt 503 once
+       --admit-queue jobs are queued, and answer jobs that queued longer
+       than --admit-max-wait-ms (or that CoDel drops, with
+       --codel-target-ms / --codel-interval-ms) with 503 too. Off unless
+       one of the limits is set. */
+    tp_admission_t adm = {
+        .high_water = (size_t)get_option_long(argc, argv, "--admit-queue=", "ADMIT_QUEUE", 0),
+        .max_wait_ms = (unsigned)get_option_long(argc, argv, "--admit-max-wait-ms=", "ADMIT_MAX_WAIT_MS", 0),
+        .codel_target_ms = (unsigned)get_option_long(argc, argv, "--codel-target-ms=", "CODEL_TARGET_MS", 0),
+        .codel_interval_ms = (unsigned)get_option_long(argc, argv, "--codel-interval-ms=", "CODEL_INTERVAL_MS", 100),
+    };
+    threadpool_set_admission(tp, &adm);
+    http_set_retry_after((unsigned)get_option_long(argc, argv, "--retry-after=", "RETRY_AFTER", 1));
+    if (adm.high_water || adm.max_wait_ms || adm.codel_target_ms)
+        LOG_INFO("overload control: queue %zu, max wait %ums, codel target %ums/%ums",
+                 adm.high_water, adm.max_wait_ms, adm.codel_target_ms, adm.codel_interval_ms);
+
+    /* start metrics/logging thread; it samples the pool's queue depth */
+    metrics_init();
+    metrics_set_queue_depth_fn(pool_queue_depth, tp);
+
+    /* docroot directory fd: opens and stats resolve beneath it, and request
+       paths remember what they resolved to; --path-cache=0 disables that */
+    size_t path_slots = (size_t)get_option_long(argc, argv, "--path-cache=", "PATH_CACHE", 4096);
+    unsigned path_ttl = (unsigned)get_option_long(argc, argv, "--path-cache-ttl-ms=", "PATH_CACHE_TTL_MS", 1000);
+    if (docroot_init(docroot, path_slots, path_ttl) != 0)
+        LOG_WARN("docroot %s could not be opened; using plain paths", docroot);
+    else if (!docroot_confined())
+        LOG_INFO("openat2 unavailable; docroot lookups are not kernel-confined");
+
+    /* --pack=IMAGE: files up to --pack-max-file bytes are served from one
+       mapped image of the docroot (see pack.h); an existing image is
+       reused unless --pack-rebuild=1, and SIGHUP rebuilds it */
+    const char *pack_image = get_option(argc, argv, "--pack=", "PACK");
+    size_t pack_max = (size_t)get_option_long(argc, argv, "--pack-max-file=", "PACK_MAX_FILE", 16 * 1024);
+    if (pack_image && *pack_image)
+        load_pack(docroot, pack_image, pack_max,
+                  (int)get_option_long(argc, argv, "--pack-rebuild=", "PACK_REBUILD", 0));
+    else
+        pack_image = NULL;
+
+    /* path -> size index for SJF estimates, seeded from the docroot and
+       kept current with inotify; --watch-docroot=0 leaves it to the caches */
+    size_t index_slots = (size_t)get_option_long(argc, argv, "--size-index=", "SIZE_INDEX", 65536);
+    if (sizeindex_init(index_slots) != 0)
+        LOG_WARN("size index disabled (init failed)");
+    else if (get_option_long(argc, argv, "--watch-docroot=", "WATCH_DOCROOT", 1) &&
+             sizeindex_watch(docroot) != 0)
+        LOG_WARN("docroot watcher unavailable; size index fills on demand");
+
+    /* hot file cache: small files are served from memory with a prebuilt
+       header; --cache-mb=0 disables it */
+    size_t cache_mb = (size_t)get_option_long(argc, argv, "--cache-mb=", "CACHE_MB", 64);
+    size_t cache_max_file = (size_t)get_option_long(argc, argv, "--cache-max-file=", "CACHE_MAX_FILE", 64 * 1024);
+    unsigned cache_reval = (unsigned)get_option_long(argc, argv, "--cache-revalidate-ms=", "CACHE_REVALIDATE_MS", 1000);
+    if (filecache_init(cache_mb * 1024 * 1024, cache_max_file, cache_reval) != 0)
+        LOG_WARN("file cache disabled (init failed)");
+
+    /* Accept-Encoding: .br/.gz siblings, else text files up to
+       --compress-max-file compressed once into the file cache;
+       --compress=0 serves identity only */
+    compress_init((int)get_option_long(argc, argv, "--compress=", "COMPRESS", 1),
+                  (size_t)get_option_long(argc, argv, "--compress-max-file=", "COMPRESS_MAX_FILE",
+                                          1024 * 1024));
+
+    /* open-fd cache for large files served with sendfile */
+    size_t fd_cache = (size_t)get_option_long(argc, argv, "--fd-cache=", "FD_CACHE", 1024);
+    unsigned fd_ttl = (unsigned)get_option_long(argc, argv, "--fd-cache-ttl-ms=", "FD_CACHE_TTL_MS", 2000);
+    if (fdcache_init(fd_cache, fd_ttl) != 0)
+        LOG_WARN("fd cache disabled (init failed)");
+
+    /* determine scheduler choice: CLI (--scheduler=...) overrides env SCHEDULER.
+       Supported values: see scheduler_create(). Default: "sjf" (to preserve current behavior). */
+    const char *sched_choice = get_option(argc, argv, "--scheduler=", "SCHEDULER");
     if (!sched_choice) sched_choice = "sjf";
 
-    if (strcmp(sched_choice, "sjf") == 0) {
-        scheduler_t *sjf = scheduler_sjf_create(queue_capacity);
-        if (sjf) {
-            threadpool_set_scheduler(tp, sjf);
-            printf("Using SJF scheduler\n");
-        } else {
-            printf("Using FIFO scheduler (sjf create failed)\n");
-        }
-    } else if (strcmp(sched_choice, "fifo") == 0) {
-        /* threadpool_create() already set FIFO; explicit message for clarity */
-        printf("Using FIFO scheduler\n");
-    } else {
+    if (threadpool_set_scheduler_by_name(tp, sched_choice) == 0) {
+        LOG_INFO("Using %s scheduler", sched_choice);
+        snprintf(live.sched, sizeof(live.sched), "%s", sched_choice);
+    } else if (strcmp(sched_choice, "sjf") != 0 &&
+               threadpool_set_scheduler_by_name(tp, "sjf") == 0) {
         /* unknown value: warn and fall back to default (sjf) */
-        fprintf(stderr, "warning: unknown scheduler '%s', falling back to sjf\n", sched_choice);
-        scheduler_t *sjf = scheduler_sjf_create(queue_capacity);
-        if (sjf) threadpool_set_scheduler(tp, sjf);
-    }
-
-    while (!stop) {
-        struct sockaddr_in client_addr;
-        socklen_t addrlen = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &addrlen);
-        if (client_fd < 0) {
-            if (errno == EINTR) continue;
-            perror("accept");
-            break;
-        }
+        LOG_WARN("unknown scheduler '%s', falling back to sjf", sched_choice);
+        snprintf(live.sched, sizeof(live.sched), "sjf");
+    } else {
+        /* threadpool_create() already set FIFO */
+        LOG_INFO("Using FIFO scheduler (%s create failed)", sched_choice);
+        snprintf(live.sched, sizeof(live.sched), "fifo");
+    }
 
-        /* attempt to peek request headers to estimate file size (SJF est_cost) */
-        long est = 0;
-        char peek[4096];
-        ssize_t n = recv(client_fd, peek, sizeof(peek) - 1, MSG_PEEK);
-        if (n > 0) {
-            peek[n] = '\0';
-            char method[16], path[1024], ver[16] = "";
-            if (sscanf(peek, "%15s %1023s %15s", method, path, ver) >= 2) {
-                /* basic sanitize: reject .. in path for stat attempt */
-                if (strstr(path, "..") == NULL) {
-                    /* map "/" -> /index.html */
-                    char file_path[PATH_MAX];
-                    if (path[0] == '\0' || strcmp(path, "/") == 0) {
-                        snprintf(file_path, sizeof(file_path), "%s/index.html", docroot);
-                    } else {
-                        const char *p = path[0] == '/' ? path + 1 : path;
-                        snprintf(file_path, sizeof(file_path), "%s/%s", docroot, p);
-                    }
-                    struct stat st;
-                    if (stat(file_path, &st) == 0) est = (long)st.st_size;
-                }
-            }
+    /* I/O mode: "epoll" (default) lets a reactor own client sockets so idle
+       keep-alive connections don't pin workers; "uring" does the same with
+       io_uring doing all socket I/O (falls back to epoll where the kernel
+       lacks it); "blocking" hands each accepted socket to a worker for its
+       whole lifetime. */
+    const char *io_mode = get_option(argc, argv, "--io=", "IO_MODE");
+    if (!io_mode) io_mode = "epoll";
+    reactor_t *reactor = NULL;
+    if (strcmp(io_mode, "blocking") != 0) {
+        int engine = REACTOR_ENGINE_EPOLL;
+        if (strcmp(io_mode, "uring") == 0) engine = REACTOR_ENGINE_URING;
+        else if (strcmp(io_mode, "epoll") != 0)
+            LOG_WARN("unknown io mode '%s', falling back to epoll", io_mode);
+        reactor = reactor_create_engine(tp, docroot, engine);
+        if (!reactor && engine == REACTOR_ENGINE_URING) {
+            LOG_WARN("io_uring engine unavailable, falling back to epoll");
+            reactor = reactor_create(tp, docroot);
         }
+        if (!reactor) LOG_WARN("reactor create failed, using blocking io");
+    }
+    LOG_INFO("Using %s io", reactor ? reactor_engine_name(reactor) : "blocking");
 
-        job_t j = { .client_fd = client_fd,
-                    .est_cost = est,
-                    .priority = 0,
-                    .arrival_ms = now_ms() };
+    /* reactor connections are fixed-size slab objects: --conn-prealloc
+       reserves room for that many up front, --max-conns caps open
+       connections (0: no cap) */
+    if (reactor) {
+        size_t prealloc = (size_t)get_option_long(argc, argv, "--conn-prealloc=", "CONN_PREALLOC", 1024);
+        size_t max_conns = (size_t)get_option_long(argc, argv, "--max-conns=", "MAX_CONNS", 0);
+        if (reactor_set_conn_limits(reactor, prealloc, max_conns) != 0)
+            LOG_WARN("could not reserve %zu connection objects", prealloc);
+        LOG_INFO("connection objects: %zu bytes each", reactor_conn_size(reactor));
+    }
 
-        /* log estimated cost for debugging/verification */
-        printf("submit: fd=%d est=%ld\n", client_fd, est);
-        fflush(stdout);
+    /* acceptors: one listen socket, or N SO_REUSEPORT sockets each with its
+       own thread (optionally pinned) so accept() scales across cores;
+       --incoming-cpu=1 makes the kernel pick the acceptor on the CPU a
+       connection arrived on */
+    acceptor_config_t acfg = {
+        .port = port,
+        .backlog = (int)get_option_long(argc, argv, "--backlog=", "LISTEN_BACKLOG", 128),
+        .nacceptors = (size_t)get_option_long(argc, argv, "--acceptors=", "ACCEPTORS", 1),
+        .pin_cpus = (int)get_option_long(argc, argv, "--pin-acceptors=", "PIN_ACCEPTORS", affinity),
+        .incoming_cpu = (int)get_option_long(argc, argv, "--incoming-cpu=", "INCOMING_CPU", 0),
+        .docroot = docroot,
+        .tp = tp,
+        .reactor = reactor,
+    };
+    if (acfg.nacceptors < 1) acfg.nacceptors = 1;
 
-        /* metrics: record submit and whether est==0 */
-        metrics_inc_submit(est);
+    /* --tls-cert=PEM (with --tls-key=PEM unless the key is in it): HTTPS
+       on the listen sockets. Handshakes run on --tls-threads threads, then
+       kernel TLS keeps sendfile zero-copy; sessions resume from tickets
+       (--tls-tickets per handshake, keys from --tls-ticket-key to survive
+       restarts) or a --tls-session-cache of that many entries, for
+       --tls-session-timeout seconds. See tls.h. */
+    const char *tls_cert = get_option(argc, argv, "--tls-cert=", "TLS_CERT");
+    if (tls_cert && !*tls_cert) tls_cert = NULL;
+    tls_t *tls = NULL;
+    if (tls_cert) {
+        const char *tls_key = get_option(argc, argv, "--tls-key=", "TLS_KEY");
+        const char *ticket_key = get_option(argc, argv, "--tls-ticket-key=", "TLS_TICKET_KEY");
+        tls_config_t tcfg = {
+            .cert = tls_cert,
+            .key = tls_key && *tls_key ? tls_key : NULL,
+            .ticket_key = ticket_key && *ticket_key ? ticket_key : NULL,
+            .session_cache = (size_t)get_option_long(argc, argv, "--tls-session-cache=", "TLS_SESSION_CACHE", 20480),
+            .session_timeout = (unsigned)get_option_long(argc, argv, "--tls-session-timeout=", "TLS_SESSION_TIMEOUT", 3600),
+            .tickets = (unsigned)get_option_long(argc, argv, "--tls-tickets=", "TLS_TICKETS", 2),
+            .handshake_ms = (unsigned)get_option_long(argc, argv, "--tls-handshake-ms=", "TLS_HANDSHAKE_MS", 10000),
+            .nthreads = (size_t)get_option_long(argc, argv, "--tls-threads=", "TLS_THREADS", 1),
+            .deliver = acceptor_dispatch,
+            .arg = &acfg,
+        };
+        tls = tls_create(&tcfg);
+        if (tls)
+            LOG_INFO("tls: serving HTTPS with %s, %zu handshake thread(s)", tls_cert,
+                     tcfg.nthreads ? tcfg.nthreads : 1);
+        else
+            LOG_ERROR("tls: cannot serve HTTPS with %s", tls_cert);
+        acfg.tls = tls;
+    }
 
-        if (threadpool_submit_job(tp, j) != 0) {
-            close(client_fd);
+    /* --handoff=PATH: take the listen sockets over from a server running
+       with the same path (it drains and exits once ours accept), and offer
+       them to the next one in turn; see handoff.h */
+    const char *handoff_path = get_option(argc, argv, "--handoff=", "HANDOFF");
+    if (handoff_path && !*handoff_path) handoff_path = NULL;
+    int inherited[HANDOFF_MAX_FDS];
+    int handoff_peer = -1;
+    if (handoff_path) {
+        int n = handoff_take(handoff_path, inherited, HANDOFF_MAX_FDS, &handoff_peer);
+        if (n > 0) {
+            acfg.listen_fds = inherited;
+            acfg.nlisten_fds = (size_t)n;
+            LOG_INFO("handoff: took over %d listen socket(s) via %s", n, handoff_path);
+        } else if (n < 0) {
+            LOG_WARN("handoff: could not take over via %s, binding", handoff_path);
         }
     }
+    acceptor_t *acc = tls_cert && !tls ? NULL : acceptor_start(&acfg);
+    if (handoff_peer >= 0) {
+        /* without a commit the previous server keeps serving */
+        if (acc) handoff_commit(handoff_peer);
+        else close(handoff_peer);
+    }
+    if (!acc) {
+        LOG_ERROR("failed to listen on port %u", port);
+        tls_destroy(tls);
+        reactor_stop(reactor);
+        metrics_set_queue_depth_fn(NULL, NULL);
+        threadpool_destroy(tp);
+        reactor_destroy(reactor);
+        fdcache_shutdown();
+        filecache_shutdown();
+        pack_shutdown();
+        docroot_shutdown();
+        sizeindex_shutdown();
+        metrics_shutdown();
+        log_shutdown();
+        return 1;
+    }
+    LOG_INFO("Listening on port %u with %zu workers in %zu shard(s), %zu acceptor(s), backlog=%d, docroot=%s",
+           port, nworkers, threadpool_nshards(tp), acfg.nlisten_fds ? acfg.nlisten_fds : acfg.nacceptors,
+           acfg.backlog, docroot);
+    if (handoff_path) {
+        int lfds[HANDOFF_MAX_FDS];
+        size_t nl = acceptor_listen_fds(acc, lfds, HANDOFF_MAX_FDS);
+        if (nl > HANDOFF_MAX_FDS || handoff_serve(handoff_path, lfds, nl) != 0)
+            LOG_WARN("handoff: cannot offer the listen sockets at %s", handoff_path);
+    }
+
+    /* SIGHUP: re-read --reload-config (scheduler and pool size; queued
+       jobs move to a new scheduler), forget cached path lookups and
+       rebuild the pack. SIGUSR2 (also raised by a successful handoff):
+       stop accepting, let open connections finish for up to --drain-ms,
+       then exit. */
+    const char *reload_conf = get_option(argc, argv, "--reload-config=", "RELOAD_CONFIG");
+    unsigned drain_ms = (unsigned)get_option_long(argc, argv, "--drain-ms=", "DRAIN_MS", 10000);
+    int sig = 0;
+    for (;;) {
+        if (sigwait(&sigs, &sig) != 0) continue;
+        if (sig != SIGHUP) break;
+        LOG_INFO("reload");
+        if (reload_conf && *reload_conf) reload_options(reload_conf, tp, docroot, &live);
+        docroot_invalidate();
+        if (pack_image) load_pack(docroot, pack_image, pack_max, 1);
+    }
 
+    handoff_shutdown();
+    if (sig == SIGUSR2) {
+        acceptor_release(acc);
+        acc = NULL;
+        drain(reactor, drain_ms);
+    }
+    acceptor_stop(acc);
+    /* relayed TLS connections end here; the reactor closes the rest */
+    tls_destroy(tls);
+    reactor_stop(reactor);
+    metrics_set_queue_depth_fn(NULL, NULL);
     threadpool_destroy(tp);
+    reactor_destroy(reactor);
+    fdcache_shutdown();
+    filecache_shutdown();
+    pack_shutdown();
+    docroot_shutdown();
+    sizeindex_shutdown();
     metrics_shutdown();
-    close(server_fd);
+    log_shutdown();
     return 0;
 }
@@ -1,19 +1,53 @@
 #include "metrics.h"
+#include "histogram.h"
 #include <stdatomic.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
-static atomic_uint_fast64_t submits_total;
-static atomic_uint_fast64_t submits_est0;
-static atomic_uint_fast64_t pops_total;
+/* per-thread shard: written only by its owner thread with plain relaxed
+   stores, read by the reporter. Shards of exited threads are recycled,
+   never freed, so the cumulative counts they hold survive the thread.
+   The hot counters sit on their own cache line at the front; request
+   totals, bytes and errors are derived from the per-class / per-status
+   counters at snapshot time. busy/idle are only ever written by pool
+   workers; rep_busy/rep_idle are the reporter's own bookkeeping (under
+   shard_lock) for per-worker interval utilisation. */
+struct metrics_shard {
+    struct {
+        _Atomic uint64_t submits;
+        _Atomic uint64_t submits_est0;
+        _Atomic uint64_t pops;
+        _Atomic uint64_t shed[2];     /* METRICS_SHED_* */
+        _Atomic uint64_t accept_errors[2]; /* METRICS_ACCEPT_* */
+    } hot __attribute__((aligned(64)));
+    hist_t latency_us[METRICS_SIZE_CLASSES] __attribute__((aligned(64)));
+    _Atomic uint64_t status[METRICS_MAX_STATUS];
+    _Atomic uint64_t class_requests[METRICS_SIZE_CLASSES];
+    _Atomic uint64_t class_bytes[METRICS_SIZE_CLASSES];
+    hist_t queue_wait_ns __attribute__((aligned(64)));
+    hist_t service_ns;
+    hist_t queue_depth;
+    _Atomic uint64_t busy_ns;
+    _Atomic uint64_t idle_ns;
+    uint64_t rep_busy, rep_idle;      /* under shard_lock */
+    int in_use;                       /* under shard_lock */
+    struct metrics_shard *next;
+} __attribute__((aligned(64)));
 
-static atomic_uint_fast64_t requests_total;
-static atomic_uint_fast64_t bytes_total;
-static atomic_uint_fast64_t errors_total;
-static atomic_uint_fast64_t sum_latency_ms;
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_shard *shards;
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+static __thread struct metrics_shard *my_shard;
+
+static pthread_mutex_t depth_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t (*depth_fn)(void *arg);
+static void *depth_arg;
 
 static pthread_t metrics_thread;
 static atomic_int metrics_running;
@@ -24,29 +58,160 @@ static uint64_t now_ms(void) {
     return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+static void shard_release(void *p) {
+    struct metrics_shard *sh = p;
+    pthread_mutex_lock(&shard_lock);
+    sh->in_use = 0;
+    pthread_mutex_unlock(&shard_lock);
+}
+
+static void shard_key_init(void) {
+    pthread_key_create(&shard_key, shard_release);
+}
+
+/* shard_get: this thread's shard, adopting a retired one or allocating */
+static struct metrics_shard *shard_get(void) {
+    if (my_shard) return my_shard;
+    pthread_once(&shard_key_once, shard_key_init);
+    pthread_mutex_lock(&shard_lock);
+    struct metrics_shard *sh = shards;
+    while (sh && sh->in_use) sh = sh->next;
+    if (!sh) {
+        sh = aligned_alloc(64, sizeof(*sh));
+        if (!sh) {
+            pthread_mutex_unlock(&shard_lock);
+            return NULL;
+        }
+        memset(sh, 0, sizeof(*sh));
+        sh->next = shards;
+        shards = sh;
+    }
+    sh->in_use = 1;
+    pthread_mutex_unlock(&shard_lock);
+    pthread_setspecific(shard_key, sh);
+    my_shard = sh;
+    return sh;
+}
+
+static void bump(_Atomic uint64_t *c, uint64_t by) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + by,
+                          memory_order_relaxed);
+}
+
+static int size_class(uint64_t bytes) {
+    return bytes > METRICS_SMALL_MAX_BYTES ? METRICS_CLASS_BIG : METRICS_CLASS_SMALL;
+}
+
+void metrics_snapshot(metrics_snapshot_t *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&shard_lock);
+    for (struct metrics_shard *sh = shards; sh; sh = sh->next) {
+        out->submits += atomic_load_explicit(&sh->hot.submits, memory_order_relaxed);
+        out->submits_est0 += atomic_load_explicit(&sh->hot.submits_est0, memory_order_relaxed);
+        out->pops += atomic_load_explicit(&sh->hot.pops, memory_order_relaxed);
+        out->shed_admit += atomic_load_explicit(&sh->hot.shed[METRICS_SHED_ADMIT], memory_order_relaxed);
+        out->shed_queue += atomic_load_explicit(&sh->hot.shed[METRICS_SHED_QUEUE], memory_order_relaxed);
+        out->accept_errors += atomic_load_explicit(&sh->hot.accept_errors[METRICS_ACCEPT_RETRY], memory_order_relaxed);
+        out->accept_fatal += atomic_load_explicit(&sh->hot.accept_errors[METRICS_ACCEPT_FATAL], memory_order_relaxed);
+        for (int c = 0; c < METRICS_SIZE_CLASSES; ++c) {
+            hist_snapshot_add(&out->latency_us[c], &sh->latency_us[c]);
+            out->class_requests[c] += atomic_load_explicit(&sh->class_requests[c], memory_order_relaxed);
+            out->class_bytes[c] += atomic_load_explicit(&sh->class_bytes[c], memory_order_relaxed);
+        }
+        for (int i = 0; i < METRICS_MAX_STATUS; ++i)
+            out->status[i] += atomic_load_explicit(&sh->status[i], memory_order_relaxed);
+        hist_snapshot_add(&out->queue_wait_ns, &sh->queue_wait_ns);
+        hist_snapshot_add(&out->service_ns, &sh->service_ns);
+        hist_snapshot_add(&out->queue_depth, &sh->queue_depth);
+        out->busy_ns += atomic_load_explicit(&sh->busy_ns, memory_order_relaxed);
+        out->idle_ns += atomic_load_explicit(&sh->idle_ns, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&shard_lock);
+
+    pthread_mutex_lock(&depth_lock);
+    if (depth_fn) out->queue_depth_now = depth_fn(depth_arg);
+    pthread_mutex_unlock(&depth_lock);
+
+    for (int c = 0; c < METRICS_SIZE_CLASSES; ++c) {
+        out->requests += out->class_requests[c];
+        out->bytes += out->class_bytes[c];
+    }
+    for (int i = 0; i < METRICS_MAX_STATUS; ++i)
+        if (i < 200 || i >= 400) out->errors += out->status[i];
+}
+
+/* merge_classes: one histogram over every size class */
+static void merge_classes(hist_snapshot_t *all, const metrics_snapshot_t *s) {
+    memset(all, 0, sizeof(*all));
+    for (int c = 0; c < METRICS_SIZE_CLASSES; ++c) {
+        const hist_snapshot_t *h = &s->latency_us[c];
+        for (int i = 0; i < HIST_BUCKETS; ++i) all->counts[i] += h->counts[i];
+        all->total += h->total;
+        all->sum += h->sum;
+        if (h->max > all->max) all->max = h->max;
+    }
+}
+
+/* worker_util: busy share of each worker over the interval since the last
+   call, as min/max over workers that did anything; returns that count */
+static int worker_util(double *min, double *max) {
+    int n = 0;
+    *min = *max = 0.0;
+    pthread_mutex_lock(&shard_lock);
+    for (struct metrics_shard *sh = shards; sh; sh = sh->next) {
+        uint64_t busy = atomic_load_explicit(&sh->busy_ns, memory_order_relaxed);
+        uint64_t idle = atomic_load_explicit(&sh->idle_ns, memory_order_relaxed);
+        uint64_t db = busy - sh->rep_busy, di = idle - sh->rep_idle;
+        sh->rep_busy = busy;
+        sh->rep_idle = idle;
+        if (db + di == 0) continue;
+        double u = 100.0 * (double)db / (double)(db + di);
+        if (n == 0 || u < *min) *min = u;
+        if (n == 0 || u > *max) *max = u;
+        n++;
+    }
+    pthread_mutex_unlock(&shard_lock);
+    return n;
+}
+
 static void *metrics_thread_fn(void *arg) {
     (void)arg;
     uint64_t prev_reqs = 0, prev_bytes = 0;
     const int interval = 5; /* seconds */
+    /* snapshots are large; keep them off the stack */
+    metrics_snapshot_t *cur = calloc(1, sizeof(*cur));
+    metrics_snapshot_t *prev = calloc(1, sizeof(*prev));
+    hist_snapshot_t *win = calloc(1, sizeof(*win));
+    hist_snapshot_t *win_prev = calloc(1, sizeof(*win_prev));
+    if (!cur || !prev || !win || !win_prev) {
+        perror("metrics snapshot alloc");
+        free(cur);
+        free(prev);
+        free(win);
+        free(win_prev);
+        return NULL;
+    }
     while (atomic_load(&metrics_running)) {
         sleep(interval);
-        uint64_t reqs = atomic_load(&requests_total);
-        uint64_t bytes = atomic_load(&bytes_total);
-        uint64_t errs = atomic_load(&errors_total);
-        uint64_t sumlat = atomic_load(&sum_latency_ms);
-        uint64_t subs = atomic_load(&submits_total);
-        uint64_t subs0 = atomic_load(&submits_est0);
-        uint64_t pops = atomic_load(&pops_total);
+        metrics_snapshot(cur);
+        merge_classes(win, cur);
+        /* cumulative average, from the microsecond histogram sums */
+        double avg_latency = win->total ? (double)win->sum / (double)win->total / 1000.0 : 0.0;
+        uint64_t reqs = cur->requests;
+        uint64_t bytes = cur->bytes;
+        uint64_t errs = cur->errors;
+        uint64_t subs = cur->submits;
+        uint64_t subs0 = cur->submits_est0;
+        uint64_t pops = cur->pops;
 
         uint64_t delta_reqs = reqs - prev_reqs;
         uint64_t delta_bytes = bytes - prev_bytes;
         double reqs_per_s = (double)delta_reqs / interval;
         double mb_per_s = ((double)delta_bytes / (1024.0 * 1024.0)) / interval;
-        double avg_latency = reqs ? ((double)sumlat / (double)reqs) : 0.0;
         double est0_frac = subs ? ((double)subs0 / (double)subs) * 100.0 : 0.0;
 
         fprintf(stderr,
-                "[metrics] ts=%llu reqs_total=%llu req/s=%.2f MB/s=%.2f avgLat=%.2fms errors=%llu submits=%llu est0%%=%.1f pops=%llu\n",
+                "[metrics] ts=%llu reqs_total=%llu req/s=%.2f MB/s=%.2f avgLat=%.2fms errors=%llu submits=%llu est0%%=%.1f pops=%llu shed=%llu dropped=%llu\n",
                 (unsigned long long)now_ms(),
                 (unsigned long long)reqs,
                 reqs_per_s,
@@ -55,23 +220,77 @@ static void *metrics_thread_fn(void *arg) {
                 (unsigned long long)errs,
                 (unsigned long long)subs,
                 est0_frac,
-                (unsigned long long)pops);
+                (unsigned long long)pops,
+                (unsigned long long)cur->shed_admit,
+                (unsigned long long)cur->shed_queue);
+
+        /* latency percentiles over the last interval, overall and per size
+           class, plus cumulative status counts */
+        merge_classes(win_prev, prev);
+        hist_snapshot_sub(win, win_prev);
+        hist_snapshot_t small = cur->latency_us[METRICS_CLASS_SMALL];
+        hist_snapshot_t big = cur->latency_us[METRICS_CLASS_BIG];
+        hist_snapshot_sub(&small, &prev->latency_us[METRICS_CLASS_SMALL]);
+        hist_snapshot_sub(&big, &prev->latency_us[METRICS_CLASS_BIG]);
+        fprintf(stderr,
+                "[metrics] lat_us p50=%llu p90=%llu p99=%llu p999=%llu max=%llu | small n=%llu p99=%llu | big n=%llu p99=%llu\n",
+                (unsigned long long)hist_percentile(win, 0.50),
+                (unsigned long long)hist_percentile(win, 0.90),
+                (unsigned long long)hist_percentile(win, 0.99),
+                (unsigned long long)hist_percentile(win, 0.999),
+                (unsigned long long)win->max,
+                (unsigned long long)small.total,
+                (unsigned long long)hist_percentile(&small, 0.99),
+                (unsigned long long)big.total,
+                (unsigned long long)hist_percentile(&big, 0.99));
+        char line[512];
+        int len = snprintf(line, sizeof(line), "[metrics] status");
+        for (int i = 0; i < METRICS_MAX_STATUS && len < (int)sizeof(line) - 24; ++i) {
+            if (cur->status[i])
+                len += snprintf(line + len, sizeof(line) - (size_t)len, " %d=%llu", i,
+                                (unsigned long long)cur->status[i]);
+        }
+        fprintf(stderr, "%s\n", line);
+
+        /* scheduler view over the interval: queueing delay vs service
+           time, pool utilisation and how deep the queues ran */
+        hist_snapshot_t wait = cur->queue_wait_ns, svc = cur->service_ns, depth = cur->queue_depth;
+        hist_snapshot_sub(&wait, &prev->queue_wait_ns);
+        hist_snapshot_sub(&svc, &prev->service_ns);
+        hist_snapshot_sub(&depth, &prev->queue_depth);
+        uint64_t dbusy = cur->busy_ns - prev->busy_ns, didle = cur->idle_ns - prev->idle_ns;
+        double busy_pct = dbusy + didle ? 100.0 * (double)dbusy / (double)(dbusy + didle) : 0.0;
+        double umin, umax;
+        int nworkers = worker_util(&umin, &umax);
+        fprintf(stderr,
+                "[metrics] sched jobs=%llu wait_ns p50=%llu p99=%llu max=%llu | service_ns p50=%llu p99=%llu"
+                " | busy%%=%.1f min=%.1f max=%.1f workers=%d | depth now=%llu p99=%llu max=%llu\n",
+                (unsigned long long)wait.total,
+                (unsigned long long)hist_percentile(&wait, 0.50),
+                (unsigned long long)hist_percentile(&wait, 0.99),
+                (unsigned long long)wait.max,
+                (unsigned long long)hist_percentile(&svc, 0.50),
+                (unsigned long long)hist_percentile(&svc, 0.99),
+                busy_pct, umin, umax, nworkers,
+                (unsigned long long)cur->queue_depth_now,
+                (unsigned long long)hist_percentile(&depth, 0.99),
+                (unsigned long long)depth.max);
         fflush(stderr);
 
+        metrics_snapshot_t *t = prev;
+        prev = cur;
+        cur = t;
         prev_reqs = reqs;
         prev_bytes = bytes;
     }
+    free(cur);
+    free(prev);
+    free(win);
+    free(win_prev);
     return NULL;
 }
 
 int metrics_init(void) {
-    atomic_init(&submits_total, 0);
-    atomic_init(&submits_est0, 0);
-    atomic_init(&pops_total, 0);
-    atomic_init(&requests_total, 0);
-    atomic_init(&bytes_total, 0);
-    atomic_init(&errors_total, 0);
-    atomic_init(&sum_latency_ms, 0);
     atomic_store(&metrics_running, 1);
     if (pthread_create(&metrics_thread, NULL, metrics_thread_fn, NULL) != 0) {
         perror("metrics thread create");
@@ -86,19 +305,54 @@ void metrics_shutdown(void) {
     pthread_join(metrics_thread, NULL);
 }
 
-void metrics_record_request(uint64_t latency_ms, uint64_t bytes, int status) {
-    atomic_fetch_add(&requests_total, 1);
-    atomic_fetch_add(&bytes_total, bytes);
-    atomic_fetch_add(&sum_latency_ms, latency_ms);
-    if (status < 200 || status >= 400) atomic_fetch_add(&errors_total, 1);
+void metrics_record_request(uint64_t latency_us, uint64_t bytes, int status) {
+    struct metrics_shard *sh = shard_get();
+    if (!sh) return;
+    int c = size_class(bytes);
+    hist_record(&sh->latency_us[c], latency_us);
+    bump(&sh->class_requests[c], 1);
+    bump(&sh->class_bytes[c], bytes);
+    if (status < 0 || status >= METRICS_MAX_STATUS) status = 0;
+    bump(&sh->status[status], 1);
+}
+
+void metrics_record_job(uint64_t wait_ns, uint64_t service_ns, uint64_t idle_ns, size_t depth) {
+    struct metrics_shard *sh = shard_get();
+    if (!sh) return;
+    hist_record(&sh->queue_wait_ns, wait_ns);
+    hist_record(&sh->service_ns, service_ns);
+    hist_record(&sh->queue_depth, depth);
+    bump(&sh->busy_ns, service_ns);
+    bump(&sh->idle_ns, idle_ns);
+}
+
+void metrics_set_queue_depth_fn(size_t (*fn)(void *arg), void *arg) {
+    pthread_mutex_lock(&depth_lock);
+    depth_fn = fn;
+    depth_arg = arg;
+    pthread_mutex_unlock(&depth_lock);
 }
 
 void metrics_inc_submit(long est) {
-    atomic_fetch_add(&submits_total, 1);
-    if (est <= 0) atomic_fetch_add(&submits_est0, 1);
+    struct metrics_shard *sh = shard_get();
+    if (!sh) return;
+    bump(&sh->hot.submits, 1);
+    if (est <= 0) bump(&sh->hot.submits_est0, 1);
 }
 
 void metrics_inc_pop(long est) {
     (void)est;
-    atomic_fetch_add(&pops_total, 1);
-}
\ No newline at end of file
+    struct metrics_shard *sh = shard_get();
+    if (sh) bump(&sh->hot.pops, 1);
+}
+
+void metrics_inc_shed(int where) {
+    struct metrics_shard *sh = shard_get();
+    if (sh && (where == METRICS_SHED_ADMIT || where == METRICS_SHED_QUEUE)) bump(&sh->hot.shed[where], 1);
+}
+
+void metrics_inc_accept_error(int where) {
+    struct metrics_shard *sh = shard_get();
+    if (sh && (where == METRICS_ACCEPT_RETRY || where == METRICS_ACCEPT_FATAL))
+        bump(&sh->hot.accept_errors[where], 1);
+}
@@ -1,6 +1,44 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
+#include "histogram.h"
+
+/* responses up to this many bytes count as "small" (the file cache's
+   default max file size), larger ones as "big" */
+#define METRICS_SMALL_MAX_BYTES (64 * 1024)
+#define METRICS_CLASS_SMALL 0
+#define METRICS_CLASS_BIG 1
+#define METRICS_SIZE_CLASSES 2
+#define METRICS_MAX_STATUS 600   /* status codes are counted directly by value */
+
+/* merged view of the per-thread shards (cumulative since start). Every
+   recording thread owns a cache-line aligned shard, so recording is a plain
+   store; the sums below are only computed here. */
+typedef struct metrics_snapshot {
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t errors;          /* responses with status < 200 or >= 400 */
+    uint64_t submits;
+    uint64_t submits_est0;
+    uint64_t pops;
+    uint64_t shed_admit;      /* refused at submit (over the high-water mark) */
+    uint64_t shed_queue;      /* dropped after queueing too long (CoDel/max wait) */
+    uint64_t accept_errors;   /* accept() failures retried after a back-off */
+    uint64_t accept_fatal;    /* acceptors stopped by an unusable listen socket */
+    hist_snapshot_t latency_us[METRICS_SIZE_CLASSES];
+    uint64_t status[METRICS_MAX_STATUS];
+    uint64_t class_requests[METRICS_SIZE_CLASSES];
+    uint64_t class_bytes[METRICS_SIZE_CLASSES];
+    /* worker-side scheduling view, nanoseconds (see metrics_record_job) */
+    hist_snapshot_t queue_wait_ns;
+    hist_snapshot_t service_ns;
+    hist_snapshot_t queue_depth;  /* depth left behind, sampled at each pop */
+    uint64_t busy_ns;
+    uint64_t idle_ns;
+    uint64_t queue_depth_now;     /* from the metrics_set_queue_depth_fn source */
+} metrics_snapshot_t;
+
 /* Initialize metrics subsystem (starts background printer). */
 int metrics_init(void);
 
@@ -8,14 +46,46 @@ int metrics_init(void);
 void metrics_shutdown(void);
 
 /* Record a completed request.
-   - latency_ms: request handling latency in milliseconds
-   - bytes: number of response bytes sent (approx)
+   - latency_us: request handling latency in microseconds
+   - bytes: response bytes (headers + body) written
    - status: HTTP status code (200, 404, 500, ...)
+   Latency goes into a per-thread log-linear histogram for its size class;
+   the reporter merges all threads and prints p50/p90/p99/p999.
 */
-void metrics_record_request(uint64_t latency_ms, uint64_t bytes, int status);
+void metrics_record_request(uint64_t latency_us, uint64_t bytes, int status);
+
+/* Record one job served by a pool worker.
+   - wait_ns: time between submit and pop (queueing delay)
+   - service_ns: time the worker spent in the job
+   - idle_ns: time the worker waited for this job since its previous one
+   - depth: jobs still queued right after the pop
+   busy/idle totals are kept per worker so the reporter can show each
+   worker's utilisation, not just the pool average. */
+void metrics_record_job(uint64_t wait_ns, uint64_t service_ns, uint64_t idle_ns, size_t depth);
+
+/* Register the source of the current queue depth (e.g. a wrapper around
+   threadpool_queue_depth). Pass NULL to unregister; do so before the
+   source goes away, since the reporter calls fn from its own thread. */
+void metrics_set_queue_depth_fn(size_t (*fn)(void *arg), void *arg);
+
+/* Fill out with the current cumulative counters and histograms. */
+void metrics_snapshot(metrics_snapshot_t *out);
 
 /* Called when a job is submitted (est may be 0 if unknown). */
 void metrics_inc_submit(long est);
 
 /* Called when a job is popped by a worker (est passed through). */
-void metrics_inc_pop(long est);
\ No newline at end of file
+void metrics_inc_pop(long est);
+
+/* Called when overload control answers a job with 503 instead of serving
+   it: METRICS_SHED_ADMIT at submit, METRICS_SHED_QUEUE after queueing. */
+#define METRICS_SHED_ADMIT 0
+#define METRICS_SHED_QUEUE 1
+void metrics_inc_shed(int where);
+
+/* Called when accept() fails: METRICS_ACCEPT_RETRY for errors the acceptor
+   backs off from, METRICS_ACCEPT_FATAL when its listen socket is unusable
+   and the acceptor thread stops. */
+#define METRICS_ACCEPT_RETRY 0
+#define METRICS_ACCEPT_FATAL 1
+void metrics_inc_accept_error(int where);
@@ -0,0 +1,176 @@
+#include "metrics_prom.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "histogram.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROM_PREFIX "httpd_"
+
+/* growable output buffer; oom latches the first allocation failure */
+struct pbuf {
+    char *p;
+    size_t len, cap;
+    int oom;
+};
+
+static void pb_printf(struct pbuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void pb_printf(struct pbuf *b, const char *fmt, ...) {
+    if (b->oom) return;
+    while (1) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < b->cap - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+        size_t cap = b->cap * 2;
+        while (cap - b->len <= (size_t)n) cap *= 2;
+        char *p = realloc(b->p, cap);
+        if (!p) {
+            b->oom = 1;
+            return;
+        }
+        b->p = p;
+        b->cap = cap;
+    }
+}
+
+static void pb_meta(struct pbuf *b, const char *name, const char *type, const char *help) {
+    pb_printf(b, "# HELP " PROM_PREFIX "%s %s\n# TYPE " PROM_PREFIX "%s %s\n", name, help, name, type);
+}
+
+static void pb_counter(struct pbuf *b, const char *name, const char *help, uint64_t v) {
+    pb_meta(b, name, "counter", help);
+    pb_printf(b, PROM_PREFIX "%s %llu\n", name, (unsigned long long)v);
+}
+
+static void pb_gauge(struct pbuf *b, const char *name, const char *help, double v) {
+    pb_meta(b, name, "gauge", help);
+    pb_printf(b, PROM_PREFIX "%s %.6g\n", name, v);
+}
+
+/* bucket bounds in seconds: 1us .. 10s on a 1-2.5-5 ladder */
+static const double prom_bounds_s[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+    1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0,
+};
+#define PROM_NBOUNDS (sizeof(prom_bounds_s) / sizeof(prom_bounds_s[0]))
+
+/* pb_hist: emit the series of one histogram. unit_s is the size of one
+   recorded unit in seconds (1e-6 for us, 1e-9 for ns); labels is either ""
+   or a `key="value",` prefix. */
+static void pb_hist(struct pbuf *b, const char *name, const char *labels,
+                    const hist_snapshot_t *h, double unit_s) {
+    uint64_t cum = 0;
+    int i = 0;
+    for (size_t k = 0; k < PROM_NBOUNDS; ++k) {
+        /* integer bound in recorded units: buckets at or below it count */
+        uint64_t bound = (uint64_t)(prom_bounds_s[k] / unit_s + 0.5);
+        while (i < HIST_BUCKETS && hist_bucket_upper(i) <= bound) cum += h->counts[i++];
+        pb_printf(b, PROM_PREFIX "%s_bucket{%sle=\"%g\"} %llu\n", name, labels,
+                  prom_bounds_s[k], (unsigned long long)cum);
+    }
+    pb_printf(b, PROM_PREFIX "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels,
+              (unsigned long long)h->total);
+    /* strip the trailing comma for the _sum/_count label sets */
+    size_t ll = strlen(labels);
+    pb_printf(b, PROM_PREFIX "%s_sum%s%.*s%s %.9g\n", name, ll ? "{" : "",
+              (int)(ll ? ll - 1 : 0), labels, ll ? "}" : "", (double)h->sum * unit_s);
+    pb_printf(b, PROM_PREFIX "%s_count%s%.*s%s %llu\n", name, ll ? "{" : "",
+              (int)(ll ? ll - 1 : 0), labels, ll ? "}" : "", (unsigned long long)h->total);
+}
+
+static double ratio(uint64_t hits, uint64_t misses) {
+    return hits + misses ? (double)hits / (double)(hits + misses) : 0.0;
+}
+
+char *metrics_prom_render(size_t *len) {
+    /* the snapshot holds several full histograms; keep it off the stack */
+    metrics_snapshot_t *s = malloc(sizeof(*s));
+    struct pbuf b = {.p = malloc(16384), .len = 0, .cap = 16384, .oom = 0};
+    if (!s || !b.p) {
+        free(s);
+        free(b.p);
+        return NULL;
+    }
+    metrics_snapshot(s);
+    static const char *class_names[METRICS_SIZE_CLASSES] = {"small", "big"};
+
+    pb_meta(&b, "requests_total", "counter", "Requests answered, by response size class.");
+    for (int c = 0; c < METRICS_SIZE_CLASSES; ++c)
+        pb_printf(&b, PROM_PREFIX "requests_total{class=\"%s\"} %llu\n", class_names[c],
+                  (unsigned long long)s->class_requests[c]);
+    pb_meta(&b, "response_bytes_total", "counter", "Response bytes (headers and body), by size class.");
+    for (int c = 0; c < METRICS_SIZE_CLASSES; ++c)
+        pb_printf(&b, PROM_PREFIX "response_bytes_total{class=\"%s\"} %llu\n", class_names[c],
+                  (unsigned long long)s->class_bytes[c]);
+    pb_meta(&b, "responses_total", "counter", "Responses by HTTP status code.");
+    for (int i = 0; i < METRICS_MAX_STATUS; ++i)
+        if (s->status[i])
+            pb_printf(&b, PROM_PREFIX "responses_total{code=\"%d\"} %llu\n", i,
+                      (unsigned long long)s->status[i]);
+    pb_counter(&b, "errors_total", "Responses with status < 200 or >= 400.", s->errors);
+
+    pb_meta(&b, "request_duration_seconds", "histogram", "Request handling latency, by size class.");
+    for (int c = 0; c < METRICS_SIZE_CLASSES; ++c) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "class=\"%s\",", class_names[c]);
+        pb_hist(&b, "request_duration_seconds", labels, &s->latency_us[c], 1e-6);
+    }
+
+    pb_counter(&b, "sched_submits_total", "Jobs submitted to the worker pool.", s->submits);
+    pb_counter(&b, "sched_submits_unknown_cost_total", "Jobs submitted without a size estimate.",
+               s->submits_est0);
+    pb_counter(&b, "sched_pops_total", "Jobs taken by workers.", s->pops);
+    pb_counter(&b, "sched_shed_total", "Jobs refused with 503 at submit (queue over its high-water mark).",
+               s->shed_admit);
+    pb_counter(&b, "sched_dropped_total", "Queued jobs answered with 503 after waiting too long.",
+               s->shed_queue);
+    pb_counter(&b, "accept_errors_total", "accept() failures retried after a back-off.", s->accept_errors);
+    pb_counter(&b, "acceptors_failed_total", "Acceptor threads stopped by an unusable listen socket.",
+               s->accept_fatal);
+    pb_meta(&b, "sched_queue_wait_seconds", "histogram", "Time jobs spent queued before a worker took them.");
+    pb_hist(&b, "sched_queue_wait_seconds", "", &s->queue_wait_ns, 1e-9);
+    pb_meta(&b, "sched_service_seconds", "histogram", "Time workers spent serving a job.");
+    pb_hist(&b, "sched_service_seconds", "", &s->service_ns, 1e-9);
+    pb_gauge(&b, "sched_queue_depth", "Jobs currently queued.", (double)s->queue_depth_now);
+    pb_gauge(&b, "sched_queue_depth_max", "Deepest queue left behind by a pop since start.",
+             (double)s->queue_depth.max);
+    pb_counter(&b, "worker_busy_nanoseconds_total", "Time workers spent serving jobs.", s->busy_ns);
+    pb_counter(&b, "worker_idle_nanoseconds_total", "Time workers spent waiting for jobs.", s->idle_ns);
+
+    uint64_t hits, misses, evictions, bytes;
+    filecache_stats(&hits, &misses, &evictions, &bytes);
+    pb_counter(&b, "filecache_hits_total", "In-memory file cache hits.", hits);
+    pb_counter(&b, "filecache_misses_total", "In-memory file cache misses.", misses);
+    pb_counter(&b, "filecache_evictions_total", "In-memory file cache evictions.", evictions);
+    pb_gauge(&b, "filecache_bytes", "Bytes held by the in-memory file cache.", (double)bytes);
+    pb_gauge(&b, "filecache_hit_ratio", "File cache hits / lookups since start.", ratio(hits, misses));
+    uint64_t fd_hits, fd_misses, open_fds;
+    fdcache_stats(&fd_hits, &fd_misses, &open_fds);
+    pb_counter(&b, "fdcache_hits_total", "Open-descriptor cache hits.", fd_hits);
+    pb_counter(&b, "fdcache_misses_total", "Open-descriptor cache misses.", fd_misses);
+    pb_gauge(&b, "fdcache_open_fds", "Descriptors held open by the fd cache.", (double)open_fds);
+    pb_gauge(&b, "fdcache_hit_ratio", "Fd cache hits / lookups since start.", ratio(fd_hits, fd_misses));
+
+    pb_counter(&b, "log_dropped_total", "Log records dropped because a ring was full.", log_dropped());
+
+    free(s);
+    if (b.oom) {
+        free(b.p);
+        return NULL;
+    }
+    *len = b.len;
+    return b.p;
+}
@@ -0,0 +1,21 @@
+// Prometheus text exposition of the server's metrics.
+//
+// The body is rendered from one metrics_snapshot plus the cache and logger
+// counters; nothing touches the filesystem. Histograms are exported with a
+// fixed, coarse set of `le` bounds derived from the log-linear buckets, so
+// a scrape stays a few KiB however many buckets are populated. Each bound
+// counts the buckets lying entirely below it, so counts may lag the true
+// cumulative value by one bucket width (~3%).
+//
+// metrics_prom_render:
+//  - Returns a malloc'd, NUL-terminated body and stores its length in *len,
+//    or NULL on allocation failure. The caller frees it.
+//  - Cost is one metrics_snapshot (a pass over the per-thread shards under
+//    the registry lock); recording threads are never blocked.
+#pragma once
+
+#include <stddef.h>
+
+#define METRICS_PROM_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+char *metrics_prom_render(size_t *len);
@@ -3,6 +3,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +16,10 @@
    - bind to INADDR_ANY and start listening with the provided backlog
    - returns the listening file descriptor on success or -1 on error */
 int create_and_bind_listen(uint16_t port, int backlog) {
+    return create_and_bind_listen_ex(port, backlog, 0);
+}
+
+int create_and_bind_listen_ex(uint16_t port, int backlog, int flags) {
     /* create a TCP socket (IPv4) */
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -30,6 +35,23 @@ int create_and_bind_listen(uint16_t port, int backlog) {
         return -1;
     }
 
+    /* SO_REUSEPORT: each acceptor gets its own socket and accept queue */
+    if ((flags & NET_LISTEN_REUSEPORT) &&
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(server_fd);
+        return -1;
+    }
+
+    /* TCP_DEFER_ACCEPT: only wake accept() once request data has arrived.
+       Best effort; a failure just means the old behaviour. */
+    if (flags & NET_LISTEN_DEFER_ACCEPT) {
+        int secs = 1;
+        if (setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &secs, sizeof(secs)) < 0) {
+            perror("setsockopt TCP_DEFER_ACCEPT");
+        }
+    }
+
     /* prepare sockaddr struct for bind() */
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -17,8 +17,22 @@
 //        extend the implementation in src/net.c.
 //      - Caller is responsible for closing the returned FD and for any
 //        further socket options (e.g., non-blocking mode).
+//
+// create_and_bind_listen_ex:
+//  - Same as create_and_bind_listen with extra NET_LISTEN_* flags:
+//      NET_LISTEN_REUSEPORT : set SO_REUSEPORT before bind() so several
+//                             sockets (one per acceptor thread) can share
+//                             the port; the kernel load-balances new
+//                             connections across them.
+//      NET_LISTEN_DEFER_ACCEPT : set TCP_DEFER_ACCEPT so accept() returns
+//                             once the client has sent data, letting the
+//                             caller peek the request without blocking.
 #pragma once
 
 #include <stdint.h>
 
+#define NET_LISTEN_REUSEPORT 0x1
+#define NET_LISTEN_DEFER_ACCEPT 0x2
+
 int create_and_bind_listen(uint16_t port, int backlog);
+int create_and_bind_listen_ex(uint16_t port, int backlog, int flags);
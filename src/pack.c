@@ -0,0 +1,571 @@
+#include "pack.h"
+#include "docroot.h"
+#include "validators.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PACK_MAGIC "HTTPDPK1"
+#define PACK_VERSION 1
+#define PACK_SHARDS 16
+#define PACK_MAX_DEPTH 16
+#define PACK_MAX_DISP (1u << 16)   /* displacements tried per bucket */
+#define PACK_SEED_TRIES 16
+
+/* image layout: header, then file data (body, header text, path per file),
+   the docroot string, the displacement table and the slot records */
+struct pack_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;             /* sizeof(struct pack_rec): layout check */
+    uint64_t seed;
+    uint32_t nrecs;                /* records in use, aliases included */
+    uint32_t nslots;
+    uint32_t nbuckets;
+    uint32_t root_len;
+    uint64_t root_off, disp_off, slots_off;
+    uint64_t size;                 /* whole image */
+};
+
+/* one slot of the perfect hash; path_len 0 marks an empty slot */
+struct pack_rec {
+    uint64_t hash;
+    uint64_t path_off, hdr_off, body_off, body_len;
+    uint32_t path_len, hdr_len;
+    uint32_t validators_off, validators_len;  /* inside the header text */
+    uint32_t etag_off, etag_len;              /* inside the header text */
+    int64_t mtime;
+};
+
+/* a mapped image; see pack_lookup for the reference scheme */
+struct pack;
+
+struct pack_entry {
+    fc_entry_t pub;
+    struct pack *pack;
+    const char *path;              /* docroot-relative, NUL-terminated */
+    unsigned shard;
+};
+
+struct pack {
+    char *map;
+    size_t size;
+    const struct pack_header *hdr;
+    const struct pack_rec *recs;
+    const uint32_t *disp;
+    struct pack_entry *entries;    /* nslots, parallel to recs */
+    char *root;
+    size_t root_len;
+    size_t files, bytes;
+    /* shard s is live while it still points at this pack or holds
+       references to it; the last shard to go unmaps */
+    atomic_int live;
+    unsigned refs[PACK_SHARDS];    /* under the shard's lock */
+};
+
+struct pack_shard {
+    pthread_mutex_t lock;
+    struct pack *cur;
+} __attribute__((aligned(64)));
+
+static struct {
+    pthread_once_t once;
+    atomic_int ready;              /* pack_once ran: the locks exist */
+    pthread_mutex_t swap_lock;     /* serializes pack_load/pack_shutdown */
+    struct pack *cur;              /* under swap_lock */
+    struct pack_shard shards[PACK_SHARDS];
+} pk = { .once = PTHREAD_ONCE_INIT };
+
+static void pack_once(void) {
+    pthread_mutex_init(&pk.swap_lock, NULL);
+    for (size_t i = 0; i < PACK_SHARDS; ++i) pthread_mutex_init(&pk.shards[i].lock, NULL);
+    atomic_store_explicit(&pk.ready, 1, memory_order_release);
+}
+
+static uint64_t hash_str(const char *p, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* splitmix64 finalizer */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint32_t bucket_of(uint64_t h, uint64_t seed, uint32_t nbuckets) {
+    return (uint32_t)(mix(h ^ seed) % nbuckets);
+}
+
+static uint32_t slot_of(uint64_t h, uint64_t seed, uint32_t d, uint32_t nslots) {
+    return (uint32_t)(mix(h ^ seed ^ (((uint64_t)d + 1) * 0x9e3779b97f4a7c15ULL)) % nslots);
+}
+
+/* shard of a path: hash of its last component, which every spelling of a
+   request path ("a//b", "<root>/a/b") shares with the packed entry */
+static unsigned shard_of(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    return (unsigned)(hash_str(base, strlen(base)) % PACK_SHARDS);
+}
+
+/* ---- building ---- */
+
+struct build {
+    FILE *f;
+    uint64_t off;                  /* bytes written so far */
+    const char *root;
+    size_t root_len;
+    size_t max_file;
+    char *body;                    /* max_file bytes of read buffer */
+    struct pack_rec *recs;
+    size_t nrecs, cap;
+    int failed;
+};
+
+static int emit(struct build *b, const void *p, size_t len, uint64_t *at) {
+    if (at) *at = b->off;
+    if (len && fwrite(p, 1, len, b->f) != len) {
+        b->failed = 1;
+        return -1;
+    }
+    b->off += len;
+    return 0;
+}
+
+static struct pack_rec *add_rec(struct build *b) {
+    if (b->nrecs == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 256;
+        struct pack_rec *r = realloc(b->recs, cap * sizeof(*r));
+        if (!r) {
+            b->failed = 1;
+            return NULL;
+        }
+        b->recs = r;
+        b->cap = cap;
+    }
+    struct pack_rec *r = &b->recs[b->nrecs++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+/* add_path: emit rel (NUL-terminated) for r and hash it */
+static int add_path(struct build *b, struct pack_rec *r, const char *rel) {
+    size_t len = strlen(rel);
+    r->hash = hash_str(rel, len);
+    r->path_len = (uint32_t)len;
+    return emit(b, rel, len + 1, &r->path_off);
+}
+
+/* pack_file: read a regular file and emit its body, header and path.
+   Returns the record index, or -1 if the file was skipped. */
+static long pack_file(struct build *b, const char *path, const char *rel) {
+    int fd = docroot_open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) return -1;
+    struct stat st;
+    int ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size <= b->max_file;
+    size_t got = 0;
+    while (ok && got < (size_t)st.st_size) {
+        ssize_t n = read(fd, b->body + got, (size_t)st.st_size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    if (!ok || got != (size_t)st.st_size) return -1; /* not a small regular file, or changed while read */
+
+    /* the same header the file cache builds (filecache.c alloc_item) */
+    char hdr[96 + VALIDATOR_MAX];
+    int status_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n", got);
+    size_t etag_off = 0, etag_len = 0;
+    size_t vlen = validator_build(hdr + status_len, sizeof(hdr) - (size_t)status_len, &st, NULL,
+                                  &etag_off, &etag_len);
+    int hdr_len = status_len + (int)vlen;
+    hdr_len += snprintf(hdr + hdr_len, sizeof(hdr) - (size_t)hdr_len, "Accept-Ranges: bytes\r\n");
+
+    struct pack_rec *r = add_rec(b);
+    if (!r) return -1;
+    r->body_len = got;
+    r->hdr_len = (uint32_t)hdr_len;
+    r->validators_off = (uint32_t)status_len;
+    r->validators_len = (uint32_t)vlen;
+    r->etag_off = (uint32_t)(status_len + etag_off);
+    r->etag_len = (uint32_t)etag_len;
+    r->mtime = st.st_mtim.tv_sec;
+    emit(b, b->body, got, &r->body_off);
+    emit(b, hdr, (size_t)hdr_len, &r->hdr_off);
+    add_path(b, r, rel);
+    return b->failed ? -1 : (long)(b->nrecs - 1);
+}
+
+/* add_alias: another path served like record target (a directory and its
+   index.html) */
+static void add_alias(struct build *b, long target, const char *rel) {
+    struct pack_rec *r = add_rec(b);
+    if (!r) return;
+    *r = b->recs[target];
+    add_path(b, r, rel);
+}
+
+static void walk(struct build *b, const char *dir, int depth) {
+    if (depth > PACK_MAX_DEPTH) return;
+    DIR *d = opendir(dir);
+    if (!d) return;
+    const char *rel_dir = dir + b->root_len; /* "" for the docroot itself */
+    while (*rel_dir == '/') rel_dir++;
+
+    long index = -1;
+    struct dirent *de;
+    char path[PATH_MAX];
+    while (!b->failed && (de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path)) continue;
+        struct stat st;
+        if (docroot_stat(path, &st) < 0) continue; /* gone, or outside the docroot */
+        if (S_ISDIR(st.st_mode)) {
+            walk(b, path, depth + 1);
+        } else if (S_ISREG(st.st_mode) && (size_t)st.st_size <= b->max_file) {
+            const char *rel = path + b->root_len;
+            while (*rel == '/') rel++;
+            long r = pack_file(b, path, rel);
+            if (r >= 0 && strcmp(de->d_name, "index.html") == 0) index = r;
+        }
+    }
+    closedir(d);
+
+    /* "/" maps to index.html by itself; subdirectories get both spellings */
+    if (index >= 0 && *rel_dir && !b->failed) {
+        add_alias(b, index, rel_dir);
+        char slash[PATH_MAX];
+        if (snprintf(slash, sizeof(slash), "%s/", rel_dir) < (int)sizeof(slash)) add_alias(b, index, slash);
+    }
+}
+
+/* place: find displacements so every record gets its own slot. Returns 0,
+   or -1 if some bucket could not be placed with this seed. */
+static int place(struct build *b, uint64_t seed, uint32_t nbuckets, uint32_t nslots, uint32_t *disp,
+                 uint32_t *slot) {
+    uint32_t *count = calloc(nbuckets + 1, sizeof(*count));
+    uint32_t *order = malloc((b->nrecs ? b->nrecs : 1) * sizeof(*order));
+    uint32_t *byb = malloc((nbuckets + 1) * sizeof(*byb));
+    uint8_t *taken = calloc(nslots, 1);
+    int rc = -1;
+    if (!count || !order || !byb || !taken) goto out;
+
+    /* records grouped by bucket (counting sort): bucket k owns
+       order[count[k] .. count[k + 1]) */
+    for (size_t i = 0; i < b->nrecs; ++i) count[bucket_of(b->recs[i].hash, seed, nbuckets) + 1]++;
+    for (uint32_t k = 0; k < nbuckets; ++k) count[k + 1] += count[k];
+    memcpy(byb, count, (nbuckets + 1) * sizeof(*byb));
+    for (size_t i = 0; i < b->nrecs; ++i) order[byb[bucket_of(b->recs[i].hash, seed, nbuckets)]++] = (uint32_t)i;
+
+    /* largest buckets first, while the table is still empty */
+    uint32_t *buckets = byb;
+    for (uint32_t k = 0; k < nbuckets; ++k) buckets[k] = k;
+    for (uint32_t i = 1; i < nbuckets; ++i) {
+        uint32_t k = buckets[i], n = count[k + 1] - count[k];
+        uint32_t j = i;
+        for (; j > 0 && count[buckets[j - 1] + 1] - count[buckets[j - 1]] < n; --j) buckets[j] = buckets[j - 1];
+        buckets[j] = k;
+    }
+
+    for (uint32_t i = 0; i < nbuckets; ++i) {
+        uint32_t k = buckets[i];
+        uint32_t first = count[k], n = count[k + 1] - count[k];
+        disp[k] = 0;
+        if (n == 0) continue;
+        uint32_t d = 0;
+        for (; d < PACK_MAX_DISP; ++d) {
+            uint32_t j = 0;
+            for (; j < n; ++j) {
+                uint32_t s = slot_of(b->recs[order[first + j]].hash, seed, d, nslots);
+                if (taken[s]) break;
+                taken[s] = 1;
+                slot[order[first + j]] = s;
+            }
+            if (j == n) break;
+            while (j-- > 0) taken[slot[order[first + j]]] = 0; /* undo the partial placement */
+        }
+        if (d == PACK_MAX_DISP) goto out;
+        disp[k] = d;
+    }
+    rc = 0;
+out:
+    free(count);
+    free(order);
+    free(byb);
+    free(taken);
+    return rc;
+}
+
+/* finish: index the records and write the tables and the header */
+static int finish(struct build *b) {
+    uint32_t nrecs = (uint32_t)b->nrecs;
+    uint32_t nbuckets = nrecs / 4 + 1;
+    uint32_t nslots = nrecs + nrecs / 8 + 1;
+    uint32_t *disp = calloc(nbuckets, sizeof(*disp));
+    uint32_t *slot = malloc((nrecs ? nrecs : 1) * sizeof(*slot));
+    struct pack_rec *table = calloc(nslots, sizeof(*table));
+    int rc = -1;
+    if (!disp || !slot || !table) goto out;
+
+    uint64_t seed = 0x5eed;
+    int tries = 0;
+    while (place(b, seed, nbuckets, nslots, disp, slot) != 0) {
+        if (++tries == PACK_SEED_TRIES) {
+            fprintf(stderr, "pack: no perfect hash for %u paths\n", nrecs);
+            goto out;
+        }
+        seed = mix(seed + (uint64_t)tries);
+    }
+    for (uint32_t i = 0; i < nrecs; ++i) table[slot[i]] = b->recs[i];
+
+    struct pack_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+    h.version = PACK_VERSION;
+    h.rec_size = sizeof(struct pack_rec);
+    h.seed = seed;
+    h.nrecs = nrecs;
+    h.nslots = nslots;
+    h.nbuckets = nbuckets;
+    h.root_len = (uint32_t)b->root_len;
+    emit(b, b->root, b->root_len + 1, &h.root_off);
+    static const char pad[8];
+    emit(b, pad, (8 - b->off % 8) % 8, NULL);
+    emit(b, disp, nbuckets * sizeof(*disp), &h.disp_off);
+    emit(b, pad, (8 - b->off % 8) % 8, NULL);
+    emit(b, table, nslots * sizeof(*table), &h.slots_off);
+    h.size = b->off;
+    if (b->failed || fseek(b->f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, b->f) != 1) goto out;
+    rc = 0;
+out:
+    free(disp);
+    free(slot);
+    free(table);
+    return rc;
+}
+
+long pack_build(const char *docroot, const char *image, size_t max_file) {
+    struct build b;
+    memset(&b, 0, sizeof(b));
+    b.root = docroot;
+    b.root_len = strlen(docroot);
+    b.max_file = max_file;
+    b.body = malloc(max_file ? max_file : 1);
+    char tmp[PATH_MAX];
+    if (!b.body || snprintf(tmp, sizeof(tmp), "%s.tmp", image) >= (int)sizeof(tmp)) {
+        free(b.body);
+        return -1;
+    }
+    b.f = fopen(tmp, "wbe");
+    if (!b.f) {
+        perror("pack: open image");
+        free(b.body);
+        return -1;
+    }
+
+    /* the header is written last, once the offsets are known */
+    struct pack_header zero;
+    memset(&zero, 0, sizeof(zero));
+    emit(&b, &zero, sizeof(zero), NULL);
+    walk(&b, docroot, 0);
+    long files = (long)b.nrecs;
+    int rc = b.failed ? -1 : finish(&b);
+    if (fflush(b.f) != 0 || fsync(fileno(b.f)) != 0) rc = -1;
+    if (fclose(b.f) != 0) rc = -1;
+    if (rc == 0 && rename(tmp, image) != 0) {
+        perror("pack: rename image");
+        rc = -1;
+    }
+    if (rc != 0) {
+        if (b.failed) perror("pack: write image");
+        unlink(tmp);
+    }
+    free(b.recs);
+    free(b.body);
+    return rc == 0 ? files : -1;
+}
+
+/* ---- serving ---- */
+
+static void unmap(struct pack *p) {
+    munmap(p->map, p->size);
+    free(p->entries);
+    free(p->root);
+    free(p);
+}
+
+/* map_image: map and check an image; NULL if it cannot be used */
+static struct pack *map_image(const char *docroot, const char *image) {
+    int fd = open(image, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct pack_header))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the image */
+    if (map == MAP_FAILED) return NULL;
+
+    struct pack *p = calloc(1, sizeof(*p));
+    if (!p) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    p->map = map;
+    p->size = (size_t)st.st_size;
+    const struct pack_header *h = map;
+    p->hdr = h;
+    size_t root_len = strlen(docroot);
+    if (memcmp(h->magic, PACK_MAGIC, sizeof(h->magic)) != 0 || h->version != PACK_VERSION ||
+        h->rec_size != sizeof(struct pack_rec) || h->size != p->size || h->nslots == 0 ||
+        h->nbuckets == 0 || h->root_len != root_len || h->root_off + root_len >= p->size ||
+        memcmp(p->map + h->root_off, docroot, root_len) != 0 || h->disp_off % 8 || h->slots_off % 8 ||
+        h->disp_off + (uint64_t)h->nbuckets * sizeof(uint32_t) > p->size ||
+        h->slots_off + (uint64_t)h->nslots * sizeof(struct pack_rec) > p->size)
+        goto bad;
+    p->disp = (const uint32_t *)(p->map + h->disp_off);
+    p->recs = (const struct pack_rec *)(p->map + h->slots_off);
+    p->root = strdup(docroot);
+    p->entries = calloc(h->nslots, sizeof(*p->entries));
+    if (!p->root || !p->entries) goto bad;
+    p->root_len = root_len;
+
+    for (uint32_t i = 0; i < h->nslots; ++i) {
+        const struct pack_rec *r = &p->recs[i];
+        if (r->path_len == 0) continue;
+        if (r->path_off + r->path_len >= p->size || p->map[r->path_off + r->path_len] != '\0' ||
+            r->hdr_off + r->hdr_len > p->size || r->body_off + r->body_len > p->size ||
+            (uint64_t)r->validators_off + r->validators_len > r->hdr_len ||
+            (uint64_t)r->etag_off + r->etag_len > r->hdr_len)
+            goto bad;
+        struct pack_entry *e = &p->entries[i];
+        e->pack = p;
+        e->path = p->map + r->path_off;
+        e->shard = shard_of(e->path);
+        e->pub.hdr = p->map + r->hdr_off;
+        e->pub.hdr_len = r->hdr_len;
+        e->pub.body = p->map + r->body_off;
+        e->pub.body_len = r->body_len;
+        e->pub.validators = e->pub.hdr + r->validators_off;
+        e->pub.validators_len = r->validators_len;
+        e->pub.etag = e->pub.hdr + r->etag_off;
+        e->pub.etag_len = r->etag_len;
+        e->pub.mtime = (time_t)r->mtime;
+        e->pub.packed = 1;
+        p->files++;
+    }
+    p->bytes = p->size;
+    atomic_init(&p->live, PACK_SHARDS);
+    /* bring the whole image in now rather than on first requests */
+    madvise(p->map, p->size, MADV_WILLNEED);
+    return p;
+bad:
+    unmap(p);
+    return NULL;
+}
+
+/* install: make p (or nothing) the pack every shard serves from; the old
+   pack goes once its references are gone. Called with swap_lock held. */
+static void install(struct pack *p) {
+    struct pack *old = pk.cur;
+    pk.cur = p;
+    int gone = 0;
+    for (size_t s = 0; s < PACK_SHARDS; ++s) {
+        struct pack_shard *sh = &pk.shards[s];
+        pthread_mutex_lock(&sh->lock);
+        sh->cur = p;
+        if (old && old->refs[s] == 0 && atomic_fetch_sub(&old->live, 1) == 1) gone = 1;
+        pthread_mutex_unlock(&sh->lock);
+    }
+    if (gone) unmap(old);
+}
+
+int pack_load(const char *docroot, const char *image) {
+    pthread_once(&pk.once, pack_once);
+    struct pack *p = map_image(docroot, image);
+    if (!p) return -1;
+    pthread_mutex_lock(&pk.swap_lock);
+    install(p);
+    pthread_mutex_unlock(&pk.swap_lock);
+    return 0;
+}
+
+/* find: the entry for a docroot-relative path, NULL if not packed */
+static struct pack_entry *find(struct pack *p, const char *rel) {
+    const struct pack_header *h = p->hdr;
+    size_t len = strlen(rel);
+    uint64_t hash = hash_str(rel, len);
+    uint32_t d = p->disp[bucket_of(hash, h->seed, h->nbuckets)];
+    uint32_t s = slot_of(hash, h->seed, d, h->nslots);
+    const struct pack_rec *r = &p->recs[s];
+    if (r->path_len != len || r->hash != hash || memcmp(p->entries[s].path, rel, len) != 0) return NULL;
+    return &p->entries[s];
+}
+
+const fc_entry_t *pack_lookup(const char *path) {
+    if (!atomic_load_explicit(&pk.ready, memory_order_acquire)) return NULL; /* never loaded */
+    unsigned s = shard_of(path);
+    struct pack_shard *sh = &pk.shards[s];
+    struct pack_entry *e = NULL;
+    pthread_mutex_lock(&sh->lock);
+    struct pack *p = sh->cur;
+    if (p && strncmp(path, p->root, p->root_len) == 0 && path[p->root_len] == '/') {
+        const char *rel = path + p->root_len;
+        while (*rel == '/') rel++;
+        e = find(p, rel);
+        if (e) p->refs[s]++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return e ? &e->pub : NULL;
+}
+
+void pack_release(const fc_entry_t *pub) {
+    struct pack_entry *e = (struct pack_entry *)pub;
+    struct pack *p = e->pack;
+    struct pack_shard *sh = &pk.shards[e->shard];
+    int gone = 0;
+    pthread_mutex_lock(&sh->lock);
+    if (--p->refs[e->shard] == 0 && sh->cur != p && atomic_fetch_sub(&p->live, 1) == 1) gone = 1;
+    pthread_mutex_unlock(&sh->lock);
+    if (gone) unmap(p);
+}
+
+void pack_stats(size_t *files, size_t *bytes) {
+    size_t f = 0, b = 0;
+    if (atomic_load_explicit(&pk.ready, memory_order_acquire)) {
+        pthread_mutex_lock(&pk.swap_lock);
+        if (pk.cur) {
+            f = pk.cur->files;
+            b = pk.cur->bytes;
+        }
+        pthread_mutex_unlock(&pk.swap_lock);
+    }
+    if (files) *files = f;
+    if (bytes) *bytes = b;
+}
+
+void pack_shutdown(void) {
+    if (!atomic_load_explicit(&pk.ready, memory_order_acquire)) return;
+    pthread_mutex_lock(&pk.swap_lock);
+    install(NULL);
+    pthread_mutex_unlock(&pk.swap_lock);
+}
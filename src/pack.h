@@ -0,0 +1,50 @@
+// Docroot pack: every small file of the docroot in one read-only image.
+//
+// For docroots of many tiny files, the per-file stat/open/read dominates
+// even with the file cache (which fills one file at a time and revalidates
+// each entry). pack_build walks the docroot once and writes every regular
+// file of up to max_file bytes, with its prebuilt response header, into a
+// single image file indexed by a perfect hash of the docroot-relative
+// path. pack_load maps it, so a warm start is one mmap, and packed files
+// are then served by filecache_lookup straight from the mapping with one
+// writev and no filesystem access at all. A directory whose index.html is
+// packed is packed too ("dir" and "dir/"), so index mappings cost no stat.
+//
+// The image is a snapshot: files changed on disk are served as packed
+// until the next pack_build/pack_load (the server rebuilds on SIGHUP).
+// Builds write "<image>.tmp" and rename() it into place, and a load swaps
+// the mapping in atomically; entries of the previous image stay valid
+// until their last reference is released.
+//
+// pack_build:
+//  - Walk docroot and write the image. Returns the number of files packed,
+//    or -1 (errno/perror) if the image could not be written.
+//
+// pack_load:
+//  - Map image and serve from it for paths under docroot, replacing the
+//    pack in use. Returns 0, or -1 if the image is missing, truncated,
+//    built for another docroot or by an incompatible build (the previous
+//    pack, if any, stays in use).
+//
+// pack_lookup:
+//  - A referenced entry for path ("<docroot>/<path>", as the HTTP layer
+//    builds it), or NULL if it is not packed. Entries have packed set and
+//    are released with filecache_release (which calls pack_release).
+//
+// pack_stats:
+//  - Paths (files and directory aliases) and image bytes of the pack in use.
+//
+// pack_shutdown:
+//  - Drop the pack in use; the mapping goes once nothing references it.
+#pragma once
+
+#include <stddef.h>
+
+#include "filecache.h"
+
+long pack_build(const char *docroot, const char *image, size_t max_file);
+int pack_load(const char *docroot, const char *image);
+const fc_entry_t *pack_lookup(const char *path);
+void pack_release(const fc_entry_t *e);
+void pack_stats(size_t *files, size_t *bytes);
+void pack_shutdown(void);
@@ -0,0 +1,480 @@
+#include "reactor.h"
+#include "http.h"
+#include "metrics.h"
+#include "reactor_int.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 256             /* epoll_wait batch size */
+
+uint64_t reactor_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void list_remove(reactor_t *r, struct conn *c) {
+    if (c->prev) c->prev->next = c->next;
+    else r->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    c->prev = c->next = NULL;
+}
+
+/* conn_new: take a connection object for fd from the slab and link it
+   into r's list. NULL at the connection limit. */
+struct conn *conn_new(reactor_t *r, int fd) {
+    struct conn *c = slab_alloc(r->conn_slab);
+    if (!c) return NULL;
+    memset(c, 0, offsetof(struct conn, out));
+    c->r = r;
+    c->fd = fd;
+    c->pipe[0] = c->pipe[1] = -1;
+    atomic_store(&c->last_active_ms, reactor_now_ms());
+    http_out_init(&c->out, fd);
+    c->out.nonblock = 1;
+    arena_init(&c->arena, c->arena_buf, sizeof(c->arena_buf));
+
+    pthread_mutex_lock(&r->lock);
+    c->next = r->conns;
+    if (r->conns) r->conns->prev = c;
+    r->conns = c;
+    pthread_mutex_unlock(&r->lock);
+    return c;
+}
+
+/* conn_free: release pending output, close and recycle an unlinked conn */
+static void conn_free(struct conn *c) {
+    http_out_discard(&c->out);
+    arena_reset(&c->arena);
+    if (c->pipe[0] >= 0) {
+        close(c->pipe[0]);
+        close(c->pipe[1]);
+    }
+    close(c->fd);
+    slab_free(c->r->conn_slab, c);
+}
+
+/* conn_close: unlink, close and free. Safe from the reactor or the worker
+   that currently owns the connection. */
+void conn_close(struct conn *c) {
+    reactor_t *r = c->r;
+    pthread_mutex_lock(&r->lock);
+    list_remove(r, c);
+    pthread_mutex_unlock(&r->lock);
+    conn_free(c);
+}
+
+/* conn_arm: hand the connection back to epoll, for its next request or,
+   while writing, for room in the socket buffer */
+static int conn_arm(struct conn *c, int op) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (c->writing ? EPOLLOUT : EPOLLIN | EPOLLRDHUP) | EPOLLONESHOT;
+    ev.data.ptr = c;
+    atomic_store(&c->last_active_ms, reactor_now_ms());
+    atomic_store(&c->in_flight, 0);
+    return epoll_ctl(c->r->epfd, op, c->fd, &ev);
+}
+
+/* conn_dispatch: a complete request is buffered, or a pending response can
+   make progress; queue it for a worker. A transfer in progress is costed by
+   the bytes it has left, so SJF-style schedulers favour nearly done ones. */
+void conn_dispatch(struct conn *c) {
+    reactor_t *r = c->r;
+    long est = c->writing ? (long)(c->out.body_end - c->out.body_off)
+                          : http_estimate_cost(c->buf, c->len, r->docroot);
+    job_t j = { .client_fd = c->fd,
+                .est_cost = est,
+                .priority = 0,
+                .arrival_ms = reactor_now_ms(),
+                .conn = c };
+
+    atomic_store(&c->in_flight, 1);
+    metrics_inc_submit(est);
+    /* a transfer under way was admitted with its request: only new
+       requests may be refused */
+    int rc = c->writing ? threadpool_submit_job(r->tp, j) : threadpool_admit_job(r->tp, j);
+    if (rc > 0) reactor_reject(c, 0);
+    else if (rc != 0) conn_close(c);
+}
+
+/* conn_on_readable: drain the (non-blocking) socket into the buffer */
+static void conn_on_readable(struct conn *c) {
+    int eof = 0;
+    while (c->len < REQ_BUF) {
+        ssize_t n = recv(c->fd, c->buf + c->len, REQ_BUF - c->len, MSG_DONTWAIT);
+        if (n > 0) {
+            c->len += (size_t)n;
+            continue;
+        }
+        if (n == 0) {
+            eof = 1;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        conn_close(c);
+        return;
+    }
+
+    if (http_find_head_end(c->buf, c->len, &c->scanned) || c->len >= REQ_BUF) {
+        /* a half-closed peer still gets its answer; the next read sees EOF */
+        conn_dispatch(c);
+        return;
+    }
+    if (eof) {
+        conn_close(c);
+        return;
+    }
+    /* partial request: wait for more bytes */
+    if (conn_arm(c, EPOLL_CTL_MOD) < 0) conn_close(c);
+}
+
+/* sweep_idle: close armed connections that have been idle too long (while
+   draining, DRAIN_IDLE_MS for those waiting on a new request) */
+static void sweep_idle(reactor_t *r) {
+    uint64_t now = reactor_now_ms();
+    int draining = atomic_load(&r->draining);
+    struct conn *expired = NULL;
+
+    pthread_mutex_lock(&r->lock);
+    struct conn *c = r->conns;
+    while (c) {
+        struct conn *next = c->next;
+        if (!atomic_load(&c->in_flight) &&
+            now - atomic_load(&c->last_active_ms) >
+                (draining && !c->writing && c->len == 0 ? DRAIN_IDLE_MS : IDLE_TIMEOUT_SECONDS * 1000ULL)) {
+            list_remove(r, c);
+            c->next = expired;
+            expired = c;
+        }
+        c = next;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    while (expired) {
+        struct conn *next = expired->next;
+        conn_free(expired);
+        expired = next;
+    }
+}
+
+static void *reactor_main(void *arg) {
+    reactor_t *r = arg;
+    struct epoll_event evs[MAX_EVENTS];
+    uint64_t last_sweep = reactor_now_ms();
+
+    while (atomic_load(&r->running)) {
+        int draining = atomic_load(&r->draining);
+        int n = epoll_wait(r->epfd, evs, MAX_EVENTS, draining ? 100 : 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            struct conn *c = evs[i].data.ptr;
+            if (!c) continue; /* wakefd: re-check running */
+            if ((evs[i].events & (EPOLLERR | EPOLLHUP)) && !(evs[i].events & EPOLLIN)) {
+                conn_close(c);
+                continue;
+            }
+            if (c->writing) conn_dispatch(c); /* room to send more */
+            else conn_on_readable(c);
+        }
+        uint64_t now = reactor_now_ms();
+        if (now - last_sweep >= (draining ? 100 : 1000)) {
+            sweep_idle(r);
+            last_sweep = now;
+        }
+    }
+    return NULL;
+}
+
+reactor_t *reactor_create(threadpool_t *tp, const char *docroot) {
+    return reactor_create_engine(tp, docroot, REACTOR_ENGINE_EPOLL);
+}
+
+reactor_t *reactor_create_engine(threadpool_t *tp, const char *docroot, int engine) {
+    reactor_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->tp = tp;
+    r->docroot = docroot;
+    r->engine = engine;
+    r->conn_slab = slab_create(sizeof(struct conn));
+    if (!r->conn_slab) {
+        free(r);
+        return NULL;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+
+    if (engine == REACTOR_ENGINE_URING) {
+        if (reactor_uring_init(r) != 0) {
+            pthread_mutex_destroy(&r->lock);
+            slab_destroy(r->conn_slab);
+            free(r);
+            return NULL;
+        }
+        atomic_store(&r->running, 1);
+        if (pthread_create(&r->thread, NULL, reactor_uring_main, r) != 0) {
+            perror("pthread_create reactor");
+            reactor_uring_destroy(r);
+            pthread_mutex_destroy(&r->lock);
+            slab_destroy(r->conn_slab);
+            free(r);
+            return NULL;
+        }
+        return r;
+    }
+
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd < 0) {
+        perror("epoll_create1");
+        goto fail;
+    }
+    r->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->wakefd < 0) {
+        perror("eventfd");
+        goto fail_ep;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wakefd, &ev) < 0) {
+        perror("epoll_ctl wakefd");
+        goto fail_wake;
+    }
+
+    atomic_store(&r->running, 1);
+    if (pthread_create(&r->thread, NULL, reactor_main, r) != 0) {
+        perror("pthread_create reactor");
+        goto fail_wake;
+    }
+    return r;
+
+fail_wake:
+    close(r->wakefd);
+fail_ep:
+    close(r->epfd);
+fail:
+    pthread_mutex_destroy(&r->lock);
+    slab_destroy(r->conn_slab);
+    free(r);
+    return NULL;
+}
+
+int reactor_add(reactor_t *r, int client_fd) {
+    /* io_uring retries blocked sends itself, so only epoll needs O_NONBLOCK */
+    if (r->engine == REACTOR_ENGINE_EPOLL) {
+        int fl = fcntl(client_fd, F_GETFL);
+        if (fl < 0 || fcntl(client_fd, F_SETFL, fl | O_NONBLOCK) < 0) {
+            perror("fcntl O_NONBLOCK");
+            close(client_fd);
+            return -1;
+        }
+    }
+    struct conn *c = conn_new(r, client_fd);
+    if (!c) {
+        close(client_fd);
+        return -1;
+    }
+    if (r->engine == REACTOR_ENGINE_URING) return reactor_uring_add(r, c);
+
+    if (conn_arm(c, EPOLL_CTL_ADD) < 0) {
+        perror("epoll_ctl add");
+        conn_close(c);
+        return -1;
+    }
+    return 0;
+}
+
+int reactor_listen(reactor_t *r, int listen_fd) {
+    if (r->engine != REACTOR_ENGINE_URING) return -1;
+    return reactor_uring_listen(r, listen_fd);
+}
+
+const char *reactor_engine_name(const reactor_t *r) {
+    return r->engine == REACTOR_ENGINE_URING ? "io_uring" : "epoll";
+}
+
+/* conn_send: push pending output; on a full socket (or a spent chunk
+   budget) re-arm for EPOLLOUT and give the worker back. Returns 1 if the
+   connection was handed off (re-armed or closed), 0 if output is done. */
+static int conn_send(struct conn *c) {
+    int rc = http_out_resume(&c->out);
+    if (rc < 0) {
+        conn_close(c);
+        return 1;
+    }
+    if (rc > 0) {
+        c->writing = 1;
+        if (conn_arm(c, EPOLL_CTL_MOD) < 0) conn_close(c);
+        return 1;
+    }
+    c->writing = 0;
+    if (c->close_after) {
+        conn_close(c);
+        return 1;
+    }
+    return 0;
+}
+
+/* conn_serve_batch: answer buffered requests into c->out until the batch is
+   busy (a deferred body, or no room left) or only a partial request is
+   left, then compact buf. A request that fails marks the connection
+   close_after. Returns -1 if the connection was closed. */
+int conn_serve_batch(struct conn *c, const char *docroot) {
+    static const char too_large[] =
+        "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+    size_t off = 0;
+    while (!c->close_after && !http_out_busy(&c->out)) {
+        http_request_t req;
+        size_t hlen = http_parse_request(c->buf + off, c->len - off, &req);
+        if (hlen == 0) {
+            if (off == 0 && c->len >= REQ_BUF) {
+                /* header block does not fit the buffer; whatever is still
+                   queued is dropped along with the connection */
+                send(c->fd, too_large, sizeof(too_large) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+                conn_close(c);
+                return -1;
+            }
+            break; /* partial (or no) request left: wait for more bytes */
+        }
+
+        c->served++;
+        int keep_alive = 0;
+        int rc = http_serve_request(&c->out, &req, docroot,
+                                    c->served >= REACTOR_MAX_KEEPALIVE_REQUESTS ||
+                                        atomic_load_explicit(&c->r->draining, memory_order_relaxed),
+                                    &c->arena, &keep_alive);
+        arena_reset(&c->arena);
+        off += hlen;
+        /* an error response is still queued: send it, then close */
+        if (rc < 0 || !keep_alive) c->close_after = 1;
+    }
+
+    /* keep any pipelined bytes that followed the last request */
+    if (off) {
+        memmove(c->buf, c->buf + off, c->len - off);
+        c->len -= off;
+    }
+    c->scanned = 0;
+    return 0;
+}
+
+void reactor_serve(struct conn *c, const char *docroot) {
+    if (c->r->engine == REACTOR_ENGINE_URING) {
+        reactor_uring_serve(c, docroot);
+        return;
+    }
+
+    /* finish (or continue) the transfer this job was queued for */
+    if (c->writing && conn_send(c)) return;
+
+    /* serve every buffered request in place with one batched write. A
+       deferred body (or a full batch) ends the batch early; the requests
+       behind it wait in buf until the output has drained. */
+    for (;;) {
+        if (conn_serve_batch(c, docroot) < 0) return;
+        if (conn_send(c)) return;
+        /* a full batch went out at once: carry on with what is buffered */
+        if (!http_find_head_end(c->buf, c->len, &c->scanned)) break;
+    }
+
+    if (conn_arm(c, EPOLL_CTL_MOD) < 0) conn_close(c);
+}
+
+int reactor_can_reject(const struct conn *c) {
+    return !c->writing && !http_out_busy(&c->out);
+}
+
+int reactor_reject(struct conn *c, uint64_t latency_us) {
+    if (!reactor_can_reject(c)) return -1;
+    http_send_unavailable(c->fd, latency_us);
+    conn_close(c);
+    return 0;
+}
+
+/* reactor_wake: make the engine thread re-check its flags */
+static void reactor_wake(reactor_t *r) {
+    if (r->engine == REACTOR_ENGINE_URING) {
+        reactor_uring_wake(r);
+    } else {
+        uint64_t one = 1;
+        ssize_t w = write(r->wakefd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
+void reactor_unlisten(reactor_t *r) {
+    if (r && r->engine == REACTOR_ENGINE_URING) reactor_uring_unlisten(r);
+}
+
+void reactor_drain(reactor_t *r) {
+    if (!r) return;
+    atomic_store(&r->draining, 1);
+    reactor_wake(r);
+}
+
+size_t reactor_conns(reactor_t *r) {
+    if (!r) return 0;
+    size_t n = 0;
+    pthread_mutex_lock(&r->lock);
+    for (struct conn *c = r->conns; c; c = c->next) n++;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+void reactor_stop(reactor_t *r) {
+    if (!r || !atomic_load(&r->running)) return;
+    atomic_store(&r->running, 0);
+    reactor_wake(r);
+    pthread_join(r->thread, NULL);
+}
+
+void reactor_destroy(reactor_t *r) {
+    if (!r) return;
+    reactor_stop(r);
+    /* the ring goes first: the kernel must be done with conn memory */
+    if (r->engine == REACTOR_ENGINE_URING) reactor_uring_destroy(r);
+    pthread_mutex_lock(&r->lock);
+    struct conn *c = r->conns;
+    r->conns = NULL;
+    pthread_mutex_unlock(&r->lock);
+    while (c) {
+        struct conn *next = c->next;
+        conn_free(c);
+        c = next;
+    }
+    if (r->engine == REACTOR_ENGINE_EPOLL) {
+        close(r->wakefd);
+        close(r->epfd);
+    }
+    pthread_mutex_destroy(&r->lock);
+    slab_destroy(r->conn_slab);
+    free(r);
+}
+
+int reactor_set_conn_limits(reactor_t *r, size_t prealloc, size_t max_conns) {
+    slab_set_limit(r->conn_slab, max_conns);
+    return slab_reserve(r->conn_slab, max_conns && prealloc > max_conns ? max_conns : prealloc);
+}
+
+size_t reactor_conn_size(const reactor_t *r) {
+    return slab_obj_size(r->conn_slab);
+}
@@ -0,0 +1,101 @@
+// Event-driven connection layer (epoll).
+//
+// The reactor owns every client socket handed to it by the acceptor. It
+// reads requests on its own thread and submits a job to the thread pool only
+// once a complete request is buffered, so idle keep-alive connections cost a
+// few kilobytes of memory instead of a worker thread.
+//
+// reactor_create / reactor_create_engine:
+//  - Create a reactor feeding `tp` and start its event-loop thread.
+//  - `docroot` must outlive the reactor (used for SJF cost estimates).
+//  - engine REACTOR_ENGINE_EPOLL (reactor_create): readiness events; the
+//    worker serving a job does its own non-blocking writes.
+//  - engine REACTOR_ENGINE_URING: one io_uring does all socket I/O. The
+//    engine thread receives into provided buffers, accepts with multishot
+//    accept (see reactor_listen), and sends the batches workers build with
+//    IORING_OP_SENDMSG (SENDMSG_ZC for large ones) and bodies with linked
+//    file -> pipe -> socket splices. Workers only parse and build
+//    responses. Fails if the kernel lacks io_uring or a required opcode.
+//  - Returns NULL on failure.
+//
+// reactor_listen:
+//  - Offer a listen socket to the reactor. Returns 0 if the reactor
+//    accepts on it itself (io_uring), -1 if the caller must run accept()
+//    and reactor_add (epoll).
+//
+// reactor_engine_name:
+//  - "epoll" or "io_uring".
+//
+// reactor_set_conn_limits / reactor_conn_size:
+//  - Connections are fixed-size objects (receive buffer, output batch and
+//    a per-request scratch arena) from a slab, so accepting and closing
+//    never malloc. set_conn_limits reserves room for `prealloc` of them up
+//    front and caps open connections at max_conns (0: no cap; reactor_add
+//    refuses past it). Call before the first reactor_add. Returns 0, or
+//    -1 if the reservation could not be mapped.
+//  - conn_size is the bytes each connection takes.
+//
+// reactor_add:
+//  - Adopt a connected client fd. The reactor closes it when the peer goes
+//    away, on idle timeout, or when a response asks for close.
+//  - Returns 0 on success, -1 on error (fd is closed).
+//
+// reactor_serve:
+//  - Called by a worker for a job carrying a reactor connection. Serves the
+//    buffered request(s), then re-arms the fd or closes the connection.
+//
+// reactor_reject:
+//  - Called instead of reactor_serve (or by the engine instead of
+//    submitting) when overload control refuses the connection's request:
+//    answers 503 and closes it. Returns -1 without touching the connection
+//    if a response is already under way; serve it normally then.
+//
+// reactor_can_reject:
+//  - 1 if reactor_reject would refuse the connection now, 0 if a response
+//    is under way. Lets overload control decide before counting a drop.
+//
+// reactor_unlisten:
+//  - Stop accepting on the sockets given to reactor_listen without shutting
+//    them down, so a process they were passed to keeps them working (see
+//    handoff.h). Connections already accepted are served. A no-op for
+//    epoll, whose acceptor threads own accept().
+//
+// reactor_drain / reactor_conns:
+//  - drain: from now on every response closes its connection, and
+//    connections waiting for a new request are closed, so the open
+//    connections run down as their requests finish. For a graceful exit.
+//  - conns: connections currently open.
+//
+// reactor_stop / reactor_destroy:
+//  - reactor_stop joins the event-loop thread; no further jobs are submitted.
+//    Call it before threadpool_destroy (workers may still re-arm fds while
+//    draining), then reactor_destroy to close the remaining connections.
+#pragma once
+
+#include <stdint.h>
+
+#include "threadpool.h"
+
+typedef struct reactor reactor_t;
+struct conn;
+
+enum {
+    REACTOR_ENGINE_EPOLL = 0,
+    REACTOR_ENGINE_URING = 1,
+};
+
+reactor_t *reactor_create(threadpool_t *tp, const char *docroot);
+reactor_t *reactor_create_engine(threadpool_t *tp, const char *docroot, int engine);
+int reactor_set_conn_limits(reactor_t *r, size_t prealloc, size_t max_conns);
+size_t reactor_conn_size(const reactor_t *r);
+int reactor_add(reactor_t *r, int client_fd);
+int reactor_listen(reactor_t *r, int listen_fd);
+const char *reactor_engine_name(const reactor_t *r);
+void reactor_serve(struct conn *c, const char *docroot);
+int reactor_reject(struct conn *c, uint64_t latency_us);
+int reactor_can_reject(const struct conn *c);
+void reactor_unlisten(reactor_t *r);
+void reactor_drain(reactor_t *r);
+size_t reactor_conns(reactor_t *r);
+void reactor_stop(reactor_t *r);
+void reactor_destroy(reactor_t *r);
@@ -0,0 +1,93 @@
+// Reactor internals shared by the epoll engine (reactor.c) and the
+// io_uring engine (reactor_uring.c). Not part of the public API.
+//
+// A connection is owned by exactly one party at a time: the engine while
+// an event (epoll) or an operation (io_uring) is pending on it, or the
+// worker running its job (in_flight). That hand-off is the only
+// synchronisation conn fields get.
+#pragma once
+
+#include "arena.h"
+#include "http.h"
+#include "reactor.h"
+#include "slab.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define REQ_BUF 8192               /* per-connection receive buffer */
+#define IDLE_TIMEOUT_SECONDS 60    /* close armed connections idle this long */
+/* while draining, close connections waiting this long for their next
+   request; closing the moment a response went out races with the request
+   the client may already have sent */
+#define DRAIN_IDLE_MS 500
+/* keep-alive is cheap here (no worker is pinned), so allow far more
+   requests per connection than the blocking handle_client path */
+#define REACTOR_MAX_KEEPALIVE_REQUESTS 1000
+
+struct reactor_uring;
+
+/* per-connection state, a fixed-size object from the reactor's slab: the
+   setup and teardown of a connection never malloc. The output batch lives
+   here so a response the socket could not take at once survives between
+   jobs. Fields before `out` are zeroed by conn_new; the buffers after it
+   need no initialisation. */
+struct conn {
+    reactor_t *r;
+    int fd;
+    atomic_int in_flight;          /* 1 while a job for this conn is queued/served */
+    _Atomic uint64_t last_active_ms;
+    int served;                    /* requests answered so far */
+    size_t len;                    /* bytes buffered in buf */
+    size_t scanned;                /* head-end search resumes here */
+    int writing;                   /* output pending: armed for EPOLLOUT */
+    int close_after;               /* close once the pending output is sent */
+    struct conn *prev, *next;      /* reactor connection list */
+    /* io_uring engine only */
+    int pending;                   /* operations (and zerocopy notifications) outstanding */
+    int closing;                   /* shut down: free once pending drops to 0 */
+    int body_failed;
+    int zc_notif;                  /* zerocopy notifications still to come */
+    int zc_wait;                   /* batch sent; waiting for them to release it */
+    int pipe[2];                   /* splice pipe for bodies, -1 until needed */
+    size_t pipe_fill;              /* body bytes sitting in the pipe */
+    size_t pipe_size;
+    struct msghdr msg;
+    http_out_t out;
+    arena_t arena;                 /* over arena_buf */
+    char arena_buf[HTTP_REQ_ARENA];
+    char buf[REQ_BUF];
+};
+
+struct reactor {
+    threadpool_t *tp;
+    const char *docroot;
+    int engine;                    /* REACTOR_ENGINE_* */
+    int epfd;
+    int wakefd;                    /* eventfd used to interrupt epoll_wait on stop */
+    pthread_t thread;
+    atomic_int running;
+    atomic_int draining;           /* reactor_drain: close connections once idle */
+    pthread_mutex_t lock;          /* protects the connection list */
+    struct conn *conns;
+    slab_t *conn_slab;             /* struct conn objects */
+    struct reactor_uring *uring;   /* io_uring engine state */
+};
+
+uint64_t reactor_now_ms(void);
+struct conn *conn_new(reactor_t *r, int fd);
+void conn_close(struct conn *c);
+void conn_dispatch(struct conn *c);
+int conn_serve_batch(struct conn *c, const char *docroot);
+
+/* io_uring engine (reactor_uring.c) */
+int reactor_uring_init(reactor_t *r);
+void *reactor_uring_main(void *arg);
+int reactor_uring_add(reactor_t *r, struct conn *c);
+int reactor_uring_listen(reactor_t *r, int listen_fd);
+void reactor_uring_serve(struct conn *c, const char *docroot);
+void reactor_uring_wake(reactor_t *r);
+void reactor_uring_unlisten(reactor_t *r);
+void reactor_uring_destroy(reactor_t *r);
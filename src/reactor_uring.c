@@ -0,0 +1,582 @@
+#define _GNU_SOURCE /* pipe2, SPLICE_F_MOVE */
+#include "fdcache.h"
+#include "log.h"
+#include "reactor_int.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* io_uring reactor engine.
+ *
+ * The engine thread owns the CQ and one operation chain per connection:
+ *   recv (provided buffer, copied into c->buf) -> job on the pool ->
+ *   sendmsg of the worker's batch -> [splice file -> pipe -> socket]* ->
+ *   recv ...
+ * Workers parse and build responses exactly as in epoll mode (the batch is
+ * in nonblock mode, so nothing is written on the worker) and queue the
+ * first send themselves. Sockets stay blocking: io_uring parks a send that
+ * would block and retries it when the socket drains, without a worker.
+ *
+ * user_data is the conn (or listener) pointer with a tag in the low bits.
+ */
+
+#define UR_ENTRIES 4096
+#define UR_PBUF_GROUP 1
+#define UR_PBUF_COUNT 1024           /* power of two */
+#define UR_PBUF_SIZE 4096
+#define UR_ZC_MIN (16 * 1024)        /* smaller batches are cheaper to copy */
+#define UR_SPLICE_PIPE (512 * 1024)  /* requested pipe size = splice chunk */
+#define UR_MAX_LISTENERS 64
+
+enum {
+    TAG_ACCEPT = 1,
+    TAG_RECV,
+    TAG_SEND,
+    TAG_SPLICE_IN,
+    TAG_SPLICE_OUT,
+    TAG_TICK,
+    TAG_WAKE,
+};
+#define TAG_MASK 7ULL
+
+struct ur_listener {
+    int fd;
+    int multishot;                   /* cleared if the kernel rejects it */
+    int armed;                       /* an accept is pending */
+    int dead;                        /* socket shut down */
+    unsigned long accepted;
+};
+
+struct reactor_uring {
+    uring_t ring;
+    pthread_mutex_t sq_lock;         /* SQ bookkeeping; the CQ is the engine thread's */
+    uring_pbuf_t pbuf;
+    int have_pbuf;
+    int have_zc;
+    struct __kernel_timespec tick;
+    struct ur_listener listeners[UR_MAX_LISTENERS];
+    int nlisteners;
+    atomic_int unlisten;             /* reactor_unlisten: cancel the accepts */
+};
+
+static uint64_t ud(const void *p, int tag) {
+    return (uint64_t)(uintptr_t)p | (uint64_t)tag;
+}
+
+/* ur_reserve: make room for n consecutive SQEs (sq_lock held), pushing
+   published entries to the kernel while the SQ is full */
+static int ur_reserve(struct reactor_uring *ru, unsigned n) {
+    while (uring_sq_space(&ru->ring) < n) {
+        uring_flush(&ru->ring);
+        if (uring_enter(&ru->ring, 0) < 0 && errno != EINTR && errno != EAGAIN) {
+            perror("io_uring_enter");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *ur_sqe(struct reactor_uring *ru) {
+    return ur_reserve(ru, 1) < 0 ? NULL : uring_get_sqe(&ru->ring);
+}
+
+/* ur_kick: publish and submit what has been prepared (any thread) */
+static void ur_kick(struct reactor_uring *ru) {
+    pthread_mutex_lock(&ru->sq_lock);
+    uring_flush(&ru->ring);
+    pthread_mutex_unlock(&ru->sq_lock);
+    if (uring_enter(&ru->ring, 0) < 0 && errno != EINTR && errno != EAGAIN) perror("io_uring_enter");
+}
+
+/* ur_close: close now if nothing is outstanding, else shut the socket down
+   so pending operations complete and the last completion frees it */
+static void ur_close(struct conn *c) {
+    if (c->pending == 0) {
+        conn_close(c);
+        return;
+    }
+    if (!c->closing) {
+        c->closing = 1;
+        shutdown(c->fd, SHUT_RDWR);
+    }
+}
+
+/* ur_put: a completion for c arrived; returns 1 if c is being closed (and
+   was freed if this was its last operation) */
+static int ur_put(struct conn *c) {
+    c->pending--;
+    if (!c->closing) return 0;
+    if (c->pending == 0) conn_close(c);
+    return 1;
+}
+
+static int post_recv(struct conn *c, int direct) {
+    struct reactor_uring *ru = c->r->uring;
+    size_t room = REQ_BUF - c->len;
+    pthread_mutex_lock(&ru->sq_lock);
+    struct io_uring_sqe *sqe = ur_sqe(ru);
+    if (!sqe) {
+        pthread_mutex_unlock(&ru->sq_lock);
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    if (ru->have_pbuf && !direct) {
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = ru->pbuf.bgid;
+        sqe->len = (uint32_t)(room < ru->pbuf.size ? room : ru->pbuf.size);
+    } else {
+        sqe->addr = (uint64_t)(uintptr_t)(c->buf + c->len);
+        sqe->len = (uint32_t)room;
+    }
+    sqe->user_data = ud(c, TAG_RECV);
+    c->pending++;
+    pthread_mutex_unlock(&ru->sq_lock);
+    return 0;
+}
+
+static int post_send(struct conn *c) {
+    struct reactor_uring *ru = c->r->uring;
+    http_out_t *o = &c->out;
+    size_t bytes = 0;
+    for (int i = 0; i < o->iovcnt; ++i) bytes += o->iov[i].iov_len;
+    memset(&c->msg, 0, sizeof(c->msg));
+    c->msg.msg_iov = o->iov;
+    c->msg.msg_iovlen = (size_t)o->iovcnt;
+
+    pthread_mutex_lock(&ru->sq_lock);
+    struct io_uring_sqe *sqe = ur_sqe(ru);
+    if (!sqe) {
+        pthread_mutex_unlock(&ru->sq_lock);
+        return -1;
+    }
+    sqe->opcode = ru->have_zc && bytes >= UR_ZC_MIN ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&c->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (o->body && o->body_off < o->body_end ? MSG_MORE : 0);
+    sqe->user_data = ud(c, TAG_SEND);
+    c->pending++;
+    pthread_mutex_unlock(&ru->sq_lock);
+    return 0;
+}
+
+static void prep_splice(struct io_uring_sqe *sqe, int fd_in, uint64_t off_in, int fd_out, size_t len) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = fd_in;
+    sqe->splice_off_in = off_in;
+    sqe->fd = fd_out;
+    sqe->off = (uint64_t)-1;
+    sqe->len = (uint32_t)len;
+    sqe->splice_flags = SPLICE_F_MOVE;
+}
+
+/* post_splice: drain the pipe into the socket, or move the next chunk of
+   the body through it with a linked file -> pipe, pipe -> socket pair */
+static int post_splice(struct conn *c) {
+    struct reactor_uring *ru = c->r->uring;
+    http_out_t *o = &c->out;
+    if (c->pipe[0] < 0) {
+        if (pipe2(c->pipe, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            return -1;
+        }
+        /* fewer, larger chunks: each one is a round trip through io-wq */
+        int sz = fcntl(c->pipe[1], F_SETPIPE_SZ, UR_SPLICE_PIPE);
+        if (sz < 0) sz = fcntl(c->pipe[1], F_GETPIPE_SZ);
+        c->pipe_size = sz > 0 ? (size_t)sz : HTTP_BODY_CHUNK;
+    }
+    pthread_mutex_lock(&ru->sq_lock);
+    if (ur_reserve(ru, 2) < 0) {
+        pthread_mutex_unlock(&ru->sq_lock);
+        return -1;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(&ru->ring);
+    if (c->pipe_fill) {
+        prep_splice(sqe, c->pipe[0], (uint64_t)-1, c->fd, c->pipe_fill);
+        sqe->user_data = ud(c, TAG_SPLICE_OUT);
+        c->pending++;
+    } else {
+        size_t want = (size_t)(o->body_end - o->body_off);
+        if (want > c->pipe_size) want = c->pipe_size;
+        prep_splice(sqe, o->body->fd, (uint64_t)o->body_off, c->pipe[1], want);
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = ud(c, TAG_SPLICE_IN);
+        sqe = uring_get_sqe(&ru->ring);
+        prep_splice(sqe, c->pipe[0], (uint64_t)-1, c->fd, want);
+        sqe->user_data = ud(c, TAG_SPLICE_OUT);
+        c->pending += 2;
+    }
+    pthread_mutex_unlock(&ru->sq_lock);
+    return 0;
+}
+
+static void post_accept(struct reactor_uring *ru, struct ur_listener *l) {
+    pthread_mutex_lock(&ru->sq_lock);
+    struct io_uring_sqe *sqe = ur_sqe(ru);
+    if (sqe) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = l->fd;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if (l->multishot) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = ud(l, TAG_ACCEPT);
+        l->armed = 1;
+    }
+    pthread_mutex_unlock(&ru->sq_lock);
+}
+
+static void post_simple(struct reactor_uring *ru, int tag) {
+    pthread_mutex_lock(&ru->sq_lock);
+    struct io_uring_sqe *sqe = ur_sqe(ru);
+    if (sqe) {
+        if (tag == TAG_TICK) {
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->addr = (uint64_t)(uintptr_t)&ru->tick;
+            sqe->len = 1;
+        } else {
+            sqe->opcode = IORING_OP_NOP;
+        }
+        sqe->user_data = ud(NULL, tag);
+    }
+    pthread_mutex_unlock(&ru->sq_lock);
+}
+
+/* ur_next: the current step of c's output finished; start the next one.
+   Runs on whichever side owns c (engine thread, or the worker that just
+   built a batch). */
+static void ur_next(struct conn *c) {
+    http_out_t *o = &c->out;
+    if (o->iovcnt > 0) {
+        if (post_send(c) < 0) ur_close(c);
+        return;
+    }
+    http_out_flush(o); /* empty: releases what backed the batch */
+    if (o->body) {
+        if (!c->body_failed && (o->body_off < o->body_end || c->pipe_fill)) {
+            if (post_splice(c) < 0) ur_close(c);
+            return;
+        }
+        if (http_out_body_finish(o) < 0 || c->body_failed) {
+            ur_close(c);
+            return;
+        }
+    }
+    if (c->close_after) {
+        ur_close(c);
+        return;
+    }
+    /* requests that waited behind the output */
+    if (http_find_head_end(c->buf, c->len, &c->scanned)) {
+        conn_dispatch(c);
+        return;
+    }
+    if (post_recv(c, 0) < 0) ur_close(c);
+}
+
+static void on_recv(struct reactor_uring *ru, struct conn *c, const struct io_uring_cqe *cqe) {
+    int res = cqe->res;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && !c->closing) memcpy(c->buf + c->len, uring_pbuf_addr(&ru->pbuf, bid), (size_t)res);
+        uring_pbuf_recycle(&ru->pbuf, bid);
+    }
+    if (ur_put(c)) return;
+    if (res == -ENOBUFS) {
+        /* every provided buffer is in use: read into the conn directly */
+        if (post_recv(c, 1) < 0) ur_close(c);
+        return;
+    }
+    if (res == -EINTR || res == -EAGAIN) {
+        if (post_recv(c, 0) < 0) ur_close(c);
+        return;
+    }
+    if (res < 0) {
+        ur_close(c);
+        return;
+    }
+    c->len += (size_t)res;
+    atomic_store(&c->last_active_ms, reactor_now_ms());
+    if (http_find_head_end(c->buf, c->len, &c->scanned) || c->len >= REQ_BUF) {
+        /* a half-closed peer still gets its answer; the next read sees EOF */
+        conn_dispatch(c);
+        return;
+    }
+    if (res == 0 || post_recv(c, 0) < 0) ur_close(c);
+}
+
+static void on_send(struct conn *c, const struct io_uring_cqe *cqe) {
+    if (cqe->flags & IORING_CQE_F_NOTIF) {
+        /* the kernel no longer references the zerocopy pages */
+        c->zc_notif--;
+        if (ur_put(c)) return;
+        if (c->zc_notif == 0 && c->zc_wait) {
+            c->zc_wait = 0;
+            ur_next(c);
+        }
+        return;
+    }
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        c->zc_notif++;
+        c->pending++;
+    }
+    if (ur_put(c)) return;
+    int res = cqe->res;
+    if (res == -EINTR || res == -EAGAIN) {
+        if (post_send(c) < 0) ur_close(c);
+        return;
+    }
+    if (res <= 0) {
+        ur_close(c);
+        return;
+    }
+    atomic_store(&c->last_active_ms, reactor_now_ms());
+    if (http_out_consume(&c->out, (size_t)res)) {
+        if (post_send(c) < 0) ur_close(c);
+        return;
+    }
+    if (c->zc_notif) {
+        c->zc_wait = 1; /* keep the batch until the pages are released */
+        return;
+    }
+    ur_next(c);
+}
+
+static void on_splice(struct conn *c, int tag, int res) {
+    if (ur_put(c)) return;
+    if (tag == TAG_SPLICE_IN) {
+        /* its linked SPLICE_OUT completes next and decides what follows */
+        if (res > 0) {
+            c->out.body_off += res;
+            c->pipe_fill += (size_t)res;
+        } else {
+            c->body_failed = 1; /* error, or the file shrank */
+        }
+        return;
+    }
+    if (res > 0) {
+        c->pipe_fill -= (size_t)res;
+        atomic_store(&c->last_active_ms, reactor_now_ms());
+    } else if (res != -ECANCELED || c->body_failed) {
+        /* -ECANCELED alone: a short file -> pipe splice broke the link and
+           the pipe is simply drained next */
+        c->body_failed = 1;
+        c->pipe_fill = 0;
+    }
+    ur_next(c);
+}
+
+static void on_accept(reactor_t *r, struct ur_listener *l, const struct io_uring_cqe *cqe) {
+    struct reactor_uring *ru = r->uring;
+    int res = cqe->res;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) l->armed = 0;
+    if (res >= 0) {
+        l->accepted++;
+        struct conn *c = atomic_load(&r->running) ? conn_new(r, res) : NULL;
+        if (!c) close(res);
+        else if (post_recv(c, 0) < 0) conn_close(c);
+    } else if (res == -EINVAL && l->multishot && l->accepted == 0) {
+        /* pre-5.19 kernels reject the flag on the first attempt */
+        LOG_INFO("io_uring: multishot accept unsupported, re-arming per connection");
+        l->multishot = 0;
+    } else if (res == -EINVAL || res == -EBADF || res == -ENOTSOCK) {
+        l->dead = 1; /* acceptor_stop shut the socket down */
+        return;
+    } else if (res == -ECANCELED && l->dead) {
+        return; /* reactor_unlisten */
+    } else if (res != -EINTR && res != -EAGAIN && res != -ECONNABORTED) {
+        /* EMFILE and friends: the tick re-arms once a second */
+        LOG_WARN("io_uring accept: %s", strerror(-res));
+        return;
+    }
+    if (!l->armed && !l->dead) post_accept(ru, l);
+}
+
+/* ur_rearm_accepts: re-post accepts a failed or finished submission left
+   unarmed. Listeners are published by reactor_uring_listen from another
+   thread (acquire pairs with its release store), and armed/dead are
+   written under sq_lock there, so they are read under it here. */
+static void ur_rearm_accepts(struct reactor_uring *ru) {
+    int n = __atomic_load_n(&ru->nlisteners, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; ++i) {
+        struct ur_listener *l = &ru->listeners[i];
+        pthread_mutex_lock(&ru->sq_lock);
+        int idle = !l->armed && !l->dead;
+        pthread_mutex_unlock(&ru->sq_lock);
+        if (idle) post_accept(ru, l);
+    }
+}
+
+/* ur_cancel_accepts: stop every listener; the sockets stay open and
+   usable by whoever else holds them (engine thread) */
+static void ur_cancel_accepts(struct reactor_uring *ru) {
+    pthread_mutex_lock(&ru->sq_lock);
+    int n = __atomic_load_n(&ru->nlisteners, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; ++i) {
+        struct ur_listener *l = &ru->listeners[i];
+        if (l->dead) continue;
+        l->dead = 1;
+        if (!l->armed) continue;
+        struct io_uring_sqe *sqe = ur_sqe(ru);
+        if (!sqe) break;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = ud(l, TAG_ACCEPT);
+        sqe->user_data = ud(NULL, TAG_WAKE);
+    }
+    pthread_mutex_unlock(&ru->sq_lock);
+}
+
+/* ur_sweep: shut down armed connections that have been idle too long
+   (while draining, DRAIN_IDLE_MS for those waiting on their next request:
+   only the recv is pending); the pending operation then completes and
+   frees them */
+static void ur_sweep(reactor_t *r) {
+    uint64_t now = reactor_now_ms();
+    int draining = atomic_load(&r->draining);
+    pthread_mutex_lock(&r->lock);
+    for (struct conn *c = r->conns; c; c = c->next) {
+        if (!atomic_load(&c->in_flight) && !c->closing &&
+            now - atomic_load(&c->last_active_ms) >
+                (draining && c->pending == 1 && c->len == 0 && c->out.iovcnt == 0 && !c->out.body
+                     ? DRAIN_IDLE_MS : IDLE_TIMEOUT_SECONDS * 1000ULL)) {
+            c->closing = 1;
+            shutdown(c->fd, SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+void *reactor_uring_main(void *arg) {
+    reactor_t *r = arg;
+    struct reactor_uring *ru = r->uring;
+    post_simple(ru, TAG_TICK);
+
+    while (atomic_load(&r->running)) {
+        pthread_mutex_lock(&ru->sq_lock);
+        uring_flush(&ru->ring);
+        pthread_mutex_unlock(&ru->sq_lock);
+        if (uring_enter(&ru->ring, 1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter");
+            break;
+        }
+        struct io_uring_cqe *p;
+        while ((p = uring_peek_cqe(&ru->ring))) {
+            struct io_uring_cqe cqe = *p;
+            uring_cqe_seen(&ru->ring);
+            int tag = (int)(cqe.user_data & TAG_MASK);
+            void *ptr = (void *)(uintptr_t)(cqe.user_data & ~TAG_MASK);
+            switch (tag) {
+            case TAG_ACCEPT: on_accept(r, ptr, &cqe); break;
+            case TAG_RECV: on_recv(ru, ptr, &cqe); break;
+            case TAG_SEND: on_send(ptr, &cqe); break;
+            case TAG_SPLICE_IN:
+            case TAG_SPLICE_OUT: on_splice(ptr, tag, cqe.res); break;
+            case TAG_TICK:
+                ur_rearm_accepts(ru);
+                ur_sweep(r);
+                post_simple(ru, TAG_TICK);
+                break;
+            default: /* TAG_WAKE: re-check running and unlisten */
+                if (atomic_exchange(&ru->unlisten, 0)) ur_cancel_accepts(ru);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int reactor_uring_init(reactor_t *r) {
+    struct reactor_uring *ru = calloc(1, sizeof(*ru));
+    if (!ru) return -1;
+    if (uring_init(&ru->ring, UR_ENTRIES) < 0) {
+        LOG_WARN("io_uring unavailable: %s", strerror(errno));
+        free(ru);
+        return -1;
+    }
+    static const int need[] = {IORING_OP_ACCEPT, IORING_OP_RECV,    IORING_OP_SENDMSG,
+                               IORING_OP_SPLICE, IORING_OP_TIMEOUT, IORING_OP_NOP};
+    for (size_t i = 0; i < sizeof(need) / sizeof(need[0]); ++i) {
+        if (!uring_probe_op(&ru->ring, need[i])) {
+            LOG_WARN("io_uring: kernel lacks opcode %d", need[i]);
+            uring_exit(&ru->ring);
+            free(ru);
+            return -1;
+        }
+    }
+    ru->have_zc = uring_probe_op(&ru->ring, IORING_OP_SENDMSG_ZC);
+    ru->have_pbuf = uring_pbuf_init(&ru->ring, &ru->pbuf, UR_PBUF_GROUP, UR_PBUF_COUNT, UR_PBUF_SIZE) == 0;
+    ru->tick.tv_sec = 1;
+    pthread_mutex_init(&ru->sq_lock, NULL);
+    r->uring = ru;
+    LOG_INFO("io_uring engine: %u entries, provided buffers %s, zerocopy send %s",
+             ru->ring.sq_entries, ru->have_pbuf ? "on" : "off", ru->have_zc ? "on" : "off");
+    return 0;
+}
+
+int reactor_uring_add(reactor_t *r, struct conn *c) {
+    if (post_recv(c, 0) < 0) {
+        conn_close(c);
+        return -1;
+    }
+    ur_kick(r->uring);
+    return 0;
+}
+
+int reactor_uring_listen(reactor_t *r, int listen_fd) {
+    struct reactor_uring *ru = r->uring;
+    pthread_mutex_lock(&ru->sq_lock);
+    if (ru->nlisteners == UR_MAX_LISTENERS) {
+        pthread_mutex_unlock(&ru->sq_lock);
+        return -1;
+    }
+    struct ur_listener *l = &ru->listeners[ru->nlisteners];
+    l->fd = listen_fd;
+    l->multishot = 1;
+    pthread_mutex_unlock(&ru->sq_lock);
+    post_accept(ru, l);
+    /* published last: the tick walks listeners[0..nlisteners) */
+    __atomic_store_n(&ru->nlisteners, ru->nlisteners + 1, __ATOMIC_RELEASE);
+    ur_kick(ru);
+    return 0;
+}
+
+void reactor_uring_serve(struct conn *c, const char *docroot) {
+    struct reactor_uring *ru = c->r->uring;
+    if (conn_serve_batch(c, docroot) < 0) return;
+    /* the engine owns c (and may free it) once the first operation is
+       queued: c is not touched after ur_next */
+    atomic_store(&c->last_active_ms, reactor_now_ms());
+    atomic_store(&c->in_flight, 0);
+    ur_next(c);
+    ur_kick(ru);
+}
+
+void reactor_uring_unlisten(reactor_t *r) {
+    atomic_store(&r->uring->unlisten, 1);
+    reactor_uring_wake(r);
+}
+
+void reactor_uring_wake(reactor_t *r) {
+    post_simple(r->uring, TAG_WAKE);
+    ur_kick(r->uring);
+}
+
+void reactor_uring_destroy(reactor_t *r) {
+    struct reactor_uring *ru = r->uring;
+    if (!ru) return;
+    /* abort transfers parked in the kernel before the ring goes away */
+    pthread_mutex_lock(&r->lock);
+    for (struct conn *c = r->conns; c; c = c->next) shutdown(c->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&r->lock);
+    uring_pbuf_free(&ru->ring, &ru->pbuf);
+    uring_exit(&ru->ring);
+    pthread_mutex_destroy(&ru->sq_lock);
+    free(ru);
+    r->uring = NULL;
+}
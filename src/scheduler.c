@@ -13,7 +13,7 @@ static int fifo_push(scheduler_t *s, job_t job) {
     fifo_state *st = (fifo_state*)s->state;
     if (st->count == st->capacity) return -1;
     st->arr[st->tail] = job;
-    st->tail = (st->tail + 1) % st->capacity;
+    if (++st->tail == st->capacity) st->tail = 0; /* wrap without a division */
     st->count++;
     return 0;
 }
@@ -22,11 +22,15 @@ static int fifo_pop(scheduler_t *s, job_t *out) {
     fifo_state *st = (fifo_state*)s->state;
     if (st->count == 0) return -1;
     *out = st->arr[st->head];
-    st->head = (st->head + 1) % st->capacity;
+    if (++st->head == st->capacity) st->head = 0;
     st->count--;
     return 0;
 }
 
+static size_t fifo_count(scheduler_t *s) {
+    return ((fifo_state*)s->state)->count;
+}
+
 static void fifo_destroy(scheduler_t *s) {
     if (!s) return;
     fifo_state *st = (fifo_state*)s->state;
@@ -48,5 +52,17 @@ scheduler_t *scheduler_fifo_create(size_t capacity) {
     s->push = fifo_push;
     s->pop = fifo_pop;
     s->destroy = fifo_destroy;
+    s->count = fifo_count;
     return s;
-}
\ No newline at end of file
+}
+
+scheduler_t *scheduler_create(const char *name, size_t capacity, size_t nworkers) {
+    if (!name) return NULL;
+    if (strcmp(name, "fifo") == 0) return scheduler_fifo_create(capacity);
+    if (strcmp(name, "sjf") == 0) return scheduler_sjf_create(capacity);
+    if (strcmp(name, "mpmc") == 0) return scheduler_mpmc_create(capacity);
+    if (strcmp(name, "ws") == 0) return scheduler_ws_create(capacity, nworkers);
+    /* big transfers may hold at most half the workers (at least one) */
+    if (strcmp(name, "mlq") == 0) return scheduler_mlq_create(capacity, nworkers > 1 ? nworkers / 2 : 1);
+    return NULL;
+}
@@ -4,20 +4,67 @@
 #include "threadpool.h"
 
 /* scheduler_t: abstract scheduler interface
- * push/pop are expected to be called while holding the threadpool lock.
+ * push/pop are expected to be called while holding the threadpool lock,
+ * unless the scheduler sets SCHED_F_LOCKFREE (then they are thread-safe and
+ * the threadpool calls them without any lock).
  * They must not block; threadpool handles blocking (condvars).
  */
 typedef struct scheduler scheduler_t;
 
+#define SCHED_F_LOCKFREE 0x1  /* push/pop/pop_worker are safe to call concurrently */
+
 struct scheduler {
     void *state;
+    int flags;                                 /* SCHED_F_* */
     int (*push)(scheduler_t *s, job_t job);   /* return 0 on success, -1 if full */
     int (*pop)(scheduler_t *s, job_t *out);    /* return 0 on success, -1 if empty */
     void (*destroy)(scheduler_t *s);
+    /* optional: pop on behalf of worker `worker` (0..nworkers-1) so
+       per-worker backends can serve local work first; NULL means use pop */
+    int (*pop_worker)(scheduler_t *s, size_t worker, job_t *out);
+    /* optional: number of queued jobs (same locking rules as push/pop;
+       lock-free backends may return a slightly stale value). NULL means
+       the backend cannot report its depth. */
+    size_t (*count)(scheduler_t *s);
+    /* optional: a job returned by pop/pop_worker has finished running.
+       Called with the same locking as pop, before the worker's next pop,
+       and only while the instance that handed the job out is installed. */
+    void (*done)(scheduler_t *s, const job_t *job);
+    /* optional: only workers 0..nactive-1 are popping now (the pool was
+       resized). Called with the same locking as push; backends sized per
+       worker use it to stop targeting parked workers. */
+    void (*set_active)(scheduler_t *s, size_t nactive);
+    /* optional: like pop, but ignoring anything held back until a done
+       (the pool empties an instance it replaces this way, after its last
+       concurrent user is gone). NULL means pop. */
+    int (*drain)(scheduler_t *s, job_t *out);
 };
 
 /* FIFO scheduler factory */
 scheduler_t *scheduler_fifo_create(size_t capacity);
 
 /* SJF scheduler factory (min-heap by est_cost ascending) */
-scheduler_t *scheduler_sjf_create(size_t capacity);
\ No newline at end of file
+scheduler_t *scheduler_sjf_create(size_t capacity);
+
+/* Lock-free FIFO scheduler factory: bounded MPMC ring with per-slot
+ * sequence numbers; capacity is rounded up to a power of two.
+ * SCHED_F_LOCKFREE, so the threadpool never takes its lock to push/pop. */
+scheduler_t *scheduler_mpmc_create(size_t capacity);
+
+/* Work-stealing scheduler factory: one Chase-Lev deque per worker.
+ * Submitters push onto the shorter of two randomly chosen deques; a worker
+ * takes from its own deque and steals from peers when it runs dry.
+ * Lock-free on the consumer side (SCHED_F_LOCKFREE). */
+scheduler_t *scheduler_ws_create(size_t capacity, size_t nworkers);
+
+/* Multilevel size-class scheduler factory: O(1) FIFO per size class
+ * (<4KiB, <64KiB, <1MiB, larger), smallest class first, with aging on
+ * arrival_ms so large jobs are not starved. At most big_cap jobs of 64KiB
+ * or more run at once (uses the done op). */
+scheduler_t *scheduler_mlq_create(size_t capacity, size_t big_cap);
+
+/* scheduler_create: build a scheduler by its CLI name ("fifo", "sjf", "mpmc", "ws", "mlq").
+ * nworkers is the most workers that will pop from the instance; a resizing
+ * pool reports the current number through set_active.
+ * Returns NULL for an unknown name or on allocation failure. */
+scheduler_t *scheduler_create(const char *name, size_t capacity, size_t nworkers);
@@ -0,0 +1,157 @@
+#include "scheduler.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Multilevel size-class scheduler.
+ *
+ * Jobs go into one FIFO ring per size class (<4KiB, <64KiB, <1MiB, larger)
+ * so push and pop are O(1). Pop serves the smallest non-empty class, which
+ * gives SJF-like latency for small files, with two protections SJF lacks:
+ *  - aging: a class whose oldest job has waited longer than its age limit
+ *    (by arrival_ms) is served first, so large downloads have a bounded
+ *    wait under sustained small traffic;
+ *  - a cap on concurrently running big jobs (>= 64KiB, the sendfile path):
+ *    once reached, big jobs stay queued until one completes (see the done
+ *    op), so small requests always find a free worker.
+ * est_cost == 0 (unknown path) lands in the <64KiB class rather than
+ * jumping ahead of known-small files.
+ */
+
+#define MLQ_CLASSES 4
+#define MLQ_BIG_CLASS 2            /* classes >= this count against the cap */
+
+static const long mlq_limits[MLQ_CLASSES - 1] = {4 * 1024, 64 * 1024, 1024 * 1024};
+/* maximum wait before a class preempts the others; under overload every
+   class is overdue and service degrades to oldest-first */
+static const uint64_t mlq_age_ms[MLQ_CLASSES] = {10, 20, 100, 250};
+
+typedef struct {
+    job_t *arr;
+    size_t head, tail, count;
+} mlq_ring;
+
+typedef struct {
+    mlq_ring rings[MLQ_CLASSES];
+    size_t capacity;               /* total jobs across every class */
+    size_t count;
+    size_t big_running;
+    size_t big_cap;
+} mlq_state;
+
+static uint64_t mlq_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int mlq_class(long est) {
+    if (est <= 0) return 1;
+    for (int c = 0; c < MLQ_CLASSES - 1; ++c)
+        if (est < mlq_limits[c]) return c;
+    return MLQ_CLASSES - 1;
+}
+
+static int mlq_push(scheduler_t *s, job_t job) {
+    mlq_state *st = (mlq_state*)s->state;
+    if (st->count == st->capacity) return -1;
+    /* every ring can hold the whole capacity, so only the total is checked */
+    mlq_ring *r = &st->rings[mlq_class(job.est_cost)];
+    r->arr[r->tail] = job;
+    if (++r->tail == st->capacity) r->tail = 0;
+    r->count++;
+    st->count++;
+    return 0;
+}
+
+/* mlq_take: pop, serving big classes only if big_ok */
+static int mlq_take(mlq_state *st, job_t *out, int big_ok) {
+    if (st->count == 0) return -1;
+    int pick = -1;
+    /* an overdue class wins, the longest-waiting one first */
+    uint64_t now = mlq_now_ms(), oldest = UINT64_MAX;
+    for (int c = 0; c < MLQ_CLASSES; ++c) {
+        mlq_ring *r = &st->rings[c];
+        if (r->count == 0 || (c >= MLQ_BIG_CLASS && !big_ok)) continue;
+        uint64_t arrival = r->arr[r->head].arrival_ms;
+        if (arrival && arrival + mlq_age_ms[c] <= now && arrival < oldest) {
+            oldest = arrival;
+            pick = c;
+        }
+    }
+    for (int c = 0; pick < 0 && c < MLQ_CLASSES; ++c) {
+        if (st->rings[c].count == 0 || (c >= MLQ_BIG_CLASS && !big_ok)) continue;
+        pick = c;
+    }
+    if (pick < 0) return -1; /* only capped big jobs are queued */
+    mlq_ring *r = &st->rings[pick];
+    *out = r->arr[r->head];
+    if (++r->head == st->capacity) r->head = 0;
+    r->count--;
+    st->count--;
+    return pick;
+}
+
+static int mlq_pop(scheduler_t *s, job_t *out) {
+    mlq_state *st = (mlq_state*)s->state;
+    int pick = mlq_take(st, out, st->big_running < st->big_cap);
+    if (pick < 0) return -1;
+    if (pick >= MLQ_BIG_CLASS) st->big_running++;
+    return 0;
+}
+
+/* mlq_drain: pop past the big-job cap; drained jobs never report done */
+static int mlq_drain(scheduler_t *s, job_t *out) {
+    return mlq_take((mlq_state*)s->state, out, 1) < 0 ? -1 : 0;
+}
+
+static void mlq_done(scheduler_t *s, const job_t *job) {
+    mlq_state *st = (mlq_state*)s->state;
+    if (mlq_class(job->est_cost) >= MLQ_BIG_CLASS && st->big_running > 0) st->big_running--;
+}
+
+static void mlq_set_active(scheduler_t *s, size_t nactive) {
+    /* keep half the running workers free for small jobs */
+    ((mlq_state*)s->state)->big_cap = nactive > 1 ? nactive / 2 : 1;
+}
+
+static size_t mlq_count(scheduler_t *s) {
+    return ((mlq_state*)s->state)->count;
+}
+
+static void mlq_destroy(scheduler_t *s) {
+    if (!s) return;
+    mlq_state *st = (mlq_state*)s->state;
+    for (int c = 0; c < MLQ_CLASSES; ++c) free(st->rings[c].arr);
+    free(st);
+    free(s);
+}
+
+scheduler_t *scheduler_mlq_create(size_t capacity, size_t big_cap) {
+    if (capacity < 1) capacity = 1;
+    scheduler_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    mlq_state *st = calloc(1, sizeof(*st));
+    if (!st) { free(s); return NULL; }
+    for (int c = 0; c < MLQ_CLASSES; ++c) {
+        st->rings[c].arr = calloc(capacity, sizeof(job_t));
+        if (!st->rings[c].arr) {
+            for (int k = 0; k < c; ++k) free(st->rings[k].arr);
+            free(st);
+            free(s);
+            return NULL;
+        }
+    }
+    st->capacity = capacity;
+    st->big_cap = big_cap ? big_cap : 1;
+    s->state = st;
+    s->push = mlq_push;
+    s->pop = mlq_pop;
+    s->destroy = mlq_destroy;
+    s->count = mlq_count;
+    s->done = mlq_done;
+    s->set_active = mlq_set_active;
+    s->drain = mlq_drain;
+    return s;
+}
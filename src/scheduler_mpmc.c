@@ -0,0 +1,118 @@
+#include "scheduler.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lock-free bounded MPMC FIFO (Vyukov's sequence-numbered ring).
+ *
+ * Every slot carries a sequence number: seq == pos means the slot is free
+ * for the producer claiming position pos, seq == pos + 1 means it holds the
+ * job for the consumer claiming pos. Producers and consumers claim positions
+ * with a CAS on enqueue_pos / dequeue_pos, which live on separate cache
+ * lines so submitters and workers don't false-share. Capacity is rounded up
+ * to a power of two, so indexing is a mask instead of '%'.
+ */
+
+typedef struct {
+    atomic_size_t seq;
+    job_t job;
+} mpmc_cell;
+
+typedef struct {
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+    _Alignas(64) mpmc_cell *cells;
+    size_t mask;
+} mpmc_state;
+
+static int mpmc_push(scheduler_t *s, job_t job) {
+    mpmc_state *st = (mpmc_state*)s->state;
+    size_t pos = atomic_load_explicit(&st->enqueue_pos, memory_order_relaxed);
+    mpmc_cell *cell;
+    while (1) {
+        cell = &st->cells[pos & st->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&st->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1; /* full */
+        } else {
+            pos = atomic_load_explicit(&st->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->job = job;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static int mpmc_pop(scheduler_t *s, job_t *out) {
+    mpmc_state *st = (mpmc_state*)s->state;
+    size_t pos = atomic_load_explicit(&st->dequeue_pos, memory_order_relaxed);
+    mpmc_cell *cell;
+    while (1) {
+        cell = &st->cells[pos & st->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&st->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1; /* empty */
+        } else {
+            pos = atomic_load_explicit(&st->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    *out = cell->job;
+    /* free the slot for the producer one lap ahead */
+    atomic_store_explicit(&cell->seq, pos + st->mask + 1, memory_order_release);
+    return 0;
+}
+
+/* read dequeue_pos first: enqueue_pos only grows, so the difference
+   never goes negative */
+static size_t mpmc_count(scheduler_t *s) {
+    mpmc_state *st = (mpmc_state*)s->state;
+    size_t deq = atomic_load_explicit(&st->dequeue_pos, memory_order_relaxed);
+    size_t enq = atomic_load_explicit(&st->enqueue_pos, memory_order_relaxed);
+    return enq - deq;
+}
+
+static void mpmc_destroy(scheduler_t *s) {
+    if (!s) return;
+    mpmc_state *st = (mpmc_state*)s->state;
+    free(st->cells);
+    free(st);
+    free(s);
+}
+
+scheduler_t *scheduler_mpmc_create(size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+
+    scheduler_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    mpmc_state *st = aligned_alloc(64, sizeof(*st));
+    if (!st) { free(s); return NULL; }
+    memset(st, 0, sizeof(*st));
+    st->cells = aligned_alloc(64, ((cap * sizeof(mpmc_cell) + 63) / 64) * 64);
+    if (!st->cells) { free(st); free(s); return NULL; }
+    for (size_t i = 0; i < cap; ++i) atomic_init(&st->cells[i].seq, i);
+    st->mask = cap - 1;
+    atomic_init(&st->enqueue_pos, 0);
+    atomic_init(&st->dequeue_pos, 0);
+
+    s->state = st;
+    s->flags = SCHED_F_LOCKFREE;
+    s->push = mpmc_push;
+    s->pop = mpmc_pop;
+    s->destroy = mpmc_destroy;
+    s->count = mpmc_count;
+    return s;
+}
@@ -68,6 +68,10 @@ static int sjf_pop(scheduler_t *s, job_t *out) {
     return 0;
 }
 
+static size_t sjf_count(scheduler_t *s) {
+    return ((sjf_state*)s->state)->count;
+}
+
 static void sjf_destroy(scheduler_t *s) {
     if (!s) return;
     sjf_state *st = (sjf_state*)s->state;
@@ -89,5 +93,6 @@ scheduler_t *scheduler_sjf_create(size_t capacity) {
     s->push = sjf_push;
     s->pop = sjf_pop;
     s->destroy = sjf_destroy;
+    s->count = sjf_count;
     return s;
 }
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "scheduler.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Work-stealing scheduler.
+ *
+ * Each worker owns a bounded Chase-Lev deque. Jobs originate on acceptor /
+ * reactor threads rather than on workers, so the bottom (push) end is
+ * serialised by a small per-deque spinlock; only submitters that picked the
+ * same deque ever contend on it. Every consumer - the owner first, then
+ * idle thieves - takes from the top with a single CAS, so a worker serves
+ * its own queue in FIFO order and idle workers steal the oldest jobs of
+ * busy peers (e.g. one stuck behind a big.bin transfer).
+ */
+
+#define WS_MIN_DEQUE 16
+
+typedef struct {
+    _Alignas(64) atomic_long top;      /* next slot to take/steal */
+    _Alignas(64) atomic_long bottom;   /* next slot to push */
+    pthread_spinlock_t push_lock;
+    job_t *buf;
+    long mask;                         /* capacity - 1 (power of two) */
+} ws_deque;
+
+typedef struct {
+    ws_deque *deques;
+    size_t n;
+    atomic_size_t active;              /* deques submitters push to */
+} ws_state;
+
+static size_t next_pow2(size_t v) {
+    size_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+/* per-thread xorshift for victim/target selection: no shared writes */
+static uint32_t ws_rand(void) {
+    static _Thread_local uint32_t x = 0;
+    if (x == 0) x = (uint32_t)(uintptr_t)&x | 1u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static long deque_size(ws_deque *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    return b - t;
+}
+
+static int deque_push(ws_deque *d, const job_t *job) {
+    pthread_spin_lock(&d->push_lock);
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t > d->mask) {
+        pthread_spin_unlock(&d->push_lock);
+        return -1; /* full */
+    }
+    d->buf[b & d->mask] = *job;
+    /* publish the slot before the new bottom becomes visible to thieves */
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    pthread_spin_unlock(&d->push_lock);
+    return 0;
+}
+
+/* deque_steal: take the oldest job. Returns 0 on success, -1 if empty.
+   A lost CAS race means another consumer got that job; retry while the
+   deque still looks non-empty. */
+static int deque_steal(ws_deque *d, job_t *out) {
+    while (1) {
+        long t = atomic_load_explicit(&d->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+        if (t >= b) return -1;
+        job_t job = d->buf[t & d->mask];
+        if (atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                    memory_order_seq_cst,
+                                                    memory_order_relaxed)) {
+            *out = job;
+            return 0;
+        }
+    }
+}
+
+static int ws_push(scheduler_t *s, job_t job) {
+    ws_state *st = (ws_state*)s->state;
+    /* power of two choices: the shorter of two random deques, among the
+       workers still running; parked workers' deques are drained by steals */
+    size_t n = atomic_load_explicit(&st->active, memory_order_relaxed);
+    size_t a = ws_rand() % n;
+    size_t b = ws_rand() % n;
+    size_t target = deque_size(&st->deques[b]) < deque_size(&st->deques[a]) ? b : a;
+    for (size_t k = 0; k < st->n; ++k) {
+        if (deque_push(&st->deques[(target + k) % st->n], &job) == 0) return 0;
+    }
+    return -1;
+}
+
+static int ws_pop_worker(scheduler_t *s, size_t worker, job_t *out) {
+    ws_state *st = (ws_state*)s->state;
+    size_t self = worker % st->n;
+    if (deque_steal(&st->deques[self], out) == 0) return 0;
+    /* local deque empty: steal from peers, starting at a random victim */
+    size_t start = ws_rand() % st->n;
+    for (size_t k = 0; k < st->n; ++k) {
+        size_t v = (start + k) % st->n;
+        if (v == self) continue;
+        if (deque_steal(&st->deques[v], out) == 0) return 0;
+    }
+    return -1;
+}
+
+static int ws_pop(scheduler_t *s, job_t *out) {
+    return ws_pop_worker(s, 0, out);
+}
+
+static size_t ws_count(scheduler_t *s) {
+    ws_state *st = (ws_state*)s->state;
+    size_t n = 0;
+    for (size_t i = 0; i < st->n; ++i) {
+        long sz = deque_size(&st->deques[i]);
+        if (sz > 0) n += (size_t)sz;
+    }
+    return n;
+}
+
+static void ws_set_active(scheduler_t *s, size_t nactive) {
+    ws_state *st = (ws_state*)s->state;
+    if (nactive < 1) nactive = 1;
+    if (nactive > st->n) nactive = st->n;
+    atomic_store_explicit(&st->active, nactive, memory_order_relaxed);
+}
+
+static void ws_destroy(scheduler_t *s) {
+    if (!s) return;
+    ws_state *st = (ws_state*)s->state;
+    for (size_t i = 0; i < st->n; ++i) {
+        pthread_spin_destroy(&st->deques[i].push_lock);
+        free(st->deques[i].buf);
+    }
+    free(st->deques);
+    free(st);
+    free(s);
+}
+
+scheduler_t *scheduler_ws_create(size_t capacity, size_t nworkers) {
+    if (nworkers == 0) nworkers = 1;
+    scheduler_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    ws_state *st = calloc(1, sizeof(*st));
+    if (!st) { free(s); return NULL; }
+    st->n = nworkers;
+    atomic_init(&st->active, nworkers);
+    st->deques = aligned_alloc(64, nworkers * sizeof(ws_deque));
+    if (!st->deques) { free(st); free(s); return NULL; }
+    memset(st->deques, 0, nworkers * sizeof(ws_deque));
+
+    size_t per = next_pow2((capacity + nworkers - 1) / nworkers);
+    if (per < WS_MIN_DEQUE) per = WS_MIN_DEQUE;
+    for (size_t i = 0; i < nworkers; ++i) {
+        ws_deque *d = &st->deques[i];
+        d->buf = calloc(per, sizeof(job_t));
+        if (!d->buf) {
+            for (size_t k = 0; k < i; ++k) {
+                pthread_spin_destroy(&st->deques[k].push_lock);
+                free(st->deques[k].buf);
+            }
+            free(st->deques);
+            free(st);
+            free(s);
+            return NULL;
+        }
+        d->mask = (long)per - 1;
+        atomic_init(&d->top, 0);
+        atomic_init(&d->bottom, 0);
+        pthread_spin_init(&d->push_lock, PTHREAD_PROCESS_PRIVATE);
+    }
+
+    s->state = st;
+    s->flags = SCHED_F_LOCKFREE;
+    s->push = ws_push;
+    s->pop = ws_pop;
+    s->pop_worker = ws_pop_worker;
+    s->destroy = ws_destroy;
+    s->count = ws_count;
+    s->set_active = ws_set_active;
+    return s;
+}
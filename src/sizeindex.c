@@ -0,0 +1,253 @@
+#include "sizeindex.h"
+#include "docroot.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SI_MAX_PROBE 64     /* linear probe limit before giving up */
+#define SI_MAX_DEPTH 32     /* docroot walk recursion limit */
+#define SI_WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM)
+
+/* open-addressing slot: key is the full path hash (0 = empty). Slots are
+   claimed once and never freed, so readers need no reclamation scheme. */
+struct si_slot {
+    _Atomic uint64_t key;
+    atomic_long size;       /* < 0: unknown */
+};
+
+struct si_watch {
+    int wd;
+    char *dir;
+};
+
+static struct {
+    struct si_slot *slots;
+    size_t mask;
+    int inotify_fd;
+    pthread_t thread;
+    int have_thread;
+    atomic_int running;
+    struct si_watch *watches;   /* watcher thread only after start */
+    size_t nwatches, cap_watches;
+} si = { .inotify_fd = -1 };
+
+/* FNV-1a; 0 is reserved for empty slots */
+static uint64_t hash_path(const char *p) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+int sizeindex_init(size_t capacity) {
+    size_t n = 1024;
+    while (n < capacity) n <<= 1;
+    si.slots = calloc(n, sizeof(*si.slots));
+    if (!si.slots) {
+        perror("sizeindex calloc");
+        return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        atomic_init(&si.slots[i].key, 0);
+        atomic_init(&si.slots[i].size, -1);
+    }
+    si.mask = n - 1;
+    return 0;
+}
+
+void sizeindex_update(const char *path, long size) {
+    if (!si.slots) return;
+    uint64_t h = hash_path(path);
+    for (size_t i = 0; i < SI_MAX_PROBE; ++i) {
+        struct si_slot *s = &si.slots[(h + i) & si.mask];
+        uint64_t k = atomic_load_explicit(&s->key, memory_order_acquire);
+        if (k == 0) {
+            uint64_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&s->key, &expected, h,
+                                                        memory_order_acq_rel,
+                                                        memory_order_acquire)) {
+                k = h;
+            } else {
+                k = expected;
+            }
+        }
+        if (k == h) {
+            atomic_store_explicit(&s->size, size, memory_order_release);
+            return;
+        }
+    }
+    /* probe window full: leave the path unindexed */
+}
+
+int sizeindex_lookup(const char *path, long *size) {
+    if (!si.slots) return -1;
+    uint64_t h = hash_path(path);
+    for (size_t i = 0; i < SI_MAX_PROBE; ++i) {
+        struct si_slot *s = &si.slots[(h + i) & si.mask];
+        uint64_t k = atomic_load_explicit(&s->key, memory_order_acquire);
+        if (k == 0) return -1;
+        if (k == h) {
+            long v = atomic_load_explicit(&s->size, memory_order_acquire);
+            if (v < 0) return -1;
+            *size = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* update_dir_index: requests for a directory are served from its index.html,
+   so publish that size under "dir" and "dir/" (both request forms) */
+static void update_dir_index(const char *dir, long size) {
+    char key[PATH_MAX];
+    sizeindex_update(dir, size);
+    if (snprintf(key, sizeof(key), "%s/", dir) < (int)sizeof(key)) sizeindex_update(key, size);
+}
+
+static void add_watch(const char *dir) {
+    if (si.inotify_fd < 0) return;
+    int wd = inotify_add_watch(si.inotify_fd, dir, SI_WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        perror("inotify_add_watch");
+        return;
+    }
+    for (size_t i = 0; i < si.nwatches; ++i) {
+        if (si.watches[i].wd == wd) return; /* already watched */
+    }
+    if (si.nwatches == si.cap_watches) {
+        size_t ncap = si.cap_watches ? si.cap_watches * 2 : 16;
+        struct si_watch *nw = realloc(si.watches, ncap * sizeof(*nw));
+        if (!nw) return;
+        si.watches = nw;
+        si.cap_watches = ncap;
+    }
+    char *copy = strdup(dir);
+    if (!copy) return;
+    si.watches[si.nwatches].wd = wd;
+    si.watches[si.nwatches].dir = copy;
+    si.nwatches++;
+}
+
+static const char *watch_dir(int wd) {
+    for (size_t i = 0; i < si.nwatches; ++i) {
+        if (si.watches[i].wd == wd) return si.watches[i].dir;
+    }
+    return NULL;
+}
+
+/* walk: seed the index with every regular file under dir and watch each
+   directory for changes */
+static void walk(const char *dir, int depth) {
+    if (depth > SI_MAX_DEPTH) return;
+    DIR *d = opendir(dir);
+    if (!d) return;
+    add_watch(dir);
+
+    struct dirent *de;
+    char path[PATH_MAX];
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path)) continue;
+        struct stat st;
+        if (stat(path, &st) < 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            walk(path, depth + 1);
+        } else if (S_ISREG(st.st_mode)) {
+            sizeindex_update(path, (long)st.st_size);
+            if (strcmp(de->d_name, "index.html") == 0) update_dir_index(dir, (long)st.st_size);
+        }
+    }
+    closedir(d);
+}
+
+static void handle_event(const struct inotify_event *ev) {
+    if (ev->len == 0) return;
+    const char *dir = watch_dir(ev->wd);
+    if (!dir) return;
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, ev->name) >= (int)sizeof(path)) return;
+    int is_index = strcmp(ev->name, "index.html") == 0;
+    /* any change can turn a remembered 404 or index mapping stale */
+    docroot_invalidate();
+
+    if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        sizeindex_update(path, -1);
+        if (is_index) update_dir_index(dir, -1);
+        return;
+    }
+    struct stat st;
+    if (stat(path, &st) < 0) return;
+    if (S_ISDIR(st.st_mode)) {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) walk(path, 1);
+    } else if (S_ISREG(st.st_mode)) {
+        sizeindex_update(path, (long)st.st_size);
+        if (is_index) update_dir_index(dir, (long)st.st_size);
+    }
+}
+
+static void *watcher_main(void *arg) {
+    (void)arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = si.inotify_fd, .events = POLLIN };
+    while (atomic_load(&si.running)) {
+        /* short timeout so shutdown never waits on a quiet docroot */
+        int rc = poll(&pfd, 1, 500);
+        if (rc <= 0) continue;
+        ssize_t n = read(si.inotify_fd, buf, sizeof(buf));
+        if (n <= 0) continue;
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(ev);
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+int sizeindex_watch(const char *docroot) {
+    si.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (si.inotify_fd < 0) perror("inotify_init1");
+    walk(docroot, 0);
+    if (si.inotify_fd < 0) return -1;
+
+    atomic_store(&si.running, 1);
+    if (pthread_create(&si.thread, NULL, watcher_main, NULL) != 0) {
+        perror("pthread_create sizeindex");
+        close(si.inotify_fd);
+        si.inotify_fd = -1;
+        return -1;
+    }
+    si.have_thread = 1;
+    return 0;
+}
+
+void sizeindex_shutdown(void) {
+    if (si.have_thread) {
+        atomic_store(&si.running, 0);
+        pthread_join(si.thread, NULL);
+        si.have_thread = 0;
+    }
+    if (si.inotify_fd >= 0) {
+        close(si.inotify_fd);
+        si.inotify_fd = -1;
+    }
+    for (size_t i = 0; i < si.nwatches; ++i) free(si.watches[i].dir);
+    free(si.watches);
+    si.watches = NULL;
+    si.nwatches = si.cap_watches = 0;
+    free(si.slots);
+    si.slots = NULL;
+}
@@ -0,0 +1,40 @@
+// Lock-free path -> file size index used for SJF cost estimates.
+//
+// The acceptor/reactor must never block on the filesystem just to fill
+// job_t.est_cost. Instead, sizes are published here by the code that
+// already touches files (file cache loads, fd cache opens) and by an
+// inotify watcher on the docroot, and estimates become a few atomic loads.
+//
+// Keys are the filesystem paths as the HTTP layer builds them
+// ("<docroot>/<path>"). A directory containing index.html is indexed with
+// the index file's size, matching how requests for it are served.
+//
+// sizeindex_init:
+//  - capacity: number of slots (rounded up to a power of two). The table
+//    never shrinks; when it is full new paths are simply not indexed.
+//  - Returns 0 on success, -1 on allocation failure (lookups then miss).
+//
+// sizeindex_update:
+//  - Publish the size of path; size < 0 marks it unknown (e.g. deleted).
+//    Safe from any thread, lock-free.
+//
+// sizeindex_lookup:
+//  - 0 and *size set if path is indexed with a known size, -1 otherwise.
+//    Wait-free for readers.
+//
+// sizeindex_watch:
+//  - Walk docroot once to seed the index, then start a thread that keeps it
+//    current from inotify events. Returns 0 on success, -1 if inotify is
+//    unavailable (the initial walk still happened).
+//
+// sizeindex_shutdown:
+//  - Stop the watcher thread (if any) and free the table.
+#pragma once
+
+#include <stddef.h>
+
+int sizeindex_init(size_t capacity);
+void sizeindex_shutdown(void);
+void sizeindex_update(const char *path, long size);
+int sizeindex_lookup(const char *path, long *size);
+int sizeindex_watch(const char *docroot);
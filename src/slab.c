@@ -0,0 +1,124 @@
+#include "slab.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define SLAB_LINE 64
+
+/* chunk header; the objects follow in the same mapping */
+struct slab_chunk {
+    struct slab_chunk *next;
+    size_t carved;               /* objects handed out from this chunk so far */
+    _Alignas(SLAB_LINE) char objs[];
+};
+
+struct slab_free_obj {
+    struct slab_free_obj *next;
+};
+
+struct slab {
+    pthread_mutex_t lock;
+    size_t obj_size;
+    size_t map_size;             /* bytes per chunk mapping */
+    size_t limit;                /* 0: unlimited */
+    size_t in_use;
+    size_t mapped;               /* objects in all chunks */
+    struct slab_free_obj *free_list;
+    struct slab_chunk *chunks;   /* newest first: only it can have uncarved objects */
+};
+
+slab_t *slab_create(size_t obj_size) {
+    slab_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    if (obj_size < sizeof(struct slab_free_obj)) obj_size = sizeof(struct slab_free_obj);
+    s->obj_size = (obj_size + SLAB_LINE - 1) & ~(size_t)(SLAB_LINE - 1);
+    s->map_size = sizeof(struct slab_chunk) + SLAB_CHUNK_OBJS * s->obj_size;
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+}
+
+/* add_chunk: map a chunk; its objects are carved lazily. Called locked. */
+static int add_chunk(slab_t *s) {
+    struct slab_chunk *c = mmap(NULL, s->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED) {
+        perror("mmap slab chunk");
+        return -1;
+    }
+    c->carved = 0;
+    c->next = s->chunks;
+    s->chunks = c;
+    s->mapped += SLAB_CHUNK_OBJS;
+    return 0;
+}
+
+int slab_reserve(slab_t *s, size_t n) {
+    pthread_mutex_lock(&s->lock);
+    int rc = 0;
+    while (s->mapped < n && (rc = add_chunk(s)) == 0) {}
+    pthread_mutex_unlock(&s->lock);
+    return rc;
+}
+
+void slab_set_limit(slab_t *s, size_t max) {
+    pthread_mutex_lock(&s->lock);
+    s->limit = max;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void *slab_alloc(slab_t *s) {
+    void *obj = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->limit && s->in_use >= s->limit) goto out;
+    if (s->free_list) {
+        obj = s->free_list;
+        s->free_list = s->free_list->next;
+    } else {
+        /* reserved chunks are pushed in front, so uncarved objects can sit
+           in any of them: the first with room wins */
+        struct slab_chunk *c = s->chunks;
+        while (c && c->carved == SLAB_CHUNK_OBJS) c = c->next;
+        if (!c) {
+            if (add_chunk(s) < 0) goto out;
+            c = s->chunks;
+        }
+        obj = c->objs + c->carved++ * s->obj_size;
+    }
+    s->in_use++;
+out:
+    pthread_mutex_unlock(&s->lock);
+    return obj;
+}
+
+void slab_free(slab_t *s, void *obj) {
+    if (!obj) return;
+    struct slab_free_obj *f = obj;
+    pthread_mutex_lock(&s->lock);
+    f->next = s->free_list;
+    s->free_list = f;
+    s->in_use--;
+    pthread_mutex_unlock(&s->lock);
+}
+
+size_t slab_obj_size(const slab_t *s) {
+    return s->obj_size;
+}
+
+void slab_stats(slab_t *s, size_t *in_use, size_t *mapped) {
+    pthread_mutex_lock(&s->lock);
+    if (in_use) *in_use = s->in_use;
+    if (mapped) *mapped = s->mapped;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void slab_destroy(slab_t *s) {
+    if (!s) return;
+    while (s->chunks) {
+        struct slab_chunk *next = s->chunks->next;
+        munmap(s->chunks, s->map_size);
+        s->chunks = next;
+    }
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
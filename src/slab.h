@@ -0,0 +1,42 @@
+// Fixed-size object pool for objects created and destroyed at connection
+// rate (reactor connections).
+//
+// Objects are carved from chunks of SLAB_CHUNK_OBJS objects that are
+// mmap'd as the pool grows and kept until slab_destroy; a freed object goes
+// on a LIFO free list, so the most recently used (cache-warm) object is
+// handed out next. Allocating and freeing are a few pointer moves under a
+// mutex, never malloc/free, and the pool's size is known from its limit.
+// Pages of a reserved chunk are only touched when an object is first used.
+//
+// slab_create:
+//  - obj_size is rounded up to a cache line. Returns NULL on failure.
+//
+// slab_reserve / slab_set_limit:
+//  - reserve: map chunks for at least n objects now. Returns 0 or -1.
+//  - set_limit: at most max objects in use at once (0: unlimited).
+//
+// slab_alloc / slab_free:
+//  - alloc: an object with undefined contents, NULL at the limit or if no
+//    chunk could be mapped. free: give it back (NULL is a no-op).
+//
+// slab_obj_size / slab_stats:
+//  - The rounded object size; objects in use and objects mapped.
+//
+// slab_destroy:
+//  - Unmap every chunk, whether or not its objects were freed.
+#pragma once
+
+#include <stddef.h>
+
+#define SLAB_CHUNK_OBJS 64
+
+typedef struct slab slab_t;
+
+slab_t *slab_create(size_t obj_size);
+int slab_reserve(slab_t *s, size_t n);
+void slab_set_limit(slab_t *s, size_t max);
+void *slab_alloc(slab_t *s);
+void slab_free(slab_t *s, void *obj);
+size_t slab_obj_size(const slab_t *s);
+void slab_stats(slab_t *s, size_t *in_use, size_t *mapped);
+void slab_destroy(slab_t *s);
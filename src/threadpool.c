@@ -2,25 +2,135 @@
 #include "http.h"
 #include "scheduler.h"
 #include "metrics.h"
+#include "reactor.h"
+#include "log.h"
+#include "topology.h"
 
+#include <limits.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <time.h>
 
-/* threadpool structure now uses scheduler_t for job management */
-struct threadpool {
-    pthread_t *workers;
-    size_t nworkers;
-    scheduler_t *sched;          /* scheduler instance (FIFO by default) */
+struct tp_shard;
+
+/* Autoscaling controller (threadpool_autoscale). Every interval it samples
+   each shard's queue depth, mean queue wait and busy ratio (time spent in
+   jobs over the interval, per active worker). Growth needs AS_UP_TICKS
+   samples in a row (one if submitters are blocked on a full queue);
+   shrinking needs AS_DOWN_TICKS idle samples and none within
+   AS_HOLD_TICKS of the last growth, and retires at most a quarter of the
+   workers at a time, so a bursty load does not make threads flap. */
+#define AS_DEFAULT_INTERVAL_MS 100
+#define AS_UP_TICKS 2
+#define AS_DOWN_TICKS 30
+#define AS_HOLD_TICKS 50
+#define AS_GROW_WAIT_NS 2000000ull  /* mean queue wait that calls for more workers */
+#define AS_GROW_BUSY 90             /* busy % that does, with jobs queued */
+#define AS_SHRINK_BUSY 50           /* busy % below which the shard is idle */
+#define AS_TARGET_BUSY 70           /* busy % a shrink aims for */
+
+/* Overload control (threadpool_set_admission): CoDel per shard, after
+   RFC 8289. A job is dropped once queue sojourn times have stayed above the
+   target for a whole interval, then at interval/sqrt(count) spacing while
+   they stay above it; one job under the target ends the dropping state. */
+#define CODEL_DEFAULT_INTERVAL_MS 100
+
+/* per-worker handle: workers pass their shard-local index to pop_worker */
+struct tp_worker {
+    struct tp_shard *sh;
+    size_t index;
+    pthread_t thread;
+    int cpu;                         /* pinned CPU (threadpool_place), -1: none */
+    /* last job popped from a scheduler with a done op, reported before the
+       next pop (NULL: nothing pending) */
+    scheduler_t *done_sched;
+    job_t done_job;
+    /* controller inputs, written only by this worker */
+    atomic_uint_least64_t busy_ns;   /* time spent in finished jobs */
+    atomic_uint_least64_t job_start; /* start of the running job, 0 if idle */
+    atomic_uint_least64_t wait_ns;   /* summed queue wait of popped jobs */
+    atomic_uint_least64_t jobs;
+    /* controller-private: busy time seen at the previous sample */
+    uint64_t seen_busy;
+} __attribute__((aligned(64)));
+
+/* One shard: its own scheduler instance, lock/condvars and worker set.
+   Shards share nothing on the hot path, so submit/pop contention drops as
+   shards are added. Aligned so two shards' locks never share a cache line. */
+struct tp_shard {
+    struct threadpool *tp;
+    _Atomic(scheduler_t *) sched; /* scheduler instance (FIFO by default); swapped under lock */
     size_t capacity;
     pthread_mutex_t lock;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
-    int shutdown;
+    atomic_int shutdown;         /* written under lock; read lock-free by submitters */
+    /* lock-free schedulers bypass lock/condvars: idle workers park on the
+       wake_seq futex and submitters only issue a wake syscall when
+       idle_workers says someone is parked */
+    atomic_uint wake_seq;
+    atomic_int idle_workers;
+    atomic_int full_waiters;     /* submitters waiting on not_full */
+    /* lock-free users of sched, counted by swap parity (shard_enter): a
+       swap waits for the ones that may hold the replaced instance */
+    atomic_uint sched_epoch;
+    atomic_int sched_users[2];
+    struct tp_worker **workers;  /* nslots slots; [0, nworkers) have threads */
+    size_t nworkers;             /* threads started (spawned lazily) */
+    size_t nslots;
+    /* placement (threadpool_place): worker i runs on CPU cpu_base + i of
+       node; node -1 until placed */
+    int node;
+    size_t cpu_base;
+    /* workers [0, active) serve jobs; the rest park on `resume` between
+       jobs. Written under lock, read lock-free by workers. */
+    atomic_size_t active;
+    size_t min_active, max_active;
+    pthread_cond_t resume;
+    /* controller state */
+    uint64_t seen_wait, seen_jobs;
+    int up_ticks, down_ticks, hold_ticks;
+    /* CoDel state, under codel_lock. codel_above mirrors "above target or
+       dropping" so workers popping fresh jobs skip the lock. */
+    pthread_spinlock_t codel_lock;
+    atomic_int codel_above;
+    uint64_t codel_first_above;  /* when sojourn must still be above target to drop; 0: below */
+    uint64_t codel_drop_next;
+    unsigned codel_count, codel_lastcount;
+    int codel_dropping;
+} __attribute__((aligned(64)));
+
+/* threadpool structure now uses scheduler_t for job management */
+struct threadpool {
+    struct tp_shard *shards;
+    size_t nshards;
+    int shard_policy;            /* TP_SHARD_* */
+    int placed;                  /* threadpool_place pinned the workers */
+    atomic_size_t next_shard;    /* round-robin cursor */
+    size_t nworkers;
+    size_t capacity;
     char *docroot;
+    char *sched_name;            /* threadpool_set_scheduler_by_name choice, NULL: none */
+    void (*job_handler)(job_t *job, void *arg);  /* NULL: serve HTTP */
+    void *job_arg;
+    /* autoscaling controller thread */
+    pthread_t ctl_thread;
+    int ctl_running;
+    int ctl_stop;                /* under ctl_lock */
+    unsigned ctl_interval_ms;
+    pthread_mutex_t ctl_lock;
+    pthread_cond_t ctl_cond;     /* CLOCK_MONOTONIC */
+    /* overload control; fixed before the first submit */
+    int admit_on;
+    size_t shard_high_water;     /* per shard; 0: only a full queue refuses */
+    uint64_t max_wait_ns, codel_target_ns, codel_interval_ns;
 };
 
 static uint64_t now_ms(void) {
@@ -29,109 +139,819 @@ static uint64_t now_ms(void) {
     return (uint64_t)(ts.tv_sec) * 1000 + (ts.tv_nsec / 1000000);
 }
 
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* run_job: serve one job. Reactor connections go back to the reactor
+   (re-armed or closed there); plain fds are served and closed here. */
+static void run_job(struct threadpool *tp, job_t *job) {
+    if (tp->job_handler) {
+        tp->job_handler(job, tp->job_arg);
+        return;
+    }
+    if (job->conn) {
+        reactor_serve(job->conn, tp->docroot);
+        return;
+    }
+    handle_client(job->client_fd, tp->docroot);
+    close(job->client_fd);
+}
+
+/* job_sheddable: whether overload control could refuse job at all; asked
+   before the CoDel decision so a job served anyway is not counted as a drop */
+static int job_sheddable(const struct threadpool *tp, const job_t *job) {
+    return !tp->job_handler && (!job->conn || reactor_can_reject(job->conn));
+}
+
+/* reject_job: answer a job refused by overload control with 503. Returns
+   -1 if it must be served anyway (synthetic jobs, or a response already
+   under way on its connection). */
+static int reject_job(struct threadpool *tp, job_t *job, uint64_t wait_ns) {
+    if (tp->job_handler) return -1;
+    if (job->conn) {
+        if (reactor_reject(job->conn, wait_ns / 1000) != 0) return -1;
+    } else {
+        http_send_unavailable(job->client_fd, wait_ns / 1000);
+        close(job->client_fd);
+    }
+    metrics_inc_shed(METRICS_SHED_QUEUE);
+    return 0;
+}
+
+static uint64_t isqrt(uint64_t v) {
+    uint64_t r = 0, bit = 1ull << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+/* codel_drop: the CoDel dequeue decision for a job that queued for
+   sojourn ns, taken at now. Called with codel_lock held. */
+static int codel_drop(struct tp_shard *sh, uint64_t sojourn, uint64_t now) {
+    uint64_t target = sh->tp->codel_target_ns, interval = sh->tp->codel_interval_ns;
+    int ok_to_drop = 0;
+    if (sojourn < target) {
+        sh->codel_first_above = 0;
+    } else if (sh->codel_first_above == 0) {
+        sh->codel_first_above = now + interval;
+    } else if (now >= sh->codel_first_above) {
+        ok_to_drop = 1;
+    }
+
+    int drop = 0;
+    if (sh->codel_dropping) {
+        if (!ok_to_drop) {
+            sh->codel_dropping = 0;
+        } else if (now >= sh->codel_drop_next) {
+            drop = 1;
+            sh->codel_count++;
+            sh->codel_drop_next += interval / isqrt(sh->codel_count);
+        }
+    } else if (ok_to_drop) {
+        drop = 1;
+        sh->codel_dropping = 1;
+        /* re-entering soon after the last episode: resume near its rate */
+        unsigned delta = sh->codel_count - sh->codel_lastcount;
+        sh->codel_count = delta > 1 && now < sh->codel_drop_next + 16 * interval ? delta : 1;
+        sh->codel_lastcount = sh->codel_count;
+        sh->codel_drop_next = now + interval / isqrt(sh->codel_count);
+    }
+    atomic_store_explicit(&sh->codel_above, sh->codel_first_above || sh->codel_dropping,
+                          memory_order_relaxed);
+    return drop;
+}
+
+/* job_overdue: whether overload control drops a job that waited wait ns */
+static int job_overdue(struct tp_shard *sh, uint64_t wait, uint64_t now) {
+    struct threadpool *tp = sh->tp;
+    if (tp->max_wait_ns && wait >= tp->max_wait_ns) return 1;
+    if (!tp->codel_target_ns) return 0;
+    if (wait < tp->codel_target_ns && !atomic_load_explicit(&sh->codel_above, memory_order_relaxed))
+        return 0;
+    pthread_spin_lock(&sh->codel_lock);
+    int drop = codel_drop(sh, wait, now);
+    pthread_spin_unlock(&sh->codel_lock);
+    return drop;
+}
+
+static int sched_is_lockfree(const scheduler_t *sched) {
+    return sched && (sched->flags & SCHED_F_LOCKFREE);
+}
+
+static size_t sched_count(scheduler_t *sched) {
+    return sched && sched->count ? sched->count(sched) : 0;
+}
+
+static int sched_pop(scheduler_t *sched, size_t worker, job_t *out) {
+    if (!sched) return -1;
+    if (sched->pop_worker) return sched->pop_worker(sched, worker, out);
+    return sched->pop(sched, out);
+}
+
+/* shard_enter / shard_exit: bracket any use of sh->sched made without the
+   shard lock. A swap bumps sched_epoch after installing the new instance
+   and waits for the old parity's users to leave; anyone entering after the
+   bump sees the new instance, so the old one is then unreachable. */
+static unsigned shard_enter(struct tp_shard *sh) {
+    unsigned e = atomic_load(&sh->sched_epoch) & 1;
+    atomic_fetch_add(&sh->sched_users[e], 1);
+    return e;
+}
+
+static void shard_exit(struct tp_shard *sh, unsigned e) {
+    atomic_fetch_sub(&sh->sched_users[e], 1);
+}
+
+/* worker_done: report the worker's previous job to the scheduler that
+   handed it out, if that instance is still installed. Called with the
+   shard lock held for locking schedulers. */
+static void worker_done(struct tp_worker *w, scheduler_t *sched) {
+    if (!w->done_sched) return;
+    if (w->done_sched == sched) sched->done(sched, &w->done_job);
+    w->done_sched = NULL;
+}
+
+static void worker_popped(struct tp_worker *w, scheduler_t *sched, const job_t *job) {
+    if (!sched->done) return;
+    w->done_sched = sched;
+    w->done_job = *job;
+}
+
+static void futex_wait(atomic_uint *addr, unsigned expected) {
+    syscall(SYS_futex, (unsigned *)addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr, int n) {
+    syscall(SYS_futex, (unsigned *)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* shard_wake: bump the event count and wake n parked lock-free workers */
+static void shard_wake(struct tp_shard *sh, int n) {
+    atomic_fetch_add(&sh->wake_seq, 1);
+    futex_wake(&sh->wake_seq, n);
+}
+
+/* job_popped: bookkeeping after a successful lock-free pop */
+static void job_popped(struct tp_shard *sh, const job_t *job) {
+    /* record that a job was popped for metrics */
+    metrics_inc_pop(job->est_cost);
+    /* signal producers that space is available (only if one is waiting);
+       the fence pairs with the one in threadpool_submit_job */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&sh->full_waiters) > 0) {
+        pthread_mutex_lock(&sh->lock);
+        pthread_cond_signal(&sh->not_full);
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* next_job_locked: wait for a job from a scheduler that needs the shard
+   lock. Returns 0 with *job filled, 1 if the scheduler was swapped for a
+   lock-free one or the worker was retired, -1 on shutdown with an empty
+   queue. *depth is the queue
+   depth left behind by the pop. */
+static int next_job_locked(struct tp_shard *sh, struct tp_worker *w, job_t *job,
+                           size_t *depth) {
+    pthread_mutex_lock(&sh->lock);
+    while (1) {
+        scheduler_t *sched = sh->sched;
+        if (sched_is_lockfree(sched) || w->index >= atomic_load(&sh->active)) {
+            pthread_mutex_unlock(&sh->lock);
+            return 1;
+        }
+        worker_done(w, sched);
+        /* try pop if available */
+        if (sched_pop(sched, w->index, job) == 0) {
+            worker_popped(w, sched, job);
+            /* record that a job was popped for metrics */
+            metrics_inc_pop(job->est_cost);
+            *depth = sched_count(sched);
+            /* signal producers that space is available */
+            pthread_cond_signal(&sh->not_full);
+            pthread_mutex_unlock(&sh->lock);
+            return 0;
+        }
+        /* no job available; shutting down once the queue is drained */
+        if (atomic_load(&sh->shutdown)) {
+            pthread_mutex_unlock(&sh->lock);
+            return -1;
+        }
+        /* wait for work or shutdown */
+        pthread_cond_wait(&sh->not_empty, &sh->lock);
+    }
+}
+
+/* next_job_lockfree: pop from a SCHED_F_LOCKFREE scheduler without any
+   lock, parking on the wake_seq futex only when it is empty. Same return
+   values as next_job_locked (1: scheduler swapped or worker retired). */
+static int next_job_lockfree(struct tp_shard *sh, struct tp_worker *w,
+                             scheduler_t *sched, job_t *job, size_t *depth) {
+    worker_done(w, sched);
+    while (1) {
+        if (w->index >= atomic_load(&sh->active)) return 1;
+        if (sched_pop(sched, w->index, job) == 0) {
+            worker_popped(w, sched, job);
+            *depth = sched_count(sched);
+            job_popped(sh, job);
+            return 0;
+        }
+        /* looks empty: sample the event count, advertise idleness, then
+           re-check. A push that raced with us either is seen by the
+           re-check or sees idle_workers > 0 and bumps wake_seq, which
+           makes futex_wait return immediately. */
+        unsigned key = atomic_load(&sh->wake_seq);
+        atomic_fetch_add(&sh->idle_workers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sched_pop(sched, w->index, job) == 0) {
+            atomic_fetch_sub(&sh->idle_workers, 1);
+            worker_popped(w, sched, job);
+            *depth = sched_count(sched);
+            job_popped(sh, job);
+            return 0;
+        }
+        if (atomic_load(&sh->shutdown)) {
+            atomic_fetch_sub(&sh->idle_workers, 1);
+            return -1;
+        }
+        if (atomic_load(&sh->sched) != sched || w->index >= atomic_load(&sh->active)) {
+            atomic_fetch_sub(&sh->idle_workers, 1);
+            return 1;
+        }
+        futex_wait(&sh->wake_seq, key);
+        atomic_fetch_sub(&sh->idle_workers, 1);
+    }
+}
+
+/* worker_park: a retired worker waits here, holding no job, until the
+   controller grows the shard again. Its last job is reported first so a
+   done-tracking scheduler does not count it as running; that may release
+   a job the scheduler held back (MLQ's big-job cap), so the workers still
+   active are woken to take it. Returns -1 on shutdown. */
+static int worker_park(struct tp_shard *sh, struct tp_worker *w) {
+    pthread_mutex_lock(&sh->lock);
+    if (w->done_sched) {
+        worker_done(w, sh->sched);
+        pthread_cond_broadcast(&sh->not_empty);
+    }
+    while (w->index >= atomic_load(&sh->active) && !atomic_load(&sh->shutdown))
+        pthread_cond_wait(&sh->resume, &sh->lock);
+    int stop = atomic_load(&sh->shutdown);
+    pthread_mutex_unlock(&sh->lock);
+    return stop ? -1 : 0;
+}
+
 /* Worker main loop:
-   - wait for a job to be available
-   - pop job via scheduler_pop, process it, then close fd
-   - exit when shutdown is set and no work is left */
+   - wait for a job to be available in this worker's shard
+   - pop job via scheduler_pop (lock-free schedulers skip the shard lock
+     entirely), process it, then close fd
+   - exit when shutdown is set and no work is left
+   - park between jobs while the controller has retired this worker
+   Each job records its queue wait (pop - arrival), service time and the
+   idle gap before it, so busy/idle ratios fall out per worker. */
 static void *worker_main(void *arg) {
-    struct threadpool *tp = (struct threadpool*)arg;
+    struct tp_worker *w = (struct tp_worker*)arg;
+    struct tp_shard *sh = w->sh;
+    struct threadpool *tp = sh->tp;
+    uint64_t last_done = now_ns();
     while (1) {
-        pthread_mutex_lock(&tp->lock);
-        while (1) {
-            /* try pop if available */
-            job_t job;
-            if (tp->sched && tp->sched->pop(tp->sched, &job) == 0) {
-                /* record that a job was popped for metrics */
-                metrics_inc_pop(job.est_cost);
-                 /* we got work */
-                 /* signal producers that space is available */
-                pthread_cond_signal(&tp->not_full);
-                pthread_mutex_unlock(&tp->lock);
-
-                /* process job */
-                handle_client(job.client_fd, tp->docroot);
-                close(job.client_fd);
-                /* loop back to get next job */
-                pthread_mutex_lock(&tp->lock);
-                continue;
-            }
-
-            /* no job available */
-            if (tp->shutdown) break;
-            /* wait for work or shutdown */
-            pthread_cond_wait(&tp->not_empty, &tp->lock);
-        }
-
-        /* shutting down - ensure queue empty */
-        if (tp->shutdown) {
-            /* drain any remaining jobs */
-            job_t leftover;
-            while (tp->sched && tp->sched->pop(tp->sched, &leftover) == 0) {
-                pthread_mutex_unlock(&tp->lock);
-                handle_client(leftover.client_fd, tp->docroot);
-                close(leftover.client_fd);
-                pthread_mutex_lock(&tp->lock);
-            }
-            pthread_mutex_unlock(&tp->lock);
-            break;
+        job_t job;
+        size_t depth = 0;
+        if (w->index >= atomic_load(&sh->active)) {
+            if (worker_park(sh, w) < 0) break;
+            last_done = now_ns(); /* parked time is not idle time */
+            continue;
+        }
+        unsigned e = shard_enter(sh);
+        scheduler_t *sched = atomic_load(&sh->sched);
+        int rc;
+        if (sched_is_lockfree(sched)) {
+            rc = next_job_lockfree(sh, w, sched, &job, &depth);
+            shard_exit(sh, e);
+        } else {
+            shard_exit(sh, e);
+            rc = next_job_locked(sh, w, &job, &depth);
         }
-        pthread_mutex_unlock(&tp->lock);
+        if (rc < 0) break;
+        if (rc > 0) continue; /* scheduler changed kind or retired: re-dispatch */
+        uint64_t start = now_ns();
+        uint64_t wait = job.arrival_ns && start > job.arrival_ns ? start - job.arrival_ns : 0;
+        atomic_store_explicit(&w->job_start, start, memory_order_relaxed);
+        /* process job, unless it queued past the overload limits */
+        if (!tp->admit_on || !job_sheddable(tp, &job) || !job_overdue(sh, wait, start) ||
+            reject_job(tp, &job, wait) != 0)
+            run_job(tp, &job);
+        uint64_t done = now_ns();
+        metrics_record_job(wait, done - start, start - last_done, depth);
+        last_done = done;
+        /* single writer: plain load/store, no locked add */
+        atomic_store_explicit(&w->busy_ns, atomic_load_explicit(&w->busy_ns, memory_order_relaxed) +
+                              (done - start), memory_order_relaxed);
+        atomic_store_explicit(&w->job_start, 0, memory_order_relaxed);
+        atomic_store_explicit(&w->wait_ns, atomic_load_explicit(&w->wait_ns, memory_order_relaxed) +
+                              wait, memory_order_relaxed);
+        atomic_store_explicit(&w->jobs, atomic_load_explicit(&w->jobs, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
     }
     return NULL;
 }
 
+/* spawn_worker: start a thread for the next unused slot. Called with the
+   shard lock held (or before the pool is shared). */
+static int spawn_worker(struct tp_shard *sh) {
+    if (sh->nworkers >= sh->nslots) return -1;
+    struct tp_worker *w = sh->workers[sh->nworkers];
+    if (!w) {
+        w = aligned_alloc(64, sizeof(*w));
+        if (!w) {
+            perror("aligned_alloc");
+            return -1;
+        }
+        memset(w, 0, sizeof(*w));
+        sh->workers[sh->nworkers] = w;
+    }
+    w->sh = sh;
+    w->index = sh->nworkers;
+    w->cpu = sh->node >= 0 ? topology_cpu((size_t)sh->node, sh->cpu_base + w->index) : -1;
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    if (w->cpu >= 0 && topology_pin(w->thread, w->cpu) != 0)
+        LOG_WARN("worker %zu: failed to pin to cpu %d", w->index, w->cpu);
+    sh->nworkers++;
+    return 0;
+}
+
 /* Create a threadpool with FIFO scheduler by default */
 threadpool_t *threadpool_create(size_t nworkers, size_t queue_capacity, const char *docroot) {
+    return threadpool_create_sharded(nworkers, queue_capacity, docroot, 1, TP_SHARD_ROUND_ROBIN);
+}
+
+threadpool_t *threadpool_create_sharded(size_t nworkers, size_t queue_capacity, const char *docroot,
+                                        size_t nshards, int shard_policy) {
+    if (nshards < 1) nshards = 1;
+    if (nworkers > 0 && nshards > nworkers) nshards = nworkers; /* every shard needs a worker */
+
     struct threadpool *tp = calloc(1, sizeof(*tp));
     if (!tp) return NULL;
+    tp->shards = aligned_alloc(64, nshards * sizeof(struct tp_shard));
+    if (!tp->shards) {
+        free(tp);
+        return NULL;
+    }
+    memset(tp->shards, 0, nshards * sizeof(struct tp_shard));
+    tp->nshards = nshards;
+    tp->shard_policy = shard_policy;
+    atomic_init(&tp->next_shard, 0);
     tp->nworkers = nworkers;
-    tp->workers = calloc(nworkers, sizeof(pthread_t));
     tp->capacity = queue_capacity;
-    pthread_mutex_init(&tp->lock, NULL);
-    pthread_cond_init(&tp->not_empty, NULL);
-    pthread_cond_init(&tp->not_full, NULL);
-    tp->shutdown = 0;
     tp->docroot = strdup(docroot ? docroot : "./www");
+    pthread_mutex_init(&tp->ctl_lock, NULL);
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&tp->ctl_cond, &ca);
+    pthread_condattr_destroy(&ca);
 
-    tp->sched = scheduler_fifo_create(queue_capacity);
-    if (!tp->sched) {
-        perror("scheduler_fifo_create");
-        /* continue though - thread creation may still work but submissions will fail */
-    }
+    size_t shard_cap = (queue_capacity + nshards - 1) / nshards;
+    for (size_t s = 0; s < nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        sh->tp = tp;
+        sh->capacity = shard_cap;
+        /* spread workers evenly; the first (nworkers % nshards) get one more */
+        sh->nslots = nworkers / nshards + (s < nworkers % nshards ? 1 : 0);
+        sh->workers = calloc(sh->nslots ? sh->nslots : 1, sizeof(*sh->workers));
+        atomic_init(&sh->active, sh->nslots);
+        sh->min_active = sh->max_active = sh->nslots;
+        sh->node = -1;
+        pthread_mutex_init(&sh->lock, NULL);
+        pthread_cond_init(&sh->not_empty, NULL);
+        pthread_cond_init(&sh->not_full, NULL);
+        pthread_cond_init(&sh->resume, NULL);
+        pthread_spin_init(&sh->codel_lock, PTHREAD_PROCESS_PRIVATE);
+        atomic_init(&sh->codel_above, 0);
+        atomic_init(&sh->shutdown, 0);
+        atomic_init(&sh->wake_seq, 0);
+        atomic_init(&sh->idle_workers, 0);
+        atomic_init(&sh->full_waiters, 0);
 
-    for (size_t i = 0; i < nworkers; ++i) {
-        if (pthread_create(&tp->workers[i], NULL, worker_main, tp) != 0) {
-            perror("pthread_create");
+        sh->sched = scheduler_fifo_create(shard_cap);
+        if (!sh->sched) {
+            perror("scheduler_fifo_create");
+            /* continue though - thread creation may still work but submissions will fail */
         }
     }
+
+    for (size_t s = 0; s < nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        pthread_mutex_lock(&sh->lock);
+        while (sh->nworkers < sh->nslots && spawn_worker(sh) == 0) {}
+        if (sh->nworkers < sh->nslots) atomic_store(&sh->active, sh->nworkers);
+        pthread_mutex_unlock(&sh->lock);
+    }
     return tp;
 }
 
+/* shard_push_wait: push onto the shard, waiting while it is full.
+   Returns 0, or -1 once the shard is shutting down. */
+static int shard_push_wait(struct tp_shard *sh, const job_t *job) {
+    pthread_mutex_lock(&sh->lock);
+    atomic_fetch_add(&sh->full_waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (1) {
+        /* try to push; if full, wait (unless shutting down) */
+        if (sh->shutdown) {
+            atomic_fetch_sub(&sh->full_waiters, 1);
+            pthread_mutex_unlock(&sh->lock);
+            return -1;
+        }
+        scheduler_t *sched = sh->sched;
+        if (sched->push(sched, *job) == 0) {
+            int lockfree = sched_is_lockfree(sched);
+            atomic_fetch_sub(&sh->full_waiters, 1);
+            /* success: notify a worker */
+            pthread_cond_signal(&sh->not_empty);
+            pthread_mutex_unlock(&sh->lock);
+            if (lockfree) shard_wake(sh, 1);
+            return 0;
+        }
+        /* full -> wait for space */
+        pthread_cond_wait(&sh->not_full, &sh->lock);
+    }
+}
+
+/* shard_set_scheduler: install sched on one shard, then move the jobs
+   still queued on the previous instance over (in its pop order) and
+   destroy it. Workers switch at their next pop; the old instance is only
+   emptied once no lock-free user can still reach it. */
+static void shard_set_scheduler(struct tp_shard *sh, scheduler_t *sched) {
+    pthread_mutex_lock(&sh->lock);
+    scheduler_t *old = sh->sched;
+    atomic_store(&sh->sched, sched);
+    if (sched->set_active) sched->set_active(sched, atomic_load(&sh->active));
+    unsigned e = atomic_fetch_add(&sh->sched_epoch, 1) & 1;
+    /* parked workers must re-evaluate which wait path to use */
+    pthread_cond_broadcast(&sh->not_empty);
+    pthread_mutex_unlock(&sh->lock);
+    shard_wake(sh, INT_MAX);
+    if (!old) return;
+
+    /* lock-free workers parked on the old instance notice the swap once
+       woken; submitters are done after one push */
+    while (atomic_load(&sh->sched_users[e]) > 0) {
+        shard_wake(sh, INT_MAX);
+        sched_yield();
+    }
+    size_t moved = 0;
+    job_t job;
+    while ((old->drain ? old->drain(old, &job) : sched_pop(old, 0, &job)) == 0) {
+        /* a pool shutting down meanwhile serves it here, like threadpool_destroy */
+        if (shard_push_wait(sh, &job) != 0) run_job(sh->tp, &job);
+        moved++;
+    }
+    if (old->destroy) old->destroy(old);
+    if (moved)
+        LOG_INFO("pool shard %zu: moved %zu queued jobs to the new scheduler",
+                 (size_t)(sh - sh->tp->shards), moved);
+}
+
 void threadpool_set_scheduler(threadpool_t *tp, struct scheduler *sched) {
     if (!tp || !sched) return;
-    pthread_mutex_lock(&tp->lock);
-    /* replace scheduler atomically: drain nothing, just swap.
-       Any in-flight workers will continue using previous scheduler until
-       next lock acquisition; to be safe we destroy the old scheduler now. */
-    if (tp->sched && tp->sched->destroy) tp->sched->destroy(tp->sched);
-    tp->sched = sched;
-    pthread_mutex_unlock(&tp->lock);
+    shard_set_scheduler(&tp->shards[0], sched);
+    /* a caller-built instance cannot be rebuilt for a resized pool */
+    free(tp->sched_name);
+    tp->sched_name = NULL;
+}
+
+int threadpool_set_scheduler_by_name(threadpool_t *tp, const char *name) {
+    if (!tp || !name) return -1;
+    /* build every instance first so a failure leaves the pool unchanged */
+    scheduler_t **scheds = calloc(tp->nshards, sizeof(*scheds));
+    if (!scheds) return -1;
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        /* a placed shard's queues live on the node its workers run on */
+        if (tp->placed) topology_prefer_node(tp->shards[s].node);
+        scheds[s] = scheduler_create(name, tp->shards[s].capacity, tp->shards[s].nslots);
+        if (!scheds[s]) {
+            if (tp->placed) topology_prefer_node(-1);
+            for (size_t k = 0; k < s; ++k) scheds[k]->destroy(scheds[k]);
+            free(scheds);
+            return -1;
+        }
+    }
+    if (tp->placed) topology_prefer_node(-1);
+    for (size_t s = 0; s < tp->nshards; ++s) shard_set_scheduler(&tp->shards[s], scheds[s]);
+    free(scheds);
+    if (name != tp->sched_name) {
+        free(tp->sched_name);
+        tp->sched_name = strdup(name);
+    }
+    return 0;
+}
+
+int threadpool_place(threadpool_t *tp) {
+    size_t nnodes = topology_nnodes();
+    if (!tp || nnodes == 0) return -1;
+    size_t *next_cpu = calloc(nnodes, sizeof(*next_cpu)); /* per node: CPUs handed out */
+    if (!next_cpu) return -1;
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        size_t node = s % nnodes;
+        pthread_mutex_lock(&sh->lock);
+        sh->node = (int)node;
+        sh->cpu_base = next_cpu[node];
+        next_cpu[node] += sh->nslots;
+        for (size_t i = 0; i < sh->nworkers; ++i) {
+            struct tp_worker *w = sh->workers[i];
+            w->cpu = topology_cpu(node, sh->cpu_base + i);
+            if (topology_pin(w->thread, w->cpu) != 0)
+                LOG_WARN("worker %zu: failed to pin to cpu %d", i, w->cpu);
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+    free(next_cpu);
+    tp->placed = 1;
+    return 0;
+}
+
+size_t threadpool_nshards(const threadpool_t *tp) {
+    return tp ? tp->nshards : 0;
+}
+
+void threadpool_set_job_handler(threadpool_t *tp, void (*fn)(job_t *job, void *arg), void *arg) {
+    if (!tp) return;
+    tp->job_handler = fn;
+    tp->job_arg = arg;
+}
+
+size_t threadpool_queue_depth(threadpool_t *tp) {
+    if (!tp) return 0;
+    size_t n = 0;
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        pthread_mutex_lock(&sh->lock);
+        /* the lock also keeps a concurrent scheduler swap from freeing it */
+        n += sched_count(sh->sched);
+        pthread_mutex_unlock(&sh->lock);
+    }
+    return n;
+}
+
+/* shard_resize: make workers [0, n) the active set. New slots get a
+   thread; parked workers resume; surplus workers park once their current
+   job (if any) is done - idle ones are woken so they notice. Returns the
+   size actually reached. */
+static size_t shard_resize(struct tp_shard *sh, size_t n) {
+    pthread_mutex_lock(&sh->lock);
+    while (sh->nworkers < n && spawn_worker(sh) == 0) {}
+    if (n > sh->nworkers) n = sh->nworkers;
+    if (n < 1) n = 1;
+    atomic_store(&sh->active, n);
+    scheduler_t *sched = sh->sched;
+    if (sched && sched->set_active) sched->set_active(sched, n);
+    pthread_cond_broadcast(&sh->resume);
+    pthread_cond_broadcast(&sh->not_empty);
+    pthread_mutex_unlock(&sh->lock);
+    shard_wake(sh, INT_MAX);
+    return n;
+}
+
+static size_t shard_depth(struct tp_shard *sh) {
+    pthread_mutex_lock(&sh->lock);
+    size_t n = sched_count(sh->sched);
+    pthread_mutex_unlock(&sh->lock);
+    return n;
+}
+
+/* shard_autoscale: one controller sample for a shard (see AS_*). */
+static void shard_autoscale(struct tp_shard *sh, uint64_t interval_ns) {
+    size_t active = atomic_load(&sh->active);
+    if (active == 0) return; /* no worker could be started */
+    uint64_t now = now_ns(), busy = 0, wait = 0, jobs = 0;
+    for (size_t i = 0; i < sh->nworkers; ++i) {
+        struct tp_worker *w = sh->workers[i];
+        /* finished jobs plus the elapsed part of a running one, so a
+           worker stuck in a long job (or a blocking-mode connection)
+           counts as busy before it finishes */
+        uint64_t start = atomic_load_explicit(&w->job_start, memory_order_relaxed);
+        uint64_t b = atomic_load_explicit(&w->busy_ns, memory_order_relaxed) +
+                     (start && now > start ? now - start : 0);
+        uint64_t d = b > w->seen_busy ? b - w->seen_busy : 0;
+        busy += d < interval_ns ? d : interval_ns;
+        if (b > w->seen_busy) w->seen_busy = b;
+        wait += atomic_load_explicit(&w->wait_ns, memory_order_relaxed);
+        jobs += atomic_load_explicit(&w->jobs, memory_order_relaxed);
+    }
+    uint64_t dwait = wait - sh->seen_wait, djobs = jobs - sh->seen_jobs;
+    sh->seen_wait = wait;
+    sh->seen_jobs = jobs;
+    uint64_t mean_wait = djobs ? dwait / djobs : 0;
+    unsigned busy_pct = (unsigned)(busy * 100 / (interval_ns * active));
+    size_t depth = shard_depth(sh);
+    int blocked = atomic_load(&sh->full_waiters) > 0;
+
+    size_t target = active;
+    if (blocked || (depth > 0 && (mean_wait >= AS_GROW_WAIT_NS || busy_pct >= AS_GROW_BUSY))) {
+        sh->down_ticks = 0;
+        if (++sh->up_ticks >= AS_UP_TICKS || blocked) {
+            target = blocked ? active * 2 : active + (active / 4 ? active / 4 : 1);
+            sh->up_ticks = 0;
+        }
+    } else if (depth == 0 && busy_pct < AS_SHRINK_BUSY) {
+        sh->up_ticks = 0;
+        if (sh->hold_ticks == 0 && ++sh->down_ticks >= AS_DOWN_TICKS) {
+            /* enough workers to run the observed load at AS_TARGET_BUSY,
+               retiring at most a quarter at a time */
+            size_t need = (size_t)(busy * 100 / ((uint64_t)AS_TARGET_BUSY * interval_ns)) + 1;
+            size_t floor = active - active / 4;
+            target = need > floor ? need : floor;
+            if (target >= active) target = active - 1;
+            sh->down_ticks = 0;
+        }
+    } else {
+        sh->up_ticks = sh->down_ticks = 0;
+    }
+    if (sh->hold_ticks > 0) sh->hold_ticks--;
+
+    if (target > sh->max_active) target = sh->max_active;
+    if (target < sh->min_active) target = sh->min_active;
+    if (target == active) return;
+    size_t got = shard_resize(sh, target);
+    if (got > active) sh->hold_ticks = AS_HOLD_TICKS;
+    LOG_INFO("pool shard %zu: %zu -> %zu workers (depth=%zu wait=%lluus busy=%u%%)",
+             (size_t)(sh - sh->tp->shards), active, got, depth,
+             (unsigned long long)(mean_wait / 1000), busy_pct);
+}
+
+static void *controller_main(void *arg) {
+    struct threadpool *tp = arg;
+    uint64_t interval_ns = (uint64_t)tp->ctl_interval_ms * 1000000ull;
+    pthread_mutex_lock(&tp->ctl_lock);
+    while (!tp->ctl_stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += tp->ctl_interval_ms / 1000;
+        ts.tv_nsec += (long)(tp->ctl_interval_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while (!tp->ctl_stop && pthread_cond_timedwait(&tp->ctl_cond, &tp->ctl_lock, &ts) == 0) {}
+        if (tp->ctl_stop) break;
+        pthread_mutex_unlock(&tp->ctl_lock);
+        for (size_t s = 0; s < tp->nshards; ++s) shard_autoscale(&tp->shards[s], interval_ns);
+        pthread_mutex_lock(&tp->ctl_lock);
+    }
+    pthread_mutex_unlock(&tp->ctl_lock);
+    return NULL;
+}
+
+static int ctl_start(struct threadpool *tp) {
+    tp->ctl_stop = 0;
+    if (pthread_create(&tp->ctl_thread, NULL, controller_main, tp) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    tp->ctl_running = 1;
+    return 0;
+}
+
+static void ctl_halt(struct threadpool *tp) {
+    if (!tp->ctl_running) return;
+    pthread_mutex_lock(&tp->ctl_lock);
+    tp->ctl_stop = 1;
+    pthread_cond_signal(&tp->ctl_cond);
+    pthread_mutex_unlock(&tp->ctl_lock);
+    pthread_join(tp->ctl_thread, NULL);
+    tp->ctl_running = 0;
+}
+
+/* pool_set_bounds: split [min, max] (pool totals) across the shards and
+   bring each shard's active set inside its share. Slots added here get a
+   rebuilt scheduler first, so per-worker queues cover them before their
+   threads start popping. Called with the controller stopped. */
+static int pool_set_bounds(struct threadpool *tp, size_t min, size_t max) {
+    size_t n = tp->nshards;
+    int grew = 0;
+    for (size_t s = 0; s < n; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        size_t hi = max / n + (s < max % n ? 1 : 0);
+        pthread_mutex_lock(&sh->lock);
+        if (hi > sh->nslots) {
+            struct tp_worker **slots = realloc(sh->workers, hi * sizeof(*slots));
+            if (!slots) {
+                pthread_mutex_unlock(&sh->lock);
+                perror("realloc");
+                return -1;
+            }
+            memset(slots + sh->nslots, 0, (hi - sh->nslots) * sizeof(*slots));
+            sh->workers = slots;
+            sh->nslots = hi;
+            grew = 1;
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+    if (grew && tp->sched_name && threadpool_set_scheduler_by_name(tp, tp->sched_name) != 0)
+        LOG_WARN("pool: could not rebuild the %s scheduler for %zu workers", tp->sched_name, max);
+    for (size_t s = 0; s < n; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        size_t lo = min / n + (s < min % n ? 1 : 0);
+        size_t hi = max / n + (s < max % n ? 1 : 0);
+        pthread_mutex_lock(&sh->lock);
+        sh->min_active = lo;
+        sh->max_active = hi;
+        size_t active = atomic_load(&sh->active);
+        pthread_mutex_unlock(&sh->lock);
+        if (active < lo) shard_resize(sh, lo);
+        else if (active > hi) shard_resize(sh, hi);
+    }
+    return 0;
+}
+
+int threadpool_autoscale(threadpool_t *tp, const tp_autoscale_t *cfg) {
+    if (!tp || !cfg || tp->ctl_running) return -1;
+    size_t n = tp->nshards;
+    size_t min = cfg->min_workers < n ? n : cfg->min_workers; /* a worker per shard */
+    size_t max = cfg->max_workers;
+    if (max < min) return -1;
+    if (pool_set_bounds(tp, min, max) != 0) return -1;
+    tp->ctl_interval_ms = cfg->interval_ms ? cfg->interval_ms : AS_DEFAULT_INTERVAL_MS;
+    return ctl_start(tp);
+}
+
+int threadpool_resize(threadpool_t *tp, size_t min_workers, size_t max_workers) {
+    if (!tp) return -1;
+    size_t min = min_workers < tp->nshards ? tp->nshards : min_workers;
+    if (max_workers < min) return -1;
+    ctl_halt(tp);
+    int rc = pool_set_bounds(tp, min, max_workers);
+    if (min != max_workers) {
+        if (!tp->ctl_interval_ms) tp->ctl_interval_ms = AS_DEFAULT_INTERVAL_MS;
+        if (ctl_start(tp) != 0) rc = -1;
+    }
+    return rc;
+}
+
+size_t threadpool_active_workers(threadpool_t *tp) {
+    if (!tp) return 0;
+    size_t n = 0;
+    for (size_t s = 0; s < tp->nshards; ++s) n += atomic_load(&tp->shards[s].active);
+    return n;
 }
 
 void threadpool_destroy(threadpool_t *tp) {
     if (!tp) return;
-    pthread_mutex_lock(&tp->lock);
-    tp->shutdown = 1;
-    pthread_cond_broadcast(&tp->not_empty);
-    pthread_mutex_unlock(&tp->lock);
-
-    for (size_t i = 0; i < tp->nworkers; ++i) pthread_join(tp->workers[i], NULL);
-
-    if (tp->sched && tp->sched->destroy) tp->sched->destroy(tp->sched);
-    free(tp->workers);
-    pthread_mutex_destroy(&tp->lock);
-    pthread_cond_destroy(&tp->not_empty);
-    pthread_cond_destroy(&tp->not_full);
+    /* stop resizing first: the controller spawns and wakes workers */
+    ctl_halt(tp);
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        pthread_mutex_lock(&sh->lock);
+        atomic_store(&sh->shutdown, 1);
+        pthread_cond_broadcast(&sh->not_empty);
+        /* submitters blocked on a full queue (e.g. the reactor) must see shutdown */
+        pthread_cond_broadcast(&sh->not_full);
+        pthread_cond_broadcast(&sh->resume);
+        pthread_mutex_unlock(&sh->lock);
+        shard_wake(sh, INT_MAX);
+    }
+
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        for (size_t i = 0; i < sh->nworkers; ++i) pthread_join(sh->workers[i]->thread, NULL);
+        /* a lock-free push can race with the last worker's exit; serve it */
+        job_t leftover;
+        while (sched_pop(sh->sched, 0, &leftover) == 0) {
+            run_job(tp, &leftover);
+            if (sh->sched->done) sh->sched->done(sh->sched, &leftover);
+        }
+    }
+
+    for (size_t s = 0; s < tp->nshards; ++s) {
+        struct tp_shard *sh = &tp->shards[s];
+        if (sh->sched && sh->sched->destroy) sh->sched->destroy(sh->sched);
+        for (size_t i = 0; i < sh->nslots; ++i) free(sh->workers[i]);
+        free(sh->workers);
+        pthread_mutex_destroy(&sh->lock);
+        pthread_cond_destroy(&sh->not_empty);
+        pthread_cond_destroy(&sh->not_full);
+        pthread_cond_destroy(&sh->resume);
+        pthread_spin_destroy(&sh->codel_lock);
+    }
+    pthread_mutex_destroy(&tp->ctl_lock);
+    pthread_cond_destroy(&tp->ctl_cond);
+    free(tp->shards);
+    free(tp->sched_name);
     free(tp->docroot);
     free(tp);
 }
@@ -143,23 +963,117 @@ int threadpool_submit(threadpool_t *tp, int client_fd) {
     return threadpool_submit_job(tp, j);
 }
 
+/* pick_shard: fd hash keeps a connection's jobs on one shard (warm
+   caches); round-robin spreads load evenly; node round-robins over the
+   shards placed on the submitting thread's NUMA node */
+static size_t pick_shard(threadpool_t *tp, const job_t *job) {
+    if (tp->nshards == 1) return 0;
+    if (tp->shard_policy == TP_SHARD_FD_HASH) {
+        uint32_t h = (uint32_t)job->client_fd * 2654435761u; /* Knuth multiplicative hash */
+        return h % tp->nshards;
+    }
+    size_t rr = atomic_fetch_add_explicit(&tp->next_shard, 1, memory_order_relaxed) % tp->nshards;
+    if (tp->shard_policy == TP_SHARD_NODE && tp->placed) {
+        int node = topology_current_node();
+        for (size_t k = 0; k < tp->nshards; ++k) {
+            size_t s = (rr + k) % tp->nshards;
+            if (tp->shards[s].node == node) return s;
+        }
+    }
+    return rr;
+}
+
+/* shard_push_lockfree: push onto a SCHED_F_LOCKFREE scheduler without
+   the shard lock; a futex wake is issued only if a worker is parked.
+   Returns 0 or -1 if full. */
+static int shard_push_lockfree(struct tp_shard *sh, scheduler_t *sched, const job_t *job) {
+    if (sched->push(sched, *job) != 0) return -1;
+    /* pairs with the fence in next_job_lockfree: either the worker's
+       re-check sees this job or we see its idle_workers increment */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&sh->idle_workers) > 0) shard_wake(sh, 1);
+    return 0;
+}
+
+/* shard_try_push: push without waiting. Returns 0 on success, -1 if the
+   shard is full (or holds high_water jobs, if nonzero), -2 if it is
+   shutting down. */
+static int shard_try_push(struct tp_shard *sh, const job_t *job, size_t high_water) {
+    unsigned e = shard_enter(sh);
+    scheduler_t *sched = atomic_load(&sh->sched);
+    if (sched_is_lockfree(sched)) {
+        int rc = -2;
+        if (!sh->shutdown) {
+            rc = high_water && sched_count(sched) >= high_water ? -1
+                                                                : shard_push_lockfree(sh, sched, job);
+        }
+        shard_exit(sh, e);
+        return rc;
+    }
+    shard_exit(sh, e);
+    pthread_mutex_lock(&sh->lock);
+    if (sh->shutdown) {
+        pthread_mutex_unlock(&sh->lock);
+        return -2;
+    }
+    if (high_water && sched_count(sh->sched) >= high_water) {
+        pthread_mutex_unlock(&sh->lock);
+        return -1;
+    }
+    /* re-read under the lock: a swap may have installed a lock-free instance */
+    sched = sh->sched;
+    int rc = sched->push(sched, *job);
+    int lockfree = sched_is_lockfree(sched);
+    if (rc == 0) pthread_cond_signal(&sh->not_empty);
+    pthread_mutex_unlock(&sh->lock);
+    if (rc == 0 && lockfree) shard_wake(sh, 1);
+    return rc == 0 ? 0 : -1;
+}
+
 /* Submit a full job (preferred). Blocks when scheduler is full. */
 int threadpool_submit_job(threadpool_t *tp, job_t job) {
     if (!tp) return -1;
-    pthread_mutex_lock(&tp->lock);
-    while (1) {
-        /* try to push; if full, wait (unless shutting down) */
-        if (tp->shutdown) {
-            pthread_mutex_unlock(&tp->lock);
-            return -1;
-        }
-        if (tp->sched->push(tp->sched, job) == 0) {
-            /* success: notify a worker */
-            pthread_cond_signal(&tp->not_empty);
-            pthread_mutex_unlock(&tp->lock);
-            return 0;
-        }
-        /* full -> wait for space */
-        pthread_cond_wait(&tp->not_full, &tp->lock);
+    if (!job.arrival_ns) job.arrival_ns = now_ns();
+    size_t first = pick_shard(tp, &job);
+
+    /* round-robin and node pools may spill into a sibling shard with room
+       rather than block; fd-hash pools stay on their shard */
+    size_t tries = tp->shard_policy != TP_SHARD_FD_HASH ? tp->nshards : 1;
+    for (size_t k = 0; k < tries; ++k) {
+        int rc = shard_try_push(&tp->shards[(first + k) % tp->nshards], &job, 0);
+        if (rc == 0) return 0;
+        if (rc == -2) return -1;
+    }
+
+    return shard_push_wait(&tp->shards[first], &job);
+}
+
+int threadpool_set_admission(threadpool_t *tp, const tp_admission_t *cfg) {
+    if (!tp || !cfg) return -1;
+    tp->admit_on = cfg->high_water || cfg->max_wait_ms || cfg->codel_target_ms;
+    size_t hw = (cfg->high_water + tp->nshards - 1) / tp->nshards;
+    size_t cap = tp->nshards ? tp->shards[0].capacity : 0;
+    tp->shard_high_water = hw < cap ? hw : 0; /* at capacity, full is the limit anyway */
+    tp->max_wait_ns = (uint64_t)cfg->max_wait_ms * 1000000ull;
+    tp->codel_target_ns = (uint64_t)cfg->codel_target_ms * 1000000ull;
+    tp->codel_interval_ns = (uint64_t)(cfg->codel_interval_ms ? cfg->codel_interval_ms
+                                                              : CODEL_DEFAULT_INTERVAL_MS) * 1000000ull;
+    return 0;
+}
+
+/* Admit a new request's job: like threadpool_submit_job, but never blocks
+   once overload control is configured. */
+int threadpool_admit_job(threadpool_t *tp, job_t job) {
+    if (!tp) return -1;
+    if (!tp->admit_on) return threadpool_submit_job(tp, job);
+    if (!job.arrival_ns) job.arrival_ns = now_ns();
+    size_t first = pick_shard(tp, &job);
+    size_t tries = tp->shard_policy != TP_SHARD_FD_HASH ? tp->nshards : 1;
+    for (size_t k = 0; k < tries; ++k) {
+        int rc = shard_try_push(&tp->shards[(first + k) % tp->nshards], &job, tp->shard_high_water);
+        if (rc == 0) return 0;
+        if (rc == -2) return -1;
     }
+    metrics_inc_shed(METRICS_SHED_ADMIT);
+    return 1;
 }
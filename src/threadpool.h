@@ -25,6 +25,71 @@ typedef struct threadpool threadpool_t;
  */
 threadpool_t *threadpool_create(size_t nworkers, size_t queue_capacity, const char *docroot);
 
+/*
+ * threadpool_create_sharded:
+ *  - Like threadpool_create, but split the pool into `nshards` independent
+ *    shards. Each shard has its own scheduler instance, lock/condvars and
+ *    worker set (workers and queue capacity are divided evenly), so submit
+ *    and pop contention scales down as shards are added.
+ *  - `shard_policy` picks the shard for each submitted job:
+ *      TP_SHARD_ROUND_ROBIN : spread jobs evenly (spills to a sibling shard
+ *                             before blocking when the first choice is full)
+ *      TP_SHARD_FD_HASH     : hash client_fd so a connection's jobs stay on
+ *                             one shard
+ *      TP_SHARD_NODE        : round-robin over the shards placed on the
+ *                             submitting thread's NUMA node (after
+ *                             threadpool_place; spills like round-robin)
+ *  - nshards is clamped to [1, nworkers].
+ */
+#define TP_SHARD_ROUND_ROBIN 0
+#define TP_SHARD_FD_HASH     1
+#define TP_SHARD_NODE        2
+threadpool_t *threadpool_create_sharded(size_t nworkers, size_t queue_capacity, const char *docroot,
+                                        size_t nshards, int shard_policy);
+
+/* threadpool_nshards: number of shards (1 for threadpool_create pools). */
+size_t threadpool_nshards(const threadpool_t *tp);
+
+/*
+ * threadpool_autoscale:
+ *  - Start a controller thread that resizes the pool between
+ *    cfg->min_workers and cfg->max_workers (pool totals, split across
+ *    shards like nworkers; min is raised to one per shard). Every
+ *    cfg->interval_ms (0: 100) it samples each shard's queue depth, mean
+ *    queue wait and worker busy ratio: it grows a shard whose queued jobs
+ *    wait or whose workers stay saturated, and shrinks one that has been
+ *    mostly idle for a few seconds, with hysteresis both ways.
+ *  - Threads for slots above the initial size are started on first growth
+ *    and never torn down: a retired worker finishes its current job and
+ *    parks until the shard grows again.
+ *  - Call before threadpool_set_scheduler_by_name so per-worker schedulers
+ *    (ws) get a queue for every slot. Returns 0, or -1 for bounds with
+ *    max < min, a second call, or allocation/thread failure.
+ */
+typedef struct {
+    size_t min_workers;
+    size_t max_workers;
+    unsigned interval_ms;
+} tp_autoscale_t;
+int threadpool_autoscale(threadpool_t *tp, const tp_autoscale_t *cfg);
+
+/* threadpool_active_workers: workers currently serving (not parked). */
+size_t threadpool_active_workers(threadpool_t *tp);
+
+/*
+ * threadpool_place:
+ *  - Pin every worker to one CPU (see topology.h): shard s is placed on
+ *    NUMA node s % nodes and its worker slots take that node's CPUs in
+ *    turn, shards on one node getting disjoint CPUs while there are
+ *    enough. Workers started later by the autoscaler are pinned the same
+ *    way, and schedulers installed afterwards allocate their queues on the
+ *    shard's node.
+ *  - Call after threadpool_autoscale (which adds slots) and before
+ *    threadpool_set_scheduler_by_name. Returns 0, or -1 without a topology
+ *    (topology_init not called or failed).
+ */
+int threadpool_place(threadpool_t *tp);
+
 /*
  * threadpool_destroy:
  *  - Request shutdown of the pool, wake workers, and join all threads.
@@ -41,18 +106,26 @@ void threadpool_destroy(threadpool_t *tp);
  * Replace the previous "raw fd in queue" approach with job_t when you
  * want to experiment with scheduling policies (SJF/priority).
  */
+struct conn;
 typedef struct {
     int client_fd;        /* client socket FD */
     long est_cost;        /* estimated cost (e.g. file size) - application provided */
     int priority;         /* priority (higher = serve earlier) */
     uint64_t arrival_ms;  /* monotonic arrival timestamp (ms), optional */
+    uint64_t arrival_ns;  /* monotonic enqueue timestamp (ns); stamped by
+                             threadpool_submit_job when left 0 */
+    struct conn *conn;    /* reactor connection state; NULL when the worker
+                             owns client_fd outright (blocking mode) */
 } job_t;
 
 /*
  * threadpool_set_scheduler:
  *  - Atomically replace the scheduler used by the threadpool. The
- *    provided scheduler instance is adopted by the pool and the old
- *    scheduler (if any) is destroyed.
+ *    provided scheduler instance is adopted by the pool; jobs still queued
+ *    on the old scheduler are moved to it in the old one's pop order, and
+ *    the old instance is then destroyed. Safe while the pool is serving:
+ *    workers switch at their next pop, and the call waits (briefly) until
+ *    no lock-free pop or push can still reach the old instance.
  *
  * Notes:
  *  - Forward-declared here to avoid header cycles; pass a scheduler
@@ -62,6 +135,32 @@ typedef struct {
 struct scheduler;
 void threadpool_set_scheduler(threadpool_t *tp, struct scheduler *sched);
 
+/*
+ * threadpool_set_scheduler_by_name:
+ *  - Give every shard a fresh scheduler built by scheduler_create(name, ...).
+ *    threadpool_set_scheduler only replaces shard 0's instance, so sharded
+ *    pools should use this instead.
+ *  - Queued jobs migrate as with threadpool_set_scheduler. The name is
+ *    remembered so threadpool_resize can rebuild per-worker schedulers
+ *    when it adds worker slots.
+ *  - Returns 0 on success, -1 for an unknown name or allocation failure
+ *    (the pool keeps its current schedulers).
+ */
+int threadpool_set_scheduler_by_name(threadpool_t *tp, const char *name);
+
+/*
+ * threadpool_resize:
+ *  - Change the pool size while it is serving: min_workers == max_workers
+ *    fixes the pool at that many workers (stopping the autoscaling
+ *    controller if one runs), a range (re)starts the controller with those
+ *    bounds (see threadpool_autoscale; min is raised to one per shard).
+ *  - Shrinking parks surplus workers after their current job. Growing
+ *    past the slots the pool had starts new threads, after rebuilding a
+ *    scheduler set by name so per-worker queues cover them.
+ *  - Returns 0, or -1 for max < min or allocation/thread failure.
+ */
+int threadpool_resize(threadpool_t *tp, size_t min_workers, size_t max_workers);
+
 /* Submit job variants:
  * - submit a raw fd (keeps backward compatibility)
  * - submit a full job (preferred for scheduling experiments)
@@ -71,3 +170,50 @@ void threadpool_set_scheduler(threadpool_t *tp, struct scheduler *sched);
  */
 int threadpool_submit(threadpool_t *tp, int client_fd);
 int threadpool_submit_job(threadpool_t *tp, job_t job);
+
+/*
+ * threadpool_set_admission / threadpool_admit_job:
+ *  - Overload control, so latency stays bounded instead of requests
+ *    piling up behind a full queue:
+ *      high_water        : queued jobs (pool total, split per shard) past
+ *                          which new requests are refused; 0 refuses only
+ *                          when the queue is full
+ *      max_wait_ms       : a job that queued this long is answered 503
+ *                          instead of served (0: no limit)
+ *      codel_target_ms   : CoDel sojourn target; once waits stay above it
+ *                          for codel_interval_ms (0: 100), jobs are dropped
+ *                          at a rising rate until one comes in under it
+ *                          (0: off)
+ *    All zero (the default) turns overload control off.
+ *  - threadpool_admit_job is for jobs that start a request: with overload
+ *    control on it never blocks, and returns 1 when the job was refused
+ *    (the caller answers 503; see http_send_unavailable). Otherwise it
+ *    behaves like threadpool_submit_job. Jobs that continue a response
+ *    already under way should use threadpool_submit_job.
+ *  - Dropped queued jobs are answered by the worker that popped them
+ *    (reactor_reject, or 503 and close for plain fds); jobs of a custom
+ *    job handler are never dropped.
+ *  - Call set_admission before the first submit.
+ */
+typedef struct {
+    size_t high_water;
+    unsigned max_wait_ms;
+    unsigned codel_target_ms;
+    unsigned codel_interval_ms;
+} tp_admission_t;
+int threadpool_set_admission(threadpool_t *tp, const tp_admission_t *cfg);
+int threadpool_admit_job(threadpool_t *tp, job_t job);
+
+/*
+ * threadpool_set_job_handler:
+ *  - Serve jobs with fn(job, arg) instead of the HTTP handlers, e.g. for
+ *    synthetic jobs in benchmarks (bench/schedbench.c). fn owns the job;
+ *    client_fd is neither served nor closed by the pool.
+ *  - Call before the first submit; NULL restores HTTP serving.
+ */
+void threadpool_set_job_handler(threadpool_t *tp, void (*fn)(job_t *job, void *arg), void *arg);
+
+/* threadpool_queue_depth: jobs currently queued across all shards (not
+ * counting jobs being served). Reads each shard's scheduler under its lock
+ * (lock-free schedulers without it); 0 for backends without a count op. */
+size_t threadpool_queue_depth(threadpool_t *tp);
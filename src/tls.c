@@ -0,0 +1,524 @@
+#define _GNU_SOURCE /* pipe2 */
+#include "tls.h"
+#include "log.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_OPENSSL
+
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TLS_RELAY_BUF (16 * 1024)  /* one TLS record of plaintext per direction */
+#define TLS_MAX_TICKET_KEYS 8
+#define TLS_TICKET_KEY_LEN 80      /* name 16 | HMAC 32 | AES 32 */
+#define TLS_EVENTS 64
+#define TLS_SWEEP_MS 1000
+
+/* kTLS implements exactly these; TLS 1.3 suites are all of this kind */
+#define TLS_CIPHERS "ECDHE+AESGCM:ECDHE+CHACHA20"
+
+struct ticket_key {
+    unsigned char name[16];
+    unsigned char hmac[32];
+    unsigned char aes[32];
+};
+
+struct tls_conn {
+    struct tls_conn *prev, *next;   /* the loop's connections */
+    SSL *ssl;
+    int fd;                         /* client socket */
+    int inner;                      /* relay end of the HTTP side's socketpair, -1 while handshaking */
+    int rd_closed;                  /* close_notify read, HTTP side shut for writing */
+    int dead;                       /* closed, freed after the current event batch */
+    uint64_t deadline_ms;           /* handshake must be done by then */
+    size_t up_off, up_len;          /* client -> HTTP, decrypted */
+    size_t down_off, down_len;      /* HTTP -> client, to encrypt */
+    char up[TLS_RELAY_BUF];
+    char down[TLS_RELAY_BUF];
+};
+
+struct tls_loop {
+    tls_t *t;
+    int epfd;
+    int pipe[2];                    /* tls_add -> loop: accepted fds, -1 stops it */
+    pthread_t thread;
+    int started;
+    struct tls_conn *conns;
+    struct tls_conn *dead;          /* closed during this batch (next-linked) */
+};
+
+struct tls {
+    tls_config_t cfg;
+    SSL_CTX *ctx;
+    struct ticket_key keys[TLS_MAX_TICKET_KEYS];
+    size_t nkeys;
+    size_t nloops;
+    struct tls_loop *loops;
+    atomic_uint next;               /* round-robin over loops */
+    atomic_int warned;
+    atomic_ulong handshakes, resumed, offloaded, relayed, failed;
+};
+
+/* monotonic ms */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* epoll data: the connection, low bit set for its relay end */
+#define INNER_TAG ((uintptr_t)1)
+
+static int conn_watch(struct tls_loop *l, int fd, void *ptr) {
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = ptr};
+    return epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* conn_retire: unlist c; later events of the batch may still name it */
+static void conn_retire(struct tls_loop *l, struct tls_conn *c) {
+    if (c->prev) c->prev->next = c->next;
+    else l->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    c->dead = 1;
+    c->next = l->dead;
+    l->dead = c;
+}
+
+static void free_dead(struct tls_loop *l) {
+    while (l->dead) {
+        struct tls_conn *c = l->dead;
+        l->dead = c->next;
+        free(c);
+    }
+}
+
+/* conn_close: clean says the peer is owed a close_notify */
+static void conn_close(struct tls_loop *l, struct tls_conn *c, int clean) {
+    if (clean) {
+        ERR_clear_error();
+        SSL_shutdown(c->ssl);
+    }
+    SSL_free(c->ssl);
+    close(c->fd);
+    if (c->inner >= 0) close(c->inner);
+    conn_retire(l, c);
+}
+
+/* relay: move whatever can move in both directions without blocking.
+   Edge-triggered, so each direction stops only on EAGAIN/WANT_* (which
+   re-arms an edge) or a full buffer whose drain is the other side's
+   edge. Returns -1 when the connection is done. */
+static int relay(struct tls_conn *c) {
+    for (;;) {
+        if (c->up_off == c->up_len) {
+            if (c->rd_closed) break;
+            ERR_clear_error();
+            int n = SSL_read(c->ssl, c->up, sizeof(c->up));
+            if (n <= 0) {
+                int e = SSL_get_error(c->ssl, n);
+                if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) break;
+                if (e != SSL_ERROR_ZERO_RETURN) return -1;
+                /* close_notify: let the HTTP side finish what it sends */
+                shutdown(c->inner, SHUT_WR);
+                c->rd_closed = 1;
+                break;
+            }
+            c->up_off = 0;
+            c->up_len = (size_t)n;
+        }
+        ssize_t w = send(c->inner, c->up + c->up_off, c->up_len - c->up_off, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        c->up_off += (size_t)w;
+    }
+    for (;;) {
+        if (c->down_off == c->down_len) {
+            ssize_t n = recv(c->inner, c->down, sizeof(c->down), 0);
+            if (n == 0) return -1; /* HTTP side closed, everything sent */
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return -1;
+            }
+            c->down_off = 0;
+            c->down_len = (size_t)n;
+        }
+        ERR_clear_error();
+        int w = SSL_write(c->ssl, c->down + c->down_off, (int)(c->down_len - c->down_off));
+        if (w <= 0) {
+            int e = SSL_get_error(c->ssl, w);
+            if (e == SSL_ERROR_WANT_WRITE || e == SSL_ERROR_WANT_READ) break;
+            return -1;
+        }
+        c->down_off += (size_t)w;
+    }
+    return 0;
+}
+
+/* established: hand the connection to HTTP, natively if the kernel took
+   both directions, otherwise through a relayed socketpair */
+static void established(struct tls_loop *l, struct tls_conn *c) {
+    tls_t *t = l->t;
+    atomic_fetch_add(&t->handshakes, 1);
+    if (SSL_session_reused(c->ssl)) atomic_fetch_add(&t->resumed, 1);
+    int tx = BIO_get_ktls_send(SSL_get_wbio(c->ssl));
+    int rx = BIO_get_ktls_recv(SSL_get_rbio(c->ssl));
+
+    if (tx && rx && !SSL_has_pending(c->ssl)) {
+        /* the socket speaks plaintext now; the session needs no more
+           user-space state (the socket BIO does not close fd) */
+        int fd = c->fd;
+        epoll_ctl(l->epfd, EPOLL_CTL_DEL, fd, NULL);
+        SSL_free(c->ssl);
+        conn_retire(l, c);
+        int fl = fcntl(fd, F_GETFL);
+        if (fl >= 0) fcntl(fd, F_SETFL, fl & ~O_NONBLOCK);
+        atomic_fetch_add(&t->offloaded, 1);
+        t->cfg.deliver(fd, t->cfg.arg);
+        return;
+    }
+
+    if (!tx && atomic_exchange(&t->warned, 1) == 0)
+        LOG_WARN("tls: no kernel TLS for %s (is the tls module loaded?), relaying in user space",
+                 SSL_get_cipher_name(c->ssl));
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        perror("socketpair");
+        atomic_fetch_add(&t->failed, 1);
+        conn_close(l, c, 0);
+        return;
+    }
+    int fl = fcntl(sv[0], F_GETFL);
+    if (fl < 0 || fcntl(sv[0], F_SETFL, fl | O_NONBLOCK) != 0 ||
+        conn_watch(l, sv[0], (void *)((uintptr_t)c | INNER_TAG)) != 0) {
+        perror("tls relay");
+        close(sv[0]);
+        close(sv[1]);
+        atomic_fetch_add(&t->failed, 1);
+        conn_close(l, c, 0);
+        return;
+    }
+    c->inner = sv[0];
+    atomic_fetch_add(&t->relayed, 1);
+    t->cfg.deliver(sv[1], t->cfg.arg);
+    /* the request may have come with the handshake's last flight */
+    if (relay(c) < 0) conn_close(l, c, 1);
+}
+
+static void handshake(struct tls_loop *l, struct tls_conn *c) {
+    ERR_clear_error();
+    int rc = SSL_do_handshake(c->ssl);
+    if (rc == 1) {
+        established(l, c);
+        return;
+    }
+    int e = SSL_get_error(c->ssl, rc);
+    if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) return;
+    LOG_DEBUG("tls: handshake failed on fd %d (%s)", c->fd,
+              ERR_reason_error_string(ERR_peek_last_error()) ? ERR_reason_error_string(ERR_peek_last_error())
+                                                             : "connection closed");
+    atomic_fetch_add(&l->t->failed, 1);
+    conn_close(l, c, 0);
+}
+
+static void conn_start(struct tls_loop *l, int fd) {
+    struct tls_conn *c = malloc(sizeof(*c));
+    SSL *ssl = c ? SSL_new(l->t->ctx) : NULL;
+    int fl = fcntl(fd, F_GETFL);
+    if (!ssl || fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) != 0 || !SSL_set_fd(ssl, fd)) {
+        LOG_WARN("tls: cannot set up a connection");
+        SSL_free(ssl);
+        free(c);
+        close(fd);
+        return;
+    }
+    SSL_set_accept_state(ssl);
+    c->ssl = ssl;
+    c->fd = fd;
+    c->inner = -1;
+    c->rd_closed = 0;
+    c->dead = 0;
+    c->up_off = c->up_len = c->down_off = c->down_len = 0;
+    c->deadline_ms = now_ms() + l->t->cfg.handshake_ms;
+    c->prev = NULL;
+    c->next = l->conns;
+    if (l->conns) l->conns->prev = c;
+    l->conns = c;
+    if (conn_watch(l, fd, c) != 0) {
+        perror("epoll_ctl add");
+        conn_close(l, c, 0);
+        return;
+    }
+    handshake(l, c);
+}
+
+/* sweep: drop handshakes past their deadline */
+static void sweep(struct tls_loop *l) {
+    uint64_t now = now_ms();
+    for (struct tls_conn *c = l->conns, *next; c; c = next) {
+        next = c->next;
+        if (c->inner < 0 && now >= c->deadline_ms) {
+            atomic_fetch_add(&l->t->failed, 1);
+            conn_close(l, c, 0);
+        }
+    }
+    free_dead(l);
+}
+
+static void *tls_main(void *arg) {
+    struct tls_loop *l = arg;
+    struct epoll_event evs[TLS_EVENTS];
+    uint64_t next_sweep = now_ms() + TLS_SWEEP_MS;
+    for (;;) {
+        int n = epoll_wait(l->epfd, evs, TLS_EVENTS, TLS_SWEEP_MS);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        int stop = 0;
+        for (int i = 0; i < n; ++i) {
+            if (evs[i].data.ptr == NULL) {
+                int fds[64];
+                ssize_t got;
+                while ((got = read(l->pipe[0], fds, sizeof(fds))) > 0) {
+                    for (size_t k = 0; k < (size_t)got / sizeof(int); ++k) {
+                        if (fds[k] < 0) stop = 1;
+                        else conn_start(l, fds[k]);
+                    }
+                }
+                continue;
+            }
+            struct tls_conn *c = (void *)((uintptr_t)evs[i].data.ptr & ~INNER_TAG);
+            if (c->dead) continue;
+            if (c->inner < 0) handshake(l, c);
+            else if (relay(c) < 0) conn_close(l, c, 1);
+        }
+        free_dead(l);
+        if (stop) break;
+        uint64_t now = now_ms();
+        if (now >= next_sweep) {
+            sweep(l);
+            next_sweep = now + TLS_SWEEP_MS;
+        }
+    }
+    while (l->conns) conn_close(l, l->conns, 0);
+    free_dead(l);
+    return NULL;
+}
+
+/* ticket_cb: issue tickets under the first configured key, accept any */
+static int ticket_cb(SSL *s, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *ectx,
+                     EVP_MAC_CTX *hctx, int enc) {
+    tls_t *t = SSL_CTX_get_app_data(SSL_get_SSL_CTX(s));
+    const struct ticket_key *k = NULL;
+    const EVP_CIPHER *cipher = EVP_aes_256_cbc();
+    if (enc) {
+        k = &t->keys[0];
+        memcpy(name, k->name, sizeof(k->name));
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(cipher)) <= 0 ||
+            !EVP_EncryptInit_ex(ectx, cipher, NULL, k->aes, iv))
+            return -1;
+    } else {
+        for (size_t i = 0; i < t->nkeys && !k; ++i)
+            if (memcmp(name, t->keys[i].name, sizeof(t->keys[i].name)) == 0) k = &t->keys[i];
+        if (!k) return 0; /* unknown key: full handshake */
+        if (!EVP_DecryptInit_ex(ectx, cipher, NULL, k->aes, iv)) return -1;
+    }
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *)k->hmac, sizeof(k->hmac)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end(),
+    };
+    if (!EVP_MAC_CTX_set_params(hctx, params)) return -1;
+    /* 2: valid, but reissue under the current key */
+    return (enc || k == &t->keys[0]) ? 1 : 2;
+}
+
+static int load_ticket_keys(tls_t *t, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    unsigned char buf[TLS_MAX_TICKET_KEYS * TLS_TICKET_KEY_LEN + 1];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    if (n == 0 || n % TLS_TICKET_KEY_LEN != 0 || n > TLS_MAX_TICKET_KEYS * TLS_TICKET_KEY_LEN) {
+        LOG_ERROR("tls: %s must hold 1..%d keys of %d bytes", path, TLS_MAX_TICKET_KEYS, TLS_TICKET_KEY_LEN);
+        return -1;
+    }
+    t->nkeys = n / TLS_TICKET_KEY_LEN;
+    for (size_t i = 0; i < t->nkeys; ++i) {
+        const unsigned char *p = buf + i * TLS_TICKET_KEY_LEN;
+        memcpy(t->keys[i].name, p, 16);
+        memcpy(t->keys[i].hmac, p + 16, 32);
+        memcpy(t->keys[i].aes, p + 48, 32);
+    }
+    OPENSSL_cleanse(buf, sizeof(buf));
+    return 0;
+}
+
+/* alpn_cb: we only speak HTTP/1.1; a client offering only h2 gets no ALPN */
+static int alpn_cb(SSL *s, const unsigned char **out, unsigned char *outlen, const unsigned char *in,
+                   unsigned inlen, void *arg) {
+    static const unsigned char http11[] = "\x08http/1.1";
+    (void)s;
+    (void)arg;
+    if (SSL_select_next_proto((unsigned char **)out, outlen, http11, sizeof(http11) - 1, in, inlen) !=
+        OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+static SSL_CTX *make_ctx(tls_t *t) {
+    const tls_config_t *cfg = &t->cfg;
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) return NULL;
+    SSL_CTX_set_app_data(ctx, t);
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    /* non-blocking relay: partial writes, retried from a moved pointer;
+       idle keep-alive connections give their record buffers back */
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_alpn_select_cb(ctx, alpn_cb, NULL);
+
+    static const unsigned char sid_ctx[] = "httpd";
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, cfg->session_cache ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+    SSL_CTX_sess_set_cache_size(ctx, (long)cfg->session_cache);
+    SSL_CTX_set_timeout(ctx, (long)cfg->session_timeout);
+    if (cfg->tickets) {
+        SSL_CTX_set_num_tickets(ctx, cfg->tickets);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_num_tickets(ctx, 0);
+    }
+
+    if (!SSL_CTX_set_cipher_list(ctx, TLS_CIPHERS) ||
+        SSL_CTX_use_certificate_chain_file(ctx, cfg->cert) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, cfg->key ? cfg->key : cfg->cert, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1 ||
+        (t->nkeys && !SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_cb))) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+tls_t *tls_create(const tls_config_t *cfg) {
+    tls_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->cfg = *cfg;
+    if (t->cfg.nthreads < 1) t->cfg.nthreads = 1;
+    if (cfg->ticket_key && load_ticket_keys(t, cfg->ticket_key) != 0) {
+        free(t);
+        return NULL;
+    }
+    t->ctx = make_ctx(t);
+    if (!t->ctx) {
+        fprintf(stderr, "tls: cannot use %s:\n", cfg->cert);
+        ERR_print_errors_fp(stderr);
+        OPENSSL_cleanse(t->keys, sizeof(t->keys));
+        free(t);
+        return NULL;
+    }
+    t->loops = calloc(t->cfg.nthreads, sizeof(*t->loops));
+    if (!t->loops) {
+        tls_destroy(t);
+        return NULL;
+    }
+    for (size_t i = 0; i < t->cfg.nthreads; ++i) {
+        struct tls_loop *l = &t->loops[i];
+        l->t = t;
+        l->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (l->epfd < 0 || pipe2(l->pipe, O_CLOEXEC) != 0) {
+            perror("tls loop");
+            if (l->epfd >= 0) close(l->epfd);
+            break;
+        }
+        t->nloops++;
+        fcntl(l->pipe[0], F_SETFL, O_NONBLOCK);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+        if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->pipe[0], &ev) != 0 ||
+            pthread_create(&l->thread, NULL, tls_main, l) != 0) {
+            perror("tls thread");
+            break;
+        }
+        l->started = 1;
+    }
+    if (t->nloops < t->cfg.nthreads || !t->loops[t->nloops - 1].started) {
+        tls_destroy(t);
+        return NULL;
+    }
+    return t;
+}
+
+void tls_add(tls_t *t, int fd) {
+    struct tls_loop *l = &t->loops[atomic_fetch_add(&t->next, 1) % t->nloops];
+    /* <= PIPE_BUF: atomic among concurrent acceptors */
+    if (write(l->pipe[1], &fd, sizeof(fd)) != (ssize_t)sizeof(fd)) {
+        perror("tls_add");
+        close(fd);
+    }
+}
+
+void tls_destroy(tls_t *t) {
+    if (!t) return;
+    for (size_t i = 0; i < t->nloops; ++i) {
+        struct tls_loop *l = &t->loops[i];
+        if (l->started) {
+            int stop = -1;
+            if (write(l->pipe[1], &stop, sizeof(stop)) == (ssize_t)sizeof(stop))
+                pthread_join(l->thread, NULL);
+        }
+        close(l->pipe[0]);
+        close(l->pipe[1]);
+        close(l->epfd);
+    }
+    if (atomic_load(&t->handshakes) || atomic_load(&t->failed))
+        LOG_INFO("tls: %lu handshakes (%lu resumed, %lu kernel TLS, %lu relayed), %lu failed",
+                 atomic_load(&t->handshakes), atomic_load(&t->resumed), atomic_load(&t->offloaded),
+                 atomic_load(&t->relayed), atomic_load(&t->failed));
+    free(t->loops);
+    SSL_CTX_free(t->ctx);
+    OPENSSL_cleanse(t->keys, sizeof(t->keys));
+    free(t);
+}
+
+#else /* !HAVE_OPENSSL */
+
+tls_t *tls_create(const tls_config_t *cfg) {
+    (void)cfg;
+    LOG_ERROR("tls: built without OpenSSL (make TLS=1)");
+    return NULL;
+}
+
+void tls_add(tls_t *t, int fd) {
+    (void)t;
+    (void)fd;
+}
+
+void tls_destroy(tls_t *t) {
+    (void)t;
+}
+
+#endif
@@ -0,0 +1,66 @@
+// TLS termination for the listen sockets (--tls-cert), with the record
+// layer handed to the kernel (kTLS) where it can take it.
+//
+// Accepted sockets go to one of cfg->nthreads TLS threads, which run the
+// handshake with OpenSSL, non-blocking. Once it is done:
+//  - kTLS for both directions (OpenSSL's SSL_OP_ENABLE_KTLS installs the
+//    session keys with setsockopt TCP_ULP "tls"): the socket now reads
+//    and writes plaintext, so it is delivered as it is and every existing
+//    path - recv, writev, sendfile, io_uring splice - runs unchanged, the
+//    kernel encrypting file bodies without a copy through user space.
+//  - Otherwise (no tls module, a cipher or direction the kernel or this
+//    OpenSSL cannot offload, e.g. TLS 1.3 receive before OpenSSL 3.2): the
+//    HTTP side gets one end of a socketpair and the TLS thread relays
+//    between it and SSL_read/SSL_write. Correct, but bodies are copied; a
+//    warning is logged the first time the send direction stays in user
+//    space.
+// Only ciphers the kernel implements are offered (AES-GCM, ChaCha20-
+// Poly1305), TLS 1.2 and later.
+//
+// Handshake CPU is kept down for reconnecting clients by resumption:
+// TLS 1.3 and ticket-capable TLS 1.2 clients get session tickets
+// (cfg->tickets per handshake, 0 disables them), others hit the server's
+// session cache (cfg->session_cache entries, 0 disables it). Both expire
+// after cfg->session_timeout seconds. Ticket keys are random per process
+// unless cfg->ticket_key names a file of one or more 80-byte keys (16 name,
+// 32 HMAC-SHA256, 32 AES-256 bytes, e.g. `openssl rand 80`): the first
+// issues tickets and all are accepted, so a key can be rotated in front of
+// the old one, and tickets survive restarts and handoffs.
+//
+// Built only with OpenSSL (HAVE_OPENSSL); otherwise tls_create fails.
+//
+// tls_create:
+//  - Load the certificate chain and key and start the TLS threads.
+//    cfg->deliver(fd, cfg->arg) is called from them with each connection
+//    ready for HTTP; it owns fd from then on. Returns NULL (with the
+//    OpenSSL error printed) if the context cannot be set up.
+//
+// tls_add:
+//  - Hand over an accepted socket; it is closed if the handshake fails or
+//    does not finish within cfg->handshake_ms.
+//
+// tls_destroy:
+//  - Stop the threads, closing connections still handshaking or relayed
+//    (stop producers calling tls_add first). Passing NULL is a no-op.
+#pragma once
+
+#include <stddef.h>
+
+typedef struct tls tls_t;
+
+typedef struct {
+    const char *cert;          /* PEM certificate chain */
+    const char *key;           /* PEM private key, NULL: in cert */
+    const char *ticket_key;    /* ticket key file, NULL: random keys */
+    size_t session_cache;      /* session cache entries, 0: off */
+    unsigned session_timeout;  /* seconds a session can be resumed */
+    unsigned tickets;          /* tickets per TLS 1.3 handshake, 0: none */
+    unsigned handshake_ms;     /* handshake deadline */
+    size_t nthreads;           /* TLS threads (>= 1) */
+    void (*deliver)(int fd, void *arg);
+    void *arg;
+} tls_config_t;
+
+tls_t *tls_create(const tls_config_t *cfg);
+void tls_add(tls_t *t, int fd);
+void tls_destroy(tls_t *t);
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE /* sched_getaffinity, sched_getcpu, pthread_setaffinity_np */
+#include "topology.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+static struct {
+    size_t ncpus;
+    int cpus[CPU_SETSIZE];        /* allowed CPUs, grouped by node */
+    size_t nnodes;
+    size_t node_start[CPU_SETSIZE];
+    size_t node_count[CPU_SETSIZE];
+    int node_id[CPU_SETSIZE];     /* dense node -> kernel node id */
+    int node_of[CPU_SETSIZE];     /* cpu -> dense node, -1 if not ours */
+    int numa;                     /* libnuma usable for allocation policy */
+} topo;
+
+/* kernel node id of cpu (0 without libnuma) */
+static int kernel_node(int cpu) {
+#ifdef HAVE_NUMA
+    if (topo.numa) {
+        int n = numa_node_of_cpu(cpu);
+        return n < 0 ? 0 : n;
+    }
+#endif
+    (void)cpu;
+    return 0;
+}
+
+int topology_init(void) {
+    memset(&topo, 0, sizeof(topo));
+    for (size_t i = 0; i < CPU_SETSIZE; ++i) topo.node_of[i] = -1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+#ifdef HAVE_NUMA
+    topo.numa = numa_available() >= 0;
+#endif
+
+    /* dense node numbering in ascending kernel id order; CPUs of a node
+       stay in ascending order too */
+    int ids[CPU_SETSIZE];
+    int kn[CPU_SETSIZE];
+    size_t nids = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        kn[cpu] = kernel_node(cpu);
+        size_t k = 0;
+        while (k < nids && ids[k] != kn[cpu]) k++;
+        if (k == nids) ids[nids++] = kn[cpu];
+    }
+    if (nids == 0) return -1;
+    for (size_t a = 1; a < nids; ++a) {
+        for (size_t b = a; b > 0 && ids[b - 1] > ids[b]; --b) {
+            int t = ids[b];
+            ids[b] = ids[b - 1];
+            ids[b - 1] = t;
+        }
+    }
+
+    for (size_t n = 0; n < nids; ++n) {
+        topo.node_id[n] = ids[n];
+        topo.node_start[n] = topo.ncpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &set) || kn[cpu] != ids[n]) continue;
+            topo.cpus[topo.ncpus++] = cpu;
+            topo.node_of[cpu] = (int)n;
+        }
+        topo.node_count[n] = topo.ncpus - topo.node_start[n];
+    }
+    topo.nnodes = nids;
+    return 0;
+}
+
+size_t topology_nnodes(void) {
+    return topo.nnodes;
+}
+
+size_t topology_node_cpus(size_t node) {
+    return node < topo.nnodes ? topo.node_count[node] : 0;
+}
+
+int topology_cpu(size_t node, size_t i) {
+    if (node >= topo.nnodes) return -1;
+    return topo.cpus[topo.node_start[node] + i % topo.node_count[node]];
+}
+
+int topology_spread_cpu(size_t i) {
+    if (topo.nnodes == 0) return -1;
+    return topology_cpu(i % topo.nnodes, i / topo.nnodes);
+}
+
+int topology_node_of(int cpu) {
+    return cpu >= 0 && cpu < CPU_SETSIZE ? topo.node_of[cpu] : -1;
+}
+
+int topology_current_node(void) {
+    return topology_node_of(sched_getcpu());
+}
+
+int topology_pin(pthread_t t, int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(t, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int topology_pin_node(pthread_t t, size_t node) {
+    if (node >= topo.nnodes) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < topo.node_count[node]; ++i) CPU_SET(topo.cpus[topo.node_start[node] + i], &set);
+    return pthread_setaffinity_np(t, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+void topology_prefer_node(int node) {
+#ifdef HAVE_NUMA
+    if (!topo.numa) return;
+    if (node < 0 || (size_t)node >= topo.nnodes) numa_set_localalloc();
+    else numa_set_preferred(topo.node_id[node]);
+#else
+    (void)node;
+#endif
+}
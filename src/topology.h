@@ -0,0 +1,44 @@
+// CPU/NUMA topology for thread placement (--affinity).
+//
+// topology_init reads the CPUs this process may run on and groups them by
+// NUMA node (through libnuma when built with NUMA=1 and the kernel reports
+// nodes; otherwise every CPU is on node 0). Nodes are numbered densely
+// from 0 here, whatever the kernel's ids are.
+//
+// topology_init:
+//  - Returns 0, or -1 if the CPU set could not be read (the other calls
+//    then report no topology and pin nothing).
+//
+// topology_nnodes / topology_node_cpus:
+//  - Number of nodes (0 before init) and CPUs on node.
+//
+// topology_cpu / topology_spread_cpu:
+//  - cpu: the i-th CPU of node, wrapping when i exceeds its CPUs.
+//  - spread_cpu: the i-th CPU when consecutive indexes alternate between
+//    nodes (0 -> node 0, 1 -> node 1, ...), for threads that should cover
+//    every node. Both return -1 without a topology.
+//
+// topology_current_node / topology_node_of:
+//  - The node of the calling thread's CPU, or of cpu; -1 if unknown.
+//
+// topology_pin / topology_pin_node:
+//  - Restrict thread to cpu, or to every CPU of node. Return 0 or -1.
+//
+// topology_prefer_node:
+//  - Allocate the calling thread's new pages on node (node < 0: back to
+//    the default, local to the CPU touching them). A no-op without libnuma.
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+
+int topology_init(void);
+size_t topology_nnodes(void);
+size_t topology_node_cpus(size_t node);
+int topology_cpu(size_t node, size_t i);
+int topology_spread_cpu(size_t i);
+int topology_current_node(void);
+int topology_node_of(int cpu);
+int topology_pin(pthread_t t, int cpu);
+int topology_pin_node(pthread_t t, size_t node);
+void topology_prefer_node(int node);
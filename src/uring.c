@@ -0,0 +1,205 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+int uring_init(uring_t *u, unsigned entries) {
+    memset(u, 0, sizeof(*u));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    int fd = sys_setup(entries, &p);
+    if (fd < 0) return -1;
+    u->fd = fd;
+    u->features = p.features;
+
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_len > u->sq_len) u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED) goto fail_sq;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail_cq;
+
+    char *sq = u->sq_ptr, *cq = u->cq_ptr;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail_cq:
+    if (u->cq_ptr != u->sq_ptr) munmap(u->cq_ptr, u->cq_len);
+fail_sq:
+    munmap(u->sq_ptr, u->sq_len);
+fail:
+    {
+        int e = errno;
+        close(fd);
+        errno = e;
+    }
+    return -1;
+}
+
+void uring_exit(uring_t *u) {
+    if (u->sqes) munmap(u->sqes, u->sqes_len);
+    if (u->cq_ptr && u->cq_ptr != u->sq_ptr) munmap(u->cq_ptr, u->cq_len);
+    if (u->sq_ptr) munmap(u->sq_ptr, u->sq_len);
+    close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *u->sq_tail + u->sq_pending;
+    if (tail - head >= u->sq_entries) return NULL;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    u->sq_pending++;
+    return sqe;
+}
+
+unsigned uring_sq_space(uring_t *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    return u->sq_entries - (*u->sq_tail + u->sq_pending - head);
+}
+
+void uring_flush(uring_t *u) {
+    if (!u->sq_pending) return;
+    __atomic_store_n(u->sq_tail, *u->sq_tail + u->sq_pending, __ATOMIC_RELEASE);
+    u->sq_pending = 0;
+}
+
+int uring_enter(uring_t *u, unsigned wait_nr) {
+    /* everything the kernel has not consumed yet, including SQEs left
+       behind by an interrupted enter or published by another thread */
+    unsigned to_submit = __atomic_load_n(u->sq_tail, __ATOMIC_ACQUIRE) -
+                         __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && wait_nr == 0) return 0;
+    return sys_enter(u->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+int uring_submit(uring_t *u, unsigned wait_nr) {
+    uring_flush(u);
+    return uring_enter(u, wait_nr);
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *u) {
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &u->cqes[head & *u->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *u) {
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_probe_op(uring_t *u, int op) {
+    const unsigned nops = 256;
+    struct io_uring_probe *pr = calloc(1, sizeof(*pr) + nops * sizeof(struct io_uring_probe_op));
+    if (!pr) return 0;
+    int ok = 0;
+    if (sys_register(u->fd, IORING_REGISTER_PROBE, pr, nops) == 0 && op < pr->ops_len)
+        ok = (pr->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    free(pr);
+    return ok;
+}
+
+int uring_pbuf_init(uring_t *u, uring_pbuf_t *p, unsigned short bgid, unsigned count, size_t size) {
+    memset(p, 0, sizeof(*p));
+    if (count == 0 || (count & (count - 1)) || count > 32768) {
+        errno = EINVAL;
+        return -1;
+    }
+    p->br_len = count * sizeof(struct io_uring_buf);
+    /* the ring must be page aligned */
+    p->br = mmap(NULL, p->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p->br == MAP_FAILED) {
+        p->br = NULL;
+        return -1;
+    }
+    p->bufs = malloc(count * size);
+    if (!p->bufs) {
+        munmap(p->br, p->br_len);
+        p->br = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    p->size = size;
+    p->count = count;
+    p->bgid = bgid;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)p->br;
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (sys_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int e = errno;
+        free(p->bufs);
+        munmap(p->br, p->br_len);
+        memset(p, 0, sizeof(*p));
+        errno = e;
+        return -1;
+    }
+    for (unsigned i = 0; i < count; ++i) uring_pbuf_recycle(p, i);
+    return 0;
+}
+
+void uring_pbuf_free(uring_t *u, uring_pbuf_t *p) {
+    if (!p->br) return;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = p->bgid;
+    sys_register(u->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(p->bufs);
+    munmap(p->br, p->br_len);
+    memset(p, 0, sizeof(*p));
+}
+
+void uring_pbuf_recycle(uring_pbuf_t *p, unsigned bid) {
+    unsigned short tail = p->br->tail;
+    struct io_uring_buf *b = &p->br->bufs[tail & (p->count - 1)];
+    b->addr = (uint64_t)(uintptr_t)uring_pbuf_addr(p, bid);
+    b->len = (uint32_t)p->size;
+    b->bid = (uint16_t)bid;
+    __atomic_store_n(&p->br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
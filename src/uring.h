@@ -0,0 +1,81 @@
+// Minimal io_uring wrapper on the raw syscalls (no liburing).
+//
+// Only what the io_uring reactor engine needs: one ring with a mapped
+// SQ/CQ, SQE allocation, submit/wait, CQE iteration, an opcode probe and a
+// provided-buffer ring. Nothing here locks; callers serialise SQ access
+// (the CQ has a single consumer).
+//
+// uring_init:
+//  - Create a ring with at least `entries` SQEs (CQ is twice that).
+//  - Returns 0, or -1 with errno set (ENOSYS / EPERM when the kernel lacks
+//    or disables io_uring).
+//
+// uring_get_sqe / uring_sq_space:
+//  - Next free SQE, zeroed, or NULL if the SQ is full (submit first) /
+//    how many SQEs can still be taken (to keep a linked chain together).
+//
+// uring_submit / uring_flush / uring_enter:
+//  - submit = flush + enter. flush publishes the prepared SQEs (under the
+//    caller's SQ lock); enter hands every published SQE to the kernel and,
+//    if wait_nr > 0, blocks until that many CQEs are ready. enter needs no
+//    lock, so one thread may wait in it while others submit. Returns the
+//    number submitted or -1 (errno).
+//
+// uring_peek_cqe / uring_cqe_seen:
+//  - Oldest unconsumed CQE (NULL if none) / mark it consumed.
+//
+// uring_probe_op:
+//  - 1 if the kernel implements opcode `op`, else 0.
+//
+// uring_pbuf_init / uring_pbuf_recycle:
+//  - Register a ring of `count` buffers of `size` bytes as buffer group
+//    `bgid` (Linux 5.19+), for IOSQE_BUFFER_SELECT receives. A buffer
+//    picked by the kernel is returned with uring_pbuf_recycle once read.
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+typedef struct uring {
+    int fd;
+    unsigned features;
+    /* submission queue */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_pending;        /* prepared but not yet submitted */
+    struct io_uring_sqe *sqes;
+    /* completion queue */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* mappings */
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+} uring_t;
+
+typedef struct uring_pbuf {
+    struct io_uring_buf_ring *br;
+    size_t br_len;
+    char *bufs;
+    size_t size;
+    unsigned count;
+    unsigned short bgid;
+} uring_pbuf_t;
+
+int uring_init(uring_t *u, unsigned entries);
+void uring_exit(uring_t *u);
+struct io_uring_sqe *uring_get_sqe(uring_t *u);
+unsigned uring_sq_space(uring_t *u);
+int uring_submit(uring_t *u, unsigned wait_nr);
+void uring_flush(uring_t *u);
+int uring_enter(uring_t *u, unsigned wait_nr);
+struct io_uring_cqe *uring_peek_cqe(uring_t *u);
+void uring_cqe_seen(uring_t *u);
+int uring_probe_op(uring_t *u, int op);
+
+int uring_pbuf_init(uring_t *u, uring_pbuf_t *p, unsigned short bgid, unsigned count, size_t size);
+void uring_pbuf_free(uring_t *u, uring_pbuf_t *p);
+void uring_pbuf_recycle(uring_pbuf_t *p, unsigned bid);
+
+static inline char *uring_pbuf_addr(const uring_pbuf_t *p, unsigned bid) {
+    return p->bufs + (size_t)bid * p->size;
+}
@@ -0,0 +1,56 @@
+#define _GNU_SOURCE /* timegm */
+#include "validators.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+static const char wdays[] = "SunMonTueWedThuFriSat";
+
+size_t validator_build(char *buf, size_t size, const struct stat *st, const char *suffix,
+                       size_t *etag_off, size_t *etag_len) {
+    struct tm tm;
+    gmtime_r(&st->st_mtim.tv_sec, &tm);
+    unsigned long long mtime_ns =
+        (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL + (unsigned long long)st->st_mtim.tv_nsec;
+    char tag[80];
+    int tag_len = snprintf(tag, sizeof(tag), "\"%llx-%llx-%llx%s\"", (unsigned long long)st->st_ino,
+                           (unsigned long long)st->st_size, mtime_ns, suffix ? suffix : "");
+    if (tag_len < 0 || (size_t)tag_len >= sizeof(tag)) return 0;
+    /* weekday and month by hand: strftime's names follow the locale */
+    int n = snprintf(buf, size, "ETag: %s\r\nLast-Modified: %.3s, %02d %.3s %04d %02d:%02d:%02d GMT\r\n",
+                     tag, wdays + 3 * tm.tm_wday, tm.tm_mday, months + 3 * tm.tm_mon,
+                     tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (n < 0 || (size_t)n >= size) return 0;
+    *etag_off = strlen("ETag: ");
+    *etag_len = (size_t)tag_len;
+    return (size_t)n;
+}
+
+static int two_digits(const char *p) {
+    if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') return -1;
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+int validator_parse_date(const char *p, size_t len, time_t *t) {
+    /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+    if (len != 29 || p[3] != ',' || p[4] != ' ' || p[7] != ' ' || p[11] != ' ' ||
+        p[16] != ' ' || p[19] != ':' || p[22] != ':' || p[25] != ' ' || memcmp(p + 26, "GMT", 3) != 0)
+        return -1;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *m = NULL;
+    for (int i = 0; i < 12 && !m; ++i)
+        if (memcmp(p + 8, months + 3 * i, 3) == 0) m = months + 3 * i;
+    int hi = two_digits(p + 12), lo = two_digits(p + 14);
+    tm.tm_mday = two_digits(p + 5);
+    tm.tm_hour = two_digits(p + 17);
+    tm.tm_min = two_digits(p + 20);
+    tm.tm_sec = two_digits(p + 23);
+    if (!m || hi < 0 || lo < 0 || tm.tm_mday < 1 || tm.tm_hour < 0 || tm.tm_min < 0 || tm.tm_sec < 0)
+        return -1;
+    tm.tm_mon = (int)(m - months) / 3;
+    tm.tm_year = hi * 100 + lo - 1900;
+    *t = timegm(&tm);
+    return 0;
+}
@@ -0,0 +1,26 @@
+// HTTP cache validators derived from stat() data.
+//
+// The caches build these once per file version, so a response costs no
+// formatting: the ETag is the strong tag "<inode>-<size>-<mtime ns>" (hex),
+// plus a suffix for an encoded variant so each representation has its
+// own tag, and Last-Modified is the mtime as an IMF-fixdate.
+//
+// validator_build:
+//  - Writes "ETag: ...\r\nLast-Modified: ...\r\n" for st into buf and
+//    returns its length (0 if it does not fit). *etag_off / *etag_len
+//    locate the quoted tag inside it.
+//
+// validator_parse_date:
+//  - Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT"). Returns 0
+//    and *t, or -1 for anything else (obsolete formats are not accepted).
+#pragma once
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define VALIDATOR_MAX 128  /* room for the two header lines */
+
+size_t validator_build(char *buf, size_t size, const struct stat *st, const char *suffix,
+                       size_t *etag_off, size_t *etag_len);
+int validator_parse_date(const char *p, size_t len, time_t *t);